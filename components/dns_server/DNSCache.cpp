@@ -0,0 +1,142 @@
+#include "DNSCache.h"
+#include <string.h>
+
+DNSCache::DNSCache() { clear(); }
+
+void DNSCache::clear() {
+    memset(_entries, 0, sizeof(_entries));
+    _clock = 0;
+}
+
+static bool expired(uint32_t expiresMs, uint32_t nowMs) {
+    return (int32_t)(expiresMs - nowMs) <= 0;
+}
+
+// Skips the owner name of a record, which may end in a compression pointer.
+// Returns the offset after it, or 0 if it runs past `length`.
+static size_t skipName(const uint8_t *message, size_t offset, size_t length) {
+    while (offset < length) {
+        uint8_t label = message[offset];
+        if (label == 0) return offset + 1;
+        if ((label & 0xC0) == 0xC0)
+            return offset + 2 <= length ? offset + 2 : 0;
+        if (label > 63) return 0;
+        offset += label + 1;
+    }
+    return 0;
+}
+
+DNSCache::Entry *DNSCache::find(const uint8_t *question, uint32_t hash,
+                                size_t nameLength) {
+    for (size_t i = 0; i < DNS_CACHE_ENTRIES; i++) {
+        Entry *entry = &_entries[i];
+        if (entry->hash == hash && entry->nameLength == nameLength &&
+            memcmp(entry->data + nameLength, question + nameLength, 4) == 0 &&
+            dnsNameEquals(entry->data, question))
+            return entry;
+    }
+    return NULL;
+}
+
+DNSCache::Entry *DNSCache::victim(uint32_t nowMs) {
+    Entry *oldest = &_entries[0];
+    for (size_t i = 0; i < DNS_CACHE_ENTRIES; i++) {
+        Entry *entry = &_entries[i];
+        if (entry->hash == 0 || expired(entry->expiresMs, nowMs)) return entry;
+        if (entry->used - _clock < oldest->used - _clock) oldest = entry;
+    }
+    return oldest;
+}
+
+bool DNSCache::insert(const uint8_t *response, size_t length, uint32_t nowMs) {
+    DNSHeader header;
+    if (length < DNS_HEADER_SIZE) return false;
+    memcpy(&header, response, DNS_HEADER_SIZE);
+    if (header.QR != DNS_QR_RESPONSE || header.TC ||
+        header.QDCount != dns_htons(1) ||
+        (header.RCode != (int)DNSReplyCode::NoError &&
+         header.RCode != (int)DNSReplyCode::NonExistentDomain))
+        return false;
+
+    const uint8_t *question = response + DNS_HEADER_SIZE;
+    size_t nameLength = dnsNameLength(question, length - DNS_HEADER_SIZE);
+    if (nameLength == 0 || DNS_HEADER_SIZE + nameLength + 4 > length)
+        return false;
+    size_t records = DNS_HEADER_SIZE + nameLength + 4;
+    size_t recordsLength = length - records;
+    if (nameLength + 4 + recordsLength > DNS_CACHE_ENTRY_SIZE) return false;
+
+    // Walk the records for their TTLs, the smallest one is how long the
+    // whole reply may be kept
+    size_t count = dns_ntohs(header.ANCount) + dns_ntohs(header.NSCount) +
+                   dns_ntohs(header.ARCount);
+    if (count == 0 || count > DNS_CACHE_MAX_RECORDS) return false;
+    uint16_t ttlOffsets[DNS_CACHE_MAX_RECORDS];
+    uint32_t minTTL = DNS_CACHE_MAX_TTL;
+    size_t offset = records;
+    for (size_t i = 0; i < count; i++) {
+        offset = skipName(response, offset, length);
+        if (offset == 0 || offset + 10 > length) return false;
+        uint16_t type, rdLength;
+        uint32_t ttl;
+        memcpy(&type, response + offset, sizeof(type));
+        memcpy(&ttl, response + offset + 4, sizeof(ttl));
+        memcpy(&rdLength, response + offset + 8, sizeof(rdLength));
+        // OPT carries no TTL but flags, such replies are not kept
+        if (type == dns_htons(DNS_QTYPE_OPT)) return false;
+        ttl = dns_ntohl(ttl);
+        if (ttl < minTTL) minTTL = ttl;
+        ttlOffsets[i] = (uint16_t)(offset + 4 - records);
+        offset += 10 + dns_ntohs(rdLength);
+        if (offset > length) return false;
+    }
+    if (minTTL == 0) return false;
+
+    uint32_t hash = dnsNameHash(question) | 1; // 0 marks free entries
+    Entry *entry = find(question, hash, nameLength);
+    if (entry == NULL) entry = victim(nowMs);
+    entry->hash = hash;
+    entry->storedMs = nowMs;
+    entry->expiresMs = nowMs + minTTL * 1000;
+    entry->used = ++_clock;
+    memcpy(entry->header, response + 2, sizeof(entry->header));
+    entry->nameLength = (uint8_t)nameLength;
+    entry->ttlCount = (uint8_t)count;
+    entry->recordsLength = (uint16_t)recordsLength;
+    memcpy(entry->ttlOffsets, ttlOffsets, count * sizeof(*ttlOffsets));
+    memcpy(entry->data, question, nameLength + 4 + recordsLength);
+    return true;
+}
+
+size_t DNSCache::answer(uint8_t *buffer, size_t questionLength,
+                        size_t capacity, uint32_t nowMs) {
+    const uint8_t *question = buffer + DNS_HEADER_SIZE;
+    size_t nameLength = questionLength - 4;
+    Entry *entry = find(question, dnsNameHash(question) | 1, nameLength);
+    if (entry == NULL) return 0;
+    if (expired(entry->expiresMs, nowMs)) {
+        entry->hash = 0;
+        return 0;
+    }
+    size_t length = DNS_HEADER_SIZE + questionLength + entry->recordsLength;
+    if (length > capacity) return 0;
+    entry->used = ++_clock;
+
+    // RD is the client's own, everything else comes from the reply
+    uint8_t rd = buffer[2] & 0x01;
+    memcpy(buffer + 2, entry->header, sizeof(entry->header));
+    buffer[2] = (uint8_t)((buffer[2] & ~0x01) | rd);
+    // Compression pointers into the question still hold: the name has the
+    // same length, only its case may differ
+    uint8_t *records = buffer + DNS_HEADER_SIZE + questionLength;
+    memcpy(records, entry->data + questionLength, entry->recordsLength);
+    uint32_t age = (nowMs - entry->storedMs) / 1000;
+    for (size_t i = 0; i < entry->ttlCount; i++) {
+        uint32_t ttl;
+        memcpy(&ttl, records + entry->ttlOffsets[i], sizeof(ttl));
+        ttl = dns_ntohl(ttl);
+        ttl = dns_htonl(ttl > age ? ttl - age : 0);
+        memcpy(records + entry->ttlOffsets[i], &ttl, sizeof(ttl));
+    }
+    return length;
+}
@@ -0,0 +1,61 @@
+#ifndef DNSCache_h
+#define DNSCache_h
+#include "DNSName.h"
+
+// Answers kept, and the bytes of name and records each one may take
+#ifndef DNS_CACHE_ENTRIES
+#define DNS_CACHE_ENTRIES 12
+#endif
+#ifndef DNS_CACHE_ENTRY_SIZE
+#define DNS_CACHE_ENTRY_SIZE 256
+#endif
+// Records of one answer whose TTL is counted down
+#define DNS_CACHE_MAX_RECORDS 8
+// Upper bound on how long anything is kept, in seconds
+#define DNS_CACHE_MAX_TTL 3600
+
+// Fixed size cache of upstream replies for DNSForwarder, keyed by question.
+// Positive answers are kept for their smallest record TTL, NXDOMAIN and
+// NODATA for the TTL of the SOA they come with (RFC 2308); replies without
+// a TTL to go by are not cached. The TTLs sent count down with the time an
+// answer has been kept. When full, expired entries go first, then the least
+// recently used one. Never allocates.
+class DNSCache {
+  public:
+    DNSCache();
+
+    // Keeps the reply in `response` if it can be cached. Returns true if it
+    // was.
+    bool insert(const uint8_t *response, size_t length, uint32_t nowMs);
+    // Completes the request in `buffer`, header and a question of
+    // `questionLength` bytes, into the cached reply to it: header flags and
+    // counts, and the records after the question. The ID and question are
+    // kept. Returns the reply length, or 0 if nothing valid is cached.
+    size_t answer(uint8_t *buffer, size_t questionLength, size_t capacity,
+                  uint32_t nowMs);
+    void clear();
+
+  private:
+    struct Entry {
+        uint32_t hash; // of the name, 0 if the entry is free
+        uint32_t storedMs;
+        uint32_t expiresMs;
+        uint32_t used; // _clock at the last hit, the smallest is evicted
+        // Header bytes 2..11 of the reply: flags and section counts
+        uint8_t header[DNS_HEADER_SIZE - 2];
+        uint8_t nameLength;
+        uint8_t ttlCount;
+        uint16_t recordsLength;
+        // Offsets of the TTLs in the records
+        uint16_t ttlOffsets[DNS_CACHE_MAX_RECORDS];
+        // Name, QTYPE and QCLASS of the question, then the records
+        uint8_t data[DNS_CACHE_ENTRY_SIZE];
+    };
+
+    Entry _entries[DNS_CACHE_ENTRIES];
+    uint32_t _clock;
+
+    Entry *find(const uint8_t *question, uint32_t hash, size_t nameLength);
+    Entry *victim(uint32_t nowMs);
+};
+#endif
@@ -0,0 +1,205 @@
+#include "DNSConfig.h"
+#include <cctype>
+#include <string.h>
+
+static void writeNBOShort(uint8_t *buf, uint16_t value, uint16_t &offset) {
+    memcpy(buf + offset, &value, sizeof(value));
+    offset += sizeof(value);
+}
+
+DNSConfig::DNSConfig() {
+    _errorReplyCode = DNSReplyCode::NonExistentDomain;
+    _upstream.addr = 0;
+    _upstream.port = 0;
+    _upstream.local = 0;
+    _retiredNext = NULL;
+    memset(_addressSets, 0, sizeof(_addressSets));
+    setTTL(60);
+    setNegativeTTL(60);
+}
+
+DNSConfig::DNSConfig(const DNSConfig &other)
+    : _zone(other._zone), _patterns(other._patterns) {
+    _errorReplyCode = other._errorReplyCode;
+    _upstream = other._upstream;
+    _ttl = other._ttl;
+    memcpy(_answerTemplate, other._answerTemplate, sizeof(_answerTemplate));
+    memcpy(_answer6Template, other._answer6Template,
+           sizeof(_answer6Template));
+    memcpy(_soaTemplate, other._soaTemplate, sizeof(_soaTemplate));
+    memcpy(_addressSets, other._addressSets, sizeof(_addressSets));
+    _retiredNext = NULL;
+}
+
+void DNSConfig::setErrorReplyCode(const DNSReplyCode &replyCode) {
+    _errorReplyCode = replyCode;
+}
+
+void DNSConfig::setTTL(const uint32_t &ttl) {
+    _ttl = dns_htonl(ttl);
+    buildAnswerTemplate(_answerTemplate, DNS_QTYPE_A, DNS_QCLASS_IN, _ttl, 4);
+    buildAnswerTemplate(_answer6Template, DNS_QTYPE_AAAA, DNS_QCLASS_IN, _ttl,
+                        16);
+}
+
+// The SOA only serves negative caching: its TTL and MINIMUM are the
+// negative TTL, which is what clients cache NXDOMAIN and NODATA replies for.
+// Everything else is fixed, so the record is built here once.
+void DNSConfig::setNegativeTTL(const uint32_t &ttl) {
+    uint16_t offset = 0;
+    uint32_t nboTTL = dns_htonl(ttl);
+    uint32_t nboOne = dns_htonl(1);
+
+    _soaTemplate[offset++] = 0; // owner is the root
+    writeNBOShort(_soaTemplate, dns_htons(DNS_QTYPE_SOA), offset);
+    writeNBOShort(_soaTemplate, dns_htons(DNS_QCLASS_IN), offset);
+    memcpy(_soaTemplate + offset, &nboTTL, sizeof(nboTTL));
+    offset += sizeof(nboTTL);
+    writeNBOShort(_soaTemplate, dns_htons(DNS_SOA_RDATA_SIZE), offset);
+    _soaTemplate[offset++] = 0; // MNAME
+    _soaTemplate[offset++] = 0; // RNAME
+    // SERIAL, REFRESH, RETRY and EXPIRE have no meaning without transfers
+    for (int i = 0; i < 4; i++) {
+        memcpy(_soaTemplate + offset, &nboOne, sizeof(nboOne));
+        offset += sizeof(nboOne);
+    }
+    memcpy(_soaTemplate + offset, &nboTTL, sizeof(nboTTL)); // MINIMUM
+}
+
+static void downcaseAndRemoveWwwPrefix(std::string &domainName) {
+    for (char &c : domainName) {
+        c = std::tolower(c);
+    }
+    if (domainName.rfind("www.", 0) == 0) {
+        domainName.erase(0, 4);
+    }
+}
+
+void DNSConfig::setDomain(const std::string &domainName,
+                          const uint8_t resolvedIP[4]) {
+    _zone.clear();
+    _patterns.clear();
+    memset(_addressSets, 0, sizeof(_addressSets));
+    if (domainName == "") return;
+    if (domainName == "*") {
+        addPattern("*", 0, resolvedIP);
+        return;
+    }
+
+    std::string name = domainName;
+    downcaseAndRemoveWwwPrefix(name);
+    addRecord(name.c_str(), resolvedIP);
+    addRecord(("www." + name).c_str(), resolvedIP);
+}
+
+static void makeRecord(DNSZoneRecord &record, const uint8_t address[4],
+                       const uint8_t *address6) {
+    memcpy(record.address, address, sizeof(record.address));
+    record.hasAddress6 = address6 != NULL;
+    if (address6 != NULL)
+        memcpy(record.address6, address6, sizeof(record.address6));
+    else
+        memset(record.address6, 0, sizeof(record.address6));
+    record.addressSet = 0;
+}
+
+// Index + 1 of the address set of the record for `name`, 0 if it has none
+uint8_t DNSConfig::addressSetOf(const char *name) const {
+    uint8_t wireName[MAX_DNS_WIRENAME_LENGTH];
+    if (dnsEncodeName(name, wireName, sizeof(wireName)) == 0) return 0;
+    const DNSZoneRecord *record = _zone.lookup(wireName);
+    return record != NULL ? record->addressSet : 0;
+}
+
+bool DNSConfig::addRecord(const char *name, const uint8_t address[4],
+                          const uint8_t *address6) {
+    DNSZoneRecord record;
+    makeRecord(record, address, address6);
+    uint8_t replaced = addressSetOf(name);
+    if (!_zone.add(name, record)) return false;
+    if (replaced != 0) _addressSets[replaced - 1].count = 0;
+    return true;
+}
+
+bool DNSConfig::addRecord(const char *name, const uint8_t (*addresses)[4],
+                          const uint8_t *weights, size_t count,
+                          const uint8_t *address6) {
+    if (count == 0 || count > DNS_ADDRESS_SET_SIZE) return false;
+    if (count == 1 && (weights == NULL || weights[0] != 0))
+        return addRecord(name, addresses[0], address6);
+
+    DNSAddressSet set;
+    set.totalWeight = 0;
+    for (size_t i = 0; i < count; i++) {
+        memcpy(set.addresses[i], addresses[i], sizeof(set.addresses[i]));
+        set.weights[i] = weights != NULL ? weights[i] : 1;
+        set.totalWeight += set.weights[i];
+    }
+    if (set.totalWeight == 0) return false;
+    set.count = count;
+
+    // A name that has a set already keeps it, so replacing its addresses
+    // cannot fail for want of a free one
+    size_t index = addressSetOf(name);
+    if (index != 0) {
+        index--;
+    } else {
+        while (index < DNS_CONFIG_MAX_ADDRESS_SETS &&
+               _addressSets[index].count != 0)
+            index++;
+        if (index == DNS_CONFIG_MAX_ADDRESS_SETS) return false;
+    }
+
+    DNSZoneRecord record;
+    makeRecord(record, addresses[0], address6);
+    record.addressSet = index + 1;
+    if (!_zone.add(name, record)) return false;
+    _addressSets[index] = set;
+    return true;
+}
+
+bool DNSConfig::removeRecord(const char *name) {
+    uint8_t removed = addressSetOf(name);
+    if (!_zone.remove(name)) return false;
+    if (removed != 0) _addressSets[removed - 1].count = 0;
+    return true;
+}
+
+bool DNSConfig::addPattern(const char *pattern, uint16_t priority,
+                           const uint8_t address[4],
+                           const uint8_t *address6) {
+    DNSZoneRecord record;
+    makeRecord(record, address, address6);
+    return _patterns.add(pattern, priority, record);
+}
+
+void DNSConfig::clearPatterns() { _patterns.clear(); }
+
+void DNSConfig::setUpstream(const DNSEndpoint &upstream) {
+    _upstream = upstream;
+}
+
+// Everything of the answer but the address only depends on the TTL, so it
+// is serialized once here instead of on every query.
+void DNSConfig::buildAnswerTemplate(uint8_t *answer, uint16_t type,
+                                    uint16_t rclass, uint32_t ttl,
+                                    uint16_t rdLength) {
+    uint16_t offset = 0;
+
+    // Rather than restate the name here, we use a pointer to the name contained
+    // in the query section. Pointers have the top two bits set.
+    writeNBOShort(answer, dns_htons(0xC000 | DNS_HEADER_SIZE), offset);
+
+    // Answer is type A or AAAA
+    writeNBOShort(answer, dns_htons(type), offset);
+
+    // Answer is in the Internet Class
+    writeNBOShort(answer, dns_htons(rclass), offset);
+
+    // Output TTL (already NBO)
+    memcpy(answer + offset, &ttl, sizeof(ttl));
+    offset += sizeof(ttl);
+
+    // Length of RData is the size of the address
+    writeNBOShort(answer, dns_htons(rdLength), offset);
+}
@@ -0,0 +1,126 @@
+#ifndef DNSConfig_h
+#define DNSConfig_h
+#include "DNSPatternMatcher.h"
+#include "DNSProtocol.h"
+#include "DNSTransport.h"
+#include "DNSZone.h"
+#include <string>
+
+// Names that resolve to several IPv4 addresses, and how many each may have
+#ifndef DNS_CONFIG_MAX_ADDRESS_SETS
+#define DNS_CONFIG_MAX_ADDRESS_SETS 4
+#endif
+#ifndef DNS_ADDRESS_SET_SIZE
+#define DNS_ADDRESS_SET_SIZE 8
+#endif
+
+// Addresses of a name served by several devices, e.g. a fleet of units
+// behind the same API name. Every reply carries all of them; which one
+// comes first, the one most clients use, rotates in proportion to the
+// weights.
+struct DNSAddressSet {
+    uint8_t count; // 0 if the set is free
+    uint8_t addresses[DNS_ADDRESS_SET_SIZE][4];
+    // An address of weight 0 is left out of the replies, e.g. while its
+    // unit is drained
+    uint8_t weights[DNS_ADDRESS_SET_SIZE];
+    uint16_t totalWeight;
+
+    // Index of the address that comes first in the reply for the `turn`th
+    // query: turns are spread over the addresses by weight, equal weights
+    // are a plain round robin
+    size_t first(uint32_t turn) const {
+        uint32_t point = turn % totalWeight;
+        size_t i = 0;
+        while (point >= weights[i]) point -= weights[i++];
+        return i;
+    }
+};
+
+// Everything a reply depends on: names, patterns, TTLs and the records
+// prebuilt from them. DNSResponder answers every batch from one snapshot,
+// which is never changed once published; changes are made to a copy that
+// replaces it, see DNSResponder::beginUpdate().
+class DNSConfig {
+  public:
+    DNSConfig();
+    // Deep copy, the starting point of the next snapshot
+    DNSConfig(const DNSConfig &other);
+
+    void setErrorReplyCode(const DNSReplyCode &replyCode);
+    void setTTL(const uint32_t &ttl);
+    // How long clients may cache NXDOMAIN and NODATA replies (RFC 2308)
+    void setNegativeTTL(const uint32_t &ttl);
+    // Replaces zone and patterns with a single record for `domainName` (and
+    // its www. variant), or answers every name with `resolvedIP` if
+    // `domainName` is "*"
+    void setDomain(const std::string &domainName, const uint8_t resolvedIP[4]);
+    // Adds or replaces the record for `name`. `address6` may be NULL, AAAA
+    // queries then get a NODATA reply. Returns false if the name is invalid
+    // or the zone is full.
+    bool addRecord(const char *name, const uint8_t address[4],
+                   const uint8_t *address6 = NULL);
+    // Adds or replaces the record for `name` with `count` IPv4 addresses (up
+    // to DNS_ADDRESS_SET_SIZE), see DNSAddressSet. `weights` may be NULL
+    // for equal weights. Returns false if the name is invalid, the zone is
+    // full, every address set is in use or no address has a weight.
+    bool addRecord(const char *name, const uint8_t (*addresses)[4],
+                   const uint8_t *weights, size_t count,
+                   const uint8_t *address6 = NULL);
+    bool removeRecord(const char *name);
+    // Adds a pattern (see DNSPatternMatcher) for names not in the zone
+    bool addPattern(const char *pattern, uint16_t priority,
+                    const uint8_t address[4], const uint8_t *address6 = NULL);
+    void clearPatterns();
+    // Resolver that names outside the zone are relayed to, see
+    // DNSForwarder. They are then not matched against the patterns. An
+    // address of 0 (the default) answers everything locally.
+    void setUpstream(const DNSEndpoint &upstream);
+
+    const DNSZone &zone() const { return _zone; }
+    const DNSPatternMatcher &patterns() const { return _patterns; }
+    DNSReplyCode errorReplyCode() const { return _errorReplyCode; }
+    const DNSEndpoint &upstream() const { return _upstream; }
+    // Address set of a record whose addressSet is not 0
+    const DNSAddressSet &addressSet(const DNSZoneRecord &record) const {
+        return _addressSets[record.addressSet - 1];
+    }
+    // A and AAAA answer records in wire format up to the RDATA, sent by
+    // reference after the question, followed by the address of the matching
+    // record
+    const uint8_t *answerTemplate(bool ipv6) const {
+        return ipv6 ? _answer6Template : _answerTemplate;
+    }
+    // SOA record sent in the authority section of negative replies
+    const uint8_t *soaTemplate() const { return _soaTemplate; }
+
+    // Writes the DNS_ANSWER_PREFIX_SIZE bytes of an answer template: a
+    // pointer to the question name, `type`, `rclass`, `ttl` (network byte
+    // order) and `rdLength`. Shared with MDNSResponder, whose records are
+    // of class IN with the cache-flush bit.
+    static void buildAnswerTemplate(uint8_t *answer, uint16_t type,
+                                    uint16_t rclass, uint32_t ttl,
+                                    uint16_t rdLength);
+
+  private:
+    friend class DNSResponder;
+
+    DNSZone _zone;
+    DNSPatternMatcher _patterns;
+    DNSReplyCode _errorReplyCode;
+    DNSEndpoint _upstream;
+    uint32_t _ttl; // network byte order
+    uint8_t _answerTemplate[DNS_ANSWER_PREFIX_SIZE];
+    uint8_t _answer6Template[DNS_ANSWER_PREFIX_SIZE];
+    uint8_t _soaTemplate[DNS_SOA_RECORD_SIZE];
+    // Referenced by zone records only. A set keeps its index while it is
+    // in use, so DNSResponder can keep the rotation of each across
+    // snapshots.
+    DNSAddressSet _addressSets[DNS_CONFIG_MAX_ADDRESS_SETS];
+    // Snapshots replaced but maybe still being read, owned by DNSResponder
+    DNSConfig *_retiredNext;
+
+    DNSConfig &operator=(const DNSConfig &);
+    uint8_t addressSetOf(const char *name) const;
+};
+#endif
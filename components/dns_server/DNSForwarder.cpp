@@ -0,0 +1,118 @@
+#include "DNSForwarder.h"
+#include <esp_timer.h>
+#include <string.h>
+
+DNSForwarder::DNSForwarder() {
+    // Upstream IDs only need to be hard to guess for someone off the path
+    _random = (uint32_t)esp_timer_get_time() | 1;
+    clear();
+}
+
+void DNSForwarder::clear() {
+    _cache.clear();
+    memset(_pending, 0, sizeof(_pending));
+}
+
+uint16_t DNSForwarder::nextId() {
+    _random ^= _random << 13;
+    _random ^= _random >> 17;
+    _random ^= _random << 5;
+    return (uint16_t)_random;
+}
+
+static bool sameQuestion(const uint8_t *a, size_t aNameLength,
+                         const uint8_t *b, size_t bNameLength) {
+    return aNameLength == bNameLength &&
+           memcmp(a + aNameLength, b + bNameLength, 4) == 0 &&
+           dnsNameEquals(a, b);
+}
+
+// Returns the question in flight matching `question`, and frees the ones
+// that timed out on the way
+DNSForwarder::Pending *DNSForwarder::find(const uint8_t *question,
+                                          size_t questionLength,
+                                          uint32_t nowMs) {
+    Pending *match = NULL;
+    for (size_t i = 0; i < DNS_FORWARDER_PENDING; i++) {
+        Pending *pending = &_pending[i];
+        if (pending->waiterCount == 0) continue;
+        if (nowMs - pending->sentMs >= DNS_FORWARDER_TIMEOUT_MS) {
+            pending->waiterCount = 0;
+            continue;
+        }
+        if (sameQuestion(pending->question, pending->nameLength, question,
+                         questionLength - 4))
+            match = pending;
+    }
+    return match;
+}
+
+DNSForwarder::Result DNSForwarder::query(uint8_t *buffer,
+                                         size_t questionLength,
+                                         size_t capacity,
+                                         const DNSEndpoint &client,
+                                         uint32_t nowMs, size_t &length) {
+    length = _cache.answer(buffer, questionLength, capacity, nowMs);
+    if (length != 0) return Answered;
+
+    DNSHeader *header = (DNSHeader *)buffer;
+    const uint8_t *question = buffer + DNS_HEADER_SIZE;
+    Pending *pending = find(question, questionLength, nowMs);
+    if (pending != NULL) {
+        if (pending->waiterCount == DNS_FORWARDER_WAITERS) return Exhausted;
+        DNSForwarderWaiter &waiter = pending->waiters[pending->waiterCount++];
+        waiter.client = client;
+        waiter.id = header->ID;
+        return Joined;
+    }
+    for (size_t i = 0; i < DNS_FORWARDER_PENDING && pending == NULL; i++) {
+        if (_pending[i].waiterCount == 0) pending = &_pending[i];
+    }
+    if (pending == NULL) return Exhausted;
+
+    pending->waiterCount = 1;
+    pending->waiters[0].client = client;
+    pending->waiters[0].id = header->ID;
+    pending->id = nextId();
+    pending->sentMs = nowMs;
+    pending->nameLength = (uint8_t)(questionLength - 4);
+    memcpy(pending->question, question, questionLength);
+
+    // The query going upstream is the request with its own ID and without
+    // anything after the question: EDNS options are the client's business
+    memset(buffer + 2, 0, DNS_HEADER_SIZE - 2);
+    header->ID = pending->id;
+    header->RD = 1;
+    header->QDCount = dns_htons(1);
+    length = DNS_HEADER_SIZE + questionLength;
+    return Forward;
+}
+
+size_t DNSForwarder::reply(const uint8_t *buffer, size_t length,
+                           uint32_t nowMs,
+                           DNSForwarderWaiter waiters[DNS_FORWARDER_WAITERS]) {
+    DNSHeader header;
+    if (length < DNS_HEADER_SIZE) return 0;
+    memcpy(&header, buffer, DNS_HEADER_SIZE);
+    if (header.QDCount != dns_htons(1)) return 0;
+    const uint8_t *question = buffer + DNS_HEADER_SIZE;
+    size_t nameLength = dnsNameLength(question, length - DNS_HEADER_SIZE);
+    if (nameLength == 0 || DNS_HEADER_SIZE + nameLength + 4 > length)
+        return 0;
+
+    // The ID alone is easy to hit with forged replies, the question has to
+    // match as well
+    for (size_t i = 0; i < DNS_FORWARDER_PENDING; i++) {
+        Pending *pending = &_pending[i];
+        if (pending->waiterCount == 0 || pending->id != header.ID ||
+            !sameQuestion(pending->question, pending->nameLength, question,
+                          nameLength))
+            continue;
+        size_t count = pending->waiterCount;
+        memcpy(waiters, pending->waiters, count * sizeof(*waiters));
+        pending->waiterCount = 0;
+        _cache.insert(buffer, length, nowMs);
+        return count;
+    }
+    return 0;
+}
@@ -0,0 +1,69 @@
+#ifndef DNSForwarder_h
+#define DNSForwarder_h
+#include "DNSCache.h"
+#include "DNSTransport.h"
+
+// Questions waiting for the upstream resolver, and clients waiting on each
+#ifndef DNS_FORWARDER_PENDING
+#define DNS_FORWARDER_PENDING 6
+#endif
+#define DNS_FORWARDER_WAITERS 4
+// A question not answered by then is given up, its clients retry
+#define DNS_FORWARDER_TIMEOUT_MS 2000
+
+// A client to send an upstream reply to, with the ID of its request
+struct DNSForwarderWaiter {
+    DNSEndpoint client;
+    uint16_t id; // network byte order
+};
+
+// Relays questions to an upstream resolver for DNSResponder. Replies are
+// cached (DNSCache), and a question already on its way upstream is not sent
+// again: the clients asking it meanwhile all get the one reply. Requests
+// and replies are rewritten in place in the buffer they arrived in, so
+// relaying costs no copy and no allocation. Used by the task answering
+// requests only.
+class DNSForwarder {
+  public:
+    enum Result {
+        Answered,  // from the cache, `buffer` holds the reply
+        Forward,   // `buffer` holds the query to send upstream
+        Joined,    // the same question is already on its way, wait for it
+        Exhausted, // no room to keep track of the question
+    };
+
+    DNSForwarder();
+
+    // Handles the request in `buffer`, header and a question of
+    // `questionLength` bytes. `length` is set to the bytes to send for
+    // Answered and Forward.
+    Result query(uint8_t *buffer, size_t questionLength, size_t capacity,
+                 const DNSEndpoint &client, uint32_t nowMs, size_t &length);
+    // Takes a reply from the upstream resolver and caches it. Fills in the
+    // clients waiting for it and returns how many there are, 0 if the reply
+    // does not answer a question in flight.
+    size_t reply(const uint8_t *buffer, size_t length, uint32_t nowMs,
+                 DNSForwarderWaiter waiters[DNS_FORWARDER_WAITERS]);
+    // Forgets cache and questions in flight, e.g. for another upstream
+    void clear();
+
+  private:
+    struct Pending {
+        uint16_t id; // upstream ID, network byte order
+        uint8_t waiterCount; // 0 if the entry is free
+        uint8_t nameLength;
+        uint32_t sentMs;
+        DNSForwarderWaiter waiters[DNS_FORWARDER_WAITERS];
+        // Name, QTYPE and QCLASS of the question
+        uint8_t question[MAX_DNS_WIRENAME_LENGTH + 4];
+    };
+
+    DNSCache _cache;
+    Pending _pending[DNS_FORWARDER_PENDING];
+    uint32_t _random;
+
+    Pending *find(const uint8_t *question, size_t questionLength,
+                  uint32_t nowMs);
+    uint16_t nextId();
+};
+#endif
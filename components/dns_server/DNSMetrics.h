@@ -0,0 +1,51 @@
+#ifndef DNSMetrics_h
+#define DNSMetrics_h
+#include "DNSProtocol.h"
+
+// Bucket i of the latency histogram counts requests handled in less than
+// 16 << i microseconds (16 us up to 32 ms), the last one everything slower
+#define DNS_METRICS_LATENCY_BUCKETS 12
+#define DNS_METRICS_LATENCY_MIN_US 16
+
+enum DNSMetricsQType {
+    DNS_METRICS_QTYPE_A,
+    DNS_METRICS_QTYPE_AAAA,
+    DNS_METRICS_QTYPE_ANY,
+    DNS_METRICS_QTYPE_OTHER,
+    DNS_METRICS_QTYPES
+};
+
+// Counters kept by DNSResponder. Only the DNS task writes them, with plain
+// increments of aligned 32 bit words, so another task may read them without
+// locking: every counter is consistent on its own, the set as a whole may
+// be off by the request in progress.
+struct DNSMetrics {
+    uint32_t requests; // datagrams received
+    uint32_t ignored;  // datagrams not answered, rate limited ones included
+    uint32_t qtypes[DNS_METRICS_QTYPES]; // questions by QTYPE
+    uint32_t rcodes[16];                 // replies by RCODE
+    uint32_t truncated;                  // replies with TC set
+    uint32_t forwarded; // queries relayed upstream, see DNSForwarder
+    uint32_t cacheHits; // answered from the forwarder's cache
+    uint32_t latency[DNS_METRICS_LATENCY_BUCKETS];
+
+    void countQType(uint16_t qtype) {
+        if (qtype == DNS_QTYPE_A)
+            qtypes[DNS_METRICS_QTYPE_A]++;
+        else if (qtype == DNS_QTYPE_AAAA)
+            qtypes[DNS_METRICS_QTYPE_AAAA]++;
+        else if (qtype == DNS_QTYPE_ANY)
+            qtypes[DNS_METRICS_QTYPE_ANY]++;
+        else
+            qtypes[DNS_METRICS_QTYPE_OTHER]++;
+    }
+
+    void countLatency(uint32_t us) {
+        size_t bucket = 0;
+        while (bucket < DNS_METRICS_LATENCY_BUCKETS - 1 &&
+               us >= (uint32_t)DNS_METRICS_LATENCY_MIN_US << bucket)
+            bucket++;
+        latency[bucket]++;
+    }
+};
+#endif
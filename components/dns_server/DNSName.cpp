@@ -0,0 +1,93 @@
+#include "DNSName.h"
+#include <string.h>
+
+size_t dnsEncodeName(const char *name, uint8_t *out, size_t capacity) {
+    size_t length = 0;
+    while (*name != '\0') {
+        size_t labelLength = 0;
+        while (name[labelLength] != '\0' && name[labelLength] != '.')
+            labelLength++;
+        if (labelLength == 0 || labelLength > 63) return 0;
+        if (length + 1 + labelLength + 1 > capacity) return 0;
+
+        out[length++] = (uint8_t)labelLength;
+        for (size_t i = 0; i < labelLength; i++)
+            out[length++] = dnsToLower(name[i]);
+        name += labelLength;
+        if (*name == '.') name++;
+    }
+    if (length == 0 || length + 1 > MAX_DNS_WIRENAME_LENGTH) return 0;
+    out[length++] = 0;
+    return length;
+}
+
+size_t dnsNameLength(const uint8_t *name, size_t remaining) {
+    size_t length = 0;
+    while (length < remaining && name[length] != 0) {
+        // Compression pointers and extended label types are not names
+        if (name[length] > 63) return 0;
+        length += name[length] + 1;
+    }
+    if (length >= remaining || length + 1 > MAX_DNS_WIRENAME_LENGTH) return 0;
+    return length + 1;
+}
+
+size_t dnsExpandName(const uint8_t *message, size_t length, size_t offset,
+                     uint8_t *out) {
+    size_t position = offset, used = 0, written = 0;
+    // Every label is written or follows a pointer, so a name that is not
+    // done after this many pointers loops
+    size_t hops = MAX_DNS_WIRENAME_LENGTH / 2;
+    for (;;) {
+        if (position >= length) return 0;
+        uint8_t labelLength = message[position];
+        if ((labelLength & 0xC0) == 0xC0) {
+            if (position + 1 >= length || hops-- == 0) return 0;
+            if (used == 0) used = position + 2 - offset;
+            position = (size_t)(labelLength & 0x3F) << 8 |
+                       message[position + 1];
+            continue;
+        }
+        // Extended label types
+        if (labelLength > 63) return 0;
+        if (position + 1 + labelLength > length ||
+            written + 1 + labelLength + (labelLength != 0) >
+                MAX_DNS_WIRENAME_LENGTH)
+            return 0;
+        memcpy(out + written, message + position, 1 + labelLength);
+        written += 1 + labelLength;
+        position += 1 + labelLength;
+        if (labelLength == 0) break;
+    }
+    return used != 0 ? used : position - offset;
+}
+
+// FNV-1a over the lower cased wire bytes, label lengths included
+uint32_t dnsNameHash(const uint8_t *name) {
+    uint32_t hash = 2166136261UL;
+    while (*name != 0) {
+        uint8_t labelLength = *name;
+        hash = (hash ^ labelLength) * 16777619UL;
+        ++name;
+        while (labelLength-- > 0) {
+            hash = (hash ^ dnsToLower(*name)) * 16777619UL;
+            ++name;
+        }
+    }
+    return hash;
+}
+
+bool dnsNameEquals(const uint8_t *a, const uint8_t *b) {
+    while (*a == *b) {
+        uint8_t labelLength = *a;
+        if (labelLength == 0) return true;
+        ++a;
+        ++b;
+        while (labelLength-- > 0) {
+            if (dnsToLower(*a) != dnsToLower(*b)) return false;
+            ++a;
+            ++b;
+        }
+    }
+    return false;
+}
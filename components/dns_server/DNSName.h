@@ -0,0 +1,34 @@
+#ifndef DNSName_h
+#define DNSName_h
+#include "DNSProtocol.h"
+
+// Longest name in wire format: length prefixed labels plus the root label
+#define MAX_DNS_WIRENAME_LENGTH 255
+
+// Helpers for names in wire format, i.e. a sequence of length prefixed
+// labels terminated by the zero length root label. Comparisons and hashes
+// are ASCII case-insensitive as DNS requires.
+
+static constexpr uint8_t dnsToLower(uint8_t c) {
+    return (c >= 'A' && c <= 'Z') ? c | 0x20 : c;
+}
+
+// Encodes a dotted name ("portal.nile.local", a trailing dot is allowed)
+// into `out` in lower case. Returns the wire length, or 0 if the name is
+// empty, has an empty or oversized label or does not fit in `capacity`.
+size_t dnsEncodeName(const char *name, uint8_t *out, size_t capacity);
+
+// Returns the wire length of `name` including the root label, or 0 if it
+// runs past `remaining` bytes or is longer than MAX_DNS_WIRENAME_LENGTH.
+size_t dnsNameLength(const uint8_t *name, size_t remaining);
+
+// Copies the name at `offset` of a `length` byte message into `out` (room
+// for MAX_DNS_WIRENAME_LENGTH bytes), following compression pointers, as
+// names past the question of mDNS messages are. Returns the bytes the name
+// takes up at `offset`, or 0 if it is malformed or runs past the message.
+size_t dnsExpandName(const uint8_t *message, size_t length, size_t offset,
+                     uint8_t *out);
+
+uint32_t dnsNameHash(const uint8_t *name);
+bool dnsNameEquals(const uint8_t *a, const uint8_t *b);
+#endif
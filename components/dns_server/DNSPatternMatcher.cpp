@@ -0,0 +1,174 @@
+#include "DNSPatternMatcher.h"
+#include <string.h>
+
+// Most labels a valid wire name can have
+#define MAX_DNS_LABELS ((MAX_DNS_WIRENAME_LENGTH + 1) / 2)
+
+static uint32_t labelHash(const uint8_t *label) {
+    uint32_t hash = 2166136261UL;
+    for (uint8_t i = 1; i <= label[0]; i++)
+        hash = (hash ^ dnsToLower(label[i])) * 16777619UL;
+    return hash;
+}
+
+static bool isStar(const uint8_t *label) {
+    return label[0] == 1 && label[1] == '*';
+}
+
+const uint16_t DNSPatternMatcher::NONE;
+
+DNSPatternMatcher::DNSPatternMatcher() { clear(); }
+
+void DNSPatternMatcher::clear() {
+    Node root = {0, 0, NONE, NONE, NONE};
+    Trie *tries[] = {&_suffix, &_prefix};
+    for (size_t i = 0; i < 2; i++) {
+        tries[i]->nodes.assign(1, root);
+        tries[i]->edges.assign(8, NONE);
+    }
+    _labels.clear();
+    _rules.clear();
+}
+
+size_t DNSPatternMatcher::edgeSlot(uint16_t parent, uint32_t hash) {
+    return (hash ^ (parent * 2654435761UL)) >> 7;
+}
+
+void DNSPatternMatcher::link(Trie &trie, uint16_t child) {
+    size_t mask = trie.edges.size() - 1;
+    const Node &node = trie.nodes[child];
+    size_t i = edgeSlot(node.parent, node.hash) & mask;
+    while (trie.edges[i] != NONE)
+        i = (i + 1) & mask;
+    trie.edges[i] = child;
+}
+
+uint16_t DNSPatternMatcher::findChild(const Trie &trie, uint16_t parent,
+                                      const uint8_t *label,
+                                      uint32_t hash) const {
+    size_t mask = trie.edges.size() - 1;
+    for (size_t i = edgeSlot(parent, hash) & mask; trie.edges[i] != NONE;
+         i = (i + 1) & mask) {
+        const Node &node = trie.nodes[trie.edges[i]];
+        if (node.parent != parent || node.hash != hash) continue;
+        const uint8_t *own = &_labels[node.label];
+        if (own[0] != label[0]) continue;
+        uint8_t c = 1;
+        while (c <= own[0] && own[c] == dnsToLower(label[c]))
+            c++;
+        if (c > own[0]) return trie.edges[i];
+    }
+    return NONE;
+}
+
+uint16_t DNSPatternMatcher::insert(Trie &trie, uint16_t parent,
+                                   const uint8_t *label) {
+    uint32_t hash = labelHash(label);
+    uint16_t child = findChild(trie, parent, label, hash);
+    if (child != NONE) return child;
+    if (trie.nodes.size() >= NONE / 2 || _labels.size() + label[0] + 1 > NONE)
+        return NONE;
+
+    Node node = {hash, (uint16_t)_labels.size(), parent, NONE, NONE};
+    _labels.insert(_labels.end(), label, label + label[0] + 1);
+    trie.nodes.push_back(node);
+    child = trie.nodes.size() - 1;
+
+    // Keep the edge table at most half full, every node but the root has
+    // exactly one edge
+    if (trie.nodes.size() * 2 > trie.edges.size()) {
+        trie.edges.assign(trie.edges.size() * 2, NONE);
+        for (uint16_t i = 1; i < trie.nodes.size(); i++)
+            link(trie, i);
+    } else {
+        link(trie, child);
+    }
+    return child;
+}
+
+bool DNSPatternMatcher::add(const char *pattern, uint16_t priority,
+                            const DNSZoneRecord &record) {
+    uint8_t wireName[MAX_DNS_WIRENAME_LENGTH];
+    const uint8_t *labels[MAX_DNS_LABELS];
+    size_t count = 0;
+
+    if (_rules.size() >= NONE) return false;
+    if (dnsEncodeName(pattern, wireName, sizeof(wireName)) == 0) return false;
+    for (const uint8_t *label = wireName; *label != 0; label += *label + 1)
+        labels[count++] = label;
+
+    bool leadingStar = isStar(labels[0]);
+    bool trailingStar = count > 1 && isStar(labels[count - 1]);
+    if (leadingStar && trailingStar) return false;
+    for (size_t i = 1; i + 1 < count; i++) {
+        if (isStar(labels[i])) return false;
+    }
+
+    uint16_t *slot;
+    uint16_t node = 0;
+    if (trailingStar) {
+        for (size_t i = 0; i + 1 < count && node != NONE; i++)
+            node = insert(_prefix, node, labels[i]);
+        if (node == NONE) return false;
+        slot = &_prefix.nodes[node].moreRule;
+    } else {
+        size_t first = leadingStar ? 1 : 0;
+        for (size_t i = count; i > first && node != NONE; i--)
+            node = insert(_suffix, node, labels[i - 1]);
+        if (node == NONE) return false;
+        slot = leadingStar ? &_suffix.nodes[node].moreRule
+                           : &_suffix.nodes[node].exactRule;
+    }
+
+    Rule entry = {priority, record};
+    if (*slot != NONE) {
+        // Same pattern again, replace its rule
+        _rules[*slot] = entry;
+    } else {
+        *slot = _rules.size();
+        _rules.push_back(entry);
+    }
+    return true;
+}
+
+void DNSPatternMatcher::consider(uint16_t rule, uint16_t &best) const {
+    if (rule == NONE) return;
+    if (best == NONE || _rules[rule].priority < _rules[best].priority ||
+        (_rules[rule].priority == _rules[best].priority && rule < best))
+        best = rule;
+}
+
+const DNSZoneRecord *DNSPatternMatcher::match(const uint8_t *wireName) const {
+    const uint8_t *labels[MAX_DNS_LABELS];
+    size_t count = 0;
+    uint16_t best = NONE;
+
+    if (_rules.empty()) return NULL;
+
+    // Wire names can only be walked forward, so note where labels start
+    for (const uint8_t *label = wireName; *label != 0; label += *label + 1)
+        labels[count++] = label;
+
+    // From the right: every node passed with labels still to come offers
+    // its "*." rule, the node reached after the last label its exact rule
+    uint16_t node = 0;
+    size_t i = count;
+    for (; i > 0; i--) {
+        consider(_suffix.nodes[node].moreRule, best);
+        const uint8_t *label = labels[i - 1];
+        node = findChild(_suffix, node, label, labelHash(label));
+        if (node == NONE) break;
+    }
+    if (i == 0) consider(_suffix.nodes[node].exactRule, best);
+
+    // From the left for ".*" rules, which need at least one more label
+    node = 0;
+    for (i = 0; i + 1 < count; i++) {
+        const uint8_t *label = labels[i];
+        node = findChild(_prefix, node, label, labelHash(label));
+        if (node == NONE) break;
+        consider(_prefix.nodes[node].moreRule, best);
+    }
+
+    return best != NONE ? &_rules[best].record : NULL;
+}
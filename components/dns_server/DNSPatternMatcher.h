@@ -0,0 +1,68 @@
+#ifndef DNSPatternMatcher_h
+#define DNSPatternMatcher_h
+#include "DNSZone.h"
+#include <vector>
+
+// Name patterns compiled into label tries, matched in one walk over the
+// labels of a wire format name. Supported patterns are
+//   "*"               any name
+//   "*.portal.local"  any name below portal.local (at least one more label)
+//   "captive.*"       captive followed by at least one more label
+//   "api.nile.local"  exactly that name
+// When several patterns match, the lowest priority value wins, and among
+// equal priorities the pattern added first.
+class DNSPatternMatcher {
+  public:
+    DNSPatternMatcher();
+
+    // Returns false if the pattern is malformed (for instance "*" in the
+    // middle) or too many patterns were added
+    bool add(const char *pattern, uint16_t priority,
+             const DNSZoneRecord &record);
+    void clear();
+
+    // Returns the record of the best matching pattern or NULL. `wireName`
+    // must be valid (see dnsNameLength).
+    const DNSZoneRecord *match(const uint8_t *wireName) const;
+
+    size_t size() const { return _rules.size(); }
+
+  private:
+    static const uint16_t NONE = 0xFFFF;
+
+    struct Node {
+        uint32_t hash;      // of the lower cased label
+        uint16_t label;     // offset of the length prefixed label in _labels
+        uint16_t parent;    // index of the parent node, NONE for the root
+        uint16_t exactRule; // rule for a name ending at this node or NONE
+        uint16_t moreRule;  // rule if more labels follow, or NONE
+    };
+
+    // Nodes plus an open addressing table of (parent, label) -> child, so
+    // each step of a walk costs the same however many siblings there are
+    struct Trie {
+        std::vector<Node> nodes;
+        std::vector<uint16_t> edges;
+    };
+
+    struct Rule {
+        uint16_t priority;
+        DNSZoneRecord record;
+    };
+
+    // Patterns with a leading "*" or none at all, keyed from the rightmost
+    // label. The root's moreRule holds the catch-all "*".
+    Trie _suffix;
+    // Patterns with a trailing "*", keyed from the leftmost label
+    Trie _prefix;
+    std::vector<uint8_t> _labels;
+    std::vector<Rule> _rules;
+
+    static size_t edgeSlot(uint16_t parent, uint32_t hash);
+    void link(Trie &trie, uint16_t child);
+    uint16_t insert(Trie &trie, uint16_t parent, const uint8_t *label);
+    uint16_t findChild(const Trie &trie, uint16_t parent, const uint8_t *label,
+                       uint32_t hash) const;
+    void consider(uint16_t rule, uint16_t &best) const;
+};
+#endif
@@ -0,0 +1,88 @@
+#ifndef DNSProtocol_h
+#define DNSProtocol_h
+#include <stddef.h>
+#include <stdint.h>
+
+#define DNS_QR_QUERY 0
+#define DNS_QR_RESPONSE 1
+#define DNS_OPCODE_QUERY 0
+
+#define DNS_PORT 53
+
+#define DNS_QCLASS_IN 1
+#define DNS_QCLASS_ANY 255
+
+#define DNS_QTYPE_A 1
+#define DNS_QTYPE_SOA 6
+#define DNS_QTYPE_AAAA 28
+#define DNS_QTYPE_OPT 41
+#define DNS_QTYPE_ANY 255
+
+#define MAX_DNSNAME_LENGTH 253
+#define MAX_DNS_PACKETSIZE 512
+
+enum class DNSReplyCode {
+    NoError = 0,
+    FormError = 1,
+    ServerFailure = 2,
+    NonExistentDomain = 3,
+    NotImplemented = 4,
+    Refused = 5,
+    YXDomain = 6,
+    YXRRSet = 7,
+    NXRRSet = 8
+};
+
+struct DNSHeader {
+    uint16_t ID;              // identification number
+    unsigned char RD : 1;     // recursion desired
+    unsigned char TC : 1;     // truncated message
+    unsigned char AA : 1;     // authoritive answer
+    unsigned char OPCode : 4; // message_type
+    unsigned char QR : 1;     // query/response flag
+    unsigned char RCode : 4;  // response code
+    unsigned char Z : 3;      // its z! reserved
+    unsigned char RA : 1;     // recursion available
+    uint16_t QDCount;         // number of question entries
+    uint16_t ANCount;         // number of answer entries
+    uint16_t NSCount;         // number of authority entries
+    uint16_t ARCount;         // number of resource entries
+};
+
+#define DNS_HEADER_SIZE sizeof(DNSHeader)
+// Compressed name pointer, TYPE, CLASS, TTL and RDLENGTH of an answer
+#define DNS_ANSWER_PREFIX_SIZE (2 + 2 + 2 + 4 + 2)
+// Answer with an IPv4 address as RDATA
+#define DNS_ANSWER_SIZE (DNS_ANSWER_PREFIX_SIZE + 4)
+// Answer with an IPv6 address as RDATA
+#define DNS_ANSWER6_SIZE (DNS_ANSWER_PREFIX_SIZE + 16)
+
+// SOA record for negative answers with the root as owner, MNAME and RNAME:
+// owner, TYPE, CLASS, TTL, RDLENGTH, MNAME, RNAME, SERIAL, REFRESH, RETRY,
+// EXPIRE and MINIMUM
+#define DNS_SOA_RDATA_SIZE (1 + 1 + 4 + 4 + 4 + 4 + 4)
+#define DNS_SOA_RECORD_SIZE (1 + 2 + 2 + 4 + 2 + DNS_SOA_RDATA_SIZE)
+
+// EDNS0 OPT pseudo record without options: root name, TYPE, UDP payload
+// size, extended RCODE, version, flags and RDLENGTH
+#define DNS_OPT_RECORD_SIZE (1 + 2 + 2 + 1 + 1 + 2 + 2)
+// Advertised in our OPT record. Requests are received into a buffer of
+// MAX_DNS_PACKETSIZE and replies never grow past it either.
+#define DNS_EDNS_UDP_PAYLOAD_SIZE MAX_DNS_PACKETSIZE
+// Extended RCODE BADVERS (16), the upper 8 bits go into the OPT record
+#define DNS_EDNS_BADVERS_HIGH 1
+
+// Both the ESP8266 and the hosts we benchmark on are little endian, and the
+// core must not depend on lwIP for lwip_htons/lwip_htonl.
+static inline uint16_t dns_htons(uint16_t value) {
+    return (uint16_t)((value << 8) | (value >> 8));
+}
+
+static inline uint32_t dns_htonl(uint32_t value) {
+    return ((value & 0x000000FFUL) << 24) | ((value & 0x0000FF00UL) << 8) |
+           ((value & 0x00FF0000UL) >> 8) | ((value & 0xFF000000UL) >> 24);
+}
+
+#define dns_ntohs dns_htons
+#define dns_ntohl dns_htonl
+#endif
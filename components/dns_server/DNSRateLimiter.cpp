@@ -0,0 +1,69 @@
+#include "DNSRateLimiter.h"
+#include <string.h>
+
+// Thousandths of a reply per token, one token pays for one reply
+#define DNS_RATE_LIMIT_TOKEN 1000
+
+DNSRateLimiter::DNSRateLimiter() {
+    configure(0, 0, 0);
+    _dropped = 0;
+    _truncated = 0;
+}
+
+void DNSRateLimiter::configure(uint16_t rate, uint16_t burst, uint8_t slip) {
+    memset(_buckets, 0, sizeof(_buckets));
+    _rate = rate;
+    _capacity = (uint32_t)(burst != 0 ? burst : 1) * DNS_RATE_LIMIT_TOKEN;
+    _slip = slip;
+    _slipCount = 0;
+}
+
+DNSRateLimiter::Verdict DNSRateLimiter::check(uint32_t addr, uint32_t nowMs) {
+    if (_rate == 0) return Allow;
+
+    // Fibonacci hashing, the low bits of an address are the ones that
+    // differ between clients on the same network
+    size_t home = (size_t)((uint32_t)(addr * 2654435761U) >> 16);
+    Bucket *bucket = NULL, *victim = NULL;
+    for (size_t i = 0; i < DNS_RATE_LIMIT_PROBES; i++) {
+        Bucket *slot = &_buckets[(home + i) & (DNS_RATE_LIMIT_SLOTS - 1)];
+        if (slot->addr == addr) {
+            bucket = slot;
+            break;
+        }
+        if (slot->addr == 0) {
+            victim = slot;
+            break;
+        }
+        if (victim == NULL || nowMs - slot->last > nowMs - victim->last)
+            victim = slot;
+    }
+
+    if (bucket == NULL) {
+        bucket = victim;
+        bucket->addr = addr;
+        bucket->tokens = _capacity;
+    } else {
+        // Tokens accrue at _rate thousandths per millisecond. Clamp the
+        // elapsed time first so the product cannot overflow.
+        uint32_t elapsed = nowMs - bucket->last;
+        if (elapsed >= _capacity / _rate)
+            bucket->tokens = _capacity;
+        else
+            bucket->tokens += elapsed * _rate;
+        if (bucket->tokens > _capacity) bucket->tokens = _capacity;
+    }
+    bucket->last = nowMs;
+
+    if (bucket->tokens >= DNS_RATE_LIMIT_TOKEN) {
+        bucket->tokens -= DNS_RATE_LIMIT_TOKEN;
+        return Allow;
+    }
+    if (_slip != 0 && ++_slipCount >= _slip) {
+        _slipCount = 0;
+        _truncated++;
+        return Truncate;
+    }
+    _dropped++;
+    return Drop;
+}
@@ -0,0 +1,54 @@
+#ifndef DNSRateLimiter_h
+#define DNSRateLimiter_h
+#include <stddef.h>
+#include <stdint.h>
+
+// Clients tracked at once, a power of two. When the table is full the
+// client seen least recently among the probed slots is forgotten, which
+// only ever gives it a fresh bucket.
+#ifndef DNS_RATE_LIMIT_SLOTS
+#define DNS_RATE_LIMIT_SLOTS 32
+#endif
+// Slots looked at for a client before one is reused
+#define DNS_RATE_LIMIT_PROBES 4
+
+// Token bucket per client address, so that a single client flooding port 53
+// cannot keep the DNS task busy answering it. The table is a fixed array,
+// check() never allocates.
+//
+// Not synchronized: configure() must not run concurrently with check().
+class DNSRateLimiter {
+  public:
+    enum Verdict { Allow, Drop, Truncate };
+
+    DNSRateLimiter();
+    // Allows `rate` replies per second to each client, in bursts of up to
+    // `burst`. Every `slip`th reply over the limit is sent truncated rather
+    // than dropped, so a legitimate client behind a spoofed address still
+    // gets an answer eventually; 0 drops them all. A rate of 0 disables
+    // limiting.
+    void configure(uint16_t rate, uint16_t burst, uint8_t slip);
+    // Takes a token from the bucket of `addr` (network byte order) at time
+    // `nowMs`, a free running millisecond clock
+    Verdict check(uint32_t addr, uint32_t nowMs);
+
+    bool enabled() const { return _rate != 0; }
+    uint32_t dropped() const { return _dropped; }
+    uint32_t truncated() const { return _truncated; }
+
+  private:
+    struct Bucket {
+        uint32_t addr; // 0 if the slot is free
+        uint32_t tokens; // in thousandths of a reply
+        uint32_t last; // time of the last refill, in ms
+    };
+
+    Bucket _buckets[DNS_RATE_LIMIT_SLOTS];
+    uint32_t _rate;
+    uint32_t _capacity; // burst, in thousandths of a reply
+    uint8_t _slip;
+    uint8_t _slipCount;
+    uint32_t _dropped;
+    uint32_t _truncated;
+};
+#endif
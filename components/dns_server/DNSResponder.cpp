@@ -0,0 +1,611 @@
+#include "DNSResponder.h"
+#include <esp_timer.h>
+#include <string.h>
+
+static const char *TAG = "dns_server";
+
+// Events logged through _eventLog, see event_log.h
+enum DNSEvent {
+    DNS_EVENT_RECEIVED,
+    DNS_EVENT_NOT_QUERY,
+    DNS_EVENT_NOT_IMPLEMENTED,
+    DNS_EVENT_QDCOUNT,
+    DNS_EVENT_QUERY,
+};
+
+static const char *const dnsEventFormats[] = {
+    "Received DNS request of %u bytes",
+    "Not a query, ignored request",
+    "Operation %u is not a query, reply with not implemented error",
+    "%u queries in one request are not supported",
+    "Query type %u, class %u, %u byte name",
+};
+
+#define DNS_ERROR_PATCH(rcode) {{(uint8_t)(rcode), 0, 1, 0, 0, 0, 0, 0, 0}}
+
+// One question, one answer, RCODE NoError
+static const DNSHeaderPatch dnsAnswerPatch = {{0, 0, 1, 0, 1, 0, 0, 0, 0}};
+// OPT records we answer EDNS0 requests with: our UDP payload size, and the
+// same with extended RCODE BADVERS for requests with an unknown version
+static const uint8_t dnsOptRecord[DNS_OPT_RECORD_SIZE] = {
+    0, 0, DNS_QTYPE_OPT, DNS_EDNS_UDP_PAYLOAD_SIZE >> 8,
+    DNS_EDNS_UDP_PAYLOAD_SIZE & 0xFF, 0, 0, 0, 0, 0, 0};
+static const uint8_t dnsOptBadVersRecord[DNS_OPT_RECORD_SIZE] = {
+    0, 0, DNS_QTYPE_OPT, DNS_EDNS_UDP_PAYLOAD_SIZE >> 8,
+    DNS_EDNS_UDP_PAYLOAD_SIZE & 0xFF, DNS_EDNS_BADVERS_HIGH, 0, 0, 0, 0, 0};
+
+// One question, no answer, indexed by RCODE
+static const DNSHeaderPatch dnsErrorPatches[] = {
+    DNS_ERROR_PATCH(DNSReplyCode::NoError),
+    DNS_ERROR_PATCH(DNSReplyCode::FormError),
+    DNS_ERROR_PATCH(DNSReplyCode::ServerFailure),
+    DNS_ERROR_PATCH(DNSReplyCode::NonExistentDomain),
+    DNS_ERROR_PATCH(DNSReplyCode::NotImplemented),
+    DNS_ERROR_PATCH(DNSReplyCode::Refused),
+    DNS_ERROR_PATCH(DNSReplyCode::YXDomain),
+    DNS_ERROR_PATCH(DNSReplyCode::YXRRSet),
+    DNS_ERROR_PATCH(DNSReplyCode::NXRRSet),
+};
+
+DNSResponder::DNSResponder() : _config(new DNSConfig()), _active(NULL) {
+    _transport = NULL;
+    _retired = NULL;
+    _forwarder = NULL;
+    event_log_ring_init(&_eventLog, TAG, dnsEventFormats);
+    for (size_t i = 0; i < DNS_BATCH_SIZE; i++) {
+        _datagrams[i].buffer = _buffers[i];
+        _datagrams[i].capacity = sizeof(_buffers[i]);
+    }
+    memset(&_metrics, 0, sizeof(_metrics));
+    memset(_rotations, 0, sizeof(_rotations));
+}
+
+// The task answering must be gone by now
+DNSResponder::~DNSResponder() {
+    _active.store(NULL);
+    reclaimConfigs();
+    delete _config.load();
+    delete _forwarder;
+}
+
+void DNSResponder::setTransport(DNSTransport *transport) {
+    _transport = transport;
+}
+
+DNSConfig *DNSResponder::beginUpdate() {
+    return new DNSConfig(*_config.load());
+}
+
+// Publishing is a single pointer store. The snapshot replaced is freed once
+// the task answering is known not to use it, here or on a later update.
+void DNSResponder::commitUpdate(DNSConfig *config) {
+    DNSConfig *old = _config.load();
+    _config.store(config);
+    old->_retiredNext = _retired;
+    _retired = old;
+    reclaimConfigs();
+}
+
+void DNSResponder::abortUpdate(DNSConfig *config) { delete config; }
+
+void DNSResponder::reclaimConfigs() {
+    const DNSConfig *active = _active.load();
+    DNSConfig **link = &_retired;
+    while (*link != NULL) {
+        DNSConfig *config = *link;
+        if (config == active) {
+            link = &config->_retiredNext;
+            continue;
+        }
+        *link = config->_retiredNext;
+        delete config;
+    }
+}
+
+// Announces the snapshot in _active before using it, then checks it is
+// still the published one. An update either sees it announced and keeps it,
+// or replaced it before the check, which then picks up the new one. Both
+// are sequentially consistent atomics for this to hold.
+const DNSConfig *DNSResponder::acquireConfig() {
+    const DNSConfig *config = _config.load();
+    for (;;) {
+        _active.store(config);
+        const DNSConfig *current = _config.load();
+        if (current == config) return config;
+        config = current;
+    }
+}
+
+// Replies point into the snapshot, so it is only released once they are
+// sent
+void DNSResponder::releaseConfig() { _active.store(NULL); }
+
+void DNSResponder::setErrorReplyCode(const DNSReplyCode &replyCode) {
+    DNSConfig *config = beginUpdate();
+    config->setErrorReplyCode(replyCode);
+    commitUpdate(config);
+}
+
+void DNSResponder::setTTL(const uint32_t &ttl) {
+    DNSConfig *config = beginUpdate();
+    config->setTTL(ttl);
+    commitUpdate(config);
+}
+
+void DNSResponder::setNegativeTTL(const uint32_t &ttl) {
+    DNSConfig *config = beginUpdate();
+    config->setNegativeTTL(ttl);
+    commitUpdate(config);
+}
+
+void DNSResponder::setDomain(std::string &domainName,
+                             const uint8_t resolvedIP[4]) {
+    DNSConfig *config = beginUpdate();
+    config->setDomain(domainName, resolvedIP);
+    commitUpdate(config);
+}
+
+bool DNSResponder::addRecord(const char *name, const uint8_t address[4],
+                             const uint8_t *address6) {
+    DNSConfig *config = beginUpdate();
+    if (!config->addRecord(name, address, address6)) {
+        abortUpdate(config);
+        return false;
+    }
+    commitUpdate(config);
+    return true;
+}
+
+bool DNSResponder::addRecord(const char *name, const uint8_t (*addresses)[4],
+                             const uint8_t *weights, size_t count,
+                             const uint8_t *address6) {
+    DNSConfig *config = beginUpdate();
+    if (!config->addRecord(name, addresses, weights, count, address6)) {
+        abortUpdate(config);
+        return false;
+    }
+    commitUpdate(config);
+    return true;
+}
+
+bool DNSResponder::removeRecord(const char *name) {
+    DNSConfig *config = beginUpdate();
+    if (!config->removeRecord(name)) {
+        abortUpdate(config);
+        return false;
+    }
+    commitUpdate(config);
+    return true;
+}
+
+bool DNSResponder::addPattern(const char *pattern, uint16_t priority,
+                              const uint8_t address[4],
+                              const uint8_t *address6) {
+    DNSConfig *config = beginUpdate();
+    if (!config->addPattern(pattern, priority, address, address6)) {
+        abortUpdate(config);
+        return false;
+    }
+    commitUpdate(config);
+    return true;
+}
+
+void DNSResponder::clearPatterns() {
+    DNSConfig *config = beginUpdate();
+    config->clearPatterns();
+    commitUpdate(config);
+}
+
+void DNSResponder::respondToRequest(DNSPacket *dnsPacket, size_t length) {
+    DNSHeader *dnsHeader;
+    uint8_t *query, *start;
+    const DNSZoneRecord *record;
+    size_t remaining, nameLength, queryLength;
+    uint16_t qtype, qclass;
+
+    dnsHeader = dnsPacket->dnsHeader;
+
+    // Must be a query for us to do anything with it
+    if (dnsHeader->QR != DNS_QR_QUERY) {
+        EVENT_LOGI(&_eventLog, DNS_EVENT_NOT_QUERY, 0, 0, 0);
+        return;
+    }
+
+    // If operation is anything other than query, we don't do it
+    if (dnsHeader->OPCode != DNS_OPCODE_QUERY) {
+        EVENT_LOGI(&_eventLog, DNS_EVENT_NOT_IMPLEMENTED, dnsHeader->OPCode,
+                   0, 0);
+        return replyWithError(dnsPacket, DNSReplyCode::NotImplemented);
+    }
+
+    // Only support requests containing single queries - everything else
+    // is badly defined
+    if (dnsHeader->QDCount != dns_htons(1)) {
+        EVENT_LOGI(&_eventLog, DNS_EVENT_QDCOUNT,
+                   dns_ntohs(dnsHeader->QDCount), 0, 0);
+        return replyWithError(dnsPacket, DNSReplyCode::FormError);
+    }
+
+    // The only additional record we understand is a single EDNS0 OPT,
+    // anything else in the other sections is a FormError
+    if (dnsHeader->ANCount != 0 || dnsHeader->NSCount != 0 ||
+        dns_ntohs(dnsHeader->ARCount) > 1)
+        return replyWithError(dnsPacket, DNSReplyCode::FormError);
+
+    // Even if we're not going to use the query, we need to parse it
+    // so we can check the address type that's being queried
+
+    uint8_t *buffer = (uint8_t *)dnsPacket->dnsHeader;
+    query = buffer + DNS_HEADER_SIZE;
+    remaining = length - DNS_HEADER_SIZE;
+    nameLength = dnsNameLength(query, remaining);
+    if (nameLength == 0)
+        return replyWithError(dnsPacket, DNSReplyCode::FormError);
+
+    // 2 octet qtype, 2 octet qclass
+    if (remaining - nameLength < 4)
+        return replyWithError(dnsPacket, DNSReplyCode::FormError);
+
+    start = query + nameLength;
+    memcpy(&qtype, start, sizeof(qtype));
+    _metrics.countQType(dns_ntohs(qtype));
+    start += 2;
+    memcpy(&qclass, start, sizeof(qclass));
+    start += 2;
+
+    queryLength = start - query;
+
+    if (dnsHeader->ARCount != 0 &&
+        !parseOpt(dnsPacket, start, remaining - queryLength))
+        return replyWithError(dnsPacket, DNSReplyCode::FormError, query,
+                              queryLength);
+    if (dnsPacket->opt == dnsOptBadVersRecord)
+        return replyWithError(dnsPacket, DNSReplyCode::NoError, query,
+                              queryLength);
+
+    EVENT_LOGD(&_eventLog, DNS_EVENT_QUERY, dns_ntohs(qtype),
+               dns_ntohs(qclass), nameLength);
+
+    if (qclass != dns_htons(DNS_QCLASS_ANY) &&
+        qclass != dns_htons(DNS_QCLASS_IN))
+        return replyWithError(dnsPacket, DNSReplyCode::NonExistentDomain, query,
+                              queryLength);
+
+    const DNSConfig *config = dnsPacket->config;
+    record = config->zone().lookup(query);
+    if (record == NULL && config->upstream().addr != 0)
+        return forward(dnsPacket, queryLength);
+    if (record == NULL) record = config->patterns().match(query);
+    if (record == NULL)
+        return replyWithError(dnsPacket, config->errorReplyCode(), query,
+                              queryLength);
+
+    if (qtype == dns_htons(DNS_QTYPE_A) || qtype == dns_htons(DNS_QTYPE_ANY))
+        return replyWithIP(dnsPacket, queryLength, record, false);
+
+    if (qtype == dns_htons(DNS_QTYPE_AAAA) && record->hasAddress6)
+        return replyWithIP(dnsPacket, queryLength, record, true);
+
+    // The name exists but has no data of this type. Unlike NXDOMAIN this
+    // does not make the client give up on the A record of the same name.
+    return replyWithError(dnsPacket, DNSReplyCode::NoError, query, queryLength);
+}
+
+// Parses the EDNS0 OPT record following the question. Options are ignored.
+// Sets dnsPacket->opt to the OPT record of the reply and returns false if
+// the additional section is not a single well formed OPT record.
+bool DNSResponder::parseOpt(DNSPacket *dnsPacket, const uint8_t *opt,
+                            size_t remaining) {
+    uint16_t type, rdLength;
+
+    if (remaining < DNS_OPT_RECORD_SIZE) return false;
+    // The owner name of an OPT record is the root
+    if (opt[0] != 0) return false;
+    memcpy(&type, opt + 1, sizeof(type));
+    if (type != dns_htons(DNS_QTYPE_OPT)) return false;
+    memcpy(&rdLength, opt + 9, sizeof(rdLength));
+    if (dns_ntohs(rdLength) > remaining - DNS_OPT_RECORD_SIZE) return false;
+
+    // Byte 6 is the EDNS version, only version 0 exists
+    dnsPacket->opt = opt[6] == 0 ? dnsOptRecord : dnsOptBadVersRecord;
+    return true;
+}
+
+void DNSResponder::handleDatagram(DNSDatagram &datagram, DNSReply &reply,
+                                  const DNSConfig *config) {
+    int64_t begin = esp_timer_get_time();
+
+    reply.count = 0;
+    reply.to = datagram.from;
+    if (datagram.length == 0) return;
+
+    _metrics.requests++;
+    if (respondToDatagram(datagram, reply, config, (uint32_t)(begin / 1000))) {
+        // Queries relayed upstream are counted by forward()
+        DNSHeader *replyHeader = (DNSHeader *)datagram.buffer;
+        if (replyHeader->QR == DNS_QR_RESPONSE) {
+            _metrics.rcodes[replyHeader->RCode]++;
+            if (replyHeader->TC) _metrics.truncated++;
+        }
+    } else {
+        _metrics.ignored++;
+    }
+    _metrics.countLatency((uint32_t)(esp_timer_get_time() - begin));
+}
+
+// Returns true if `reply` was filled in
+bool DNSResponder::respondToDatagram(DNSDatagram &datagram, DNSReply &reply,
+                                     const DNSConfig *config, uint32_t nowMs) {
+    DNSPacket dnsPacket;
+    size_t currentPacketSize = datagram.length;
+
+    // The DNS RFC requires that DNS packets be less than 512 bytes in size,
+    // so just discard them if they are larger
+    if (currentPacketSize > MAX_DNS_PACKETSIZE) return false;
+
+    // If the packet size is smaller than the DNS header, then someone is
+    // messing with us
+    if (currentPacketSize < DNS_HEADER_SIZE) return false;
+
+    dnsPacket.dnsHeader = (DNSHeader *)datagram.buffer;
+    dnsPacket.from = datagram.from;
+    dnsPacket.reply = &reply;
+    dnsPacket.opt = NULL;
+    dnsPacket.config = config;
+    dnsPacket.nowMs = nowMs;
+    dnsPacket.local = (const uint8_t *)&datagram.from.local;
+    EVENT_LOGD(&_eventLog, DNS_EVENT_RECEIVED, currentPacketSize, 0, 0);
+
+    if (dnsPacket.dnsHeader->QR == DNS_QR_RESPONSE &&
+        relayUpstreamReply(&dnsPacket, currentPacketSize))
+        return true;
+
+    // Rate limiting comes before any parsing so that a flood costs as
+    // little as possible. Other replies are ignored, they are never
+    // answered.
+    if (dnsPacket.dnsHeader->QR == DNS_QR_QUERY) {
+        switch (_rateLimiter.check(datagram.from.addr, nowMs)) {
+            case DNSRateLimiter::Allow:
+                break;
+            case DNSRateLimiter::Drop:
+                return false;
+            case DNSRateLimiter::Truncate:
+                replyTruncated(&dnsPacket);
+                return true;
+        }
+    }
+    respondToRequest(&dnsPacket, currentPacketSize);
+    return reply.count != 0;
+}
+
+void DNSResponder::processNextRequest() {
+    DNSDatagram &datagram = _datagrams[0];
+    datagram.length =
+        _transport->receive(datagram.buffer, datagram.capacity, datagram.from);
+    handleDatagram(datagram, _replies[0], acquireConfig());
+    if (_replies[0].count != 0)
+        _transport->send(_replies[0].slices, _replies[0].count,
+                         _replies[0].to);
+    releaseConfig();
+}
+
+void DNSResponder::processNextBatch() {
+    size_t count = _transport->receiveBatch(_datagrams, DNS_BATCH_SIZE);
+    if (count == 0) return;
+    const DNSConfig *config = acquireConfig();
+    for (size_t i = 0; i < count; i++)
+        handleDatagram(_datagrams[i], _replies[i], config);
+    _transport->sendBatch(_replies, count);
+    releaseConfig();
+}
+
+// Turns the request header into a reply header: sets QR and overwrites
+// RCODE and the section counts with a prebuilt patch. ID, OPCODE and RD are
+// kept from the request.
+void DNSResponder::patchHeader(DNSPacket *dnsPacket,
+                               const DNSHeaderPatch &patch, bool withQuestion) {
+    uint8_t *buffer = (uint8_t *)dnsPacket->dnsHeader;
+    buffer[2] |= DNS_QR_RESPONSE << 7;
+    memcpy(buffer + 3, patch.bytes, sizeof(patch.bytes));
+    if (!withQuestion) dnsPacket->dnsHeader->QDCount = 0;
+}
+
+// Completes a reply whose first `count` slices are filled in, adding the
+// OPT record if the request was EDNS0
+void DNSResponder::finishReply(DNSPacket *dnsPacket, size_t count) {
+    DNSReply *reply = dnsPacket->reply;
+    if (dnsPacket->opt != NULL) {
+        reply->slices[count].data = dnsPacket->opt;
+        reply->slices[count].length = DNS_OPT_RECORD_SIZE;
+        count++;
+        dnsPacket->dnsHeader->ARCount = dns_htons(1);
+    }
+    reply->count = count;
+}
+
+// The reply is the request header patched in place, followed by the
+// question that is already in the buffer and, by reference, the prebuilt
+// answer and the address.
+void DNSResponder::replyWithIP(DNSPacket *dnsPacket, size_t queryLength,
+                               const DNSZoneRecord *record, bool ipv6) {
+    if (!ipv6 && record->addressSet != 0)
+        return replyWithAddresses(dnsPacket, queryLength, record);
+
+    DNSSlice *reply = dnsPacket->reply->slices;
+    reply[0].data = (uint8_t *)dnsPacket->dnsHeader;
+    reply[0].length = DNS_HEADER_SIZE + queryLength;
+    reply[1].data = dnsPacket->config->answerTemplate(ipv6);
+    reply[1].length = DNS_ANSWER_PREFIX_SIZE;
+    reply[2].data = ipv6 ? record->address6 : record->address;
+    // 0.0.0.0 resolves to the interface the request arrived on
+    if (!ipv6 && memcmp(record->address, "\0\0\0\0", 4) == 0)
+        reply[2].data = dnsPacket->local;
+    reply[2].length = ipv6 ? 16 : 4;
+
+    if (reply[0].length + reply[1].length + reply[2].length +
+            DNS_OPT_RECORD_SIZE >
+        MAX_DNS_PACKETSIZE) {
+        // No room left for the answer, let the client retry over TCP
+        patchHeader(dnsPacket, dnsErrorPatches[(int)DNSReplyCode::NoError],
+                    true);
+        dnsPacket->dnsHeader->TC = 1;
+        finishReply(dnsPacket, 1);
+        return;
+    }
+    patchHeader(dnsPacket, dnsAnswerPatch, true);
+    finishReply(dnsPacket, 3);
+}
+
+// One A record per address of the set, written into the buffer after the
+// question instead of being sent by reference: there are too many of them
+// for the slices of a reply. Each is a copy of the prebuilt answer, whose
+// name is a pointer to the question, followed by the address, i.e. 16
+// bytes, so the whole set fits in any reply with room for one answer.
+void DNSResponder::replyWithAddresses(DNSPacket *dnsPacket, size_t queryLength,
+                                      const DNSZoneRecord *record) {
+    const DNSAddressSet &set = dnsPacket->config->addressSet(*record);
+    const uint8_t *answerTemplate = dnsPacket->config->answerTemplate(false);
+    uint8_t *buffer = (uint8_t *)dnsPacket->dnsHeader;
+    size_t length = DNS_HEADER_SIZE + queryLength;
+    size_t limit = MAX_DNS_PACKETSIZE - DNS_OPT_RECORD_SIZE;
+    size_t first = set.first(_rotations[record->addressSet - 1]++);
+    uint16_t answers = 0;
+    bool truncated = false;
+
+    for (size_t n = 0; n < set.count; n++) {
+        size_t i = (first + n) % set.count;
+        if (set.weights[i] == 0) continue;
+        if (length + DNS_ANSWER_PREFIX_SIZE + 4 > limit) {
+            truncated = true;
+            break;
+        }
+        memcpy(buffer + length, answerTemplate, DNS_ANSWER_PREFIX_SIZE);
+        length += DNS_ANSWER_PREFIX_SIZE;
+        // 0.0.0.0 resolves to the interface the request arrived on
+        const uint8_t *address = set.addresses[i];
+        if (memcmp(address, "\0\0\0\0", 4) == 0) address = dnsPacket->local;
+        memcpy(buffer + length, address, 4);
+        length += 4;
+        answers++;
+    }
+
+    patchHeader(dnsPacket, dnsAnswerPatch, true);
+    dnsPacket->dnsHeader->ANCount = dns_htons(answers);
+    // Part of the set only, the client may retry over TCP for all of it
+    if (truncated) dnsPacket->dnsHeader->TC = 1;
+    dnsPacket->reply->slices[0].data = buffer;
+    dnsPacket->reply->slices[0].length = length;
+    finishReply(dnsPacket, 1);
+}
+
+void DNSResponder::replyWithError(DNSPacket *dnsPacket, DNSReplyCode rcode,
+                                  unsigned char *query, size_t queryLength) {
+    patchHeader(dnsPacket, dnsErrorPatches[(int)rcode], query != NULL);
+
+    // The question, if any, already follows the header in the buffer
+    DNSSlice *reply = dnsPacket->reply->slices;
+    reply[0].data = (uint8_t *)dnsPacket->dnsHeader;
+    reply[0].length = DNS_HEADER_SIZE + queryLength;
+    reply[1].data = dnsPacket->config->soaTemplate();
+    reply[1].length = DNS_SOA_RECORD_SIZE;
+
+    // NXDOMAIN and NODATA carry the SOA so clients can cache them, if it
+    // fits (the client just does not cache otherwise)
+    bool negative = rcode == DNSReplyCode::NonExistentDomain ||
+                    (rcode == DNSReplyCode::NoError &&
+                     dnsPacket->opt != dnsOptBadVersRecord);
+    if (query != NULL && negative &&
+        reply[0].length + reply[1].length + DNS_OPT_RECORD_SIZE <=
+            MAX_DNS_PACKETSIZE) {
+        dnsPacket->dnsHeader->NSCount = dns_htons(1);
+        finishReply(dnsPacket, 2);
+        return;
+    }
+    finishReply(dnsPacket, 1);
+}
+
+void DNSResponder::replyWithError(DNSPacket *dnsPacket, DNSReplyCode rcode) {
+    replyWithError(dnsPacket, rcode, NULL, 0);
+}
+
+// Empty reply with TC set, sent instead of dropping some of the requests of
+// a rate limited client. It is as small as a reply can be, so answering
+// spoofed requests this way amplifies nothing.
+void DNSResponder::replyTruncated(DNSPacket *dnsPacket) {
+    patchHeader(dnsPacket, dnsErrorPatches[(int)DNSReplyCode::NoError], false);
+    dnsPacket->dnsHeader->TC = 1;
+    dnsPacket->reply->slices[0].data = (uint8_t *)dnsPacket->dnsHeader;
+    dnsPacket->reply->slices[0].length = DNS_HEADER_SIZE;
+    finishReply(dnsPacket, 1);
+}
+
+DNSForwarder *DNSResponder::forwarder(const DNSConfig *config) {
+    const DNSEndpoint &upstream = config->upstream();
+    if (_forwarder == NULL) {
+        _forwarder = new DNSForwarder();
+    } else if (_forwarderUpstream.addr != upstream.addr ||
+               _forwarderUpstream.port != upstream.port) {
+        // Another network, what was cached there may not hold here
+        _forwarder->clear();
+    }
+    _forwarderUpstream = upstream;
+    return _forwarder;
+}
+
+// Answers from the cache, or turns the request into the query for the
+// upstream resolver and sends it there instead of replying
+void DNSResponder::forward(DNSPacket *dnsPacket, size_t queryLength) {
+    DNSForwarder *forwarder = this->forwarder(dnsPacket->config);
+    uint8_t *buffer = (uint8_t *)dnsPacket->dnsHeader;
+    DNSReply *reply = dnsPacket->reply;
+    size_t length;
+    switch (forwarder->query(buffer, queryLength, MAX_DNS_PACKETSIZE,
+                             dnsPacket->from, dnsPacket->nowMs, length)) {
+        case DNSForwarder::Answered:
+            _metrics.cacheHits++;
+            break;
+        case DNSForwarder::Forward:
+            _metrics.forwarded++;
+            reply->to = dnsPacket->config->upstream();
+            break;
+        case DNSForwarder::Joined:
+            return;
+        case DNSForwarder::Exhausted:
+            return replyWithError(dnsPacket, DNSReplyCode::ServerFailure,
+                                  buffer + DNS_HEADER_SIZE, queryLength);
+    }
+    reply->slices[0].data = buffer;
+    reply->slices[0].length = length;
+    reply->count = 1;
+}
+
+// Sends a reply of the upstream resolver on to every client that asked its
+// question: all but the last one right away, the last one with the batch.
+// Returns false if it does not come from upstream or answers nothing asked.
+bool DNSResponder::relayUpstreamReply(DNSPacket *dnsPacket, size_t length) {
+    const DNSEndpoint &upstream = dnsPacket->config->upstream();
+    if (upstream.addr == 0 || dnsPacket->from.addr != upstream.addr ||
+        dnsPacket->from.port != upstream.port)
+        return false;
+
+    DNSForwarderWaiter waiters[DNS_FORWARDER_WAITERS];
+    uint8_t *buffer = (uint8_t *)dnsPacket->dnsHeader;
+    size_t count = forwarder(dnsPacket->config)
+                       ->reply(buffer, length, dnsPacket->nowMs, waiters);
+    if (count == 0) return false;
+    for (size_t i = 0; i + 1 < count; i++) {
+        dnsPacket->dnsHeader->ID = waiters[i].id;
+        _transport->send(buffer, length, waiters[i].client);
+    }
+    dnsPacket->dnsHeader->ID = waiters[count - 1].id;
+    DNSReply *reply = dnsPacket->reply;
+    reply->slices[0].data = buffer;
+    reply->slices[0].length = length;
+    reply->count = 1;
+    reply->to = waiters[count - 1].client;
+    return true;
+}
+
+void DNSResponder::setRateLimit(uint16_t rate, uint16_t burst, uint8_t slip) {
+    _rateLimiter.configure(rate, burst, slip);
+}
@@ -0,0 +1,144 @@
+#ifndef DNSResponder_h
+#define DNSResponder_h
+#include "DNSProtocol.h"
+#include "DNSConfig.h"
+#include "DNSForwarder.h"
+#include "DNSMetrics.h"
+#include "DNSRateLimiter.h"
+#include "DNSTransport.h"
+#include <atomic>
+#include <event_log.h>
+#include <string>
+
+// Requests handled per wakeup by processNextBatch(). Every one of them needs
+// a MAX_DNS_PACKETSIZE buffer, so keep this small on the device.
+#ifndef DNS_BATCH_SIZE
+#define DNS_BATCH_SIZE 4
+#endif
+
+// Bytes 3..11 of a reply header (RCODE, Z, RA and the four section counts),
+// prebuilt so that turning a request into a reply is a single copy
+struct DNSHeaderPatch {
+    uint8_t bytes[DNS_HEADER_SIZE - 3];
+};
+
+struct DNSPacket {
+    DNSHeader *dnsHeader;
+    DNSEndpoint from;
+    // Filled in with the slices of the reply, left empty if there is none
+    DNSReply *reply;
+    // OPT record to append to the reply, NULL if the request had none
+    const uint8_t *opt;
+    // Snapshot the batch is answered from
+    const DNSConfig *config;
+    uint32_t nowMs;
+    // Our address the request came to (the datagram's from.local), which
+    // records of 0.0.0.0 are answered with
+    const uint8_t *local;
+};
+
+// Platform independent part of the DNS server: parses a query, looks it up
+// in the zone, then relays it upstream if there is an upstream resolver, or
+// else looks it up in the patterns, and sends the reply through a
+// DNSTransport. Upstream queries and replies go through the same transport
+// as the requests.
+//
+// The configuration can be changed while requests are being answered. Each
+// batch is answered from the DNSConfig snapshot current when it started,
+// and changes are published as a new snapshot; the task answering takes no
+// lock, and no request is dropped or answered from a half made change.
+class DNSResponder {
+  public:
+    DNSResponder();
+    ~DNSResponder();
+    // Receives and answers one request
+    void processNextRequest();
+    // Receives every request already queued (up to DNS_BATCH_SIZE, waiting
+    // only for the first), then sends all replies together
+    void processNextBatch();
+    void setTransport(DNSTransport *transport);
+
+    // Returns a copy of the current configuration to change, published by
+    // commitUpdate() or thrown away by abortUpdate(). Updates must not
+    // overlap each other, they may overlap answering requests.
+    DNSConfig *beginUpdate();
+    void commitUpdate(DNSConfig *config);
+    void abortUpdate(DNSConfig *config);
+    // Single changes as an update each, see DNSConfig
+    void setErrorReplyCode(const DNSReplyCode &replyCode);
+    void setTTL(const uint32_t &ttl);
+    void setNegativeTTL(const uint32_t &ttl);
+    void setDomain(std::string &domainName, const uint8_t resolvedIP[4]);
+    bool addRecord(const char *name, const uint8_t address[4],
+                   const uint8_t *address6 = NULL);
+    bool addRecord(const char *name, const uint8_t (*addresses)[4],
+                   const uint8_t *weights, size_t count,
+                   const uint8_t *address6 = NULL);
+    bool removeRecord(const char *name);
+    bool addPattern(const char *pattern, uint16_t priority,
+                    const uint8_t address[4], const uint8_t *address6 = NULL);
+    void clearPatterns();
+
+    // Limits each client to `rate` replies per second with bursts of up to
+    // `burst`, see DNSRateLimiter. A rate of 0 (the default) disables it.
+    void setRateLimit(uint16_t rate, uint16_t burst, uint8_t slip);
+    // Requests dropped and answered truncated because of the rate limit
+    uint32_t rateLimitDropped() const { return _rateLimiter.dropped(); }
+    uint32_t rateLimitTruncated() const { return _rateLimiter.truncated(); }
+    const DNSMetrics &metrics() const { return _metrics; }
+    // Written by the task answering requests, see event_log_register()
+    event_log_ring_t *eventLog() { return &_eventLog; }
+
+  private:
+    DNSTransport *_transport;
+    // Published snapshot, replaced by commitUpdate()
+    std::atomic<DNSConfig *> _config;
+    // Snapshot the task answering is using, NULL between batches. Written
+    // by that task only, so updates can tell which replaced snapshots are
+    // still in use.
+    std::atomic<const DNSConfig *> _active;
+    // Replaced snapshots not freed yet, linked by _retiredNext
+    DNSConfig *_retired;
+    DNSRateLimiter _rateLimiter;
+    // Allocated when the first request is relayed, cleared when the
+    // upstream changes
+    DNSForwarder *_forwarder;
+    DNSEndpoint _forwarderUpstream;
+    DNSMetrics _metrics;
+    // Queries answered from each DNSAddressSet so far, which picks the
+    // address that comes first. Written by the task answering only.
+    uint32_t _rotations[DNS_CONFIG_MAX_ADDRESS_SETS];
+    event_log_ring_t _eventLog;
+    // Each receives a request and is rewritten in place into its reply, so
+    // answering a query needs no heap allocation
+    uint8_t _buffers[DNS_BATCH_SIZE][MAX_DNS_PACKETSIZE];
+    DNSDatagram _datagrams[DNS_BATCH_SIZE];
+    DNSReply _replies[DNS_BATCH_SIZE];
+
+    DNSResponder(const DNSResponder &);
+    DNSResponder &operator=(const DNSResponder &);
+    const DNSConfig *acquireConfig();
+    void releaseConfig();
+    void reclaimConfigs();
+    void patchHeader(DNSPacket *dnsPacket, const DNSHeaderPatch &patch,
+                     bool withQuestion);
+    void finishReply(DNSPacket *dnsPacket, size_t count);
+    void replyWithIP(DNSPacket *dnsPacket, size_t queryLength,
+                     const DNSZoneRecord *record, bool ipv6);
+    void replyWithAddresses(DNSPacket *dnsPacket, size_t queryLength,
+                            const DNSZoneRecord *record);
+    void replyWithError(DNSPacket *dnsPacket, DNSReplyCode rcode,
+                        unsigned char *query, size_t queryLength);
+    void replyWithError(DNSPacket *dnsPacket, DNSReplyCode rcode);
+    void replyTruncated(DNSPacket *dnsPacket);
+    void forward(DNSPacket *dnsPacket, size_t queryLength);
+    bool relayUpstreamReply(DNSPacket *dnsPacket, size_t length);
+    DNSForwarder *forwarder(const DNSConfig *config);
+    void handleDatagram(DNSDatagram &datagram, DNSReply &reply,
+                        const DNSConfig *config);
+    bool respondToDatagram(DNSDatagram &datagram, DNSReply &reply,
+                           const DNSConfig *config, uint32_t nowMs);
+    void respondToRequest(DNSPacket *dnsPacket, size_t length);
+    bool parseOpt(DNSPacket *dnsPacket, const uint8_t *opt, size_t remaining);
+};
+#endif
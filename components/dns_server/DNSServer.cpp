@@ -1,300 +1,215 @@
 #include "DNSServer.h"
-#include <lwip/def.h>
-#include <lwip/ip_addr.h>
-// #include <Arduino.h>
-#include <cctype>
 #include <esp_log.h>
-#include <memory>
 #include <string.h>
 
-#define DNS_HEADER_SIZE sizeof(DNSHeader)
-
 static const char *TAG = "dns_server";
 
 void DNSServer::task(void *parm) {
     DNSServer *server = (DNSServer *)parm;
-    for (;;) {
-        server->processNextRequest();
+    while (server->_running.load()) {
+        if (server->_interfacesChanged.load()) server->applyInterfaces();
+        server->processNextBatch();
     }
+    xSemaphoreGive(server->_stopped);
     vTaskDelete(NULL);
 }
 
-DNSServer::DNSServer() {
-    _ttl = lwip_htonl(60);
-    _errorReplyCode = DNSReplyCode::NonExistentDomain;
+DNSServer::DNSServer() : _running(false), _interfacesChanged(false) {
     _task = NULL;
+    memset(_interfaces, 0, sizeof(_interfaces));
+    _stopped = xSemaphoreCreateBinary();
+    _updateLock = xSemaphoreCreateMutex();
+    _responder.setTransport(&_transport);
+}
+
+DNSServer::~DNSServer() {
+    stop();
+    vSemaphoreDelete(_stopped);
+    vSemaphoreDelete(_updateLock);
 }
 
 bool DNSServer::start(const uint16_t &port, std::string &domainName,
                       const ip_addr_t &resolvedIP) {
     _port = port;
 
-    _domainName = domainName;
-    _resolvedIP[0] = ip4_addr1(&resolvedIP);
-    _resolvedIP[1] = ip4_addr2(&resolvedIP);
-    _resolvedIP[2] = ip4_addr3(&resolvedIP);
-    _resolvedIP[3] = ip4_addr4(&resolvedIP);
-    downcaseAndRemoveWwwPrefix(_domainName);
+    uint8_t ip[4] = {ip4_addr1(&resolvedIP), ip4_addr2(&resolvedIP),
+                     ip4_addr3(&resolvedIP), ip4_addr4(&resolvedIP)};
+    setDomain(domainName, resolvedIP);
     ESP_LOGI(TAG,
              "Starting at port: %d, with domainName: %s and ip: %d.%d.%d.%d",
-             _port, _domainName.c_str(), _resolvedIP[0], _resolvedIP[1],
-             _resolvedIP[2], _resolvedIP[3]);
-    _udp = netconn_new(NETCONN_UDP);
-    if (netconn_bind(_udp, IP_ADDR_ANY, _port) != ERR_OK) return false;
+             _port, domainName.c_str(), ip[0], ip[1], ip[2], ip[3]);
+    if (!_transport.open(_port, DNS_SERVER_POLL_MS, false)) return false;
+    memset(_listening, 0, sizeof(_listening));
+    _listeningAny = false;
+    if (!applyInterfaces()) {
+        _transport.close();
+        return false;
+    }
+    event_log_register(_responder.eventLog());
+    _running.store(true);
     xTaskCreate(DNSServer::task, "DNS_SERVER_TASK", 1024, this, 9, &_task);
     return true;
 }
 
-void DNSServer::setErrorReplyCode(const DNSReplyCode &replyCode) {
-    _errorReplyCode = replyCode;
-}
-
-void DNSServer::setTTL(const uint32_t &ttl) { _ttl = lwip_htonl(ttl); }
-
-void DNSServer::stop() {
-    if (_task != NULL) {
-        vTaskDelete(_task);
-        _task = NULL;
-    }
-    netconn_delete(_udp);
-}
-
-void DNSServer::downcaseAndRemoveWwwPrefix(std::string &domainName) {
-    for (char &c : domainName) {
-        c = std::tolower(c);
-    }
-    if (domainName.rfind("www.", 0) == 0) {
-        domainName.erase(0, 4);
-    }
+void DNSServer::setInterface(size_t index, const ip_addr_t &address,
+                             const ip_addr_t &netmask) {
+    if (index >= DNS_TRANSPORT_MAX_LISTENERS) return;
+    xSemaphoreTake(_updateLock, portMAX_DELAY);
+    _interfaces[index].address = ip4_addr_get_u32(ip_2_ip4(&address));
+    _interfaces[index].netmask = ip4_addr_get_u32(ip_2_ip4(&netmask));
+    xSemaphoreGive(_updateLock);
+    _interfacesChanged.store(true);
+    // Rebinding is up to the task, which is likely waiting for a request
+    _transport.wake();
 }
 
-void DNSServer::respondToRequest(DNSPacket *dnsPacket, size_t length) {
-    DNSHeader *dnsHeader;
-    uint8_t *query, *start;
-    const char *matchString;
-    size_t remaining, labelLength, queryLength;
-    uint16_t qtype, qclass;
-
-    dnsHeader = dnsPacket->dnsHeader;
-
-    // Must be a query for us to do anything with it
-    if (dnsHeader->QR != DNS_QR_QUERY) {
-        ESP_LOGI(TAG, "Not a query, ignored request");
-        return;
+// Brings the listeners of the transport in line with the interfaces. Runs
+// in the server task, or in start() before there is one. Returns false if
+// a listener could not be opened.
+bool DNSServer::applyInterfaces() {
+    Interface wanted[DNS_TRANSPORT_MAX_LISTENERS];
+    bool changed[DNS_TRANSPORT_MAX_LISTENERS];
+    bool any = true, listening = true;
+
+    // Cleared before reading, so a change made meanwhile is seen next time
+    _interfacesChanged.store(false);
+    xSemaphoreTake(_updateLock, portMAX_DELAY);
+    memcpy(wanted, _interfaces, sizeof(wanted));
+    xSemaphoreGive(_updateLock);
+    for (size_t i = 0; i < DNS_TRANSPORT_MAX_LISTENERS; i++) {
+        if (wanted[i].address != 0) any = false;
     }
 
-    // If operation is anything other than query, we don't do it
-    if (dnsHeader->OPCode != DNS_OPCODE_QUERY) {
-        ESP_LOGI(
-            TAG,
-            "Operation %d is not a query, reply with not implemented error",
-            dnsHeader->OPCode);
-        return replyWithError(dnsPacket, DNSReplyCode::NotImplemented);
+    // Whatever changes is closed before anything is opened: a socket on
+    // all addresses holds the port on every one of them
+    for (size_t i = 0; i < DNS_TRANSPORT_MAX_LISTENERS; i++) {
+        changed[i] = any != _listeningAny ||
+                     wanted[i].address != _listening[i].address ||
+                     wanted[i].netmask != _listening[i].netmask;
+        if (changed[i]) _transport.stopListening(i);
     }
-
-    // Only support requests containing single queries - everything else
-    // is badly defined
-    if (dnsHeader->QDCount != lwip_htons(1)) {
-        ESP_LOGI(TAG, "More than 1 queries are not supported");
-        return replyWithError(dnsPacket, DNSReplyCode::FormError);
-    }
-
-    // We must return a FormError in the case of a non-zero ARCount to
-    // be minimally compatible with EDNS resolvers
-    if (dnsHeader->ANCount != 0 || dnsHeader->NSCount != 0 ||
-        dnsHeader->ARCount != 0)
-        return replyWithError(dnsPacket, DNSReplyCode::FormError);
-
-    // Even if we're not going to use the query, we need to parse it
-    // so we can check the address type that's being queried
-
-    uint8_t *buffer = (uint8_t *)dnsPacket->dnsHeader;
-    query = start = buffer + DNS_HEADER_SIZE;
-    remaining = length - DNS_HEADER_SIZE;
-    while (remaining != 0 && *start != 0) {
-        labelLength = *start;
-        if (labelLength + 1 > remaining)
-            return replyWithError(dnsPacket, DNSReplyCode::FormError);
-        remaining -= (labelLength + 1);
-        start += (labelLength + 1);
-    }
-
-    // 1 octet labelLength, 2 octet qtype, 2 octet qclass
-    if (remaining < 5)
-        return replyWithError(dnsPacket, DNSReplyCode::FormError);
-
-    start += 1; // Skip the 0 length label that we found above
-
-    memcpy(&qtype, start, sizeof(qtype));
-    start += 2;
-    memcpy(&qclass, start, sizeof(qclass));
-    start += 2;
-
-    queryLength = start - query;
-
-    ESP_LOGI(TAG, "Query: %s", query);
-
-    if (qclass != lwip_htons(DNS_QCLASS_ANY) &&
-        qclass != lwip_htons(DNS_QCLASS_IN))
-        return replyWithError(dnsPacket, DNSReplyCode::NonExistentDomain, query,
-                              queryLength);
-
-    if (qtype != lwip_htons(DNS_QTYPE_A) && qtype != lwip_htons(DNS_QTYPE_ANY))
-        return replyWithError(dnsPacket, DNSReplyCode::NonExistentDomain, query,
-                              queryLength);
-
-    // If we have no domain name configured, just return an error
-    if (_domainName == "")
-        return replyWithError(dnsPacket, _errorReplyCode, query, queryLength);
-
-    // If we're running with a wildcard we can just return a result now
-    if (_domainName == "*") {
-        ESP_LOGI(TAG, "Wildcard response");
-        return replyWithIP(dnsPacket, query, queryLength);
-    }
-
-    matchString = _domainName.c_str();
-
-    start = query;
-
-    // If there's a leading 'www', skip it
-    if (*start == 3 && strncasecmp("www", (char *)start + 1, 3) == 0)
-        start += 4;
-
-    while (*start != 0) {
-        labelLength = *start;
-        start += 1;
-        while (labelLength > 0) {
-            if (tolower(*start) != *matchString)
-                return replyWithError(dnsPacket, _errorReplyCode, query,
-                                      queryLength);
-            ++start;
-            ++matchString;
-            --labelLength;
+    for (size_t i = 0; i < DNS_TRANSPORT_MAX_LISTENERS; i++) {
+        if (!changed[i] || (any ? i != 0 : wanted[i].address == 0)) continue;
+        ip4_addr_t address = {wanted[i].address};
+        if (_transport.listen(i, wanted[i].address, wanted[i].netmask)) {
+            ESP_LOGI(TAG, "Listening on interface %u at %s", (unsigned)i,
+                     any ? "all addresses" : ip4addr_ntoa(&address));
+        } else {
+            ESP_LOGE(TAG, "Cannot listen on interface %u", (unsigned)i);
+            listening = false;
         }
-        if (*start == 0 && *matchString == '\0')
-            return replyWithIP(dnsPacket, query, queryLength);
-
-        if (*matchString != '.')
-            return replyWithError(dnsPacket, _errorReplyCode, query,
-                                  queryLength);
-        ++matchString;
     }
-
-    return replyWithError(dnsPacket, _errorReplyCode, query, queryLength);
+    memcpy(_listening, wanted, sizeof(_listening));
+    _listeningAny = any;
+    return listening;
 }
 
-void DNSServer::processNextRequest() {
-    netbuf *buf = netbuf_new();
-    netconn_recv(_udp, &buf);
-
-    size_t currentPacketSize;
-
-    currentPacketSize = netbuf_len(buf);
-    if (currentPacketSize == 0) return;
+uint32_t DNSServer::stackFree() const {
+    if (_task == NULL) return 0;
+    return uxTaskGetStackHighWaterMark(_task) * sizeof(StackType_t);
+}
 
-    // The DNS RFC requires that DNS packets be less than 512 bytes in size,
-    // so just discard them if they are larger
-    if (currentPacketSize > MAX_DNS_PACKETSIZE) return;
+void DNSServer::processNextRequest() { _responder.processNextRequest(); }
 
-    // If the packet size is smaller than the DNS header, then someone is
-    // messing with us
-    if (currentPacketSize < DNS_HEADER_SIZE) return;
+void DNSServer::processNextBatch() { _responder.processNextBatch(); }
 
-    uint8_t buffer[currentPacketSize];
-    netbuf_copy(buf, buffer, currentPacketSize);
-    DNSPacket *dnsPacket = new DNSPacket();
-    dnsPacket->dnsHeader = (DNSHeader *)buffer;
-    dnsPacket->addr = buf->addr;
-    dnsPacket->port = buf->port;
-    netbuf_free(buf);
-    ESP_LOGI(TAG, "Received DNS request");
-    respondToRequest(dnsPacket, currentPacketSize);
+void DNSServer::setErrorReplyCode(const DNSReplyCode &replyCode) {
+    xSemaphoreTake(_updateLock, portMAX_DELAY);
+    _responder.setErrorReplyCode(replyCode);
+    xSemaphoreGive(_updateLock);
 }
 
-void DNSServer::writeNBOShort(netbuf *buf, uint16_t value, uint16_t &offset) {
-    pbuf_take_at(buf->p, &value, sizeof(value), offset);
-    offset += sizeof(value);
+void DNSServer::setTTL(const uint32_t &ttl) {
+    xSemaphoreTake(_updateLock, portMAX_DELAY);
+    _responder.setTTL(ttl);
+    xSemaphoreGive(_updateLock);
 }
 
-void DNSServer::replyWithIP(DNSPacket *dnsPacket, unsigned char *query,
-                            size_t queryLength) {
-    uint16_t value;
+void DNSServer::setNegativeTTL(const uint32_t &ttl) {
+    xSemaphoreTake(_updateLock, portMAX_DELAY);
+    _responder.setNegativeTTL(ttl);
+    xSemaphoreGive(_updateLock);
+}
 
-    DNSHeader *dnsHeader = dnsPacket->dnsHeader;
-    dnsHeader->QR = DNS_QR_RESPONSE;
-    dnsHeader->QDCount = lwip_htons(1);
-    dnsHeader->ANCount = lwip_htons(1);
-    dnsHeader->NSCount = 0;
-    dnsHeader->ARCount = 0;
+void DNSServer::setRateLimit(uint16_t rate, uint16_t burst, uint8_t slip) {
+    _responder.setRateLimit(rate, burst, slip);
+}
 
-    // _udp.beginPacket(_udp.remoteIP(), _udp.remotePort());
-    // _udp.write((unsigned char *)dnsHeader, sizeof(DNSHeader));
-    // _udp.write(query, queryLength);
-    netbuf *buf = netbuf_new();
-    netbuf_alloc(buf, DNS_HEADER_SIZE + queryLength + 2 * 4 + sizeof(_ttl) +
-                          sizeof(_resolvedIP));
-    u16_t offset = 0;
-    pbuf_take(buf->p, dnsHeader, DNS_HEADER_SIZE);
-    offset += DNS_HEADER_SIZE;
-    free(dnsHeader);
-    pbuf_take_at(buf->p, query, queryLength, offset);
-    offset += queryLength;
-    free(query);
-    // Rather than restate the name here, we use a pointer to the name contained
-    // in the query section. Pointers have the top two bits set.
-    value = 0xC000 | DNS_HEADER_SIZE;
-    writeNBOShort(buf, lwip_htons(value), offset);
+void DNSServer::setDomain(const std::string &domainName,
+                          const ip_addr_t &resolvedIP) {
+    uint8_t ip[4] = {ip4_addr1(&resolvedIP), ip4_addr2(&resolvedIP),
+                     ip4_addr3(&resolvedIP), ip4_addr4(&resolvedIP)};
+    xSemaphoreTake(_updateLock, portMAX_DELAY);
+    DNSConfig *config = _responder.beginUpdate();
+    config->setDomain(domainName, ip);
+    _responder.commitUpdate(config);
+    xSemaphoreGive(_updateLock);
+}
 
-    // Answer is type A (an IPv4 address)
-    writeNBOShort(buf, lwip_htons(DNS_QTYPE_A), offset);
+void DNSServer::setUpstream(const ip_addr_t &upstream) {
+    DNSEndpoint endpoint = {ip4_addr_get_u32(ip_2_ip4(&upstream)),
+                            lwip_htons(DNS_PORT)};
+    xSemaphoreTake(_updateLock, portMAX_DELAY);
+    DNSConfig *config = _responder.beginUpdate();
+    config->setUpstream(endpoint);
+    _responder.commitUpdate(config);
+    xSemaphoreGive(_updateLock);
+}
 
-    // Answer is in the Internet Class
-    writeNBOShort(buf, lwip_htons(DNS_QCLASS_IN), offset);
+bool DNSServer::addRecord(const char *name, const ip_addr_t &address,
+                          const uint8_t *address6) {
+    uint8_t ip[4] = {ip4_addr1(&address), ip4_addr2(&address),
+                     ip4_addr3(&address), ip4_addr4(&address)};
+    xSemaphoreTake(_updateLock, portMAX_DELAY);
+    bool added = _responder.addRecord(name, ip, address6);
+    xSemaphoreGive(_updateLock);
+    return added;
+}
 
-    // Output TTL (already NBO)
-    // _udp.write((unsigned char *)&_ttl, 4);
-    pbuf_take_at(buf->p, &_ttl, sizeof(_ttl), offset);
-    offset += sizeof(_ttl);
+bool DNSServer::addRecord(const char *name, const ip_addr_t *addresses,
+                          const uint8_t *weights, size_t count) {
+    uint8_t ips[DNS_ADDRESS_SET_SIZE][4];
+    if (count > DNS_ADDRESS_SET_SIZE) return false;
+    for (size_t i = 0; i < count; i++) {
+        ips[i][0] = ip4_addr1(&addresses[i]);
+        ips[i][1] = ip4_addr2(&addresses[i]);
+        ips[i][2] = ip4_addr3(&addresses[i]);
+        ips[i][3] = ip4_addr4(&addresses[i]);
+    }
+    xSemaphoreTake(_updateLock, portMAX_DELAY);
+    bool added = _responder.addRecord(name, ips, weights, count);
+    xSemaphoreGive(_updateLock);
+    return added;
+}
 
-    // Length of RData is 4 bytes (because, in this case, RData is IPv4)
-    writeNBOShort(buf, lwip_htons(sizeof(_resolvedIP)), offset);
-    // _udp.write(_resolvedIP, sizeof(_resolvedIP));
-    pbuf_take_at(buf->p, &_resolvedIP, sizeof(_resolvedIP), offset);
-    // _udp.endPacket();
-    netconn_sendto(_udp, buf, &dnsPacket->addr, dnsPacket->port);
-    netbuf_free(buf);
-    free(dnsPacket);
+bool DNSServer::removeRecord(const char *name) {
+    xSemaphoreTake(_updateLock, portMAX_DELAY);
+    bool removed = _responder.removeRecord(name);
+    xSemaphoreGive(_updateLock);
+    return removed;
 }
 
-void DNSServer::replyWithError(DNSPacket *dnsPacket, DNSReplyCode rcode,
-                               unsigned char *query, size_t queryLength) {
-    DNSHeader *dnsHeader = dnsPacket->dnsHeader;
-    dnsHeader->QR = DNS_QR_RESPONSE;
-    dnsHeader->RCode = (unsigned char)rcode;
-    if (query)
-        dnsHeader->QDCount = lwip_htons(1);
-    else
-        dnsHeader->QDCount = 0;
-    dnsHeader->ANCount = 0;
-    dnsHeader->NSCount = 0;
-    dnsHeader->ARCount = 0;
-    netbuf *buf = netbuf_new();
-    netbuf_alloc(buf, DNS_HEADER_SIZE + queryLength);
-    // _udp.write((unsigned char *)dnsHeader, sizeof(DNSHeader));
-    // if (query != NULL) _udp.write(query, queryLength);
-    // _udp.beginPacket(_udp.remoteIP(), _udp.remotePort());
-    // _udp.endPacket();
-    pbuf_take_at(buf->p, dnsHeader, DNS_HEADER_SIZE, 0);
-    free(dnsHeader);
-    if (query != NULL)
-        pbuf_take_at(buf->p, query, queryLength, DNS_HEADER_SIZE);
-    free(query);
-    netconn_sendto(_udp, buf, &dnsPacket->addr, dnsPacket->port);
-    netbuf_free(buf);
-    free(dnsPacket);
+bool DNSServer::addPattern(const char *pattern, uint16_t priority,
+                           const ip_addr_t &address,
+                           const uint8_t *address6) {
+    uint8_t ip[4] = {ip4_addr1(&address), ip4_addr2(&address),
+                     ip4_addr3(&address), ip4_addr4(&address)};
+    xSemaphoreTake(_updateLock, portMAX_DELAY);
+    bool added = _responder.addPattern(pattern, priority, ip, address6);
+    xSemaphoreGive(_updateLock);
+    return added;
 }
 
-void DNSServer::replyWithError(DNSPacket *dnsPacket, DNSReplyCode rcode) {
-    replyWithError(dnsPacket, rcode, NULL, 0);
+// Deleting the task while it waits in netconn_recv() would leave the
+// netconn and whatever the task holds behind. Instead it is asked to stop,
+// which it sees right away when woken, or within DNS_SERVER_POLL_MS thanks
+// to the receive timeout.
+void DNSServer::stop() {
+    if (_task == NULL) return;
+    _running.store(false);
+    _transport.wake();
+    xSemaphoreTake(_stopped, portMAX_DELAY);
+    _task = NULL;
+    event_log_unregister(_responder.eventLog());
+    _transport.close();
 }
@@ -1,90 +1,100 @@
 #ifndef DNSServer_h
 #define DNSServer_h
 // #include <WiFiUdp.h>
+#include "DNSResponder.h"
+#include "LwipDNSTransport.h"
 #include <FreeRTOS.h>
+#include <atomic>
+#include <freertos/semphr.h>
 #include <freertos/task.h>
-#include <lwip/api.h>
 #include <lwip/ip_addr.h>
 #include <string>
 
-#define DNS_QR_QUERY 0
-#define DNS_QR_RESPONSE 1
-#define DNS_OPCODE_QUERY 0
-
-#define DNS_QCLASS_IN 1
-#define DNS_QCLASS_ANY 255
-
-#define DNS_QTYPE_A 1
-#define DNS_QTYPE_ANY 255
-
-#define MAX_DNSNAME_LENGTH 253
-#define MAX_DNS_PACKETSIZE 512
-
-enum class DNSReplyCode {
-    NoError = 0,
-    FormError = 1,
-    ServerFailure = 2,
-    NonExistentDomain = 3,
-    NotImplemented = 4,
-    Refused = 5,
-    YXDomain = 6,
-    YXRRSet = 7,
-    NXRRSet = 8
-};
-
-struct DNSHeader {
-    uint16_t ID;              // identification number
-    unsigned char RD : 1;     // recursion desired
-    unsigned char TC : 1;     // truncated message
-    unsigned char AA : 1;     // authoritive answer
-    unsigned char OPCode : 4; // message_type
-    unsigned char QR : 1;     // query/response flag
-    unsigned char RCode : 4;  // response code
-    unsigned char Z : 3;      // its z! reserved
-    unsigned char RA : 1;     // recursion available
-    uint16_t QDCount;         // number of question entries
-    uint16_t ANCount;         // number of answer entries
-    uint16_t NSCount;         // number of authority entries
-    uint16_t ARCount;         // number of resource entries
-};
-
-struct DNSPacket {
-    DNSHeader *dnsHeader;
-    ip_addr_t addr;
-    u16_t port;
-};
-
 class DNSServer {
   public:
     DNSServer();
-    ~DNSServer() { stop(); };
+    ~DNSServer();
     void processNextRequest();
+    // Answers every request queued on the socket, see DNSResponder
+    void processNextBatch();
+    // Changing records and TTLs is safe while the server runs: replies keep
+    // coming from the configuration before until the change is complete,
+    // see DNSResponder. Changes from several tasks are serialized.
     void setErrorReplyCode(const DNSReplyCode &replyCode);
     void setTTL(const uint32_t &ttl);
+    void setNegativeTTL(const uint32_t &ttl);
+    // Per-client reply rate limit, see DNSResponder::setRateLimit. Not
+    // synchronized with the server task, so configure before start().
+    void setRateLimit(uint16_t rate, uint16_t burst, uint8_t slip);
+    uint32_t rateLimitDropped() const { return _responder.rateLimitDropped(); }
+    uint32_t rateLimitTruncated() const {
+        return _responder.rateLimitTruncated();
+    }
+    // Safe to read from any task, see DNSMetrics
+    const DNSMetrics &metrics() const { return _responder.metrics(); }
+    // Bytes of the server task stack never used so far, 0 if not running
+    uint32_t stackFree() const;
+    // Replaces every name and pattern with `domainName` ("*" for all names)
+    // resolving to `resolvedIP`, e.g. when the interface address changes
+    void setDomain(const std::string &domainName, const ip_addr_t &resolvedIP);
+    // Relays names outside the zone to the resolver at `upstream` (port 53)
+    // instead of answering them from the patterns, see DNSForwarder. An
+    // address of 0 turns forwarding off again.
+    void setUpstream(const ip_addr_t &upstream);
+    // Serve additional names next to the one given to start(). `address6`
+    // (16 bytes, may be NULL) answers AAAA queries
+    bool addRecord(const char *name, const ip_addr_t &address,
+                   const uint8_t *address6 = NULL);
+    // Answers `name` with all `count` addresses, the first one rotating by
+    // `weights` (NULL for round robin), see DNSAddressSet
+    bool addRecord(const char *name, const ip_addr_t *addresses,
+                   const uint8_t *weights, size_t count);
+    bool removeRecord(const char *name);
+    // Patterns like "*.portal.local" or "captive.*" for names without a
+    // record, lowest priority first
+    bool addPattern(const char *pattern, uint16_t priority,
+                    const ip_addr_t &address, const uint8_t *address6 = NULL);
+
+    // Serves network interface `index` (below DNS_TRANSPORT_MAX_LISTENERS)
+    // at `address` with a socket of its own, so that replies leave from the
+    // address the request came to and records of 0.0.0.0 resolve to it.
+    // Call again when the address changes, with address 0 when the
+    // interface goes down. Without any interface the server listens on all
+    // addresses. May be called from any task, before start() too.
+    void setInterface(size_t index, const ip_addr_t &address,
+                      const ip_addr_t &netmask);
 
     // Returns true if successful, false if there are no sockets available
     bool start(const uint16_t &port, std::string &domainName,
                const ip_addr_t &resolvedIP);
-    // stops the DNS server
+    // Stops the DNS server: the task finishes the batch it is answering and
+    // exits on its own before the socket is closed
     void stop();
 
   private:
-    netconn *_udp;
+    LwipDNSTransport _transport;
+    DNSResponder _responder;
     uint16_t _port;
-    std::string _domainName;
-    unsigned char _resolvedIP[4];
-    uint32_t _ttl;
-    DNSReplyCode _errorReplyCode;
     TaskHandle_t _task;
+    // Cleared by stop(), the task exits when it sees it and gives _stopped
+    std::atomic<bool> _running;
+    SemaphoreHandle_t _stopped;
+    SemaphoreHandle_t _updateLock;
+
+    struct Interface {
+        uint32_t address; // network byte order, 0 if down
+        uint32_t netmask;
+    };
+    // Set by setInterface() under _updateLock, and taken over by the task
+    // when it sees _interfacesChanged
+    Interface _interfaces[DNS_TRANSPORT_MAX_LISTENERS];
+    std::atomic<bool> _interfacesChanged;
+    // What the transport listens on, touched by the task only: the
+    // interfaces as last taken over, or all addresses if none was up
+    Interface _listening[DNS_TRANSPORT_MAX_LISTENERS];
+    bool _listeningAny;
 
     static void task(void *parm);
-    void downcaseAndRemoveWwwPrefix(std::string &domainName);
-    void replyWithIP(DNSPacket *dnsPacket, unsigned char *query,
-                     size_t queryLength);
-    void replyWithError(DNSPacket *dnsPacket, DNSReplyCode rcode,
-                        unsigned char *query, size_t queryLength);
-    void replyWithError(DNSPacket *dnsPacket, DNSReplyCode rcode);
-    void respondToRequest(DNSPacket *dnsPacket, size_t length);
-    void writeNBOShort(netbuf *buf, uint16_t value, uint16_t &offset);
+    bool applyInterfaces();
 };
 #endif
@@ -0,0 +1,71 @@
+#ifndef DNSStaticRecord_h
+#define DNSStaticRecord_h
+#include "DNSName.h"
+
+// The one name and address of a fixed-function DNS server, built at compile
+// time: the name in wire format to match questions against, and the whole
+// answer record that follows the question in a reply. Both are constants,
+// nothing is encoded or allocated at run time:
+//
+//   constexpr auto portal = dnsStaticRecord("portal.local", 192, 168, 4, 1,
+//                                           60);
+//
+// "*" matches every name. An empty label or one longer than 63 characters
+// does not compile.
+template <size_t WireLength> struct DNSStaticRecord {
+    uint8_t name[WireLength];
+    // Pointer to the question name, TYPE A, CLASS IN, TTL, RDLENGTH and
+    // the address
+    uint8_t answer[DNS_ANSWER_SIZE];
+};
+
+// Compile time index sequence, std::index_sequence is C++14
+template <size_t... I> struct DNSIndices {};
+template <size_t N, size_t... I>
+struct DNSMakeIndices : DNSMakeIndices<N - 1, N - 1, I...> {};
+template <size_t... I> struct DNSMakeIndices<0, I...> {
+    typedef DNSIndices<I...> type;
+};
+
+// Not constexpr and never defined: a name that reaches it fails to compile
+// instead of being encoded wrong
+uint8_t dnsStaticInvalidLabel();
+
+constexpr uint8_t dnsStaticLabelLength(const char *name, size_t i,
+                                       size_t length = 0) {
+    return name[i] == '.' || name[i] == '\0'
+               ? (length == 0 || length > 63 ? dnsStaticInvalidLabel()
+                                             : (uint8_t)length)
+               : dnsStaticLabelLength(name, i + 1, length + 1);
+}
+
+// Byte i of `name` in wire format: the length of the first label, then
+// every '.' replaced by the length of the label after it, and the '\0'
+// by the root label
+constexpr uint8_t dnsStaticNameByte(const char *name, size_t i) {
+    return i == 0 || name[i - 1] == '.' ? dnsStaticLabelLength(name, i)
+           : name[i - 1] == '\0'        ? 0
+                                        : dnsToLower((uint8_t)name[i - 1]);
+}
+
+template <size_t N, size_t... I>
+constexpr DNSStaticRecord<N + 1>
+dnsStaticRecord(const char (&name)[N], DNSIndices<I...>, uint8_t a, uint8_t b,
+                uint8_t c, uint8_t d, uint32_t ttl) {
+    return {{dnsStaticNameByte(name, I)...},
+            {0xC0, DNS_HEADER_SIZE, 0, DNS_QTYPE_A, 0, DNS_QCLASS_IN,
+             (uint8_t)(ttl >> 24), (uint8_t)(ttl >> 16), (uint8_t)(ttl >> 8),
+             (uint8_t)ttl, 0, 4, a, b, c, d}};
+}
+
+// `name` without a trailing dot resolving to a.b.c.d for `ttl` seconds
+template <size_t N>
+constexpr DNSStaticRecord<N + 1> dnsStaticRecord(const char (&name)[N],
+                                                 uint8_t a, uint8_t b,
+                                                 uint8_t c, uint8_t d,
+                                                 uint32_t ttl) {
+    static_assert(N + 1 <= MAX_DNS_WIRENAME_LENGTH, "DNS name too long");
+    return dnsStaticRecord(name, typename DNSMakeIndices<N + 1>::type(), a, b,
+                           c, d, ttl);
+}
+#endif
@@ -0,0 +1,69 @@
+#include "DNSStaticResponder.h"
+#include <string.h>
+
+// Bytes 3..5 of the reply header: RCODE, and one question or none. The
+// answer, authority and additional counts are set apart.
+static void patchHeader(uint8_t *buffer, DNSReplyCode rcode,
+                        bool withQuestion, bool withAnswer) {
+    // QR, and RD copied from the request; OPCODE is QUERY, AA and TC clear
+    buffer[2] = (uint8_t)(DNS_QR_RESPONSE << 7) | (buffer[2] & 1);
+    buffer[3] = (uint8_t)rcode;
+    buffer[4] = 0;
+    buffer[5] = withQuestion;
+    memset(buffer + 6, 0, DNS_HEADER_SIZE - 6);
+    buffer[7] = withAnswer;
+}
+
+size_t DNSStaticResponder::respond(uint8_t *buffer, size_t length,
+                                   DNSSlice slices[2]) const {
+    DNSHeader *header = (DNSHeader *)buffer;
+    if (length < DNS_HEADER_SIZE || length > MAX_DNS_PACKETSIZE ||
+        header->QR != DNS_QR_QUERY)
+        return 0;
+
+    slices[0].data = buffer;
+    slices[0].length = DNS_HEADER_SIZE;
+    if (header->OPCode != DNS_OPCODE_QUERY) {
+        patchHeader(buffer, DNSReplyCode::NotImplemented, false, false);
+        return 1;
+    }
+
+    const uint8_t *question = buffer + DNS_HEADER_SIZE;
+    size_t nameLength = dnsNameLength(question, length - DNS_HEADER_SIZE);
+    if (header->QDCount != dns_htons(1) || nameLength == 0 ||
+        DNS_HEADER_SIZE + nameLength + 4 > length) {
+        patchHeader(buffer, DNSReplyCode::FormError, false, false);
+        return 1;
+    }
+    uint16_t qtype, qclass;
+    memcpy(&qtype, question + nameLength, sizeof(qtype));
+    memcpy(&qclass, question + nameLength + 2, sizeof(qclass));
+    // Anything after the question, an OPT record say, is left out
+    slices[0].length = DNS_HEADER_SIZE + nameLength + 4;
+
+    bool wildcard = _name[0] == 1 && _name[1] == '*' && _name[2] == 0;
+    if ((qclass != dns_htons(DNS_QCLASS_IN) &&
+         qclass != dns_htons(DNS_QCLASS_ANY)) ||
+        !(wildcard || dnsNameEquals(question, _name))) {
+        patchHeader(buffer, DNSReplyCode::NonExistentDomain, true, false);
+        return 1;
+    }
+    if (qtype != dns_htons(DNS_QTYPE_A) && qtype != dns_htons(DNS_QTYPE_ANY)) {
+        // The name exists, without data of this type
+        patchHeader(buffer, DNSReplyCode::NoError, true, false);
+        return 1;
+    }
+    // A question is at most 259 bytes, so the answer always fits
+    patchHeader(buffer, DNSReplyCode::NoError, true, true);
+    slices[1].data = _answer;
+    slices[1].length = DNS_ANSWER_SIZE;
+    return 2;
+}
+
+void DNSStaticResponder::processNextRequest() {
+    DNSEndpoint from;
+    DNSSlice slices[2];
+    size_t length = _transport->receive(_buffer, sizeof(_buffer), from);
+    size_t count = respond(_buffer, length, slices);
+    if (count != 0) _transport->send(slices, count, from);
+}
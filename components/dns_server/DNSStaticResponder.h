@@ -0,0 +1,31 @@
+#ifndef DNSStaticResponder_h
+#define DNSStaticResponder_h
+#include "DNSStaticRecord.h"
+#include "DNSTransport.h"
+
+// DNSResponder for fixed-function builds: answers the one name of a
+// DNSStaticRecord, NXDOMAIN for every other name, and nothing more. There
+// is no zone, pattern, forwarder, rate limit or live update, and no heap:
+// the record is a compile time constant, the reply is the request patched
+// in place followed by the prebuilt answer. EDNS is not supported, requests
+// with an OPT record are answered without one (RFC 6891, section 7).
+class DNSStaticResponder {
+  public:
+    template <size_t WireLength>
+    explicit DNSStaticResponder(const DNSStaticRecord<WireLength> &record)
+        : _name(record.name), _answer(record.answer), _transport(NULL) {}
+
+    void setTransport(DNSTransport *transport) { _transport = transport; }
+    // Receives and answers one request
+    void processNextRequest();
+    // Turns the request of `length` bytes in `buffer` into the reply, in
+    // `slices`. Returns the number of slices, 0 if there is no reply.
+    size_t respond(uint8_t *buffer, size_t length, DNSSlice slices[2]) const;
+
+  private:
+    const uint8_t *_name;
+    const uint8_t *_answer;
+    DNSTransport *_transport;
+    uint8_t _buffer[MAX_DNS_PACKETSIZE];
+};
+#endif
@@ -0,0 +1,93 @@
+#ifndef DNSTransport_h
+#define DNSTransport_h
+#include <stddef.h>
+#include <stdint.h>
+
+// IPv4 address and port of a peer, both in network byte order
+struct DNSEndpoint {
+    uint32_t addr;
+    uint16_t port;
+    // Our address the peer sent to, and replies go out from. 0 if unknown,
+    // then the transport picks the one that reaches `addr`. For a multicast
+    // `addr`, the interface the datagram goes out on.
+    uint32_t local;
+};
+
+// Addresses a transport may listen on at once, one per network interface
+// (station and access point)
+#ifndef DNS_TRANSPORT_MAX_LISTENERS
+#define DNS_TRANSPORT_MAX_LISTENERS 2
+#endif
+
+// Most slices a reply is made of (header and question, answer records,
+// additional records)
+#define DNS_TRANSPORT_MAX_SLICES 4
+
+// Part of an outgoing datagram, see DNSTransport::send
+struct DNSSlice {
+    const uint8_t *data;
+    size_t length;
+};
+
+// A reply ready to go out: the concatenation of `count` slices sent as one
+// datagram to `to`
+struct DNSReply {
+    DNSSlice slices[DNS_TRANSPORT_MAX_SLICES];
+    size_t count; // 0 if there is nothing to send
+    DNSEndpoint to;
+};
+
+// One entry of a receive batch
+struct DNSDatagram {
+    uint8_t *buffer;
+    size_t capacity;
+    size_t length; // full datagram length, may be larger than capacity
+    DNSEndpoint from;
+};
+
+// Datagram transport used by DNSResponder. Implemented on top of lwIP
+// netconn on the device (LwipDNSTransport) and on top of BSD sockets on the
+// host (PosixDNSTransport) so the same core can be benchmarked on Linux.
+class DNSTransport {
+  public:
+    virtual ~DNSTransport(){};
+
+    // Blocks until a datagram arrives and copies at most `capacity` bytes of
+    // it into `buffer`. Returns the full datagram length, which may be larger
+    // than `capacity`, or 0 if nothing was received.
+    virtual size_t receive(uint8_t *buffer, size_t capacity,
+                           DNSEndpoint &from) = 0;
+    // Sends the concatenation of `count` slices as one datagram to `to`,
+    // without copying them where the backend allows. The slices must stay
+    // unchanged until send returns. Returns false on failure.
+    virtual bool send(const DNSSlice *slices, size_t count,
+                      const DNSEndpoint &to) = 0;
+
+    // How long receive() and receiveBatch() wait for the first datagram
+    // before returning 0, from now on. 0 waits for as long as it takes.
+    virtual void setReceiveTimeout(uint32_t timeoutMs) = 0;
+
+    bool send(const uint8_t *data, size_t length, const DNSEndpoint &to) {
+        DNSSlice slice = {data, length};
+        return send(&slice, 1, to);
+    }
+
+    // Blocks like receive() for the first datagram, then takes whatever
+    // else is already queued, up to `count` datagrams, without blocking.
+    // Returns the number of datagrams filled in. By default that is only
+    // the first one.
+    virtual size_t receiveBatch(DNSDatagram *datagrams, size_t /*count*/) {
+        datagrams[0].length = receive(datagrams[0].buffer,
+                                      datagrams[0].capacity, datagrams[0].from);
+        return datagrams[0].length != 0 ? 1 : 0;
+    }
+
+    // Sends every reply with a non-zero slice count
+    virtual void sendBatch(const DNSReply *replies, size_t count) {
+        for (size_t i = 0; i < count; i++) {
+            if (replies[i].count != 0)
+                send(replies[i].slices, replies[i].count, replies[i].to);
+        }
+    }
+};
+#endif
@@ -0,0 +1,103 @@
+#include "DNSZone.h"
+#include <string.h>
+
+DNSZone::DNSZone(size_t maxRecords) {
+    // Keep the load factor at or below 3/4 so probe sequences stay short
+    size_t slotCount = 4;
+    while (slotCount * 3 / 4 < maxRecords)
+        slotCount <<= 1;
+    _slots = new Slot[slotCount];
+    memset(_slots, 0, slotCount * sizeof(Slot));
+    _mask = slotCount - 1;
+    _size = 0;
+    _maxRecords = maxRecords;
+}
+
+DNSZone::DNSZone(const DNSZone &other) {
+    size_t slotCount = other._mask + 1;
+    _slots = new Slot[slotCount];
+    memcpy(_slots, other._slots, slotCount * sizeof(Slot));
+    for (size_t i = 0; i < slotCount; i++) {
+        if (_slots[i].name == NULL) continue;
+        size_t length = dnsNameLength(other._slots[i].name,
+                                      MAX_DNS_WIRENAME_LENGTH);
+        _slots[i].name = new uint8_t[length];
+        memcpy(_slots[i].name, other._slots[i].name, length);
+    }
+    _mask = other._mask;
+    _size = other._size;
+    _maxRecords = other._maxRecords;
+}
+
+DNSZone::~DNSZone() {
+    clear();
+    delete[] _slots;
+}
+
+DNSZone::Slot *DNSZone::find(const uint8_t *wireName, uint32_t hash) const {
+    for (size_t i = hash & _mask;; i = (i + 1) & _mask) {
+        Slot *slot = &_slots[i];
+        if (slot->name == NULL) return slot;
+        if (slot->hash == hash && dnsNameEquals(slot->name, wireName))
+            return slot;
+    }
+}
+
+bool DNSZone::add(const char *name, const DNSZoneRecord &record) {
+    uint8_t wireName[MAX_DNS_WIRENAME_LENGTH];
+    size_t length = dnsEncodeName(name, wireName, sizeof(wireName));
+    if (length == 0) return false;
+
+    uint32_t hash = dnsNameHash(wireName);
+    Slot *slot = find(wireName, hash);
+    if (slot->name == NULL) {
+        if (_size >= _maxRecords) return false;
+        slot->name = new uint8_t[length];
+        memcpy(slot->name, wireName, length);
+        slot->hash = hash;
+        _size++;
+    }
+    slot->record = record;
+    return true;
+}
+
+bool DNSZone::remove(const char *name) {
+    uint8_t wireName[MAX_DNS_WIRENAME_LENGTH];
+    if (dnsEncodeName(name, wireName, sizeof(wireName)) == 0) return false;
+
+    Slot *slot = find(wireName, dnsNameHash(wireName));
+    if (slot->name == NULL) return false;
+    delete[] slot->name;
+    slot->name = NULL;
+    _size--;
+
+    // Backward shift deletion: move later members of the probe sequence
+    // into the hole so lookups never need tombstones
+    size_t hole = slot - _slots;
+    for (size_t i = (hole + 1) & _mask; _slots[i].name != NULL;
+         i = (i + 1) & _mask) {
+        size_t home = _slots[i].hash & _mask;
+        // Entry at i may move to the hole only if its home slot is not
+        // cyclically within (hole, i]
+        if (((i - home) & _mask) >= ((i - hole) & _mask)) {
+            _slots[hole] = _slots[i];
+            _slots[i].name = NULL;
+            hole = i;
+        }
+    }
+    return true;
+}
+
+void DNSZone::clear() {
+    for (size_t i = 0; i <= _mask; i++) {
+        delete[] _slots[i].name;
+        _slots[i].name = NULL;
+    }
+    _size = 0;
+}
+
+const DNSZoneRecord *DNSZone::lookup(const uint8_t *wireName) const {
+    if (_size == 0) return NULL;
+    Slot *slot = find(wireName, dnsNameHash(wireName));
+    return slot->name != NULL ? &slot->record : NULL;
+}
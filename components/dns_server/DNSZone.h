@@ -0,0 +1,63 @@
+#ifndef DNSZone_h
+#define DNSZone_h
+#include "DNSName.h"
+
+#define DNS_ZONE_DEFAULT_MAX_RECORDS 32
+
+struct DNSZoneRecord {
+    // IPv4 address, network byte order. 0.0.0.0 stands for the address
+    // the query came to, i.e. of the interface it arrived on.
+    uint8_t address[4];
+    // AAAA queries are answered with address6 if set, with an empty
+    // NOERROR (NODATA) reply otherwise
+    bool hasAddress6;
+    uint8_t address6[16];
+    // 1 + the index of the DNSAddressSet in DNSConfig that A queries are
+    // answered from instead of `address`, 0 for a single address
+    uint8_t addressSet;
+};
+
+// Fixed capacity hash table of names served by DNSResponder. Names are kept
+// in wire format so a query can be looked up straight from the request
+// buffer, without building a string. Memory is only allocated when records
+// are added, never by lookup().
+//
+// Not synchronized: add()/remove() must not run concurrently with lookup().
+class DNSZone {
+  public:
+    explicit DNSZone(size_t maxRecords = DNS_ZONE_DEFAULT_MAX_RECORDS);
+    // Deep copy, names included
+    DNSZone(const DNSZone &other);
+    ~DNSZone();
+
+    // Adds `name` (dotted, case-insensitive) or replaces its record. Returns
+    // false if the name is invalid or the zone is full.
+    bool add(const char *name, const DNSZoneRecord &record);
+    // Returns false if `name` was not in the zone
+    bool remove(const char *name);
+    void clear();
+
+    // Looks up a wire format name, e.g. the question of a request. The name
+    // must be valid (see dnsNameLength). Returns NULL if it is not in the
+    // zone.
+    const DNSZoneRecord *lookup(const uint8_t *wireName) const;
+
+    size_t size() const { return _size; }
+    size_t maxRecords() const { return _maxRecords; }
+
+  private:
+    struct Slot {
+        uint32_t hash;
+        uint8_t *name; // wire format, NULL if the slot is free
+        DNSZoneRecord record;
+    };
+
+    Slot *_slots;
+    size_t _mask; // slot count - 1, the slot count is a power of two
+    size_t _size;
+    size_t _maxRecords;
+
+    DNSZone &operator=(const DNSZone &);
+    Slot *find(const uint8_t *wireName, uint32_t hash) const;
+};
+#endif
@@ -0,0 +1,221 @@
+#include "LwipDNSTransport.h"
+#include <lwip/netif.h>
+#include <lwip/udp.h>
+#include <string.h>
+
+LwipDNSTransport *volatile LwipDNSTransport::_open[LWIP_DNS_TRANSPORT_MAX_OPEN];
+
+LwipDNSTransport::LwipDNSTransport() {
+    memset(_listeners, 0, sizeof(_listeners));
+    _ready = NULL;
+    _next = 0;
+}
+
+// Called by lwIP in the tcpip thread, for every datagram queued on one of
+// our netconns among other events
+void LwipDNSTransport::event(netconn *conn, netconn_evt evt, u16_t) {
+    if (evt != NETCONN_EVT_RCVPLUS) return;
+    for (size_t i = 0; i < LWIP_DNS_TRANSPORT_MAX_OPEN; i++) {
+        LwipDNSTransport *transport = _open[i];
+        if (transport == NULL) continue;
+        for (size_t j = 0; j < DNS_TRANSPORT_MAX_LISTENERS; j++) {
+            Listener &listener = transport->_listeners[j];
+            if (listener.udp != conn) continue;
+            listener.arrived++;
+            xSemaphoreGive(transport->_ready);
+            return;
+        }
+    }
+}
+
+bool LwipDNSTransport::open(const uint16_t &port, uint32_t receiveTimeoutMs,
+                            bool anyAddress) {
+    _port = port;
+    setReceiveTimeout(receiveTimeoutMs);
+    _ready = xSemaphoreCreateBinary();
+    if (_ready == NULL) return false;
+    size_t slot = 0;
+    while (slot < LWIP_DNS_TRANSPORT_MAX_OPEN && _open[slot] != NULL) slot++;
+    if (slot == LWIP_DNS_TRANSPORT_MAX_OPEN) {
+        close();
+        return false;
+    }
+    _open[slot] = this;
+    if (anyAddress && !listen(0, 0, 0)) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void LwipDNSTransport::close() {
+    for (size_t i = 0; i < DNS_TRANSPORT_MAX_LISTENERS; i++) stopListening(i);
+    for (size_t i = 0; i < LWIP_DNS_TRANSPORT_MAX_OPEN; i++) {
+        if (_open[i] == this) _open[i] = NULL;
+    }
+    if (_ready != NULL) {
+        vSemaphoreDelete(_ready);
+        _ready = NULL;
+    }
+}
+
+bool LwipDNSTransport::listen(size_t index, uint32_t address,
+                              uint32_t netmask) {
+    Listener &listener = _listeners[index];
+    stopListening(index);
+    netconn *udp = netconn_new_with_callback(NETCONN_UDP, event);
+    if (udp == NULL) return false;
+    listener.address = address;
+    listener.netmask = netmask;
+    // Set before binding: nothing arrives, and the callback does not look
+    // for the netconn, until then
+    listener.udp = udp;
+
+    ip_addr_t local;
+    ip_addr_set_ip4_u32(&local, address);
+    if (netconn_bind(udp, &local, _port) != ERR_OK) {
+        stopListening(index);
+        return false;
+    }
+    return true;
+}
+
+void LwipDNSTransport::stopListening(size_t index) {
+    Listener &listener = _listeners[index];
+    if (listener.udp == NULL) return;
+    // No callback comes for the netconn once it is deleted
+    netconn_delete(listener.udp);
+    listener.udp = NULL;
+    listener.arrived = 0;
+    listener.taken = 0;
+}
+
+void LwipDNSTransport::wake() {
+    if (_ready != NULL) xSemaphoreGive(_ready);
+}
+
+// At least a tick, a timeout rounded down to none would make receive() spin
+void LwipDNSTransport::setReceiveTimeout(uint32_t timeoutMs) {
+    TickType_t ticks = pdMS_TO_TICKS(timeoutMs);
+    _timeout = timeoutMs == 0 ? portMAX_DELAY : ticks != 0 ? ticks : 1;
+}
+
+bool LwipDNSTransport::joinGroup(uint32_t group, uint32_t interfaceAddress,
+                                 bool join) {
+#if LWIP_IGMP
+    if (_listeners[0].udp == NULL) return false;
+    ip_addr_t multicast, local;
+    ip_addr_set_ip4_u32(&multicast, group);
+    ip_addr_set_ip4_u32(&local, interfaceAddress);
+    return netconn_join_leave_group(_listeners[0].udp, &multicast, &local,
+                                    join ? NETCONN_JOIN : NETCONN_LEAVE) ==
+           ERR_OK;
+#else
+    return false;
+#endif
+}
+
+size_t LwipDNSTransport::receive(uint8_t *buffer, size_t capacity,
+                                 DNSEndpoint &from) {
+    return receive(buffer, capacity, from, false);
+}
+
+size_t LwipDNSTransport::receive(uint8_t *buffer, size_t capacity,
+                                 DNSEndpoint &from, bool dontBlock) {
+    for (bool waited = false;; waited = true) {
+        for (size_t i = 0; i < DNS_TRANSPORT_MAX_LISTENERS; i++) {
+            Listener &listener = _listeners[_next];
+            _next = (_next + 1) % DNS_TRANSPORT_MAX_LISTENERS;
+            if (listener.udp == NULL || listener.arrived == listener.taken)
+                continue;
+            listener.taken++;
+
+            // Does not block, a datagram is queued
+            netbuf *buf;
+            if (netconn_recv(listener.udp, &buf) != ERR_OK) continue;
+            size_t length = netbuf_len(buf);
+            netbuf_copy(buf, buffer, length < capacity ? length : capacity);
+            from.addr = ip4_addr_get_u32(ip_2_ip4(netbuf_fromaddr(buf)));
+            from.port = lwip_htons(netbuf_fromport(buf));
+            from.local = listener.address;
+            netbuf_delete(buf);
+            return length;
+        }
+        // Nothing after waiting: woken by wake(), or the semaphore was
+        // given for datagrams already taken. Returning 0 is fine either way.
+        if (dontBlock || waited || xSemaphoreTake(_ready, _timeout) != pdTRUE)
+            return 0;
+    }
+}
+
+// Takes the datagrams queued on all listeners, blocking only for the first
+size_t LwipDNSTransport::receiveBatch(DNSDatagram *datagrams, size_t count) {
+    size_t received = 0;
+    while (received < count) {
+        DNSDatagram &datagram = datagrams[received];
+        datagram.length = receive(datagram.buffer, datagram.capacity,
+                                  datagram.from, received != 0);
+        if (datagram.length == 0) break;
+        received++;
+    }
+    return received;
+}
+
+// Replies are sent by reference: the netbuf is a chain of PBUF_REF pbufs
+// pointing at the slices instead of a payload of its own. netconn_sendto()
+// returns only after the tcpip thread has handed the packet on, and lwIP
+// copies PBUF_REF payloads before queueing them, so the caller may reuse
+// the slices as soon as this returns.
+bool LwipDNSTransport::send(const DNSSlice *slices, size_t count,
+                            const DNSEndpoint &to) {
+    Listener *listener = route(to);
+    if (listener == NULL) return false;
+    ip_addr_t addr;
+    ip_addr_set_ip4_u32(&addr, to.addr);
+
+    netbuf buf;
+    memset(&buf, 0, sizeof(buf));
+    if (netbuf_ref(&buf, slices[0].data, slices[0].length) != ERR_OK)
+        return false;
+    for (size_t i = 1; i < count; i++) {
+        pbuf *p = pbuf_alloc(PBUF_RAW, slices[i].length, PBUF_REF);
+        if (p == NULL) {
+            netbuf_free(&buf);
+            return false;
+        }
+        p->payload = (void *)slices[i].data;
+        pbuf_cat(buf.p, p);
+    }
+#if LWIP_MULTICAST_TX_OPTIONS
+    // Only this task sends through the netconn, and the tcpip thread reads
+    // the interface during netconn_sendto() only
+    if (ip4_addr_ismulticast(ip_2_ip4(&addr)) && to.local != 0) {
+        ip4_addr_t local = {to.local};
+        udp_set_multicast_netif_addr(listener->udp->pcb.udp, &local);
+    }
+#endif
+    err_t err = netconn_sendto(listener->udp, &buf, &addr, lwip_ntohs(to.port));
+    netbuf_free(&buf);
+    return err == ERR_OK;
+}
+
+// The listener on the address `to` sent its request to. Otherwise, for
+// queries to the upstream resolver say, the one on the subnet of `to`, or
+// that of the interface lwIP routes everything else through.
+LwipDNSTransport::Listener *LwipDNSTransport::route(const DNSEndpoint &to) {
+    uint32_t defaultAddress =
+        netif_default != NULL
+            ? ip4_addr_get_u32(netif_ip4_addr(netif_default))
+            : 0;
+    Listener *subnet = NULL, *fallback = NULL;
+    for (size_t i = 0; i < DNS_TRANSPORT_MAX_LISTENERS; i++) {
+        Listener &listener = _listeners[i];
+        if (listener.udp == NULL) continue;
+        if (listener.address == to.local) return &listener;
+        if (((listener.address ^ to.addr) & listener.netmask) == 0)
+            subnet = &listener;
+        if (fallback == NULL || listener.address == defaultAddress)
+            fallback = &listener;
+    }
+    return subnet != NULL ? subnet : fallback;
+}
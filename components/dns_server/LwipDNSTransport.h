@@ -0,0 +1,91 @@
+#ifndef LwipDNSTransport_h
+#define LwipDNSTransport_h
+#include "DNSTransport.h"
+#include <FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <lwip/api.h>
+#include <lwip/ip_addr.h>
+
+// Receive timeout of the server tasks (DNSServer, StaticDNSServer): how
+// often they look up from the socket to see whether they should stop, which
+// bounds how long stop() takes
+#ifndef DNS_SERVER_POLL_MS
+#define DNS_SERVER_POLL_MS 250
+#endif
+
+// Transports open at once, each with up to DNS_TRANSPORT_MAX_LISTENERS
+// netconns: the unicast server (DNSServer, or StaticDNSServer in its place)
+// and MDNSServer
+#ifndef LWIP_DNS_TRANSPORT_MAX_OPEN
+#define LWIP_DNS_TRANSPORT_MAX_OPEN 2
+#endif
+
+// DNSTransport on top of lwIP UDP netconns, one per listening address. A
+// single task serves them all: lwIP's netconn callback counts the datagrams
+// queued on each and wakes the task, which then only reads from netconns
+// that have something, so no listener ever blocks another.
+class LwipDNSTransport : public DNSTransport {
+  public:
+    LwipDNSTransport();
+    ~LwipDNSTransport() { close(); };
+
+    // Prepares to serve `port`, listening on all addresses if `anyAddress`,
+    // otherwise on nothing until listen(). Returns true if successful, false
+    // if there are no sockets available. A non-zero `receiveTimeoutMs` makes
+    // receive() return 0 when nothing arrives in time.
+    bool open(const uint16_t &port, uint32_t receiveTimeoutMs = 0,
+              bool anyAddress = true);
+    void close();
+    // Makes listener `index` listen on `address` only, of an interface with
+    // `netmask` (both network byte order), in place of what it listened on
+    // before. Replies to requests it receives go out from `address`. An
+    // address of 0 listens on all addresses, and then no other listener may
+    // be open. Must not run concurrently with receive().
+    bool listen(size_t index, uint32_t address, uint32_t netmask);
+    void stopListening(size_t index);
+    // Makes a receive() blocked in another task return early
+    void wake();
+    // Joins (or leaves) the multicast `group` on the interface at
+    // `interfaceAddress` (both network byte order), for listener 0 to
+    // receive what is sent there. Returns false if lwIP has no IGMP.
+    bool joinGroup(uint32_t group, uint32_t interfaceAddress, bool join);
+
+    using DNSTransport::send;
+
+    size_t receive(uint8_t *buffer, size_t capacity,
+                   DNSEndpoint &from) override;
+    bool send(const DNSSlice *slices, size_t count,
+              const DNSEndpoint &to) override;
+    void setReceiveTimeout(uint32_t timeoutMs) override;
+    size_t receiveBatch(DNSDatagram *datagrams, size_t count) override;
+
+  private:
+    struct Listener {
+        netconn *udp; // NULL if not listening
+        uint32_t address;
+        uint32_t netmask;
+        // Datagrams queued on `udp` are those counted by the callback in
+        // the tcpip thread and not yet by receive(). Each counter has a
+        // single writer, so no atomic read-modify-write is needed.
+        volatile uint32_t arrived;
+        uint32_t taken;
+    };
+
+    Listener _listeners[DNS_TRANSPORT_MAX_LISTENERS];
+    uint16_t _port;
+    TickType_t _timeout;
+    // Given for every datagram queued on any listener
+    SemaphoreHandle_t _ready;
+    // Listener receive() looks at first, in turn so that a busy one does
+    // not starve the others
+    size_t _next;
+
+    // Open transports, for the callback to find netconns in
+    static LwipDNSTransport *volatile _open[LWIP_DNS_TRANSPORT_MAX_OPEN];
+
+    static void event(netconn *conn, netconn_evt evt, u16_t length);
+    size_t receive(uint8_t *buffer, size_t capacity, DNSEndpoint &from,
+                   bool dontBlock);
+    Listener *route(const DNSEndpoint &to);
+};
+#endif
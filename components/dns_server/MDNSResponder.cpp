@@ -0,0 +1,457 @@
+#include "MDNSResponder.h"
+#include "DNSConfig.h"
+#include <esp_timer.h>
+#include <string.h>
+
+static_assert(MDNS_MAX_RECORDS * 2 <= 16,
+              "MDNSResponder::RecordSet has a bit per A and AAAA record");
+
+static size_t countRecords(uint16_t records) {
+    size_t count = 0;
+    for (; records != 0; records &= records - 1) count++;
+    return count;
+}
+
+// Signed difference of two times that may have wrapped around
+static int32_t msBetween(uint32_t from, uint32_t to) {
+    return (int32_t)(to - from);
+}
+
+MDNSResponder::MDNSResponder() {
+    _transport = NULL;
+    _port = dns_htons(MDNS_PORT);
+    memset(_records, 0, sizeof(_records));
+    memset(_interfaces, 0, sizeof(_interfaces));
+    memset(&_metrics, 0, sizeof(_metrics));
+    // Only spreads the replies to truncated queries, any seed but 0 will do
+    _random = (uint32_t)esp_timer_get_time() | 1;
+    setTTL(MDNS_DEFAULT_TTL);
+}
+
+MDNSResponder::~MDNSResponder() {
+    for (size_t i = 0; i < MDNS_MAX_RECORDS; i++) delete[] _records[i].name;
+}
+
+void MDNSResponder::setTransport(DNSTransport *transport, uint16_t port) {
+    _transport = transport;
+    _port = dns_htons(port);
+}
+
+void MDNSResponder::setTTL(uint32_t ttl) {
+    uint32_t legacyTTL = ttl < MDNS_LEGACY_TTL ? ttl : MDNS_LEGACY_TTL;
+    _ttl = ttl;
+    DNSConfig::buildAnswerTemplate(_answerTemplates[0], DNS_QTYPE_A,
+                                   DNS_QCLASS_IN | MDNS_CLASS_FLUSH,
+                                   dns_htonl(ttl), 4);
+    DNSConfig::buildAnswerTemplate(_answerTemplates[1], DNS_QTYPE_AAAA,
+                                   DNS_QCLASS_IN | MDNS_CLASS_FLUSH,
+                                   dns_htonl(ttl), 16);
+    DNSConfig::buildAnswerTemplate(_legacyTemplates[0], DNS_QTYPE_A,
+                                   DNS_QCLASS_IN, dns_htonl(legacyTTL), 4);
+    DNSConfig::buildAnswerTemplate(_legacyTemplates[1], DNS_QTYPE_AAAA,
+                                   DNS_QCLASS_IN, dns_htonl(legacyTTL), 16);
+}
+
+bool MDNSResponder::addRecord(const char *name, const uint8_t address[4],
+                              const uint8_t *address6) {
+    uint8_t wireName[MAX_DNS_WIRENAME_LENGTH];
+    size_t nameLength = dnsEncodeName(name, wireName, sizeof(wireName));
+    if (nameLength == 0) return false;
+
+    Record *record = NULL;
+    for (size_t i = 0; i < MDNS_MAX_RECORDS; i++) {
+        Record &candidate = _records[i];
+        if (candidate.name != NULL && dnsNameEquals(candidate.name, wireName)) {
+            record = &candidate;
+            break;
+        }
+        if (candidate.name == NULL && record == NULL) record = &candidate;
+    }
+    if (record == NULL) return false;
+    if (record->name == NULL) {
+        record->name = new uint8_t[nameLength];
+        memcpy(record->name, wireName, nameLength);
+        record->nameLength = nameLength;
+    }
+    memcpy(record->address, address, sizeof(record->address));
+    record->hasAddress6 = address6 != NULL;
+    if (address6 != NULL)
+        memcpy(record->address6, address6, sizeof(record->address6));
+    return true;
+}
+
+void MDNSResponder::setInterface(size_t index, uint32_t address,
+                                 uint32_t netmask) {
+    if (index >= DNS_TRANSPORT_MAX_LISTENERS) return;
+    Interface &interface = _interfaces[index];
+    if (interface.address == address && interface.netmask == netmask) return;
+    // Neither what was pending nor what was sent holds for a new address
+    memset(&interface, 0, sizeof(interface));
+    interface.address = address;
+    interface.netmask = netmask;
+}
+
+// The interface a datagram came in on: the one at the address it was sent
+// to if the transport knows it, otherwise the one on the sender's subnet.
+// Senders on no subnet of ours are not on the link (section 11).
+MDNSResponder::Interface *MDNSResponder::interfaceFor(const DNSEndpoint &from) {
+    for (size_t i = 0; i < DNS_TRANSPORT_MAX_LISTENERS; i++) {
+        Interface &interface = _interfaces[i];
+        if (interface.address == 0) continue;
+        if (from.local != 0 ? interface.address == from.local
+                            : ((interface.address ^ from.addr) &
+                               interface.netmask) == 0)
+            return &interface;
+    }
+    return NULL;
+}
+
+// Our records answering a question for `name` of `type`
+MDNSResponder::RecordSet MDNSResponder::match(const uint8_t *name,
+                                              uint16_t type) const {
+    RecordSet records = 0;
+    for (size_t i = 0; i < MDNS_MAX_RECORDS; i++) {
+        const Record &record = _records[i];
+        if (record.name == NULL || !dnsNameEquals(record.name, name)) continue;
+        if (type == DNS_QTYPE_A || type == DNS_QTYPE_ANY)
+            records |= 1 << (2 * i);
+        if ((type == DNS_QTYPE_AAAA || type == DNS_QTYPE_ANY) &&
+            record.hasAddress6)
+            records |= 1 << (2 * i + 1);
+    }
+    return records;
+}
+
+// RDATA of record `bit` as answered on `interface`, 4 or 16 bytes
+const uint8_t *MDNSResponder::recordData(size_t bit,
+                                         const Interface &interface) const {
+    const Record &record = _records[bit / 2];
+    if (bit & 1) return record.address6;
+    // 0.0.0.0 resolves to the interface the query came in on
+    if (memcmp(record.address, "\0\0\0\0", 4) == 0)
+        return (const uint8_t *)&interface.address;
+    return record.address;
+}
+
+// Parses `count` resource records from `offset` on, the known answers of a
+// query or the answers of another responder, and adds the records of ours
+// among them that have at least half their TTL left to `known` (section
+// 7.1). Returns false if the records are malformed.
+bool MDNSResponder::parseAnswers(const uint8_t *message, size_t length,
+                                 size_t offset, uint16_t count,
+                                 const Interface &interface,
+                                 RecordSet &known) const {
+    uint8_t name[MAX_DNS_WIRENAME_LENGTH];
+    uint16_t type, rclass, rdLength;
+    uint32_t ttl;
+
+    for (uint16_t i = 0; i < count; i++) {
+        size_t nameLength = dnsExpandName(message, length, offset, name);
+        if (nameLength == 0) return false;
+        offset += nameLength;
+        // TYPE, CLASS, TTL and RDLENGTH
+        if (offset + DNS_ANSWER_PREFIX_SIZE - 2 > length) return false;
+        memcpy(&type, message + offset, sizeof(type));
+        memcpy(&rclass, message + offset + 2, sizeof(rclass));
+        memcpy(&ttl, message + offset + 4, sizeof(ttl));
+        memcpy(&rdLength, message + offset + 8, sizeof(rdLength));
+        offset += DNS_ANSWER_PREFIX_SIZE - 2;
+        rdLength = dns_ntohs(rdLength);
+        if (offset + rdLength > length) return false;
+        const uint8_t *rdata = message + offset;
+        offset += rdLength;
+
+        type = dns_ntohs(type);
+        if ((dns_ntohs(rclass) & ~MDNS_CLASS_FLUSH) != DNS_QCLASS_IN ||
+            (type != DNS_QTYPE_A && type != DNS_QTYPE_AAAA) ||
+            dns_ntohl(ttl) < _ttl / 2)
+            continue;
+        RecordSet records = match(name, type);
+        for (size_t bit = 0; records != 0; bit++, records >>= 1) {
+            if ((records & 1) && rdLength == (bit & 1 ? 16 : 4) &&
+                memcmp(rdata, recordData(bit, interface), rdLength) == 0)
+                known |= 1 << bit;
+        }
+    }
+    return true;
+}
+
+// Records asked for with QU that still have to be multicast: those not
+// multicast on the interface for a quarter of their TTL (section 5.4)
+MDNSResponder::RecordSet
+MDNSResponder::staleForUnicast(RecordSet records, const Interface &interface,
+                               uint32_t nowMs) const {
+    RecordSet stale = 0;
+    for (size_t bit = 0; bit < MDNS_MAX_RECORDS * 2; bit++) {
+        if (!(records & (1 << bit))) continue;
+        if (!(interface.sent & (1 << bit)) ||
+            msBetween(interface.lastSentMs[bit], nowMs) >=
+                (int32_t)(_ttl * 1000 / 4))
+            stale |= 1 << bit;
+    }
+    return stale;
+}
+
+void MDNSResponder::schedule(Interface &interface, RecordSet records,
+                             bool truncated, uint32_t from, uint32_t nowMs) {
+    uint32_t delay = MDNS_RESPONSE_DELAY_MS;
+    if (truncated) {
+        // xorshift32
+        _random ^= _random << 13;
+        _random ^= _random >> 17;
+        _random ^= _random << 5;
+        delay = MDNS_TRUNCATED_DELAY_MS + _random % MDNS_TRUNCATED_JITTER_MS;
+    }
+
+    if (interface.pending == 0) {
+        interface.dueMs = nowMs + delay;
+        interface.truncatedOnly = 0;
+    } else {
+        _metrics.aggregated++;
+        // The known answers of a truncated query are still to come
+        if (truncated && msBetween(interface.dueMs, nowMs + delay) > 0)
+            interface.dueMs = nowMs + delay;
+    }
+    if (truncated) {
+        interface.truncatedOnly |= records & ~interface.pending;
+        interface.truncatedFrom = from;
+    } else {
+        interface.truncatedOnly &= ~records;
+    }
+    interface.pending |= records;
+}
+
+void MDNSResponder::handleDatagram(uint8_t *buffer, size_t length,
+                                   const DNSEndpoint &from, uint32_t nowMs) {
+    uint8_t name[MAX_DNS_WIRENAME_LENGTH];
+    DNSHeader *header = (DNSHeader *)buffer;
+
+    // Messages with another OPCODE or RCODE are ignored (section 18)
+    if (length < DNS_HEADER_SIZE || length > MAX_DNS_PACKETSIZE ||
+        header->OPCode != DNS_OPCODE_QUERY || header->RCode != 0) {
+        _metrics.ignored++;
+        return;
+    }
+    Interface *interface = interfaceFor(from);
+    if (interface == NULL) {
+        _metrics.ignored++;
+        return;
+    }
+    bool legacy = from.port != _port;
+    uint16_t questions = dns_ntohs(header->QDCount);
+    RecordSet multicast = 0, unicast = 0, known = 0, first = 0;
+    size_t offset = DNS_HEADER_SIZE, questionEnd = 0;
+
+    if (header->QR == DNS_QR_QUERY) _metrics.queries++;
+    for (uint16_t i = 0; i < questions; i++) {
+        size_t nameLength = dnsExpandName(buffer, length, offset, name);
+        if (nameLength == 0 || offset + nameLength + 4 > length) {
+            _metrics.ignored++;
+            return;
+        }
+        uint16_t qtype, qclass;
+        memcpy(&qtype, buffer + offset + nameLength, sizeof(qtype));
+        memcpy(&qclass, buffer + offset + nameLength + 2, sizeof(qclass));
+        offset += nameLength + 4;
+        qclass = dns_ntohs(qclass);
+
+        if ((qclass & ~MDNS_CLASS_QU) != DNS_QCLASS_IN &&
+            (qclass & ~MDNS_CLASS_QU) != DNS_QCLASS_ANY)
+            continue;
+        RecordSet records = match(name, dns_ntohs(qtype));
+        if (i == 0) {
+            first = records;
+            questionEnd = offset;
+        }
+        if (qclass & MDNS_CLASS_QU)
+            unicast |= records;
+        else
+            multicast |= records;
+    }
+    if (!parseAnswers(buffer, length, offset, dns_ntohs(header->ANCount),
+                      *interface, known)) {
+        _metrics.ignored++;
+        return;
+    }
+
+    if (header->QR == DNS_QR_RESPONSE) {
+        // Another responder multicast what we were about to (section 7.4)
+        RecordSet duplicates = interface->pending & known;
+        _metrics.duplicates += countRecords(duplicates);
+        interface->pending &= ~duplicates;
+        interface->truncatedOnly &= ~duplicates;
+        return;
+    }
+
+    // Legacy resolvers get a plain DNS reply right away (section 6.7)
+    if (legacy) {
+        if (questions == 1 && first != 0)
+            replyLegacy(buffer, questionEnd, first, *interface, from);
+        return;
+    }
+
+    // Known answers following a truncated query (section 7.2)
+    if (questions == 0 && from.addr == interface->truncatedFrom) {
+        RecordSet cancelled = interface->pending & interface->truncatedOnly &
+                              known;
+        _metrics.knownAnswers += countRecords(cancelled);
+        interface->pending &= ~cancelled;
+        interface->truncatedOnly &= ~cancelled;
+        return;
+    }
+
+    _metrics.knownAnswers += countRecords((multicast | unicast) & known);
+    multicast &= ~known;
+    unicast &= ~known;
+    RecordSet stale = staleForUnicast(unicast, *interface, nowMs);
+    multicast |= stale;
+    unicast &= ~stale;
+
+    if (unicast != 0) {
+        RecordSet records = unicast;
+        size_t responseLength = buildResponse(records, *interface);
+        if (_transport->send(_response, responseLength, from))
+            _metrics.unicast++;
+    }
+    if (multicast != 0)
+        schedule(*interface, multicast, header->TC, from.addr, nowMs);
+}
+
+int32_t MDNSResponder::msUntilDue(uint32_t nowMs) const {
+    int32_t wait = -1;
+    for (size_t i = 0; i < DNS_TRANSPORT_MAX_LISTENERS; i++) {
+        const Interface &interface = _interfaces[i];
+        if (interface.address == 0 || interface.pending == 0) continue;
+        int32_t left = msBetween(nowMs, interface.dueMs);
+        if (left < 0) left = 0;
+        if (wait < 0 || left < wait) wait = left;
+    }
+    return wait;
+}
+
+// Multicasts the pending answers of every interface whose response is due,
+// except for records multicast there less than a second ago: those wait
+// until the second is over.
+void MDNSResponder::sendDue(uint32_t nowMs) {
+    for (size_t i = 0; i < DNS_TRANSPORT_MAX_LISTENERS; i++) {
+        Interface &interface = _interfaces[i];
+        if (interface.address == 0 || interface.pending == 0 ||
+            msBetween(interface.dueMs, nowMs) < 0)
+            continue;
+
+        RecordSet ready = 0;
+        uint32_t nextMs = nowMs;
+        bool waiting = false;
+        for (size_t bit = 0; bit < MDNS_MAX_RECORDS * 2; bit++) {
+            if (!(interface.pending & (1 << bit))) continue;
+            uint32_t allowedMs =
+                interface.lastSentMs[bit] + MDNS_MULTICAST_INTERVAL_MS;
+            if (!(interface.sent & (1 << bit)) ||
+                msBetween(allowedMs, nowMs) >= 0) {
+                ready |= 1 << bit;
+            } else if (!waiting || msBetween(allowedMs, nextMs) > 0) {
+                nextMs = allowedMs;
+                waiting = true;
+            }
+        }
+        if (ready != 0) {
+            size_t length = buildResponse(ready, interface);
+            DNSEndpoint group = {MDNS_GROUP, _port, interface.address};
+            if (_transport->send(_response, length, group))
+                _metrics.responses++;
+            for (size_t bit = 0; bit < MDNS_MAX_RECORDS * 2; bit++) {
+                if (ready & (1 << bit)) interface.lastSentMs[bit] = nowMs;
+            }
+            interface.sent |= ready;
+            interface.pending &= ~ready;
+            interface.truncatedOnly &= ~ready;
+        }
+        // What did not fit goes out next time, what is held back when its
+        // second is over
+        if (interface.pending != 0)
+            interface.dueMs = waiting && ready == 0 ? nextMs : nowMs;
+    }
+}
+
+// Builds a response with the answers in `records` into _response: no
+// question, each name written once and pointed to by its other records.
+// Leaves in `records` the answers that fit, and returns the length.
+size_t MDNSResponder::buildResponse(RecordSet &records,
+                                    const Interface &interface) {
+    size_t nameOffsets[MDNS_MAX_RECORDS] = {0};
+    size_t length = DNS_HEADER_SIZE;
+    RecordSet written = 0;
+    uint16_t count = 0;
+
+    memset(_response, 0, DNS_HEADER_SIZE);
+    // QR and AA, the ID of multicast responses is 0 (section 18.1)
+    _response[2] = DNS_QR_RESPONSE << 7 | 1 << 2;
+    for (size_t bit = 0; bit < MDNS_MAX_RECORDS * 2; bit++) {
+        if (!(records & (1 << bit))) continue;
+        const Record &record = _records[bit / 2];
+        size_t &nameOffset = nameOffsets[bit / 2];
+        size_t rdLength = bit & 1 ? 16 : 4;
+        size_t needed = (nameOffset != 0 ? 2 : record.nameLength) +
+                        DNS_ANSWER_PREFIX_SIZE - 2 + rdLength;
+        if (length + needed > MAX_DNS_PACKETSIZE) continue;
+
+        if (nameOffset != 0) {
+            uint16_t pointer = dns_htons(0xC000 | nameOffset);
+            memcpy(_response + length, &pointer, sizeof(pointer));
+            length += sizeof(pointer);
+        } else {
+            nameOffset = length;
+            memcpy(_response + length, record.name, record.nameLength);
+            length += record.nameLength;
+        }
+        memcpy(_response + length, _answerTemplates[bit & 1] + 2,
+               DNS_ANSWER_PREFIX_SIZE - 2);
+        length += DNS_ANSWER_PREFIX_SIZE - 2;
+        memcpy(_response + length, recordData(bit, interface), rdLength);
+        length += rdLength;
+        written |= 1 << bit;
+        count++;
+    }
+    ((DNSHeader *)_response)->ANCount = dns_htons(count);
+    records = written;
+    return length;
+}
+
+// The request header patched in place, its question, then the answer by
+// reference like DNSResponder::replyWithIP. The A record if it was asked
+// for, the AAAA record otherwise.
+void MDNSResponder::replyLegacy(uint8_t *buffer, size_t questionEnd,
+                                RecordSet records, const Interface &interface,
+                                const DNSEndpoint &to) {
+    size_t bit = 0;
+    while (!(records & (1 << bit))) bit++;
+
+    // QR, AA and RD copied from the request, one question and one answer
+    buffer[2] = DNS_QR_RESPONSE << 7 | 1 << 2 | (buffer[2] & 1);
+    memset(buffer + 3, 0, DNS_HEADER_SIZE - 3);
+    buffer[5] = 1;
+    buffer[7] = 1;
+
+    DNSSlice slices[3];
+    slices[0].data = buffer;
+    slices[0].length = questionEnd;
+    slices[1].data = _legacyTemplates[bit & 1];
+    slices[1].length = DNS_ANSWER_PREFIX_SIZE;
+    slices[2].data = recordData(bit, interface);
+    slices[2].length = bit & 1 ? 16 : 4;
+    if (_transport->send(slices, 3, to)) _metrics.unicast++;
+}
+
+void MDNSResponder::processNextRequest() {
+    DNSEndpoint from;
+    uint32_t nowMs = (uint32_t)(esp_timer_get_time() / 1000);
+    int32_t wait = msUntilDue(nowMs);
+    // A timeout of 0 would wait for as long as it takes
+    _transport->setReceiveTimeout(wait < 0 ? MDNS_POLL_MS
+                                           : wait > 0 ? wait : 1);
+
+    size_t length = _transport->receive(_buffer, sizeof(_buffer), from);
+    nowMs = (uint32_t)(esp_timer_get_time() / 1000);
+    if (length != 0) handleDatagram(_buffer, length, from, nowMs);
+    sendDue(nowMs);
+}
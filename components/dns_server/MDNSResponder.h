@@ -0,0 +1,160 @@
+#ifndef MDNSResponder_h
+#define MDNSResponder_h
+#include "DNSName.h"
+#include "DNSTransport.h"
+
+#define MDNS_PORT 5353
+// 224.0.0.251, in network byte order
+#define MDNS_GROUP dns_htonl(0xE00000FBUL)
+
+// Names answered, each with an A and optionally an AAAA record
+#ifndef MDNS_MAX_RECORDS
+#define MDNS_MAX_RECORDS 4
+#endif
+
+// TTL of host address records (RFC 6762, section 10), and the most that
+// legacy unicast resolvers may cache our answers for (section 6.7)
+#define MDNS_DEFAULT_TTL 120
+#define MDNS_LEGACY_TTL 10
+
+// Answers wait this long for other queries on the same interface, which
+// then go out in the same response (section 6.4). Queries with TC set wait
+// longer, for the rest of their known answers to arrive (section 7.2).
+#define MDNS_RESPONSE_DELAY_MS 20
+#define MDNS_TRUNCATED_DELAY_MS 400
+#define MDNS_TRUNCATED_JITTER_MS 100
+// A record is multicast on an interface at most this often (section 6.2)
+#define MDNS_MULTICAST_INTERVAL_MS 1000
+
+// How long processNextRequest() waits for a datagram when no response is
+// pending, which bounds how long stopping the task takes
+#ifndef MDNS_POLL_MS
+#define MDNS_POLL_MS 250
+#endif
+
+// Top bit of the class: cache flush in records, unicast response wanted
+// (QU) in questions
+#define MDNS_CLASS_FLUSH 0x8000
+#define MDNS_CLASS_QU 0x8000
+
+// Counters kept by MDNSResponder, written by its task only like DNSMetrics
+struct MDNSMetrics {
+    uint32_t queries;    // queries received
+    uint32_t ignored;    // malformed or from another subnet
+    uint32_t responses;  // multicast responses sent
+    uint32_t unicast;    // replies to QU questions and legacy resolvers
+    uint32_t aggregated; // queries answered by a response already pending
+    // Answers left out because the querier listed them as known
+    uint32_t knownAnswers;
+    // Pending answers dropped because another responder multicast them
+    uint32_t duplicates;
+};
+
+// Multicast DNS (RFC 6762) responder for a few host names such as
+// "nile_a1b2c3.local", platform independent like DNSResponder and built
+// from the same pieces: DNSName parses the messages, DNSConfig's answer
+// template makes the records and a DNSTransport carries them. Only A and
+// AAAA records are answered.
+//
+// Multicast airtime is what a responder costs everybody on the network, so
+// answers are held back briefly and sent together, once per interface,
+// for all queries that arrived meanwhile; answers the querier already has
+// (known-answer suppression) or that another responder just multicast
+// (duplicate answer suppression) are left out, and no record is multicast
+// on an interface more than once a second.
+//
+// Not synchronized: configure it before its task runs, or from that task.
+class MDNSResponder {
+  public:
+    MDNSResponder();
+    ~MDNSResponder();
+
+    // `port` is the mDNS port, queries from any other port come from legacy
+    // resolvers and are answered right away by unicast
+    void setTransport(DNSTransport *transport, uint16_t port = MDNS_PORT);
+    // Answers `name` with `address`, or with the address of the interface
+    // asked if 0.0.0.0, and AAAA questions with `address6` (16 bytes) if
+    // not NULL. Returns false if the name is invalid or there is no room.
+    bool addRecord(const char *name, const uint8_t address[4],
+                   const uint8_t *address6 = NULL);
+    void setTTL(uint32_t ttl);
+    // Serves interface `index` (below DNS_TRANSPORT_MAX_LISTENERS) at
+    // `address` with `netmask`, both network byte order. Queries are only
+    // answered for senders on the subnet of an interface. An address of 0
+    // takes the interface down.
+    void setInterface(size_t index, uint32_t address, uint32_t netmask);
+
+    // Receives one datagram, waiting no longer than until the next response
+    // is due, then sends the responses that are due
+    void processNextRequest();
+    // The halves of processNextRequest(), with the time given by the
+    // caller. The request is turned into the reply in `buffer`.
+    void handleDatagram(uint8_t *buffer, size_t length,
+                        const DNSEndpoint &from, uint32_t nowMs);
+    void sendDue(uint32_t nowMs);
+    // Milliseconds until sendDue() has something to send, -1 if nothing
+    // is pending
+    int32_t msUntilDue(uint32_t nowMs) const;
+
+    const MDNSMetrics &metrics() const { return _metrics; }
+
+  private:
+    struct Record {
+        uint8_t *name; // wire format, NULL if the slot is free
+        size_t nameLength;
+        uint8_t address[4];
+        bool hasAddress6;
+        uint8_t address6[16];
+    };
+
+    // Bit 2 * i stands for the A record of _records[i], 2 * i + 1 for its
+    // AAAA record
+    typedef uint16_t RecordSet;
+
+    struct Interface {
+        uint32_t address; // network byte order, 0 if down
+        uint32_t netmask;
+        // Answers to multicast once dueMs has come
+        RecordSet pending;
+        uint32_t dueMs;
+        // Pending answers asked for only by the truncated query of
+        // truncatedFrom, which its next known answers may still cancel
+        RecordSet truncatedOnly;
+        uint32_t truncatedFrom;
+        // Records multicast at least once, at lastSentMs
+        RecordSet sent;
+        uint32_t lastSentMs[MDNS_MAX_RECORDS * 2];
+    };
+
+    DNSTransport *_transport;
+    uint16_t _port; // network byte order
+    uint32_t _ttl;
+    // Answer templates of mDNS responses, written without the leading
+    // pointer after the name, and of legacy replies, pointing at the
+    // question, see DNSConfig::buildAnswerTemplate
+    uint8_t _answerTemplates[2][DNS_ANSWER_PREFIX_SIZE];
+    uint8_t _legacyTemplates[2][DNS_ANSWER_PREFIX_SIZE];
+    Record _records[MDNS_MAX_RECORDS];
+    Interface _interfaces[DNS_TRANSPORT_MAX_LISTENERS];
+    uint32_t _random;
+    MDNSMetrics _metrics;
+    uint8_t _buffer[MAX_DNS_PACKETSIZE];
+    uint8_t _response[MAX_DNS_PACKETSIZE];
+
+    MDNSResponder(const MDNSResponder &);
+    MDNSResponder &operator=(const MDNSResponder &);
+    Interface *interfaceFor(const DNSEndpoint &from);
+    RecordSet match(const uint8_t *name, uint16_t type) const;
+    const uint8_t *recordData(size_t bit, const Interface &interface) const;
+    bool parseAnswers(const uint8_t *message, size_t length, size_t offset,
+                      uint16_t count, const Interface &interface,
+                      RecordSet &known) const;
+    RecordSet staleForUnicast(RecordSet records, const Interface &interface,
+                              uint32_t nowMs) const;
+    void schedule(Interface &interface, RecordSet records, bool truncated,
+                  uint32_t from, uint32_t nowMs);
+    size_t buildResponse(RecordSet &records, const Interface &interface);
+    void replyLegacy(uint8_t *buffer, size_t questionEnd, RecordSet records,
+                     const Interface &interface, const DNSEndpoint &to);
+};
+#endif
@@ -0,0 +1,97 @@
+#include "MDNSServer.h"
+#include <esp_log.h>
+#include <string.h>
+
+static const char *TAG = "mdns_server";
+
+void MDNSServer::task(void *parm) {
+    MDNSServer *server = (MDNSServer *)parm;
+    while (server->_running.load()) {
+        if (server->_interfacesChanged.load()) server->applyInterfaces();
+        server->_responder.processNextRequest();
+    }
+    xSemaphoreGive(server->_stopped);
+    vTaskDelete(NULL);
+}
+
+MDNSServer::MDNSServer() : _running(false), _interfacesChanged(false) {
+    _task = NULL;
+    memset(_interfaces, 0, sizeof(_interfaces));
+    _stopped = xSemaphoreCreateBinary();
+    _updateLock = xSemaphoreCreateMutex();
+    _responder.setTransport(&_transport);
+}
+
+MDNSServer::~MDNSServer() {
+    stop();
+    vSemaphoreDelete(_stopped);
+    vSemaphoreDelete(_updateLock);
+}
+
+bool MDNSServer::addRecord(const char *name, const ip_addr_t &address) {
+    uint8_t ip[4] = {ip4_addr1(&address), ip4_addr2(&address),
+                     ip4_addr3(&address), ip4_addr4(&address)};
+    return _task == NULL && _responder.addRecord(name, ip);
+}
+
+bool MDNSServer::start() {
+    if (_task != NULL) return false;
+    if (!_transport.open(MDNS_PORT, MDNS_POLL_MS)) return false;
+    memset(_joined, 0, sizeof(_joined));
+    applyInterfaces();
+    ESP_LOGI(TAG, "Starting at port: %d", MDNS_PORT);
+    _running.store(true);
+    xTaskCreate(MDNSServer::task, "MDNS_SERVER_TASK", 1024, this, 5, &_task);
+    return true;
+}
+
+void MDNSServer::setInterface(size_t index, const ip_addr_t &address,
+                              const ip_addr_t &netmask) {
+    if (index >= DNS_TRANSPORT_MAX_LISTENERS) return;
+    xSemaphoreTake(_updateLock, portMAX_DELAY);
+    _interfaces[index].address = ip4_addr_get_u32(ip_2_ip4(&address));
+    _interfaces[index].netmask = ip4_addr_get_u32(ip_2_ip4(&netmask));
+    xSemaphoreGive(_updateLock);
+    _interfacesChanged.store(true);
+    _transport.wake();
+}
+
+// Leaves the group on interfaces that went down or changed address and
+// joins it on the new ones, see DNSServer::applyInterfaces. Runs in the
+// server task, or in start() before there is one.
+void MDNSServer::applyInterfaces() {
+    Interface wanted[DNS_TRANSPORT_MAX_LISTENERS];
+
+    _interfacesChanged.store(false);
+    xSemaphoreTake(_updateLock, portMAX_DELAY);
+    memcpy(wanted, _interfaces, sizeof(wanted));
+    xSemaphoreGive(_updateLock);
+
+    for (size_t i = 0; i < DNS_TRANSPORT_MAX_LISTENERS; i++) {
+        Interface &joined = _joined[i];
+        if (wanted[i].address == joined.address &&
+            wanted[i].netmask == joined.netmask)
+            continue;
+        if (joined.address != 0)
+            _transport.joinGroup(MDNS_GROUP, joined.address, false);
+        joined = wanted[i];
+        _responder.setInterface(i, joined.address, joined.netmask);
+        if (joined.address == 0) continue;
+        ip4_addr_t address = {joined.address};
+        if (_transport.joinGroup(MDNS_GROUP, joined.address, true))
+            ESP_LOGI(TAG, "Serving interface %u at %s", (unsigned)i,
+                     ip4addr_ntoa(&address));
+        else
+            ESP_LOGE(TAG, "Cannot join the mDNS group on interface %u",
+                     (unsigned)i);
+    }
+}
+
+void MDNSServer::stop() {
+    if (_task == NULL) return;
+    _running.store(false);
+    _transport.wake();
+    xSemaphoreTake(_stopped, portMAX_DELAY);
+    _task = NULL;
+    _transport.close();
+}
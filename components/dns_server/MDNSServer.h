@@ -0,0 +1,57 @@
+#ifndef MDNSServer_h
+#define MDNSServer_h
+#include "LwipDNSTransport.h"
+#include "MDNSResponder.h"
+#include <FreeRTOS.h>
+#include <atomic>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#include <lwip/ip_addr.h>
+
+// Runs an MDNSResponder in a task of its own, on one netconn bound to all
+// addresses at the mDNS port that joins the mDNS group on every interface
+// served.
+class MDNSServer {
+  public:
+    MDNSServer();
+    ~MDNSServer();
+
+    // Answers `name` (e.g. "nile_a1b2c3.local") with `address`, 0.0.0.0 for
+    // the address of the interface asked. Call before start().
+    bool addRecord(const char *name, const ip_addr_t &address);
+    // Serves network interface `index` (below DNS_TRANSPORT_MAX_LISTENERS)
+    // at `address`, like DNSServer::setInterface. May be called from any
+    // task, before start() too.
+    void setInterface(size_t index, const ip_addr_t &address,
+                      const ip_addr_t &netmask);
+    // Safe to read from any task, see MDNSMetrics
+    const MDNSMetrics &metrics() const { return _responder.metrics(); }
+
+    // Returns true if successful, false if there are no sockets available
+    bool start();
+    // Like DNSServer::stop(), waits for the task to exit
+    void stop();
+
+  private:
+    LwipDNSTransport _transport;
+    MDNSResponder _responder;
+    TaskHandle_t _task;
+    std::atomic<bool> _running;
+    SemaphoreHandle_t _stopped;
+    SemaphoreHandle_t _updateLock;
+
+    struct Interface {
+        uint32_t address; // network byte order, 0 if down
+        uint32_t netmask;
+    };
+    // Set by setInterface() under _updateLock, taken over by the task when
+    // it sees _interfacesChanged
+    Interface _interfaces[DNS_TRANSPORT_MAX_LISTENERS];
+    std::atomic<bool> _interfacesChanged;
+    // Interfaces the group is joined on, touched by the task only
+    Interface _joined[DNS_TRANSPORT_MAX_LISTENERS];
+
+    static void task(void *parm);
+    void applyInterfaces();
+};
+#endif
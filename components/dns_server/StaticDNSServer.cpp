@@ -0,0 +1,46 @@
+#include <FreeRTOS.h>
+// Built with the component whether used or not, see StaticDNSServer.h
+#if configSUPPORT_STATIC_ALLOCATION
+#include "StaticDNSServer.h"
+#include <esp_log.h>
+
+static const char *TAG = "dns_server";
+
+void StaticDNSServer::task(void *parm) {
+    StaticDNSServer *server = (StaticDNSServer *)parm;
+    while (server->_running.load()) {
+        server->_responder.processNextRequest();
+    }
+    xSemaphoreGive(server->_stopped);
+    // Deleted by stop(): a task deleting itself is only cleaned up later by
+    // the idle task, and its buffers could not be reused by start() until
+    // then
+    vTaskSuspend(NULL);
+}
+
+bool StaticDNSServer::start(uint16_t port) {
+    if (_task != NULL) return false;
+    if (!_transport.open(port, DNS_SERVER_POLL_MS)) return false;
+    ESP_LOGI(TAG, "Starting static server at port: %d", port);
+    _running.store(true);
+    _task = xTaskCreateStatic(StaticDNSServer::task, "DNS_SERVER_TASK",
+                              DNS_STATIC_SERVER_STACK_SIZE, this, 9, _stack,
+                              &_taskBuffer);
+    return true;
+}
+
+void StaticDNSServer::stop() {
+    if (_task == NULL) return;
+    _running.store(false);
+    _transport.wake();
+    xSemaphoreTake(_stopped, portMAX_DELAY);
+    vTaskDelete(_task);
+    _task = NULL;
+    _transport.close();
+}
+
+uint32_t StaticDNSServer::stackFree() const {
+    if (_task == NULL) return 0;
+    return uxTaskGetStackHighWaterMark(_task) * sizeof(StackType_t);
+}
+#endif
@@ -0,0 +1,66 @@
+#ifndef StaticDNSServer_h
+#define StaticDNSServer_h
+#include "DNSStaticResponder.h"
+#include "LwipDNSTransport.h"
+#include <FreeRTOS.h>
+#include <atomic>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+
+// CONFIG_FREERTOS_SUPPORT_STATIC_ALLOCATION, on in sdkconfig.defaults
+#if !configSUPPORT_STATIC_ALLOCATION
+#error "StaticDNSServer needs configSUPPORT_STATIC_ALLOCATION"
+#endif
+
+// Stack of the server task, in the unit of xTaskCreate()'s usStackDepth.
+// DNSStaticResponder needs far less than DNSServer's task.
+#ifndef DNS_STATIC_SERVER_STACK_SIZE
+#define DNS_STATIC_SERVER_STACK_SIZE 512
+#endif
+
+// DNSServer for fixed-function builds where the name, address and TTL are
+// known when building. Meant to be a static object: the task, its stack,
+// the receive buffer and the record all live in static memory, and starting
+// it allocates from the heap only the socket and the semaphore of the
+// transport.
+//
+// It replaces DNSServer rather than running next to it: both listen on the
+// same port, and with MDNSServer they would need a third transport, beyond
+// LWIP_DNS_TRANSPORT_MAX_OPEN. start() fails while DNSServer is running.
+//
+//   static constexpr auto portalRecord =
+//       dnsStaticRecord("*", 192, 168, 4, 1, 60);
+//   static StaticDNSServer portalDNS(portalRecord);
+//   ...
+//   portalDNS.start(53);
+class StaticDNSServer {
+  public:
+    template <size_t WireLength>
+    explicit StaticDNSServer(const DNSStaticRecord<WireLength> &record)
+        : _responder(record), _task(NULL), _running(false) {
+        _responder.setTransport(&_transport);
+        _stopped = xSemaphoreCreateBinaryStatic(&_stoppedBuffer);
+    }
+    ~StaticDNSServer() { stop(); }
+
+    // Returns true if successful, false if there are no sockets available
+    // or the server is already running
+    bool start(uint16_t port);
+    // Like DNSServer::stop(), waits for the task to exit
+    void stop();
+    // Bytes of the server task stack never used so far, 0 if not running
+    uint32_t stackFree() const;
+
+  private:
+    LwipDNSTransport _transport;
+    DNSStaticResponder _responder;
+    TaskHandle_t _task;
+    std::atomic<bool> _running;
+    SemaphoreHandle_t _stopped;
+    StaticSemaphore_t _stoppedBuffer;
+    StaticTask_t _taskBuffer;
+    StackType_t _stack[DNS_STATIC_SERVER_STACK_SIZE];
+
+    static void task(void *parm);
+};
+#endif
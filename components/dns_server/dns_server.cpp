@@ -1,5 +1,14 @@
 #include "dns_server.h"
 #include "DNSServer.h"
+#include <string.h>
+
+static_assert(DNS_SERVER_LATENCY_BUCKETS == DNS_METRICS_LATENCY_BUCKETS,
+              "dns_server_metrics_t and DNSMetrics histograms differ");
+static_assert(DNS_SERVER_MAX_INTERFACES == DNS_TRANSPORT_MAX_LISTENERS,
+              "DNS_SERVER_MAX_INTERFACES and DNSTransport listeners differ");
+static_assert(DNS_SERVER_MAX_SET_ADDRESSES == DNS_ADDRESS_SET_SIZE &&
+                  DNS_SERVER_MAX_RECORD_SETS == DNS_CONFIG_MAX_ADDRESS_SETS,
+              "dns_server_add_record_set limits and DNSConfig differ");
 
 extern "C" {
 
@@ -16,6 +25,83 @@ void dns_server_start(DNSServer *server, uint16_t port, const char *domainName,
     server->start(port, strDomainName, *resolvedIP);
 }
 
+void dns_server_set_interface(DNSServer *server, uint8_t index,
+                              const ip_addr_t *address,
+                              const ip_addr_t *netmask) {
+    ip_addr_t none = IPADDR4_INIT(0);
+    server->setInterface(index, address != NULL ? *address : none,
+                         netmask != NULL ? *netmask : none);
+}
+
+void dns_server_set_domain(DNSServer *server, const char *domainName,
+                           const ip_addr_t *resolvedIP) {
+    server->setDomain(std::string(domainName), *resolvedIP);
+}
+
+void dns_server_set_upstream(DNSServer *server, const ip_addr_t *upstream) {
+    if (upstream == NULL) {
+        ip_addr_t none = IPADDR4_INIT(0);
+        server->setUpstream(none);
+    } else {
+        server->setUpstream(*upstream);
+    }
+}
+
+bool dns_server_add_record(DNSServer *server, const char *name,
+                           const ip_addr_t *address) {
+    return server->addRecord(name, *address);
+}
+
+bool dns_server_add_record6(DNSServer *server, const char *name,
+                            const ip_addr_t *address,
+                            const uint8_t address6[16]) {
+    return server->addRecord(name, *address, address6);
+}
+
+bool dns_server_add_record_set(DNSServer *server, const char *name,
+                               const ip_addr_t *addresses,
+                               const uint8_t *weights, size_t count) {
+    return server->addRecord(name, addresses, weights, count);
+}
+
+bool dns_server_remove_record(DNSServer *server, const char *name) {
+    return server->removeRecord(name);
+}
+
+bool dns_server_add_pattern(DNSServer *server, const char *pattern,
+                            uint16_t priority, const ip_addr_t *address) {
+    return server->addPattern(pattern, priority, *address);
+}
+
+void dns_server_set_negative_ttl(DNSServer *server, uint32_t ttl) {
+    server->setNegativeTTL(ttl);
+}
+
+void dns_server_set_rate_limit(DNSServer *server, uint16_t rate,
+                               uint16_t burst, uint8_t slip) {
+    server->setRateLimit(rate, burst, slip);
+}
+
+uint32_t dns_server_rate_limit_dropped(const DNSServer *server) {
+    return server->rateLimitDropped();
+}
+
+void dns_server_get_metrics(const DNSServer *server,
+                            dns_server_metrics_t *metrics) {
+    const DNSMetrics &source = server->metrics();
+    metrics->requests = source.requests;
+    metrics->ignored = source.ignored;
+    memcpy(metrics->qtypes, source.qtypes, sizeof(metrics->qtypes));
+    memcpy(metrics->rcodes, source.rcodes, sizeof(metrics->rcodes));
+    metrics->truncated = source.truncated;
+    metrics->forwarded = source.forwarded;
+    metrics->cache_hits = source.cacheHits;
+    metrics->rate_limit_dropped = server->rateLimitDropped();
+    metrics->rate_limit_truncated = server->rateLimitTruncated();
+    memcpy(metrics->latency, source.latency, sizeof(metrics->latency));
+    metrics->stack_free = server->stackFree();
+}
+
 void dns_server_stop(DNSServer *server) {
     server->stop();
 }
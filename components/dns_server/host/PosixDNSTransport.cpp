@@ -0,0 +1,216 @@
+#include "PosixDNSTransport.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+PosixDNSTransport::PosixDNSTransport() {
+    for (size_t i = 0; i < DNS_TRANSPORT_MAX_LISTENERS; i++) _fds[i] = -1;
+    _port = 0;
+    _next = 0;
+}
+
+bool PosixDNSTransport::open(uint32_t address, uint16_t port,
+                             int receiveTimeoutMs) {
+    _port = port;
+    _receiveTimeoutMs = receiveTimeoutMs;
+    return listen(0, address);
+}
+
+void PosixDNSTransport::close() {
+    for (size_t i = 0; i < DNS_TRANSPORT_MAX_LISTENERS; i++) stopListening(i);
+}
+
+bool PosixDNSTransport::listen(size_t index, uint32_t address) {
+    stopListening(index);
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0) return false;
+    // mDNS shares its port with the other responders on the host
+    int reuse = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = address;
+    addr.sin_port = htons(_port);
+    if (bind(fd, (sockaddr *)&addr, sizeof(addr)) != 0 ||
+        getsockname(fd, (sockaddr *)&addr, &len) != 0) {
+        ::close(fd);
+        return false;
+    }
+    // The ephemeral port picked for the first listener is the port of all
+    _port = ntohs(addr.sin_port);
+    _fds[index] = fd;
+    _addresses[index] = address;
+    return true;
+}
+
+void PosixDNSTransport::stopListening(size_t index) {
+    if (_fds[index] >= 0) {
+        ::close(_fds[index]);
+        _fds[index] = -1;
+    }
+}
+
+bool PosixDNSTransport::joinGroup(uint32_t group, uint32_t interfaceAddress,
+                                  bool join) {
+    ip_mreq request;
+    request.imr_multiaddr.s_addr = group;
+    request.imr_interface.s_addr = interfaceAddress;
+    return _fds[0] >= 0 &&
+           setsockopt(_fds[0], IPPROTO_IP,
+                      join ? IP_ADD_MEMBERSHIP : IP_DROP_MEMBERSHIP, &request,
+                      sizeof(request)) == 0;
+}
+
+int PosixDNSTransport::readable() {
+    pollfd fds[DNS_TRANSPORT_MAX_LISTENERS];
+    for (size_t i = 0; i < DNS_TRANSPORT_MAX_LISTENERS; i++) {
+        fds[i].fd = _fds[i]; // negative ones are skipped by poll()
+        fds[i].events = POLLIN;
+        fds[i].revents = 0;
+    }
+    int timeout = _receiveTimeoutMs > 0 ? _receiveTimeoutMs : -1;
+    if (poll(fds, DNS_TRANSPORT_MAX_LISTENERS, timeout) <= 0) return -1;
+    for (size_t i = 0; i < DNS_TRANSPORT_MAX_LISTENERS; i++) {
+        size_t index = _next;
+        _next = (_next + 1) % DNS_TRANSPORT_MAX_LISTENERS;
+        if (fds[index].revents & POLLIN) return (int)index;
+    }
+    return -1;
+}
+
+// The listener the request came to, otherwise the first one
+int PosixDNSTransport::route(const DNSEndpoint &to) const {
+    int fallback = -1;
+    for (size_t i = 0; i < DNS_TRANSPORT_MAX_LISTENERS; i++) {
+        if (_fds[i] < 0) continue;
+        if (_addresses[i] == to.local) return _fds[i];
+        if (fallback < 0) fallback = _fds[i];
+    }
+    return fallback;
+}
+
+size_t PosixDNSTransport::receive(uint8_t *buffer, size_t capacity,
+                                  DNSEndpoint &from) {
+    int index = readable();
+    if (index < 0) return 0;
+    sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    // MSG_TRUNC makes recvfrom report the real size of oversized datagrams
+    ssize_t n = recvfrom(_fds[index], buffer, capacity, MSG_TRUNC,
+                         (sockaddr *)&addr, &len);
+    if (n <= 0) return 0;
+    from.addr = addr.sin_addr.s_addr;
+    from.port = addr.sin_port;
+    from.local = _addresses[index];
+    return (size_t)n;
+}
+
+bool PosixDNSTransport::send(const DNSSlice *slices, size_t count,
+                             const DNSEndpoint &to) {
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = to.addr;
+    addr.sin_port = to.port;
+
+    iovec iov[DNS_TRANSPORT_MAX_SLICES];
+    size_t length = 0;
+    if (count > DNS_TRANSPORT_MAX_SLICES) return false;
+    for (size_t i = 0; i < count; i++) {
+        iov[i].iov_base = (void *)slices[i].data;
+        iov[i].iov_len = slices[i].length;
+        length += slices[i].length;
+    }
+
+    msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_name = &addr;
+    msg.msg_namelen = sizeof(addr);
+    msg.msg_iov = iov;
+    msg.msg_iovlen = count;
+    int fd = route(to);
+    if (IN_MULTICAST(ntohl(to.addr)) && to.local != 0) {
+        in_addr local;
+        local.s_addr = to.local;
+        setsockopt(fd, IPPROTO_IP, IP_MULTICAST_IF, &local, sizeof(local));
+    }
+    return sendmsg(fd, &msg, 0) == (ssize_t)length;
+}
+
+size_t PosixDNSTransport::receiveBatch(DNSDatagram *datagrams, size_t count) {
+    mmsghdr msgs[POSIX_DNS_MAX_BATCH];
+    iovec iov[POSIX_DNS_MAX_BATCH];
+    sockaddr_in addrs[POSIX_DNS_MAX_BATCH];
+
+    if (count > POSIX_DNS_MAX_BATCH) count = POSIX_DNS_MAX_BATCH;
+    memset(msgs, 0, count * sizeof(msgs[0]));
+    for (size_t i = 0; i < count; i++) {
+        iov[i].iov_base = datagrams[i].buffer;
+        iov[i].iov_len = datagrams[i].capacity;
+        msgs[i].msg_hdr.msg_iov = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+        msgs[i].msg_hdr.msg_name = &addrs[i];
+        msgs[i].msg_hdr.msg_namelen = sizeof(addrs[i]);
+    }
+
+    // The batch comes from one listener, the next one gets the next batch.
+    // MSG_TRUNC reports the real size of oversized datagrams.
+    int index = readable();
+    if (index < 0) return 0;
+    int n = recvmmsg(_fds[index], msgs, count, MSG_DONTWAIT | MSG_TRUNC, NULL);
+    if (n <= 0) return 0;
+    for (int i = 0; i < n; i++) {
+        datagrams[i].length = msgs[i].msg_len;
+        datagrams[i].from.addr = addrs[i].sin_addr.s_addr;
+        datagrams[i].from.port = addrs[i].sin_port;
+        datagrams[i].from.local = _addresses[index];
+    }
+    return n;
+}
+
+void PosixDNSTransport::sendBatch(const DNSReply *replies, size_t count) {
+    mmsghdr msgs[POSIX_DNS_MAX_BATCH];
+    iovec iov[POSIX_DNS_MAX_BATCH][DNS_TRANSPORT_MAX_SLICES];
+    sockaddr_in addrs[POSIX_DNS_MAX_BATCH];
+
+    while (count > 0) {
+        size_t n = 0, used = 0;
+        int fd = -1;
+        // Replies leaving through the same socket go out together
+        for (; used < count && n < POSIX_DNS_MAX_BATCH; used++) {
+            const DNSReply &reply = replies[used];
+            if (reply.count == 0) continue;
+            if (fd < 0) fd = route(reply.to);
+            if (route(reply.to) != fd) break;
+            memset(&msgs[n], 0, sizeof(msgs[n]));
+            memset(&addrs[n], 0, sizeof(addrs[n]));
+            addrs[n].sin_family = AF_INET;
+            addrs[n].sin_addr.s_addr = reply.to.addr;
+            addrs[n].sin_port = reply.to.port;
+            for (size_t s = 0; s < reply.count; s++) {
+                iov[n][s].iov_base = (void *)reply.slices[s].data;
+                iov[n][s].iov_len = reply.slices[s].length;
+            }
+            msgs[n].msg_hdr.msg_name = &addrs[n];
+            msgs[n].msg_hdr.msg_namelen = sizeof(addrs[n]);
+            msgs[n].msg_hdr.msg_iov = iov[n];
+            msgs[n].msg_hdr.msg_iovlen = reply.count;
+            n++;
+        }
+        // A datagram that fails to go out is dropped, like with send()
+        for (size_t sent = 0; sent < n;) {
+            int r = sendmmsg(fd, msgs + sent, n - sent, 0);
+            if (r <= 0) break;
+            sent += r;
+        }
+        replies += used;
+        count -= used;
+    }
+}
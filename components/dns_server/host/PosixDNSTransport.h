@@ -0,0 +1,60 @@
+#ifndef PosixDNSTransport_h
+#define PosixDNSTransport_h
+#include "DNSTransport.h"
+
+// Datagrams per recvmmsg()/sendmmsg() call
+#define POSIX_DNS_MAX_BATCH 64
+
+// DNSTransport on top of BSD UDP sockets, used to run DNSResponder on a
+// Linux host (benchmarks, local testing). Not built for the device. Like
+// LwipDNSTransport it may listen on several addresses at once, one socket
+// each, waiting on all of them with poll().
+class PosixDNSTransport : public DNSTransport {
+  public:
+    PosixDNSTransport();
+    ~PosixDNSTransport() { close(); };
+
+    // Binds listener 0 to `address` (network byte order) and `port` (host
+    // byte order, 0 picks an ephemeral port). A non-zero `receiveTimeoutMs`
+    // makes receive() return 0 when nothing arrives in time.
+    bool open(uint32_t address, uint16_t port, int receiveTimeoutMs);
+    void close();
+    // Listens on `address` as listener `index` too, on the port open() got,
+    // in place of what it listened on before, see LwipDNSTransport::listen
+    bool listen(size_t index, uint32_t address);
+    void stopListening(size_t index);
+    // Joins (or leaves) the multicast `group` on the interface at
+    // `interfaceAddress` with listener 0, see LwipDNSTransport::joinGroup
+    bool joinGroup(uint32_t group, uint32_t interfaceAddress, bool join);
+    // Port actually bound, in host byte order
+    uint16_t port() const { return _port; }
+
+    using DNSTransport::send;
+
+    size_t receive(uint8_t *buffer, size_t capacity,
+                   DNSEndpoint &from) override;
+    // Multicast goes out on the interface at `to.local`
+    bool send(const DNSSlice *slices, size_t count,
+              const DNSEndpoint &to) override;
+    void setReceiveTimeout(uint32_t timeoutMs) override {
+        _receiveTimeoutMs = (int)timeoutMs;
+    }
+    // recvmmsg()/sendmmsg(), one system call per batch and socket. Replies
+    // are unicast, multicast ones go through send().
+    size_t receiveBatch(DNSDatagram *datagrams, size_t count) override;
+    void sendBatch(const DNSReply *replies, size_t count) override;
+
+  private:
+    int _fds[DNS_TRANSPORT_MAX_LISTENERS]; // -1 if not listening
+    uint32_t _addresses[DNS_TRANSPORT_MAX_LISTENERS];
+    uint16_t _port;
+    int _receiveTimeoutMs;
+    // Listener looked at first, in turn like LwipDNSTransport
+    size_t _next;
+
+    // Index of a listener with a datagram queued, waiting for one up to the
+    // receive timeout, -1 if there is none
+    int readable();
+    int route(const DNSEndpoint &to) const;
+};
+#endif
@@ -1,5 +1,8 @@
 #pragma once
 #include <lwip/ip_addr.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -7,10 +10,82 @@ extern "C" {
 
 typedef struct DNSServer DNSServer;
 
+// Network interfaces served with a socket each, see
+// dns_server_set_interface
+#define DNS_SERVER_MAX_INTERFACES 2
+
+// Addresses per name and names of dns_server_add_record_set
+#define DNS_SERVER_MAX_SET_ADDRESSES 8
+#define DNS_SERVER_MAX_RECORD_SETS 4
+
+// Buckets of dns_server_metrics_t.latency
+#define DNS_SERVER_LATENCY_BUCKETS 12
+
+typedef struct {
+    uint32_t requests; // datagrams received
+    uint32_t ignored;  // datagrams not answered, rate limited ones included
+    uint32_t qtypes[4]; // questions for A, AAAA, ANY and anything else
+    uint32_t rcodes[16]; // replies by RCODE
+    uint32_t truncated;  // replies with TC set
+    uint32_t forwarded;  // queries relayed to the upstream resolver
+    uint32_t cache_hits; // answered from the cache of upstream replies
+    uint32_t rate_limit_dropped;
+    uint32_t rate_limit_truncated;
+    // Bucket i counts requests handled in less than 16 << i microseconds,
+    // the last one everything slower
+    uint32_t latency[DNS_SERVER_LATENCY_BUCKETS];
+    uint32_t stack_free; // bytes of the server task stack never used
+} dns_server_metrics_t;
+
 DNSServer *dns_server_init();
 void dns_server_delete(DNSServer *server);
 void dns_server_start(DNSServer *server, uint16_t port,
                       const char *domainName, const ip_addr_t *resolvedIP);
+// Serves interface `index` (a tcpip_adapter_if_t) at `address`, answering
+// names that resolve to 0.0.0.0 with the address of the interface asked.
+// Call again whenever the address changes, with NULL when the interface
+// goes down. Without any interface the server listens on all addresses.
+void dns_server_set_interface(DNSServer *server, uint8_t index,
+                              const ip_addr_t *address,
+                              const ip_addr_t *netmask);
+// Records and patterns may be changed while the server is running, without
+// dropping requests. Replaces every name and pattern like the domainName
+// given to dns_server_start().
+void dns_server_set_domain(DNSServer *server, const char *domainName,
+                           const ip_addr_t *resolvedIP);
+// Relays names without a record to the resolver at `upstream` and caches
+// its replies, instead of answering them from the patterns. NULL stops
+// relaying, e.g. when the station interface goes down.
+void dns_server_set_upstream(DNSServer *server, const ip_addr_t *upstream);
+bool dns_server_add_record(DNSServer *server, const char *name,
+                           const ip_addr_t *address);
+// Like dns_server_add_record, also answering AAAA queries with address6.
+// Names added without one get an empty NOERROR reply to AAAA queries.
+bool dns_server_add_record6(DNSServer *server, const char *name,
+                            const ip_addr_t *address,
+                            const uint8_t address6[16]);
+// Answers `name` with all `count` addresses, e.g. of several units serving
+// the same API. The address listed first, which most clients use, rotates
+// between them in proportion to `weights`, or round robin if NULL; an
+// address of weight 0 is left out.
+bool dns_server_add_record_set(DNSServer *server, const char *name,
+                               const ip_addr_t *addresses,
+                               const uint8_t *weights, size_t count);
+bool dns_server_remove_record(DNSServer *server, const char *name);
+bool dns_server_add_pattern(DNSServer *server, const char *pattern,
+                            uint16_t priority, const ip_addr_t *address);
+// Seconds clients may cache "no such name" and "no such record" replies
+void dns_server_set_negative_ttl(DNSServer *server, uint32_t ttl);
+// Limits each client to `rate` replies per second in bursts of up to
+// `burst`. Every `slip`th reply over the limit is sent truncated instead of
+// dropped (0 drops them all). A rate of 0 disables the limit.
+void dns_server_set_rate_limit(DNSServer *server, uint16_t rate,
+                               uint16_t burst, uint8_t slip);
+// Requests dropped because of the rate limit
+uint32_t dns_server_rate_limit_dropped(const DNSServer *server);
+// Copies the counters of a server, may be called from any task
+void dns_server_get_metrics(const DNSServer *server,
+                            dns_server_metrics_t *metrics);
 void dns_server_stop(DNSServer *server);
 #ifdef __cplusplus
 }
@@ -0,0 +1,28 @@
+#pragma once
+#include <lwip/ip_addr.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct MDNSServer MDNSServer;
+
+MDNSServer *mdns_server_init();
+void mdns_server_delete(MDNSServer *server);
+// Answers multicast DNS queries for `name` (e.g. "nile_a1b2c3.local") with
+// `address`, or with the address of the interface asked if it is 0.0.0.0.
+// Call before mdns_server_start().
+bool mdns_server_add_host(MDNSServer *server, const char *name,
+                          const ip_addr_t *address);
+// Serves interface `index` (a tcpip_adapter_if_t) at `address`, like
+// dns_server_set_interface. NULL takes the interface down.
+void mdns_server_set_interface(MDNSServer *server, uint8_t index,
+                               const ip_addr_t *address,
+                               const ip_addr_t *netmask);
+bool mdns_server_start(MDNSServer *server);
+void mdns_server_stop(MDNSServer *server);
+#ifdef __cplusplus
+}
+#endif
\ No newline at end of file
@@ -0,0 +1,29 @@
+#include "mdns_server.h"
+#include "MDNSServer.h"
+
+extern "C" {
+
+MDNSServer *mdns_server_init() { return new MDNSServer(); }
+
+void mdns_server_delete(MDNSServer *server) {
+    mdns_server_stop(server);
+    delete server;
+}
+
+bool mdns_server_add_host(MDNSServer *server, const char *name,
+                          const ip_addr_t *address) {
+    return server->addRecord(name, *address);
+}
+
+void mdns_server_set_interface(MDNSServer *server, uint8_t index,
+                               const ip_addr_t *address,
+                               const ip_addr_t *netmask) {
+    ip_addr_t none = IPADDR4_INIT(0);
+    server->setInterface(index, address != NULL ? *address : none,
+                         netmask != NULL ? *netmask : none);
+}
+
+bool mdns_server_start(MDNSServer *server) { return server->start(); }
+
+void mdns_server_stop(MDNSServer *server) { server->stop(); }
+}
\ No newline at end of file
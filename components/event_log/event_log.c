@@ -0,0 +1,84 @@
+#include "event_log.h"
+#include <FreeRTOS.h>
+#include <esp_log.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#include <stdio.h>
+
+// Records are formatted with printf, every argument as an unsigned int
+_Static_assert(sizeof(uintptr_t) == sizeof(unsigned),
+               "event log arguments must fit an unsigned int");
+
+#define EVENT_LOG_TASK_PRIORITY (tskIDLE_PRIORITY + 1)
+#define EVENT_LOG_TASK_STACK 2048
+#define EVENT_LOG_DRAIN_PERIOD_MS 50
+
+static const char level_letters[] = "NEWIDV";
+
+static event_log_ring_t *rings;
+// Held while the drain task walks the rings, so unregistering waits for
+// it to be done with the ring
+static SemaphoreHandle_t rings_lock;
+static TaskHandle_t drain_task;
+
+static void event_log_print(const event_log_ring_t *ring,
+                            const event_log_record_t *record) {
+    char message[96];
+    snprintf(message, sizeof(message), ring->formats[record->event],
+             (unsigned)record->args[0], (unsigned)record->args[1],
+             (unsigned)record->args[2]);
+    esp_log_write((esp_log_level_t)record->level, ring->tag, "%c (%u) %s: %s\n",
+                  level_letters[record->level], record->time, ring->tag,
+                  message);
+}
+
+static void event_log_drain(event_log_ring_t *ring) {
+    uint32_t lost = ring->lost - ring->reported;
+    while (ring->tail != ring->head) {
+        uint32_t tail = ring->tail;
+        event_log_print(ring, &ring->records[tail & (EVENT_LOG_RING_SIZE - 1)]);
+        EVENT_LOG_BARRIER();
+        ring->tail = tail + 1;
+    }
+    if (lost != 0) {
+        ring->reported += lost;
+        ESP_LOGW(ring->tag, "%u log records lost", lost);
+    }
+}
+
+static void event_log_task(void *parm) {
+    for (;;) {
+        xSemaphoreTake(rings_lock, portMAX_DELAY);
+        for (event_log_ring_t *ring = rings; ring != NULL; ring = ring->next)
+            event_log_drain(ring);
+        xSemaphoreGive(rings_lock);
+        vTaskDelay(EVENT_LOG_DRAIN_PERIOD_MS / portTICK_PERIOD_MS);
+    }
+}
+
+void event_log_register(event_log_ring_t *ring) {
+    // The first ring is registered during startup, before any other task
+    // could race for creating the lock
+    if (rings_lock == NULL) rings_lock = xSemaphoreCreateMutex();
+
+    xSemaphoreTake(rings_lock, portMAX_DELAY);
+    ring->next = rings;
+    rings = ring;
+    if (drain_task == NULL)
+        xTaskCreate(event_log_task, "EVENT_LOG_TASK", EVENT_LOG_TASK_STACK,
+                    NULL, EVENT_LOG_TASK_PRIORITY, &drain_task);
+    xSemaphoreGive(rings_lock);
+}
+
+void event_log_unregister(event_log_ring_t *ring) {
+    if (rings_lock == NULL) return;
+    xSemaphoreTake(rings_lock, portMAX_DELAY);
+    for (event_log_ring_t **link = &rings; *link != NULL;
+         link = &(*link)->next) {
+        if (*link == ring) {
+            *link = ring->next;
+            break;
+        }
+    }
+    xSemaphoreGive(rings_lock);
+}
@@ -0,0 +1,124 @@
+#pragma once
+// Deferred logging for hot paths. Instead of formatting a message, a call
+// site stores a small binary record (event id and up to three integer
+// arguments) in a ring; a low priority task formats and prints the records
+// later. Each ring has a single producer task, so writing a record needs no
+// lock. Events above EVENT_LOG_LEVEL are compiled out entirely.
+#include <esp_timer.h>
+#include <stdint.h>
+#ifdef ESP_PLATFORM
+#include <sdkconfig.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Same values as esp_log_level_t
+#define EVENT_LOG_ERROR 1
+#define EVENT_LOG_WARN 2
+#define EVENT_LOG_INFO 3
+#define EVENT_LOG_DEBUG 4
+#define EVENT_LOG_VERBOSE 5
+
+// Most verbose level compiled in, the ESP-IDF default log level unless set
+#ifndef EVENT_LOG_LEVEL
+#ifdef CONFIG_LOG_DEFAULT_LEVEL
+#define EVENT_LOG_LEVEL CONFIG_LOG_DEFAULT_LEVEL
+#else
+#define EVENT_LOG_LEVEL EVENT_LOG_INFO
+#endif
+#endif
+
+// Records per ring, a power of two
+#ifndef EVENT_LOG_RING_SIZE
+#define EVENT_LOG_RING_SIZE 32
+#endif
+
+typedef struct {
+    uint8_t level;
+    uint8_t event;
+    uint32_t time; // ms since boot
+    // Integers, or pointers to strings that outlive the record (literals,
+    // static tables), formatted with %u/%d/%x and %s respectively
+    uintptr_t args[3];
+} event_log_record_t;
+
+typedef struct event_log_ring {
+    const char *tag;
+    // printf formats indexed by event id
+    const char *const *formats;
+    // head is only written by the producer, tail only by the drain task
+    volatile uint32_t head;
+    volatile uint32_t tail;
+    volatile uint32_t lost; // records dropped because the ring was full
+    uint32_t reported;      // lost records already reported by the drain task
+    event_log_record_t records[EVENT_LOG_RING_SIZE];
+    struct event_log_ring *next;
+} event_log_ring_t;
+
+// Keeps the compiler from moving the stores of a record past the store of
+// head. Both the ESP8266 (single core) and x86 hosts keep stores in order,
+// so no fence instruction is needed.
+#define EVENT_LOG_BARRIER() __asm__ __volatile__("" ::: "memory")
+
+static inline void event_log_ring_init(event_log_ring_t *ring,
+                                       const char *tag,
+                                       const char *const *formats) {
+    ring->tag = tag;
+    ring->formats = formats;
+    ring->head = 0;
+    ring->tail = 0;
+    ring->lost = 0;
+    ring->reported = 0;
+    ring->next = 0;
+}
+
+// Called by the producer of the ring only
+static inline void event_log_write(event_log_ring_t *ring, uint8_t level,
+                                   uint8_t event, uintptr_t arg0,
+                                   uintptr_t arg1, uintptr_t arg2) {
+    uint32_t head = ring->head;
+    if (head - ring->tail >= EVENT_LOG_RING_SIZE) {
+        ring->lost++;
+        return;
+    }
+    event_log_record_t *record =
+        &ring->records[head & (EVENT_LOG_RING_SIZE - 1)];
+    record->level = level;
+    record->event = event;
+    record->time = (uint32_t)(esp_timer_get_time() / 1000);
+    record->args[0] = arg0;
+    record->args[1] = arg1;
+    record->args[2] = arg2;
+    EVENT_LOG_BARRIER();
+    ring->head = head + 1;
+}
+
+#define EVENT_LOG(ring, level, event, arg0, arg1, arg2)                        \
+    do {                                                                       \
+        if ((level) <= EVENT_LOG_LEVEL)                                        \
+            event_log_write((ring), (level), (event), (uintptr_t)(arg0),       \
+                            (uintptr_t)(arg1), (uintptr_t)(arg2));             \
+    } while (0)
+
+#define EVENT_LOGE(ring, event, a, b, c)                                       \
+    EVENT_LOG(ring, EVENT_LOG_ERROR, event, a, b, c)
+#define EVENT_LOGW(ring, event, a, b, c)                                       \
+    EVENT_LOG(ring, EVENT_LOG_WARN, event, a, b, c)
+#define EVENT_LOGI(ring, event, a, b, c)                                       \
+    EVENT_LOG(ring, EVENT_LOG_INFO, event, a, b, c)
+#define EVENT_LOGD(ring, event, a, b, c)                                       \
+    EVENT_LOG(ring, EVENT_LOG_DEBUG, event, a, b, c)
+#define EVENT_LOGV(ring, event, a, b, c)                                       \
+    EVENT_LOG(ring, EVENT_LOG_VERBOSE, event, a, b, c)
+
+// Adds a ring, initialized with event_log_ring_init(), to those printed by
+// the drain task, starting the task with the first ring. The ring must stay
+// valid until event_log_unregister() returns.
+void event_log_register(event_log_ring_t *ring);
+void event_log_unregister(event_log_ring_t *ring);
+
+#ifdef __cplusplus
+}
+#endif
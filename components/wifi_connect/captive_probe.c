@@ -0,0 +1,80 @@
+#include "./captive_probe.h"
+#include <stdio.h>
+#include <string.h>
+
+#define PROBE(path, online)                                                    \
+    { path, sizeof(path) - 1, online, sizeof(online) - 1 }
+
+static const char android_online[] = "HTTP/1.1 204 No Content\r\n"
+                                     "Content-Length: 0\r\n"
+                                     "\r\n";
+static const char apple_online[] =
+    "HTTP/1.1 200 OK\r\n"
+    "Content-Type: text/html\r\n"
+    "Content-Length: 68\r\n"
+    "\r\n"
+    "<HTML><HEAD><TITLE>Success</TITLE></HEAD><BODY>Success</BODY></HTML>";
+static const char windows_online[] = "HTTP/1.1 200 OK\r\n"
+                                     "Content-Type: text/plain\r\n"
+                                     "Content-Length: 22\r\n"
+                                     "\r\n"
+                                     "Microsoft Connect Test";
+static const char ncsi_online[] = "HTTP/1.1 200 OK\r\n"
+                                  "Content-Type: text/plain\r\n"
+                                  "Content-Length: 14\r\n"
+                                  "\r\n"
+                                  "Microsoft NCSI";
+
+// Sorted by path length, then path
+static const captive_probe_t probes[] = {
+    PROBE("/gen_204", android_online),
+    PROBE("/ncsi.txt", ncsi_online),
+    PROBE("/generate_204", android_online),
+    PROBE("/connecttest.txt", windows_online),
+    PROBE("/hotspot-detect.html", apple_online),
+    PROBE("/library/test/success.html", apple_online),
+};
+
+#define PROBE_COUNT (sizeof(probes) / sizeof(probes[0]))
+
+static char redirect[160];
+static size_t redirect_length;
+static bool online;
+
+bool captive_probes_init(const char *portal_host) {
+    int length = snprintf(redirect, sizeof(redirect),
+                          "HTTP/1.1 302 Found\r\n"
+                          "Location: http://%s/\r\n"
+                          "Cache-Control: no-store\r\n"
+                          "Content-Length: 0\r\n"
+                          "\r\n",
+                          portal_host);
+    if (length < 0 || (size_t)length >= sizeof(redirect)) {
+        redirect_length = 0;
+        return false;
+    }
+    redirect_length = (size_t)length;
+    return true;
+}
+
+void captive_probes_set_online(bool value) { online = value; }
+
+const captive_probe_t *captive_probe_find(const char *path, size_t len_path) {
+    for (size_t i = 0; i < PROBE_COUNT; i++) {
+        if (probes[i].path_length > len_path) break;
+        if (probes[i].path_length == len_path &&
+            memcmp(probes[i].path, path, len_path) == 0)
+            return &probes[i];
+    }
+    return NULL;
+}
+
+const char *captive_probe_response(const captive_probe_t *probe,
+                                   size_t *length) {
+    if (online || redirect_length == 0) {
+        *length = probe->online_length;
+        return probe->online;
+    }
+    *length = redirect_length;
+    return redirect;
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Connectivity checks phones and laptops run right after joining a network.
+// As long as they do not get the answer they expect, the OS opens the sign
+// in sheet, so they are answered with a redirect to the portal. The answers
+// are complete HTTP responses built once, sent as is.
+typedef struct {
+    const char *path;
+    size_t path_length;
+    // What the OS expects when it is online, sent once the device is
+    // configured so the sheet closes
+    const char *online;
+    size_t online_length;
+} captive_probe_t;
+
+// Builds the redirect to http://<portal_host>/. Returns false if the host
+// name is too long.
+bool captive_probes_init(const char *portal_host);
+// Answer probes with what they expect instead of the redirect
+void captive_probes_set_online(bool online);
+
+// Returns the probe at the first `len_path` characters of `path`, NULL if
+// it is not one
+const captive_probe_t *captive_probe_find(const char *path, size_t len_path);
+// The response to send for `probe`
+const char *captive_probe_response(const captive_probe_t *probe,
+                                   size_t *length);
+
+#ifdef __cplusplus
+}
+#endif
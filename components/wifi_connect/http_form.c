@@ -0,0 +1,114 @@
+#include "./http_form.h"
+#include <string.h>
+
+enum {
+    HTTP_FORM_NAME,
+    HTTP_FORM_VALUE,
+    HTTP_FORM_ESCAPE_HIGH, // after '%'
+    HTTP_FORM_ESCAPE_LOW,
+};
+
+void http_form_init(http_form_t *form, http_form_field_t *fields,
+                    size_t field_count) {
+    form->fields = fields;
+    form->field_count = field_count;
+    form->field = NULL;
+    form->name_length = 0;
+    form->state = HTTP_FORM_NAME;
+    form->status = HTTP_FORM_OK;
+    for (size_t i = 0; i < field_count; i++) {
+        fields[i].length = 0;
+        fields[i].seen = false;
+    }
+}
+
+static int hex_digit(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// Looks up the name just read. Names are compared as sent: browsers never
+// escape the ASCII names of form fields. A name too long for the buffer
+// has its length set past it, so it matches nothing.
+static void http_form_begin_value(http_form_t *form) {
+    form->field = NULL;
+    for (size_t i = 0; i < form->field_count; i++) {
+        http_form_field_t *field = &form->fields[i];
+        if (strlen(field->name) == form->name_length &&
+            memcmp(field->name, form->name, form->name_length) == 0) {
+            form->field = field;
+            field->length = 0;
+            field->seen = true;
+            break;
+        }
+    }
+    form->state = HTTP_FORM_VALUE;
+}
+
+static void http_form_put(http_form_t *form, uint8_t c) {
+    http_form_field_t *field = form->field;
+    if (field == NULL) return;
+    if (field->length == field->size) {
+        form->status = HTTP_FORM_TOO_LONG;
+        return;
+    }
+    field->value[field->length++] = c;
+}
+
+bool http_form_feed(http_form_t *form, const char *data, size_t length) {
+    for (size_t i = 0; i < length && form->status == HTTP_FORM_OK; i++) {
+        char c = data[i];
+        int digit;
+        switch (form->state) {
+            case HTTP_FORM_NAME:
+                if (c == '=') {
+                    http_form_begin_value(form);
+                } else if (c == '&') {
+                    // A name without a value, e.g. a checkbox
+                    form->name_length = 0;
+                } else if (form->name_length < sizeof(form->name)) {
+                    form->name[form->name_length++] = c;
+                } else {
+                    form->name_length = sizeof(form->name) + 1;
+                }
+                break;
+            case HTTP_FORM_VALUE:
+                if (c == '&') {
+                    form->field = NULL;
+                    form->name_length = 0;
+                    form->state = HTTP_FORM_NAME;
+                } else if (c == '%') {
+                    form->state = HTTP_FORM_ESCAPE_HIGH;
+                } else {
+                    http_form_put(form, c == '+' ? ' ' : (uint8_t)c);
+                }
+                break;
+            case HTTP_FORM_ESCAPE_HIGH:
+                if ((digit = hex_digit(c)) < 0) {
+                    form->status = HTTP_FORM_BAD_ENCODING;
+                    break;
+                }
+                form->hex = (uint8_t)digit;
+                form->state = HTTP_FORM_ESCAPE_LOW;
+                break;
+            case HTTP_FORM_ESCAPE_LOW:
+                if ((digit = hex_digit(c)) < 0) {
+                    form->status = HTTP_FORM_BAD_ENCODING;
+                    break;
+                }
+                http_form_put(form, (uint8_t)(form->hex << 4 | digit));
+                form->state = HTTP_FORM_VALUE;
+                break;
+        }
+    }
+    return form->status == HTTP_FORM_OK;
+}
+
+http_form_status_t http_form_finish(http_form_t *form) {
+    if (form->status == HTTP_FORM_OK && form->state != HTTP_FORM_NAME &&
+        form->state != HTTP_FORM_VALUE)
+        form->status = HTTP_FORM_BAD_ENCODING; // cut in an escape
+    return form->status;
+}
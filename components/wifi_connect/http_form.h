@@ -0,0 +1,55 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Longest field name looked for, longer names are skipped like unknown ones
+#define HTTP_FORM_NAME_MAX 16
+
+typedef enum {
+    HTTP_FORM_OK,
+    HTTP_FORM_TOO_LONG,     // a value does not fit its field
+    HTTP_FORM_BAD_ENCODING, // '%' not followed by two hex digits
+} http_form_status_t;
+
+// A field to fill in: `value` receives up to `size` decoded bytes, not
+// NUL-terminated, since values may hold any byte
+typedef struct {
+    const char *name;
+    uint8_t *value;
+    size_t size;
+    size_t length;
+    bool seen;
+} http_form_field_t;
+
+// Decodes an application/x-www-form-urlencoded body as it arrives, in
+// chunks of any size, straight into the fields. Only the name being read
+// is buffered, so the memory needed is fixed however long the body is.
+// Fields not asked for are skipped; a field given twice keeps the last
+// value.
+typedef struct {
+    http_form_field_t *fields;
+    size_t field_count;
+    http_form_field_t *field; // the value being read, NULL if skipped
+    char name[HTTP_FORM_NAME_MAX];
+    size_t name_length;
+    uint8_t state;
+    uint8_t hex; // high digit of a %XX escape
+    http_form_status_t status;
+} http_form_t;
+
+void http_form_init(http_form_t *form, http_form_field_t *fields,
+                    size_t field_count);
+// Feeds the next `length` bytes of the body. Returns false once the body
+// is known to be invalid, the rest of it may then be skipped.
+bool http_form_feed(http_form_t *form, const char *data, size_t length);
+// To be called at the end of the body
+http_form_status_t http_form_finish(http_form_t *form);
+
+#ifdef __cplusplus
+}
+#endif
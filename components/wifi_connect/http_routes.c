@@ -0,0 +1,296 @@
+#include "./http_routes.h"
+#include <string.h>
+
+// Set of trie nodes, one bit per node
+#define HTTP_ROUTE_SET_WORDS ((HTTP_ROUTES_MAX_NODES + 31) / 32)
+
+typedef struct {
+    uint32_t bits[HTTP_ROUTE_SET_WORDS];
+} http_route_set_t;
+
+void http_routes_init(http_routes_t *routes) {
+    memset(routes, 0, sizeof(*routes));
+    // Node 0 is the root, so 0 can mean "no node" everywhere else
+    routes->node_count = 1;
+    // With no routes the start state matches nothing
+    routes->state_count = 2;
+}
+
+static uint8_t http_routes_new_node(http_routes_t *routes) {
+    if (routes->node_count >= HTTP_ROUTES_MAX_NODES) return 0;
+    return (uint8_t)routes->node_count++;
+}
+
+// A '*' node loops back to itself. The root has no '*' child ever, but its
+// star field is 0 like its index.
+static bool http_routes_is_star(const http_routes_t *routes, uint8_t node) {
+    return node != 0 && routes->nodes[node].star == node;
+}
+
+static uint8_t http_routes_literal(const http_routes_t *routes, uint8_t node,
+                                   char c) {
+    uint8_t child = routes->nodes[node].first;
+    while (child != 0 && routes->nodes[child].c != c)
+        child = routes->nodes[child].next;
+    return child;
+}
+
+// Returns the child of `node` for pattern character `c`, adding it if
+// needed, or 0 if the trie is full
+static uint8_t http_routes_child(http_routes_t *routes, uint8_t node,
+                                 char c, bool wildcard) {
+    uint8_t child;
+    if (wildcard && c == '*') {
+        // "**" is the same as "*"
+        if (http_routes_is_star(routes, node)) return node;
+        if (routes->nodes[node].star == 0 &&
+            (child = http_routes_new_node(routes)) != 0) {
+            routes->nodes[child].star = child;
+            routes->nodes[node].star = child;
+        }
+        return routes->nodes[node].star;
+    }
+    if (wildcard && c == '?') {
+        if (routes->nodes[node].one == 0)
+            routes->nodes[node].one = http_routes_new_node(routes);
+        return routes->nodes[node].one;
+    }
+    child = http_routes_literal(routes, node, c);
+    if (child == 0 && (child = http_routes_new_node(routes)) != 0) {
+        routes->nodes[child].c = c;
+        routes->nodes[child].next = routes->nodes[node].first;
+        routes->nodes[node].first = child;
+    }
+    return child;
+}
+
+// Adds `node` and, since '*' also matches nothing, the '*' node below it
+static void http_route_set_enter(const http_routes_t *routes,
+                                 http_route_set_t *set, uint8_t node) {
+    uint8_t star = routes->nodes[node].star;
+    set->bits[node / 32] |= 1UL << (node % 32);
+    if (star != 0) set->bits[star / 32] |= 1UL << (star % 32);
+}
+
+static bool http_route_set_has(const http_route_set_t *set, size_t node) {
+    return (set->bits[node / 32] >> (node % 32)) & 1;
+}
+
+static bool http_route_set_empty(const http_route_set_t *set) {
+    for (size_t w = 0; w < HTTP_ROUTE_SET_WORDS; w++) {
+        if (set->bits[w] != 0) return false;
+    }
+    return true;
+}
+
+// Returns the state for a set of trie nodes, adding it if it is new, or 0
+// if there is no room left
+static uint8_t http_routes_intern(http_routes_t *routes,
+                                  http_route_set_t *sets,
+                                  const http_route_set_t *set) {
+    if (http_route_set_empty(set)) return 0;
+    for (size_t i = 1; i < routes->state_count; i++) {
+        if (memcmp(&sets[i], set, sizeof(*set)) == 0) return (uint8_t)i;
+    }
+    if (routes->state_count >= HTTP_ROUTES_MAX_STATES) return 0;
+    sets[routes->state_count] = *set;
+    return (uint8_t)routes->state_count++;
+}
+
+// Subset construction: every state stands for the set of trie nodes the
+// characters read so far can lead to. Characters no pattern spells out
+// literally all behave the same, they only get the state's `other` edge.
+bool http_routes_compile(http_routes_t *routes) {
+    // The node set of every state, only needed while compiling. Small with
+    // the limits sized to the routes served, and no heap block to find
+    // when the server starts.
+    static http_route_set_t sets[HTTP_ROUTES_MAX_STATES];
+    bool ok = true;
+    memset(&sets[1], 0, sizeof(sets[1]));
+    http_route_set_enter(routes, &sets[1], 0);
+    memset(&routes->states[0], 0, sizeof(routes->states[0]));
+    routes->state_count = 2;
+    routes->edge_count = 0;
+    for (size_t s = 1; ok && s < routes->state_count; s++) {
+        http_route_set_t current = sets[s], other;
+        uint32_t chars[256 / 32];
+        uint8_t route = 0;
+
+        memset(&other, 0, sizeof(other));
+        memset(chars, 0, sizeof(chars));
+        for (size_t n = 0; n < routes->node_count; n++) {
+            if (!http_route_set_has(&current, n)) continue;
+            const http_route_node_t *node = &routes->nodes[n];
+            if (node->route != 0 && (route == 0 || node->route < route))
+                route = node->route;
+            if (node->one != 0) http_route_set_enter(routes, &other, node->one);
+            if (http_routes_is_star(routes, (uint8_t)n))
+                http_route_set_enter(routes, &other, (uint8_t)n);
+            for (uint8_t child = node->first; child != 0;
+                 child = routes->nodes[child].next) {
+                uint8_t c = (uint8_t)routes->nodes[child].c;
+                chars[c / 32] |= 1UL << (c % 32);
+            }
+        }
+
+        http_route_state_t *state = &routes->states[s];
+        state->route = route;
+        state->other = http_routes_intern(routes, sets, &other);
+        state->edges = (uint16_t)routes->edge_count;
+        state->edge_count = 0;
+        for (size_t c = 0; ok && c < 256; c++) {
+            if (!((chars[c / 32] >> (c % 32)) & 1)) continue;
+            http_route_set_t next = other;
+            for (size_t n = 0; n < routes->node_count; n++) {
+                if (!http_route_set_has(&current, n)) continue;
+                uint8_t child =
+                    http_routes_literal(routes, (uint8_t)n, (char)c);
+                if (child != 0) http_route_set_enter(routes, &next, child);
+            }
+            uint8_t target = http_routes_intern(routes, sets, &next);
+            if (target == 0 || routes->edge_count >= HTTP_ROUTES_MAX_EDGES) {
+                ok = false;
+                break;
+            }
+            if (target == state->other) continue;
+            routes->edges[routes->edge_count].c = (uint8_t)c;
+            routes->edges[routes->edge_count].next = target;
+            routes->edge_count++;
+            state->edge_count++;
+        }
+        // The set was not empty but no state was left for it
+        if (state->other == 0 && !http_route_set_empty(&other)) ok = false;
+        // Most states only go on along one literal, which is kept in the
+        // state itself. Without an edge, `next` is just `other`.
+        state->c = 0;
+        state->next = state->other;
+        if (state->edge_count == 1) {
+            routes->edge_count--;
+            state->c = routes->edges[routes->edge_count].c;
+            state->next = routes->edges[routes->edge_count].next;
+        }
+    }
+    if (!ok) {
+        // Match nothing rather than through a half-built automaton
+        memset(&routes->states[1], 0, sizeof(routes->states[1]));
+        routes->state_count = 2;
+        routes->edge_count = 0;
+    }
+    return ok;
+}
+
+// Takes the nodes from `node_count` on back out of the trie, with the
+// links older nodes have to them. Adding a pattern links each older node
+// to at most one new node, a new literal child being put first.
+static void http_routes_truncate(http_routes_t *routes, size_t node_count) {
+    for (size_t n = 0; n < node_count; n++) {
+        http_route_node_t *node = &routes->nodes[n];
+        if (node->first >= node_count)
+            node->first = routes->nodes[node->first].next;
+        if (node->one >= node_count) node->one = 0;
+        if (node->star >= node_count) node->star = 0;
+    }
+    memset(&routes->nodes[node_count], 0,
+           (routes->node_count - node_count) * sizeof(routes->nodes[0]));
+    routes->node_count = node_count;
+}
+
+bool http_routes_add(http_routes_t *routes, int method, const char *pattern,
+                     void *target) {
+    if (routes->route_count >= HTTP_ROUTES_MAX) return false;
+    size_t node_count = routes->node_count;
+    uint8_t node = http_routes_child(routes, 0, (char)method, false);
+    for (const char *p = pattern; node != 0 && *p != '\0'; p++)
+        node = http_routes_child(routes, node, *p, true);
+    if (node == 0) {
+        // Nodes that end no route still make states of their own, so those
+        // of a pattern that does not fit must go again
+        http_routes_truncate(routes, node_count);
+        return false;
+    }
+    routes->targets[routes->route_count++] = target;
+    if (routes->nodes[node].route == 0)
+        routes->nodes[node].route = (uint8_t)routes->route_count;
+    return true;
+}
+
+void *http_routes_find(const http_routes_t *routes, int method,
+                       const char *uri, size_t len_uri) {
+    const http_route_edge_t *edges = routes->edges;
+    uint8_t state = 1;
+    uint8_t c = (uint8_t)method;
+    size_t i = 0;
+    for (;;) {
+        const http_route_state_t *current = &routes->states[state];
+        if (current->edge_count <= 1) {
+            state = c == current->c ? current->next : current->other;
+        } else {
+            // Edges are sorted by character
+            const http_route_edge_t *edge = edges + current->edges;
+            size_t low = 0, high = current->edge_count;
+            while (low < high) {
+                size_t middle = (low + high) / 2;
+                if (edge[middle].c < c)
+                    low = middle + 1;
+                else
+                    high = middle;
+            }
+            state = low < current->edge_count && edge[low].c == c
+                        ? edge[low].next
+                        : current->other;
+        }
+        if (state == 0) return NULL;
+        if (i == len_uri) break;
+        c = (uint8_t)uri[i++];
+    }
+    uint8_t route = routes->states[state].route;
+    return route != 0 ? routes->targets[route - 1] : NULL;
+}
+
+bool httpd_uri_match_glob(const char *pattern, const char *uri,
+                          size_t len_uri) {
+    const size_t len_pattern = strlen(pattern);
+    int px = 0;
+    int ux = 0;
+    int nextPx = 0;
+    int nextUx = 0;
+    char c;
+    while (px < len_pattern || ux < len_uri) {
+        if (px < len_pattern) {
+            c = pattern[px];
+            switch (c) {
+                default: // ordinary character
+                    if (ux < len_uri && uri[ux] == c) {
+                        px++;
+                        ux++;
+                        continue;
+                    }
+                    break;
+                case '?': // single-character wildcard
+                    if (ux < len_uri) {
+                        px++;
+                        ux++;
+                        continue;
+                    }
+                    break;
+                case '*': // zero-or-more-character wildcard
+                    // Try to match at ux.
+                    // If that doesn't work out,
+                    // restart at ux+1 next.
+                    nextPx = px;
+                    nextUx = ux + 1;
+                    px++;
+                    continue;
+            }
+        }
+        // Mismatch. Maybe restart.
+        if (0 < nextUx && nextUx <= len_uri) {
+            px = nextPx;
+            ux = nextUx;
+            continue;
+        }
+        return false;
+    }
+    // Matched all of pattern to all of uri. Success.
+    return true;
+}
@@ -0,0 +1,98 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Patterns are URIs in which '?' matches any one character and '*' any
+// sequence, like httpd_uri_match_glob(). Routes are added to a trie keyed
+// by the method followed by the pattern, which is then compiled once into
+// a deterministic automaton, so a request is routed in a single pass over
+// its URI with one transition per character, however many routes there
+// are.
+#ifndef HTTP_ROUTES_MAX
+#define HTTP_ROUTES_MAX 8
+#endif
+// Sized for the portal's routes (http_server.c), with room to spare. Node
+// and state indices are 8 bit, so neither can go above 255. Without '*' in
+// the middle of patterns there are about as many states as nodes, one per
+// pattern character. Each '*' in the middle can multiply the states,
+// though: a set of patterns the glob matcher handled may not compile, and
+// http_routes_compile() then refuses it. host/http_route_bench checks a
+// larger set against these limits raised.
+#ifndef HTTP_ROUTES_MAX_NODES
+#define HTTP_ROUTES_MAX_NODES 63
+#endif
+#ifndef HTTP_ROUTES_MAX_STATES
+#define HTTP_ROUTES_MAX_STATES 63
+#endif
+#ifndef HTTP_ROUTES_MAX_EDGES
+#define HTTP_ROUTES_MAX_EDGES 64
+#endif
+
+// Trie node, wildcards are children of their own
+typedef struct {
+    char c;        // character of the edge into a literal node
+    uint8_t first; // first literal child, 0 if none
+    uint8_t next;  // next sibling literal node
+    uint8_t one;   // child for '?', 0 if none
+    uint8_t star;  // child for '*', 0 if none; a '*' node is its own child
+    uint8_t route; // index + 1 of the first route ending here, 0 if none
+} http_route_node_t;
+
+// Automaton state: `edge_count` edges sorted by character starting at
+// `edges`, and the state any other character leads to. A single edge is
+// kept in the state as `c` and `next` instead. State 0 matches nothing,
+// state 1 is the start.
+typedef struct {
+    uint16_t edges;
+    uint8_t edge_count;
+    uint8_t other;
+    uint8_t route; // index + 1 of the route matched if the URI ends here
+    uint8_t c;
+    uint8_t next; // `other` if there is no edge
+} http_route_state_t;
+
+typedef struct {
+    uint8_t c;
+    uint8_t next;
+} http_route_edge_t;
+
+typedef struct {
+    http_route_node_t nodes[HTTP_ROUTES_MAX_NODES];
+    size_t node_count;
+    http_route_state_t states[HTTP_ROUTES_MAX_STATES];
+    size_t state_count;
+    http_route_edge_t edges[HTTP_ROUTES_MAX_EDGES];
+    size_t edge_count;
+    void *targets[HTTP_ROUTES_MAX];
+    size_t route_count;
+} http_routes_t;
+
+void http_routes_init(http_routes_t *routes);
+// Adds a route to `target`. Routes added first win when several match.
+// Returns false, leaving the table as it was, if the table is full. Takes
+// effect once the routes are compiled.
+bool http_routes_add(http_routes_t *routes, int method, const char *pattern,
+                     void *target);
+// Builds the automaton of the routes added, before any request is routed:
+// http_routes_find() must not run meanwhile. Returns false if it needs more
+// than HTTP_ROUTES_MAX_STATES states or HTTP_ROUTES_MAX_EDGES edges, and
+// the table then matches nothing.
+bool http_routes_compile(http_routes_t *routes);
+// Returns the target of the first route matching the first `len_uri`
+// characters of `uri`, NULL if there is none. Does not allocate.
+void *http_routes_find(const http_routes_t *routes, int method,
+                       const char *uri, size_t len_uri);
+
+// The backtracking matcher the route table replaced, kept as the reference
+// for its semantics
+bool httpd_uri_match_glob(const char *pattern, const char *uri,
+                          size_t len_uri);
+
+#ifdef __cplusplus
+}
+#endif
@@ -1,75 +1,447 @@
 #include "./http_server.h"
-#include <esp_log.h>
+#include "./captive_probe.h"
+#include "./http_routes.h"
+#include "./http_workers_esp.h"
+#include "./web_bundle.h"
+#include "./wifi_fast_connect.h"
+#include "./wifi_scan.h"
 #include <esp_http_server.h>
+#include <esp_log.h>
+#include <esp_system.h>
+#include <esp_timer.h>
+#include <event_log.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <tcpip_adapter.h>
 
 const static char *TAG = "http_server";
 
-static esp_err_t http_get_handler(httpd_req_t *req) {
-    httpd_resp_send(req, "Hello World!", -1);
-    return ESP_OK;
+// Bucket i counts requests handled in less than 1 << i milliseconds, the
+// last one everything slower
+#define HTTP_LATENCY_BUCKETS 12
+
+// Counters of one URI handler. Handlers all run in the httpd task, which is
+// the only writer, so they are plain increments of aligned 32 bit words and
+// the /metrics handler can read them without locking.
+typedef struct {
+    const char *name;
+    uint32_t requests;
+    uint32_t errors; // handler returned something else than ESP_OK
+    uint32_t latency[HTTP_LATENCY_BUCKETS];
+} http_metrics_t;
+
+static http_metrics_t probes_metrics = {.name = "probes"};
+static http_metrics_t assets_metrics = {.name = "assets"};
+static http_metrics_t metrics_metrics = {.name = "metrics"};
+static http_metrics_t scan_metrics = {.name = "scan"};
+static DNSServer *dns_server;
+static http_provision_fn provision;
+static httpd_handle_t server;
+
+// Events logged through event_log, see event_log.h. Route patterns are
+// static; the request URI is not, so only its length is kept.
+enum {
+    HTTP_EVENT_ROUTE,
+    HTTP_EVENT_NO_ROUTE,
+};
+
+static const char *const http_event_formats[] = {
+    "matching: '%s' - %u byte URI",
+    "no route for %u byte URI",
+};
+
+static http_routes_t routes;
+
+// Written by the httpd task only
+static event_log_ring_t event_log;
+
+static esp_err_t http_count(http_metrics_t *metrics, int64_t begin,
+                            esp_err_t err) {
+    uint32_t ms = (uint32_t)((esp_timer_get_time() - begin) / 1000);
+    size_t bucket = 0;
+    while (bucket < HTTP_LATENCY_BUCKETS - 1 && ms >= (1U << bucket))
+        bucket++;
+    metrics->latency[bucket]++;
+    metrics->requests++;
+    if (err != ESP_OK) metrics->errors++;
+    return err;
+}
+
+// Returns true if the If-None-Match header of the request lists `etag`
+static bool http_etag_matches(httpd_req_t *req, const char *etag) {
+    char value[64];
+    if (httpd_req_get_hdr_value_str(req, "If-None-Match", value,
+                                    sizeof(value)) != ESP_OK)
+        return false;
+    return strstr(value, etag) != NULL || strcmp(value, "*") == 0;
+}
+
+// Serves the packed web directory straight from flash. Bodies are gzipped
+// at build time, every browser a phone brings up for a captive portal
+// accepts that. Paths without an asset get the portal page, whatever site
+// the user tried to open.
+static esp_err_t http_asset_handler(httpd_req_t *req) {
+    int64_t begin = esp_timer_get_time();
+    size_t len_uri = strcspn(req->uri, "?");
+    const web_asset_t *asset = web_bundle_find(req->uri, len_uri);
+    if (asset == NULL) asset = web_bundle_find("/index.html", 11);
+    if (asset == NULL)
+        return http_count(&assets_metrics, begin, httpd_resp_send_404(req));
+
+    httpd_resp_set_hdr(req, "ETag", asset->etag);
+    httpd_resp_set_hdr(req, "Cache-Control", asset->cache_control);
+    httpd_resp_set_hdr(req, "Vary", "Accept-Encoding");
+    if (http_etag_matches(req, asset->etag)) {
+        httpd_resp_set_status(req, "304 Not Modified");
+        return http_count(&assets_metrics, begin,
+                          httpd_resp_send(req, NULL, 0));
+    }
+    httpd_resp_set_type(req, asset->content_type);
+    httpd_resp_set_hdr(req, "Content-Encoding", "gzip");
+    return http_count(&assets_metrics, begin,
+                      httpd_resp_send(req, (const char *)asset->body,
+                                      asset->body_length));
 }
 
-static const httpd_uri_t hello = {
+static const httpd_uri_t assets = {
     .uri = "/*",
     .method = HTTP_GET,
-    .handler = http_get_handler,
+    .handler = http_asset_handler,
     .user_ctx = NULL,
 };
 
-bool httpd_uri_match_glob(const char *pattern, const char *uri,
-                          size_t len_uri) {
-    const size_t len_pattern = strlen(pattern);
-    int px = 0;
-    int ux = 0;
-    int nextPx = 0;
-    int nextUx = 0;
-    char c;
-    while (px < len_pattern || ux < len_uri) {
-        if (px < len_pattern) {
-            c = pattern[px];
-            switch (c) {
-                default: // ordinary character
-                    if (ux < len_uri && uri[ux] == c) {
-                        px++;
-                        ux++;
-                        continue;
-                    }
-                    break;
-                case '?': // single-character wildcard
-                    if (ux < len_uri) {
-                        px++;
-                        ux++;
-                        continue;
-                    }
-                    break;
-                case '*': // zero-or-more-character wildcard
-                    // Try to match at ux.
-                    // If that doesn't work out,
-                    // restart at ux+1 next.
-                    nextPx = px;
-                    nextUx = ux + 1;
-                    px++;
-                    continue;
-            }
-        }
-        // Mismatch. Maybe restart.
-        if (0 < nextUx && nextUx <= len_uri) {
-            px = nextPx;
-            ux = nextUx;
-            continue;
-        }
-        ESP_LOGI(TAG, "not matching: '%s' - '%s'", pattern, uri);
+// Networks around, as the background scan last saw them. Asking starts a
+// new scan when the results are stale; the page polls while "scanning" is
+// true. The JSON is streamed through a small buffer on the httpd task
+// stack, one network at a time.
+static esp_err_t http_scan_handler(httpd_req_t *req) {
+    int64_t begin = esp_timer_get_time();
+    uint32_t now = (uint32_t)(begin / 1000);
+    wifi_scan_request(now);
+
+    wifi_scan_json_t json;
+    char buffer[128];
+    size_t length;
+    esp_err_t err = ESP_OK;
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+    wifi_scan_json_begin(&json, now);
+    while (err == ESP_OK &&
+           (length = wifi_scan_json_read(&json, buffer, sizeof(buffer))) != 0)
+        err = httpd_resp_send_chunk(req, buffer, length);
+    if (err == ESP_OK) err = httpd_resp_send_chunk(req, NULL, 0);
+    return http_count(&scan_metrics, begin, err);
+}
+
+static const httpd_uri_t scan = {
+    .uri = "/api/scan",
+    .method = HTTP_GET,
+    .handler = http_scan_handler,
+    .user_ctx = NULL,
+};
+
+// Lines of the /metrics page are collected here and sent as chunks
+typedef struct {
+    httpd_req_t *req;
+    char buffer[256];
+    size_t length;
+    esp_err_t err;
+} metrics_writer_t;
+
+static void metrics_flush(metrics_writer_t *writer) {
+    if (writer->length != 0 && writer->err == ESP_OK)
+        writer->err =
+            httpd_resp_send_chunk(writer->req, writer->buffer, writer->length);
+    writer->length = 0;
+}
+
+static void metrics_line(metrics_writer_t *writer, const char *format, ...)
+    __attribute__((format(printf, 2, 3)));
+
+static void metrics_line(metrics_writer_t *writer, const char *format, ...) {
+    va_list args;
+    char line[96];
+    va_start(args, format);
+    int length = vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    if (length < 0) return;
+    if ((size_t)length >= sizeof(line)) length = sizeof(line) - 1;
+    if (writer->length + length > sizeof(writer->buffer))
+        metrics_flush(writer);
+    memcpy(writer->buffer + writer->length, line, length);
+    writer->length += length;
+}
+
+// Cumulative histogram in the Prometheus text format, bucket i of `counts`
+// holds values below `unit << i`
+static void metrics_histogram(metrics_writer_t *writer, const char *metric,
+                              const char *labels, const uint32_t *counts,
+                              size_t buckets, uint32_t unit) {
+    uint32_t total = 0;
+    for (size_t i = 0; i < buckets; i++) {
+        total += counts[i];
+        if (i < buckets - 1)
+            metrics_line(writer, "%s_bucket{%sle=\"%u\"} %u\n", metric,
+                         labels, unit << i, total);
+        else
+            metrics_line(writer, "%s_bucket{%sle=\"+Inf\"} %u\n", metric,
+                         labels, total);
+    }
+    metrics_line(writer, "%s_count{%s} %u\n", metric, labels, total);
+}
+
+static void metrics_http(metrics_writer_t *writer,
+                         const http_metrics_t *metrics) {
+    char labels[32];
+    snprintf(labels, sizeof(labels), "handler=\"%s\",", metrics->name);
+    metrics_line(writer, "http_requests_total{%s} %u\n", labels,
+                 metrics->requests);
+    metrics_line(writer, "http_errors_total{%s} %u\n", labels,
+                 metrics->errors);
+    metrics_histogram(writer, "http_latency_ms", labels, metrics->latency,
+                      HTTP_LATENCY_BUCKETS, 1);
+}
+
+static void metrics_workers(metrics_writer_t *writer) {
+    http_workers_metrics_t metrics;
+    http_workers_get_metrics(&metrics);
+    metrics_line(writer, "http_jobs_total{result=\"queued\"} %u\n",
+                 metrics.submitted);
+    metrics_line(writer, "http_jobs_total{result=\"rejected\"} %u\n",
+                 metrics.rejected);
+    metrics_line(writer, "http_jobs_total{result=\"canceled\"} %u\n",
+                 metrics.canceled);
+    metrics_line(writer, "http_jobs_max_busy %u\n", metrics.max_busy);
+    metrics_histogram(writer, "http_job_latency_ms", "", metrics.latency,
+                      HTTP_WORKERS_LATENCY_BUCKETS, 1);
+}
+
+static void metrics_dns(metrics_writer_t *writer, DNSServer *server) {
+    static const char *qtypes[] = {"A", "AAAA", "ANY", "other"};
+    dns_server_metrics_t metrics;
+    dns_server_get_metrics(server, &metrics);
+
+    metrics_line(writer, "dns_requests_total %u\n", metrics.requests);
+    metrics_line(writer, "dns_ignored_total %u\n", metrics.ignored);
+    for (size_t i = 0; i < sizeof(qtypes) / sizeof(*qtypes); i++)
+        metrics_line(writer, "dns_questions_total{qtype=\"%s\"} %u\n",
+                     qtypes[i], metrics.qtypes[i]);
+    for (size_t i = 0; i < sizeof(metrics.rcodes) / sizeof(*metrics.rcodes);
+         i++) {
+        if (metrics.rcodes[i] != 0)
+            metrics_line(writer, "dns_replies_total{rcode=\"%u\"} %u\n",
+                         (unsigned)i, metrics.rcodes[i]);
+    }
+    metrics_line(writer, "dns_truncated_total %u\n", metrics.truncated);
+    metrics_line(writer, "dns_forwarded_total %u\n", metrics.forwarded);
+    metrics_line(writer, "dns_cache_hits_total %u\n", metrics.cache_hits);
+    metrics_line(writer, "dns_rate_limited_total{action=\"drop\"} %u\n",
+                 metrics.rate_limit_dropped);
+    metrics_line(writer, "dns_rate_limited_total{action=\"truncate\"} %u\n",
+                 metrics.rate_limit_truncated);
+    metrics_histogram(writer, "dns_latency_us", "", metrics.latency,
+                      DNS_SERVER_LATENCY_BUCKETS, 16);
+    metrics_line(writer, "dns_task_stack_free_bytes %u\n",
+                 metrics.stack_free);
+}
+
+static void metrics_wifi(metrics_writer_t *writer) {
+    wifi_fast_connect_metrics_t metrics;
+    wifi_fast_connect_get_metrics(&metrics);
+    metrics_line(writer, "wifi_connections_total{path=\"lease\"} %u\n",
+                 metrics.fast);
+    metrics_line(writer, "wifi_connections_total{path=\"scan\"} %u\n",
+                 metrics.full);
+    metrics_line(writer, "wifi_lease_fallbacks_total %u\n",
+                 metrics.fallbacks);
+    metrics_histogram(writer, "wifi_connect_ms", "", metrics.latency,
+                      WIFI_FAST_CONNECT_BUCKETS, WIFI_FAST_CONNECT_MIN_MS);
+}
+
+// Plain text counters in the Prometheus exposition format. Everything is
+// formatted into a small buffer on the httpd task stack, so the page costs
+// no heap however many lines it grows to.
+static esp_err_t http_metrics_handler(httpd_req_t *req) {
+    int64_t begin = esp_timer_get_time();
+    metrics_writer_t writer = {.req = req, .length = 0, .err = ESP_OK};
+
+    httpd_resp_set_type(req, "text/plain; version=0.0.4");
+    metrics_line(&writer, "heap_free_bytes %u\n",
+                 esp_get_free_heap_size());
+    metrics_line(&writer, "heap_min_free_bytes %u\n",
+                 esp_get_minimum_free_heap_size());
+    metrics_http(&writer, &probes_metrics);
+    metrics_http(&writer, &assets_metrics);
+    metrics_http(&writer, &metrics_metrics);
+    metrics_http(&writer, &scan_metrics);
+    metrics_workers(&writer);
+    metrics_wifi(&writer);
+    if (dns_server != NULL) metrics_dns(&writer, dns_server);
+    metrics_flush(&writer);
+    if (writer.err == ESP_OK)
+        writer.err = httpd_resp_send_chunk(req, NULL, 0);
+    return http_count(&metrics_metrics, begin, writer.err);
+}
+
+static const httpd_uri_t metrics = {
+    .uri = "/metrics",
+    .method = HTTP_GET,
+    .handler = http_metrics_handler,
+    .user_ctx = NULL,
+};
+
+// Reads and checks the body of the connect form into the job, in chunks
+// through a small buffer on the httpd task stack. Rejects it here, so that
+// only valid credentials take up a worker.
+static bool http_connect_prepare(httpd_req_t *req, http_job_t *job) {
+    wifi_credentials_parser_t parser;
+    char chunk[64];
+    int timeouts = 0;
+    wifi_credentials_parser_init(&parser, (wifi_credentials_t *)job->data);
+
+    if (req->content_len > WIFI_CREDENTIALS_BODY_MAX) {
+        httpd_resp_set_status(req, "413 Payload Too Large");
+        httpd_resp_send(req, NULL, 0);
         return false;
     }
-    // Matched all of pattern to all of uri. Success.
-    ESP_LOGI(TAG, "matching: '%s' - '%s'", pattern, uri);
+    size_t remaining = req->content_len;
+    while (remaining > 0) {
+        int length = httpd_req_recv(
+            req, chunk, remaining < sizeof(chunk) ? remaining : sizeof(chunk));
+        // A client that stops sending is not waited for long, the httpd
+        // task serves nobody else meanwhile
+        if (length == HTTPD_SOCK_ERR_TIMEOUT && ++timeouts < 2) continue;
+        if (length == HTTPD_SOCK_ERR_TIMEOUT) {
+            httpd_resp_send_408(req);
+            return false;
+        }
+        // The connection is gone, nobody to answer
+        if (length <= 0) return false;
+        remaining -= length;
+        // The rest of an invalid body is drained by the server
+        if (!wifi_credentials_parser_feed(&parser, chunk, length)) break;
+    }
+    const char *error = wifi_credentials_parser_finish(&parser);
+    if (error == NULL) return true;
+    httpd_resp_set_status(req, "400 Bad Request");
+    httpd_resp_set_type(req, "text/plain");
+    httpd_resp_send(req, error, strlen(error));
+    return false;
+}
+
+// Storing the credentials writes flash, which takes long enough to hold
+// up every other request, so it runs in a worker
+static void http_connect_run(http_job_t *job) {
+    static const char page[] =
+        "<!DOCTYPE html><meta name=\"viewport\" "
+        "content=\"width=device-width\"><title>Nile setup</title>"
+        "<p>Connecting to your network, this page can be closed.";
+    static const char failed[] = "The network could not be stored";
+    if (!provision((const wifi_credentials_t *)job->data)) {
+        http_job_respond(job, "500 Internal Server Error", "text/plain",
+                         failed, sizeof(failed) - 1);
+        return;
+    }
+    http_job_respond(job, "200 OK", "text/html", page, sizeof(page) - 1);
+}
+
+static const http_async_route_t connect = {
+    .uri =
+        {
+            .uri = "/api/connect",
+            .method = HTTP_POST,
+            .handler = http_async_handler,
+            .user_ctx = (void *)&connect,
+        },
+    .prepare = http_connect_prepare,
+    .run = http_connect_run,
+};
+
+_Static_assert(sizeof(wifi_credentials_t) <= HTTP_JOB_DATA_MAX,
+               "wifi_credentials_t does not fit the data of a job");
+
+// esp_http_server tries every handler in turn, so it only gets one
+// catch-all handler per method and requests are routed by http_dispatch()
+static bool http_match_any(const char *pattern, const char *uri,
+                           size_t len_uri) {
     return true;
 }
 
-void http_server_start(void) {
-    httpd_handle_t server = NULL;
+// Connectivity checks get their prebuilt response before any routing, the
+// sooner they are answered the sooner the phone shows the portal
+static esp_err_t http_probe(httpd_req_t *req,
+                            const captive_probe_t *probe) {
+    int64_t begin = esp_timer_get_time();
+    size_t length;
+    const char *response = captive_probe_response(probe, &length);
+    esp_err_t err =
+        httpd_send(req, response, length) == (int)length ? ESP_OK : ESP_FAIL;
+    return http_count(&probes_metrics, begin, err);
+}
+
+static esp_err_t http_dispatch(httpd_req_t *req) {
+    // The query string is not part of the path
+    size_t len_uri = strcspn(req->uri, "?");
+    const captive_probe_t *probe;
+    if (req->method == HTTP_GET &&
+        (probe = captive_probe_find(req->uri, len_uri)) != NULL)
+        return http_probe(req, probe);
+
+    const httpd_uri_t *route =
+        http_routes_find(&routes, req->method, req->uri, len_uri);
+    if (route == NULL) {
+        EVENT_LOGD(&event_log, HTTP_EVENT_NO_ROUTE, len_uri, 0, 0);
+        return httpd_resp_send_404(req);
+    }
+    EVENT_LOGD(&event_log, HTTP_EVENT_ROUTE, route->uri, len_uri, 0);
+    req->user_ctx = route->user_ctx;
+    return route->handler(req);
+}
+
+// Matched in this order; assets matches everything, so it goes last
+static const httpd_uri_t *const http_server_routes[] = {
+    &metrics,
+    &scan,
+    &connect.uri,
+    &assets,
+};
+
+#define HTTP_SERVER_ROUTE_COUNT                                                \
+    (sizeof(http_server_routes) / sizeof(http_server_routes[0]))
+
+void http_server_start(DNSServer *dnsServer, http_provision_fn value) {
     httpd_config_t config = HTTPD_DEFAULT_CONFIG();
-    config.uri_match_fn = httpd_uri_match_glob;
+    config.uri_match_fn = http_match_any;
+    dns_server = dnsServer;
+    provision = value;
+    if (server != NULL) return;
+    event_log_ring_init(&event_log, TAG, http_event_formats);
+    event_log_register(&event_log);
+    // Everything requests are routed through is ready before the server
+    // takes the first one, the access point is already up
+    http_routes_init(&routes);
+    for (size_t i = 0; i < HTTP_SERVER_ROUTE_COUNT; i++) {
+        const httpd_uri_t *uri = http_server_routes[i];
+        if (!http_routes_add(&routes, uri->method, uri->uri, (void *)uri))
+            ESP_LOGE(TAG, "No room for route %s", uri->uri);
+    }
+    if (!http_routes_compile(&routes))
+        ESP_LOGE(TAG, "Routes do not fit HTTP_ROUTES_MAX_STATES");
+    tcpip_adapter_ip_info_t ip_info;
+    tcpip_adapter_get_ip_info(TCPIP_ADAPTER_IF_AP, &ip_info);
+    captive_probes_init(ip4addr_ntoa(&ip_info.ip));
+
     ESP_ERROR_CHECK(httpd_start(&server, &config));
-    httpd_register_uri_handler(server, &hello);
-}
\ No newline at end of file
+    http_workers_esp_start(server);
+    for (size_t i = 0; i < HTTP_SERVER_ROUTE_COUNT; i++) {
+        const httpd_uri_t dispatcher = {
+            .uri = "*",
+            .method = http_server_routes[i]->method,
+            .handler = http_dispatch,
+            .user_ctx = NULL,
+        };
+        // Fails with ESP_ERR_HTTPD_HANDLER_EXISTS once the method has one
+        httpd_register_uri_handler(server, &dispatcher);
+    }
+}
@@ -1,3 +1,14 @@
 #pragma once
+#include "./wifi_credentials.h"
+#include "dns_server.h"
 
-void http_server_start(void);
\ No newline at end of file
+// Stores the credentials submitted through the portal and has the device
+// join that network. Runs in a worker task, may take a while. Returns
+// false if they could not be stored.
+typedef bool (*http_provision_fn)(const wifi_credentials_t *credentials);
+
+// Starts the portal web server. /metrics reports the counters of
+// `dnsServer` (may be NULL) next to its own. POST /api/connect hands the
+// credentials to `provision`. Starting it again, when the portal comes
+// back, only updates these.
+void http_server_start(DNSServer *dnsServer, http_provision_fn provision);
\ No newline at end of file
@@ -0,0 +1,166 @@
+#include "./http_workers.h"
+#include <stdio.h>
+#include <string.h>
+
+enum {
+    HTTP_JOB_FREE,
+    HTTP_JOB_CLAIMED, // being filled in by the server task
+    HTTP_JOB_QUEUED,
+    HTTP_JOB_RUNNING,
+    HTTP_JOB_DONE, // waiting for the server task to send the response
+};
+
+static const http_workers_platform_t *platform;
+// Everything below is guarded by platform->lock
+static http_job_t jobs[HTTP_WORKERS_JOBS];
+// Jobs queued, oldest first. There are never more than there are jobs.
+static http_job_t *queue[HTTP_WORKERS_JOBS];
+static size_t queue_head;
+static size_t queue_count;
+static size_t busy;
+static http_workers_metrics_t metrics;
+
+static void lock(void) { platform->lock(platform->ctx); }
+
+static void unlock(void) { platform->unlock(platform->ctx); }
+
+void http_workers_init(const http_workers_platform_t *value) {
+    platform = value;
+    memset(jobs, 0, sizeof(jobs));
+    queue_head = 0;
+    queue_count = 0;
+    busy = 0;
+    memset(&metrics, 0, sizeof(metrics));
+}
+
+http_job_t *http_workers_claim(void) {
+    http_job_t *job = NULL;
+    lock();
+    for (size_t i = 0; i < HTTP_WORKERS_JOBS && job == NULL; i++) {
+        if (jobs[i].state == HTTP_JOB_FREE) job = &jobs[i];
+    }
+    if (job != NULL) {
+        job->state = HTTP_JOB_CLAIMED;
+        job->closed = false;
+        if (++busy > metrics.max_busy) metrics.max_busy = busy;
+    } else {
+        metrics.rejected++;
+    }
+    unlock();
+    return job;
+}
+
+void http_workers_submit(http_job_t *job, http_job_fn run, void *user_ctx,
+                         int sockfd) {
+    job->run = run;
+    job->user_ctx = user_ctx;
+    job->sockfd = sockfd;
+    job->status = NULL;
+    job->body_length = 0;
+    uint32_t now = platform->now_ms(platform->ctx);
+    lock();
+    job->state = HTTP_JOB_QUEUED;
+    job->queued_ms = now;
+    queue[(queue_head + queue_count) % HTTP_WORKERS_JOBS] = job;
+    queue_count++;
+    metrics.submitted++;
+    unlock();
+    platform->signal(platform->ctx);
+}
+
+void http_workers_cancel(http_job_t *job) {
+    lock();
+    job->closed = true;
+    unlock();
+}
+
+bool http_workers_deliverable(http_job_t *job) {
+    lock();
+    bool deliverable = !job->closed;
+    if (job->closed) metrics.canceled++;
+    unlock();
+    return deliverable;
+}
+
+void http_workers_release(http_job_t *job) {
+    lock();
+    job->state = HTTP_JOB_FREE;
+    busy--;
+    unlock();
+}
+
+bool http_workers_work(void) {
+    platform->wait(platform->ctx);
+    lock();
+    // Every signal but the stop ones comes with a job
+    if (queue_count == 0) {
+        unlock();
+        return false;
+    }
+    http_job_t *job = queue[queue_head];
+    queue_head = (queue_head + 1) % HTTP_WORKERS_JOBS;
+    queue_count--;
+    job->state = HTTP_JOB_RUNNING;
+    // Nobody is waiting for the answer any more
+    bool skip = job->closed;
+    unlock();
+
+    if (!skip) {
+        job->run(job);
+        if (job->status == NULL)
+            http_job_respond(job, "500 Internal Server Error", "text/plain",
+                             NULL, 0);
+    }
+
+    uint32_t ms = platform->now_ms(platform->ctx);
+    lock();
+    ms -= job->queued_ms;
+    size_t bucket = 0;
+    while (bucket < HTTP_WORKERS_LATENCY_BUCKETS - 1 && ms >= (1U << bucket))
+        bucket++;
+    metrics.latency[bucket]++;
+    job->state = HTTP_JOB_DONE;
+    unlock();
+    platform->done(platform->ctx, job);
+    return true;
+}
+
+void http_workers_stop(void) {
+    for (int i = 0; i < HTTP_WORKERS_COUNT; i++)
+        platform->signal(platform->ctx);
+}
+
+bool http_job_respond(http_job_t *job, const char *status, const char *type,
+                      const char *body, size_t length) {
+    if (length > sizeof(job->body)) {
+        job->status = "500 Internal Server Error";
+        job->type = "text/plain";
+        job->body_length = 0;
+        return false;
+    }
+    job->status = status;
+    job->type = type;
+    if (length != 0) memcpy(job->body, body, length);
+    job->body_length = length;
+    return true;
+}
+
+// Responses of jobs are answers to API calls, never cached
+size_t http_job_format_head(const http_job_t *job, char *buffer,
+                            size_t size) {
+    int length = snprintf(buffer, size,
+                          "HTTP/1.1 %s\r\n"
+                          "Content-Type: %s\r\n"
+                          "Content-Length: %u\r\n"
+                          "Cache-Control: no-store\r\n"
+                          "\r\n",
+                          job->status, job->type, (unsigned)job->body_length);
+    if (length < 0 || (size_t)length >= size) return 0;
+    return length;
+}
+
+void http_workers_get_metrics(http_workers_metrics_t *copy) {
+    lock();
+    *copy = metrics;
+    unlock();
+}
@@ -0,0 +1,110 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Tasks that run slow handlers, and jobs that may be waiting or running at
+// once. A request that finds every job taken gets a 503 right away instead
+// of queueing behind the others.
+#ifndef HTTP_WORKERS_COUNT
+#define HTTP_WORKERS_COUNT 2
+#endif
+#ifndef HTTP_WORKERS_JOBS
+#define HTTP_WORKERS_JOBS 4
+#endif
+// What the server task hands a job (e.g. the parsed form of a POST) and
+// the most a job can answer
+#define HTTP_JOB_DATA_MAX 128
+#define HTTP_JOB_BODY_MAX 160
+// Buckets of http_workers_metrics_t.latency, in ms like the handlers'
+#define HTTP_WORKERS_LATENCY_BUCKETS 12
+
+typedef struct http_job http_job_t;
+
+// Runs in a worker. Answers with http_job_respond(), a job that does not
+// gets a 500.
+typedef void (*http_job_fn)(http_job_t *job);
+
+struct http_job {
+    http_job_fn run;
+    void *user_ctx;
+    int sockfd; // connection the response goes to
+    uint8_t data[HTTP_JOB_DATA_MAX];
+    // The response, sent by the server task once the job is done
+    const char *status; // e.g. "200 OK", static
+    const char *type;   // content type, static
+    char body[HTTP_JOB_BODY_MAX];
+    size_t body_length;
+    // Everything below is guarded by the platform lock
+    uint8_t state;
+    bool closed; // the connection went away, the response is dropped
+    uint32_t queued_ms;
+};
+
+// What the pool needs from the system: FreeRTOS on the device
+// (http_server.c), threads on the host
+typedef struct {
+    void (*lock)(void *ctx);
+    void (*unlock)(void *ctx);
+    // Counting semaphore the workers wait on, given once per job queued
+    // and once per worker on http_workers_stop()
+    void (*signal)(void *ctx);
+    void (*wait)(void *ctx);
+    uint32_t (*now_ms)(void *ctx);
+    // Called from the worker once `job` has run. Must have the server
+    // task send the response, if the connection is still open, then call
+    // http_workers_release().
+    void (*done)(void *ctx, http_job_t *job);
+    void *ctx;
+} http_workers_platform_t;
+
+// Written under the platform lock
+typedef struct {
+    uint32_t submitted;
+    uint32_t rejected; // every job was taken
+    uint32_t canceled; // the connection closed before the response
+    uint32_t max_busy; // most jobs taken at once
+    // Bucket i counts jobs done less than 1 << i ms after being queued, the
+    // last one everything slower
+    uint32_t latency[HTTP_WORKERS_LATENCY_BUCKETS];
+} http_workers_metrics_t;
+
+void http_workers_init(const http_workers_platform_t *platform);
+
+// From the server task. Takes a free job to fill in, NULL if there is
+// none. The job then goes to http_workers_submit(), or back to
+// http_workers_release() if the request turns out to need no worker.
+http_job_t *http_workers_claim(void);
+void http_workers_submit(http_job_t *job, http_job_fn run, void *user_ctx,
+                         int sockfd);
+// The connection of `job` was closed, from the server task
+void http_workers_cancel(http_job_t *job);
+// Returns true if the response of `job` is to be sent
+bool http_workers_deliverable(http_job_t *job);
+// Frees the job once the server task is done with it
+void http_workers_release(http_job_t *job);
+
+// The loop body of a worker task: waits for a job and runs it. Returns
+// false once the pool is stopping and nothing is left to run.
+bool http_workers_work(void);
+// Makes every worker return false from http_workers_work() once the jobs
+// queued are done
+void http_workers_stop(void);
+
+// From a job: sets its response, copying `length` bytes of `body`. Returns
+// false, and answers 500 instead, if the body is too long.
+bool http_job_respond(http_job_t *job, const char *status, const char *type,
+                      const char *body, size_t length);
+// Writes the status line and headers of the response into `buffer`,
+// returns their length, 0 if `size` is too small
+size_t http_job_format_head(const http_job_t *job, char *buffer, size_t size);
+
+void http_workers_get_metrics(http_workers_metrics_t *metrics);
+
+#ifdef __cplusplus
+}
+#endif
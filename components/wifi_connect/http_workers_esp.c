@@ -0,0 +1,109 @@
+#include "./http_workers_esp.h"
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+
+const static char *TAG = "http_workers";
+
+// Below the httpd task, which then always gets to accept and route
+#define HTTP_WORKERS_PRIORITY (tskIDLE_PRIORITY + 4)
+#define HTTP_WORKERS_STACK 3072
+
+static httpd_handle_t server;
+static SemaphoreHandle_t jobs_queued;
+
+// Jobs are only ever moved between lists under the lock, a critical
+// section is cheaper than a mutex for that
+static void http_workers_esp_lock(void *ctx) { taskENTER_CRITICAL(); }
+
+static void http_workers_esp_unlock(void *ctx) { taskEXIT_CRITICAL(); }
+
+static void http_workers_esp_signal(void *ctx) { xSemaphoreGive(jobs_queued); }
+
+static void http_workers_esp_wait(void *ctx) {
+    xSemaphoreTake(jobs_queued, portMAX_DELAY);
+}
+
+static uint32_t http_workers_esp_now_ms(void *ctx) {
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+// Sends the response of a job that is done, in the httpd task: only that
+// task may touch its sessions, and a connection cannot be closed and its
+// socket reused by another while the response goes out.
+static void http_job_deliver(void *arg) {
+    http_job_t *job = arg;
+    char head[160];
+    if (http_workers_deliverable(job)) {
+        // The job is over, closing the connection no longer cancels it
+        httpd_sess_set_ctx(server, job->sockfd, NULL, NULL);
+        size_t length = http_job_format_head(job, head, sizeof(head));
+        if (length == 0 ||
+            httpd_socket_send(server, job->sockfd, head, length, 0) !=
+                (int)length ||
+            httpd_socket_send(server, job->sockfd, job->body,
+                              job->body_length, 0) != (int)job->body_length)
+            httpd_sess_trigger_close(server, job->sockfd);
+    }
+    http_workers_release(job);
+}
+
+static void http_workers_esp_done(void *ctx, http_job_t *job) {
+    // Fails only while the control socket of the server is full
+    while (httpd_queue_work(server, http_job_deliver, job) != ESP_OK)
+        vTaskDelay(pdMS_TO_TICKS(10));
+}
+
+static const http_workers_platform_t platform = {
+    .lock = http_workers_esp_lock,
+    .unlock = http_workers_esp_unlock,
+    .signal = http_workers_esp_signal,
+    .wait = http_workers_esp_wait,
+    .now_ms = http_workers_esp_now_ms,
+    .done = http_workers_esp_done,
+    .ctx = NULL,
+};
+
+static void http_worker_task(void *parm) {
+    while (http_workers_work()) {
+    }
+    vTaskDelete(NULL);
+}
+
+void http_workers_esp_start(httpd_handle_t value) {
+    server = value;
+    jobs_queued = xSemaphoreCreateCounting(
+        HTTP_WORKERS_JOBS + HTTP_WORKERS_COUNT, 0);
+    http_workers_init(&platform);
+    for (int i = 0; i < HTTP_WORKERS_COUNT; i++) {
+        if (xTaskCreate(http_worker_task, "http_worker", HTTP_WORKERS_STACK,
+                        NULL, HTTP_WORKERS_PRIORITY, NULL) != pdPASS)
+            ESP_LOGE(TAG, "Cannot start worker %d", i);
+    }
+}
+
+// Called by the server when a connection with a job in flight is closed,
+// through the session context set below
+static void http_job_closed(void *ctx) { http_workers_cancel(ctx); }
+
+esp_err_t http_async_handler(httpd_req_t *req) {
+    const http_async_route_t *route = req->user_ctx;
+    http_job_t *job = http_workers_claim();
+    if (job == NULL) {
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        httpd_resp_set_hdr(req, "Retry-After", "1");
+        return httpd_resp_send(req, NULL, 0);
+    }
+    if (route->prepare != NULL && !route->prepare(req, job)) {
+        http_workers_release(job);
+        return ESP_OK;
+    }
+    // Taken over by the session once the handler returns
+    req->sess_ctx = job;
+    req->free_ctx = http_job_closed;
+    http_workers_submit(job, route->run, (void *)route,
+                        httpd_req_to_sockfd(req));
+    return ESP_OK;
+}
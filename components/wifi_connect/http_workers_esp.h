@@ -0,0 +1,23 @@
+#pragma once
+#include "./http_workers.h"
+#include <esp_http_server.h>
+
+// A route whose handler runs in the worker pool, so that NVS writes, radio
+// calls or network waits do not hold up the httpd task and every other
+// request with it. Registered like any route, with `uri.handler` set to
+// http_async_handler and `uri.user_ctx` pointing at the route itself.
+typedef struct {
+    httpd_uri_t uri;
+    // Runs first, in the httpd task, e.g. to read the body into job->data.
+    // Returns false if it answered the request itself and there is no job
+    // to run. May be NULL.
+    bool (*prepare)(httpd_req_t *req, http_job_t *job);
+    http_job_fn run;
+} http_async_route_t;
+
+// Starts the worker tasks, responses are handed back to `server`
+void http_workers_esp_start(httpd_handle_t server);
+// Hands the request to the pool, or answers 503 if all jobs are taken. The
+// response is sent once the job is done; meanwhile the httpd task serves
+// other requests.
+esp_err_t http_async_handler(httpd_req_t *req);
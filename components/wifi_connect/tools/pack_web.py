@@ -0,0 +1,121 @@
+#!/usr/bin/env python
+"""Packs a directory of web assets into a C source file.
+
+Every file is gzipped once at build time and stored as a const array, so
+the portal serves it from flash as is. Each asset gets a strong ETag (a hash
+of its compressed body) and a Cache-Control header. HTML is revalidated on
+every load, anything else is cached for a year: references to other assets
+in HTML files get "?v=<etag>" appended, so a changed asset has a new URL.
+
+Usage: pack_web.py <web directory> <output .c file>
+"""
+import gzip
+import hashlib
+import io
+import os
+import sys
+
+CONTENT_TYPES = {
+    ".html": "text/html",
+    ".css": "text/css",
+    ".js": "application/javascript",
+    ".json": "application/json",
+    ".svg": "image/svg+xml",
+    ".png": "image/png",
+    ".ico": "image/x-icon",
+    ".txt": "text/plain",
+}
+
+CACHE_REVALIDATE = "no-cache"
+CACHE_IMMUTABLE = "public, max-age=31536000, immutable"
+
+
+def compress(data):
+    # Fixed mtime and no file name, so the output only depends on the input
+    out = io.BytesIO()
+    with gzip.GzipFile(filename="", mode="wb", compresslevel=9, fileobj=out,
+                       mtime=0) as f:
+        f.write(data)
+    return out.getvalue()
+
+
+def etag(body):
+    return '"%s"' % hashlib.sha256(body).hexdigest()[:16]
+
+
+def collect(root):
+    assets = {}
+    for directory, _, files in os.walk(root):
+        for name in files:
+            path = os.path.join(directory, name)
+            uri = "/" + os.path.relpath(path, root).replace(os.sep, "/")
+            with open(path, "rb") as f:
+                assets[uri] = f.read()
+    return assets
+
+
+def c_string(value):
+    return '"%s"' % value.replace("\\", "\\\\").replace('"', '\\"')
+
+
+def main(root, output):
+    sources = collect(root)
+    entries = {}
+    # Everything else first, HTML refers to it by versioned URL
+    for uri in sorted(u for u in sources if not u.endswith(".html")):
+        body = compress(sources[uri])
+        entries[uri] = (body, CACHE_IMMUTABLE)
+    for uri in sorted(u for u in sources if u.endswith(".html")):
+        data = sources[uri]
+        for other, (body, _) in entries.items():
+            versioned = '%s?v=%s' % (other, etag(body).strip('"'))
+            data = data.replace(('"%s"' % other).encode(),
+                                ('"%s"' % versioned).encode())
+        entries[uri] = (compress(data), CACHE_REVALIDATE)
+
+    lines = [
+        "// Generated by tools/pack_web.py from %s, do not edit" %
+        os.path.basename(os.path.normpath(root)),
+        '#include "web_bundle.h"',
+        "",
+    ]
+    # Sorted by path, web_bundle_find() does a binary search
+    uris = sorted(entries)
+    for index, uri in enumerate(uris):
+        body = entries[uri][0]
+        lines.append("// %s, %d bytes gzipped from %d" %
+                     (uri, len(body), len(sources[uri])))
+        lines.append("static const uint8_t asset_%d[] "
+                     "__attribute__((aligned(4))) = {" % index)
+        for offset in range(0, len(body), 12):
+            chunk = body[offset:offset + 12]
+            lines.append("    " + " ".join("0x%02x," % b for b in
+                                          bytearray(chunk)))
+        lines.append("};")
+        lines.append("")
+
+    lines.append("const web_asset_t web_assets[] = {")
+    for index, uri in enumerate(uris):
+        body, cache_control = entries[uri]
+        extension = os.path.splitext(uri)[1].lower()
+        content_type = CONTENT_TYPES.get(extension, "application/octet-stream")
+        lines.append("    {%s, %d, %s, %s, %s, asset_%d, sizeof(asset_%d)}," %
+                     (c_string(uri), len(uri), c_string(content_type),
+                      c_string(etag(body)), c_string(cache_control), index,
+                      index))
+    lines.append("};")
+    lines.append("")
+    lines.append("const size_t web_asset_count = "
+                 "sizeof(web_assets) / sizeof(web_assets[0]);")
+
+    # Always written: the build runs this only when an input changed, and
+    # an output left older than its inputs would have it run on every build
+    with open(output, "w") as f:
+        f.write("\n".join(lines) + "\n")
+
+
+if __name__ == "__main__":
+    if len(sys.argv) != 3:
+        sys.stderr.write(__doc__)
+        sys.exit(2)
+    main(sys.argv[1], sys.argv[2])
@@ -0,0 +1,31 @@
+// Fills the network list from the scan results of the device. The form
+// works without it, the list is only a convenience.
+(function () {
+    var list = document.getElementById("networks");
+    var status = document.getElementById("status");
+
+    function load() {
+        var request = new XMLHttpRequest();
+        request.open("GET", "/api/scan");
+        request.onload = function () {
+            if (request.status !== 200) return;
+            var scan = JSON.parse(request.responseText);
+            list.innerHTML = "";
+            scan.networks.forEach(function (network) {
+                var option = document.createElement("option");
+                option.value = network.ssid;
+                list.appendChild(option);
+            });
+            status.textContent = scan.networks.length + " networks found";
+            // The device scans in the background, ask again once it is done
+            if (scan.scanning) {
+                if (scan.networks.length === 0)
+                    status.textContent = "Looking for networks...";
+                setTimeout(load, 1000);
+            }
+        };
+        request.send();
+    }
+
+    load();
+})();
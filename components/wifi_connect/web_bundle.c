@@ -0,0 +1,23 @@
+#include "./web_bundle.h"
+#include <string.h>
+
+const web_asset_t *web_bundle_find(const char *path, size_t len_path) {
+    size_t low = 0, high = web_asset_count;
+    while (low < high) {
+        size_t middle = (low + high) / 2;
+        const web_asset_t *asset = &web_assets[middle];
+        size_t common = len_path < asset->path_length ? len_path
+                                                      : asset->path_length;
+        int order = memcmp(path, asset->path, common);
+        if (order == 0)
+            order = len_path < asset->path_length
+                        ? -1
+                        : len_path > asset->path_length ? 1 : 0;
+        if (order == 0) return asset;
+        if (order < 0)
+            high = middle;
+        else
+            low = middle + 1;
+    }
+    return NULL;
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// A file of the web directory, packed by tools/pack_web.py at build time.
+// All strings and the body are in flash; the body is gzipped. It is only
+// served gzipped, whatever the request's Accept-Encoding: every browser
+// accepts it, and a plain copy would not fit the flash budget.
+typedef struct {
+    const char *path;
+    size_t path_length;
+    const char *content_type;
+    const char *etag; // quoted, ready for the ETag header
+    const char *cache_control;
+    const uint8_t *body;
+    size_t body_length;
+} web_asset_t;
+
+// Sorted by path
+extern const web_asset_t web_assets[];
+extern const size_t web_asset_count;
+
+// Returns the asset at the first `len_path` characters of `path`, NULL if
+// there is none
+const web_asset_t *web_bundle_find(const char *path, size_t len_path);
+
+#ifdef __cplusplus
+}
+#endif
@@ -1,18 +1,140 @@
 #include "wifi_connect.h"
+#include "./captive_probe.h"
 #include "./http_server.h"
+#include "./wifi_fast_connect.h"
+#include "./wifi_reconnect.h"
+#include "./wifi_scan_esp.h"
 #include "dns_server.h"
+#include "mdns_server.h"
 #include <esp_event_loop.h>
 #include <esp_log.h>
+#include <esp_system.h>
+#include <esp_timer.h>
 #include <esp_wifi.h>
+#include <freertos/FreeRTOS.h>
 #include <freertos/event_groups.h>
+#include <freertos/task.h>
+#include <lwip/dns.h>
 #include <lwip/err.h>
 #include <lwip/sys.h>
+#include <nvs.h>
 #include <string.h>
 
 const static char *TAG = "wifi_connect";
 static EventGroupHandle_t wifi_event_group;
 const int WIFI_CONNECTED_BIT = BIT0;
+// Set with disconnect_reason when the station is disconnected, for
+// wifi_reconnect_task() to decide on the next attempt
+const int WIFI_DISCONNECTED_BIT = BIT1;
+// Set once credentials from the portal are stored, for
+// wifi_reconnect_task() to leave the configuration mode
+const int WIFI_PROVISIONED_BIT = BIT2;
+// Set when the stored network is back while the configuration mode stands
+// in for it, for wifi_reconnect_task() to return to the connection mode
+const int WIFI_RECOVERED_BIT = BIT3;
+// Time the portal has to send its answer before the access point goes down
+#define WIFI_PROVISION_DELAY_MS 2000
+static volatile uint8_t disconnect_reason;
+static volatile bool disconnect_was_connected;
+
+_Static_assert(WIFI_RECONNECT_REASON_4WAY_HANDSHAKE_TIMEOUT ==
+                       WIFI_REASON_4WAY_HANDSHAKE_TIMEOUT &&
+                   WIFI_RECONNECT_REASON_BEACON_TIMEOUT ==
+                       WIFI_REASON_BEACON_TIMEOUT &&
+                   WIFI_RECONNECT_REASON_NO_AP_FOUND ==
+                       WIFI_REASON_NO_AP_FOUND &&
+                   WIFI_RECONNECT_REASON_AUTH_FAIL == WIFI_REASON_AUTH_FAIL &&
+                   WIFI_RECONNECT_REASON_HANDSHAKE_TIMEOUT ==
+                       WIFI_REASON_HANDSHAKE_TIMEOUT,
+               "wifi_reconnect.h reasons do not match esp_wifi_types.h");
 DNSServer *dnsServer;
+// Answers <ssid>.local on every interface up, in both modes
+static MDNSServer *mdnsServer;
+// Station connections go through wifi_fast_connect outside of the
+// configuration mode
+static bool configuration_mode;
+// The configuration mode was entered because the stored network could not
+// be reached, not because there is none
+static bool configuration_fallback;
+
+static uint32_t now_ms(void) {
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+static void wifi_lease_load(wifi_lease_t *lease) {
+    nvs_handle handle;
+    size_t length = sizeof(*lease);
+    memset(lease, 0, sizeof(*lease));
+    if (nvs_open("wifi_connect", NVS_READONLY, &handle) != ESP_OK) return;
+    if (nvs_get_blob(handle, "lease", lease, &length) != ESP_OK ||
+        length != sizeof(*lease))
+        memset(lease, 0, sizeof(*lease));
+    nvs_close(handle);
+}
+
+static void wifi_lease_store(const wifi_lease_t *lease) {
+    nvs_handle handle;
+    esp_err_t err = nvs_open("wifi_connect", NVS_READWRITE, &handle);
+    if (err == ESP_OK) {
+        err = nvs_set_blob(handle, "lease", lease, sizeof(*lease));
+        if (err == ESP_OK) err = nvs_commit(handle);
+        nvs_close(handle);
+    }
+    if (err != ESP_OK) ESP_LOGW(TAG, "Lease not stored: %d", err);
+}
+
+// Connects to the stored network, straight to the access point of the last
+// connection when wifi_fast_connect says so. The configuration mode keeps
+// trying the stored network, if there is one, in the background.
+static void wifi_connect_station(void) {
+    wifi_config_t wifi_config;
+    ESP_ERROR_CHECK(esp_wifi_get_config(ESP_IF_WIFI_STA, &wifi_config));
+    if (configuration_mode) {
+        if (wifi_config.sta.ssid[0] != 0) ESP_ERROR_CHECK(esp_wifi_connect());
+        return;
+    }
+    const wifi_lease_t *lease = wifi_fast_connect_attempt(now_ms());
+    if (lease != NULL) {
+        wifi_config.sta.bssid_set = 1;
+        memcpy(wifi_config.sta.bssid, lease->bssid, sizeof(lease->bssid));
+        wifi_config.sta.channel = lease->channel;
+    } else {
+        wifi_config.sta.bssid_set = 0;
+        wifi_config.sta.channel = 0;
+    }
+    ESP_ERROR_CHECK(esp_wifi_set_config(ESP_IF_WIFI_STA, &wifi_config));
+    ESP_ERROR_CHECK(esp_wifi_connect());
+}
+
+static void wifi_got_ip(const tcpip_adapter_ip_info_t *ip_info) {
+    wifi_lease_t current;
+    wifi_ap_record_t ap;
+    mdns_server_set_interface(mdnsServer, TCPIP_ADAPTER_IF_STA, &ip_info->ip,
+                              &ip_info->netmask);
+    if (configuration_mode) {
+        // The portal is no longer needed, the reconnect task closes it
+        if (configuration_fallback)
+            xEventGroupSetBits(wifi_event_group, WIFI_RECOVERED_BIT);
+        if (dnsServer == NULL) return;
+        // Clients on the network just joined get the station address, and
+        // names outside the portal resolve through that network
+        dns_server_set_interface(dnsServer, TCPIP_ADAPTER_IF_STA, &ip_info->ip,
+                                 &ip_info->netmask);
+        const ip_addr_t *upstream = dns_getserver(0);
+        if (!ip_addr_isany(upstream))
+            dns_server_set_upstream(dnsServer, upstream);
+        return;
+    }
+    if (esp_wifi_sta_get_ap_info(&ap) != ESP_OK) return;
+    memcpy(current.bssid, ap.bssid, sizeof(current.bssid));
+    current.channel = ap.primary;
+    current.valid = 1;
+    if (wifi_fast_connect_got_ip(now_ms(), &current))
+        wifi_lease_store(&current);
+    wifi_fast_connect_metrics_t metrics;
+    wifi_fast_connect_get_metrics(&metrics);
+    ESP_LOGI(TAG, "Connected in %u ms", metrics.last_ms);
+}
 
 esp_err_t event_handler(void *ctx, system_event_t *event) {
     /* For accessing reason codes in case of disconnection */
@@ -20,11 +142,12 @@ esp_err_t event_handler(void *ctx, system_event_t *event) {
 
     switch (event->event_id) {
         case SYSTEM_EVENT_STA_START:
-            ESP_ERROR_CHECK(esp_wifi_connect());
+            wifi_connect_station();
             break;
         case SYSTEM_EVENT_STA_GOT_IP:
             ESP_LOGI(TAG, "Got ip: %s",
                      ip4addr_ntoa(&event->event_info.got_ip.ip_info.ip));
+            wifi_got_ip(&event->event_info.got_ip.ip_info);
             xEventGroupSetBits(wifi_event_group, WIFI_CONNECTED_BIT);
             break;
         case SYSTEM_EVENT_STA_DISCONNECTED:
@@ -36,8 +159,25 @@ esp_err_t event_handler(void *ctx, system_event_t *event) {
                     ESP_IF_WIFI_STA,
                     WIFI_PROTOCAL_11B | WIFI_PROTOCAL_11G | WIFI_PROTOCAL_11N));
             }
-            ESP_ERROR_CHECK(esp_wifi_connect());
-            xEventGroupClearBits(wifi_event_group, WIFI_CONNECTED_BIT);
+            mdns_server_set_interface(mdnsServer, TCPIP_ADAPTER_IF_STA, NULL,
+                                      NULL);
+            if (!configuration_mode)
+                wifi_fast_connect_disconnected();
+            else if (dnsServer != NULL) {
+                dns_server_set_interface(dnsServer, TCPIP_ADAPTER_IF_STA, NULL,
+                                         NULL);
+                dns_server_set_upstream(dnsServer, NULL);
+            }
+            disconnect_reason = info->disconnected.reason;
+            disconnect_was_connected =
+                (xEventGroupClearBits(wifi_event_group, WIFI_CONNECTED_BIT) &
+                 WIFI_CONNECTED_BIT) != 0;
+            xEventGroupSetBits(wifi_event_group, WIFI_DISCONNECTED_BIT);
+            break;
+        case SYSTEM_EVENT_SCAN_DONE:
+            wifi_scan_done(now_ms(), info->scan_done.status == 0);
+            ESP_LOGI(TAG, "Scan done: %u networks",
+                     (unsigned)wifi_scan_count());
             break;
         default:
             ESP_LOGI(TAG, "Unhandled event: %d", event->event_id);
@@ -54,8 +194,60 @@ void get_ap_ssid(char *ssid) {
              mac[3], mac[4], mac[5]);
 }
 
+// Makes the device reachable as <ssid>.local, the SSID of its own access
+// point, from the network it joins as well as from the portal
+static void mdns_start(void) {
+    char ssid[sizeof(((wifi_config_t *)0)->ap.ssid) + 1];
+    char hostname[sizeof(ssid) + sizeof(".local")];
+    get_ap_ssid(ssid);
+    snprintf(hostname, sizeof(hostname), "%s.local", ssid);
+    mdnsServer = mdns_server_init();
+    // Answered with the address of the interface asked
+    ip_addr_t interface_address = IPADDR4_INIT(0);
+    mdns_server_add_host(mdnsServer, hostname, &interface_address);
+    if (mdns_server_start(mdnsServer))
+        ESP_LOGI(TAG, "Answering mDNS for %s", hostname);
+    else
+        ESP_LOGE(TAG, "Cannot start the mDNS responder");
+}
+
+// Credentials submitted through the portal, called from an HTTP worker.
+// They go to flash, unlike the per-attempt changes of the connection mode,
+// and the lease of the previous network is forgotten.
+static bool wifi_provision(const wifi_credentials_t *credentials) {
+    wifi_config_t wifi_config;
+    wifi_lease_t none;
+    if (esp_wifi_get_config(ESP_IF_WIFI_STA, &wifi_config) != ESP_OK)
+        return false;
+    memset(wifi_config.sta.ssid, 0, sizeof(wifi_config.sta.ssid));
+    memcpy(wifi_config.sta.ssid, credentials->ssid, credentials->ssid_length);
+    memset(wifi_config.sta.password, 0, sizeof(wifi_config.sta.password));
+    memcpy(wifi_config.sta.password, credentials->password,
+           credentials->password_length);
+    wifi_config.sta.bssid_set = 0;
+    wifi_config.sta.channel = 0;
+    esp_err_t err = esp_wifi_set_storage(WIFI_STORAGE_FLASH);
+    if (err == ESP_OK) err = esp_wifi_set_config(ESP_IF_WIFI_STA, &wifi_config);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Credentials not stored: %d", err);
+        return false;
+    }
+    memset(&none, 0, sizeof(none));
+    wifi_lease_store(&none);
+    wifi_fast_connect_forget();
+    ESP_LOGI(TAG, "Stored WiFi: ssid=%.*s", credentials->ssid_length,
+             (const char *)credentials->ssid);
+    // The phone's connectivity check passes from now on and its sign in
+    // sheet closes
+    captive_probes_set_online(true);
+    xEventGroupSetBits(wifi_event_group, WIFI_PROVISIONED_BIT);
+    return true;
+}
+
 void switch_to_wifi_configuration_mode() {
     char ssid[sizeof(((wifi_config_t *)0)->ap.ssid) + 1];
+    configuration_mode = true;
+    captive_probes_set_online(false);
     get_ap_ssid(ssid);
     // wifi_config_t wifi_config = {0};
     wifi_config_t wifi_config = {
@@ -73,26 +265,111 @@ void switch_to_wifi_configuration_mode() {
     ESP_ERROR_CHECK(esp_wifi_start());
     ESP_LOGI(TAG, "Started AP: ssid=\"%s\", pass=\"%s\"", wifi_config.ap.ssid,
              wifi_config.ap.password);
-    http_server_start();
-    dnsServer = dns_server_init();
+    // The list is ready by the time someone opens the portal
+    wifi_scan_init(wifi_scan_esp_scanner());
+    wifi_scan_request(now_ms());
+    // Kept when the portal closes, the HTTP server reports its counters
+    if (dnsServer == NULL) dnsServer = dns_server_init();
+    // Phones look up a dozen names right after joining, anything well above
+    // that is a client hammering the server
+    dns_server_set_rate_limit(dnsServer, 20, 40, 2);
+    http_server_start(dnsServer, wifi_provision);
     tcpip_adapter_ip_info_t ip_info;
-    tcpip_adapter_get_ip_info(ESP_IF_WIFI_AP, &ip_info);
-    dns_server_start(dnsServer, 53, "*", &ip_info.ip);
+    tcpip_adapter_get_ip_info(TCPIP_ADAPTER_IF_AP, &ip_info);
+    dns_server_set_interface(dnsServer, TCPIP_ADAPTER_IF_AP, &ip_info.ip,
+                             &ip_info.netmask);
+    mdns_server_set_interface(mdnsServer, TCPIP_ADAPTER_IF_AP, &ip_info.ip,
+                              &ip_info.netmask);
+    // Every name resolves to the address of the interface it is asked on
+    ip_addr_t interface_address = IPADDR4_INIT(0);
+    dns_server_start(dnsServer, 53, "*", &interface_address);
 }
 
 void switch_to_wifi_connection_mode() {
+    wifi_lease_t lease;
+    configuration_mode = false;
+    configuration_fallback = false;
+    wifi_lease_load(&lease);
+    wifi_fast_connect_init(&lease);
+    // The access point and channel are set for every attempt, that is no
+    // reason to write flash. The credentials stay as they were stored.
+    ESP_ERROR_CHECK(esp_wifi_set_storage(WIFI_STORAGE_RAM));
     ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
     ESP_ERROR_CHECK(esp_wifi_start());
 }
 
+// Closes the portal once it has been given credentials, or once the stored
+// network it stood in for is back. The HTTP server keeps running, on the
+// station address too.
+static void leave_wifi_configuration_mode(void) {
+    ESP_LOGI(TAG, "Leaving configuration");
+    captive_probes_set_online(true);
+    ESP_ERROR_CHECK(esp_wifi_stop());
+    dns_server_stop(dnsServer);
+    mdns_server_set_interface(mdnsServer, TCPIP_ADAPTER_IF_AP, NULL, NULL);
+    switch_to_wifi_connection_mode();
+}
+
+// Makes the next attempt after a disconnection, once the backoff is over.
+// Running here rather than in the event handler keeps the event loop free
+// while waiting. When the station does not come back, the configuration
+// mode takes over, so the device can be given other credentials.
+static void wifi_reconnect_task(void *arg) {
+    wifi_reconnect_t reconnect;
+    wifi_reconnect_init(&reconnect, esp_random());
+    for (;;) {
+        EventBits_t bits = xEventGroupWaitBits(
+            wifi_event_group,
+            WIFI_DISCONNECTED_BIT | WIFI_PROVISIONED_BIT | WIFI_RECOVERED_BIT,
+            pdTRUE, pdFALSE, portMAX_DELAY);
+        // Either bit may come late, after the other one already closed the
+        // portal
+        if ((bits & (WIFI_PROVISIONED_BIT | WIFI_RECOVERED_BIT)) &&
+            configuration_mode) {
+            if (bits & WIFI_PROVISIONED_BIT)
+                vTaskDelay(pdMS_TO_TICKS(WIFI_PROVISION_DELAY_MS));
+            else
+                ESP_LOGI(TAG, "Network back, leaving configuration");
+            leave_wifi_configuration_mode();
+            // Disconnections of the old mode say nothing about the network
+            // connected to next
+            xEventGroupClearBits(wifi_event_group,
+                                 WIFI_DISCONNECTED_BIT | WIFI_RECOVERED_BIT);
+            wifi_reconnect_init(&reconnect, esp_random());
+            continue;
+        }
+        if (!(bits & WIFI_DISCONNECTED_BIT)) continue;
+        uint32_t delay = wifi_reconnect_disconnected(
+            &reconnect, disconnect_reason, disconnect_was_connected);
+        if (delay == WIFI_RECONNECT_GIVE_UP) {
+            wifi_reconnect_init(&reconnect, esp_random());
+            if (!configuration_mode) {
+                ESP_LOGW(TAG, "Network unreachable, starting configuration");
+                ESP_ERROR_CHECK(esp_wifi_stop());
+                // Before the station can get an address again
+                configuration_fallback = true;
+                switch_to_wifi_configuration_mode();
+                continue;
+            }
+            delay = WIFI_RECONNECT_MAX_MS;
+        }
+        ESP_LOGI(TAG, "Reconnecting in %u ms", delay);
+        vTaskDelay(pdMS_TO_TICKS(delay));
+        wifi_connect_station();
+    }
+}
+
 void wifi_init() {
     wifi_event_group = xEventGroupCreate();
+    xTaskCreate(wifi_reconnect_task, "wifi_reconnect", 3072, NULL,
+                tskIDLE_PRIORITY + 2, NULL);
 
     tcpip_adapter_init();
     ESP_ERROR_CHECK(esp_event_loop_init(event_handler, NULL));
 
     wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
     ESP_ERROR_CHECK(esp_wifi_init(&cfg));
+    mdns_start();
 
     wifi_config_t wifi_config;
     ESP_ERROR_CHECK(esp_wifi_get_config(ESP_IF_WIFI_STA, &wifi_config));
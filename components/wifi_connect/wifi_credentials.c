@@ -0,0 +1,58 @@
+#include "./wifi_credentials.h"
+#include <string.h>
+
+void wifi_credentials_parser_init(wifi_credentials_parser_t *parser,
+                                  wifi_credentials_t *credentials) {
+    memset(credentials, 0, sizeof(*credentials));
+    parser->credentials = credentials;
+    parser->fields[0].name = "ssid";
+    parser->fields[0].value = credentials->ssid;
+    parser->fields[0].size = sizeof(credentials->ssid);
+    parser->fields[1].name = "password";
+    parser->fields[1].value = credentials->password;
+    parser->fields[1].size = sizeof(credentials->password);
+    http_form_init(&parser->form, parser->fields, 2);
+}
+
+bool wifi_credentials_parser_feed(wifi_credentials_parser_t *parser,
+                                  const char *data, size_t length) {
+    return http_form_feed(&parser->form, data, length);
+}
+
+const char *wifi_credentials_parser_finish(wifi_credentials_parser_t *parser) {
+    switch (http_form_finish(&parser->form)) {
+        case HTTP_FORM_OK:
+            break;
+        case HTTP_FORM_TOO_LONG:
+            return "The network name or password is too long";
+        case HTTP_FORM_BAD_ENCODING:
+            return "Malformed form";
+    }
+    parser->credentials->ssid_length = parser->fields[0].length;
+    parser->credentials->password_length = parser->fields[1].length;
+    return wifi_credentials_check(parser->credentials);
+}
+
+static bool is_hex(uint8_t c) {
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') ||
+           (c >= 'A' && c <= 'F');
+}
+
+const char *wifi_credentials_check(const wifi_credentials_t *credentials) {
+    size_t length = credentials->password_length;
+    if (credentials->ssid_length == 0 ||
+        credentials->ssid_length > sizeof(credentials->ssid))
+        return "Choose a network";
+    if (length == 0) return NULL;
+    if (length == sizeof(credentials->password)) {
+        for (size_t i = 0; i < length; i++)
+            if (!is_hex(credentials->password[i]))
+                return "A 64 character password must be hexadecimal";
+        return NULL;
+    }
+    if (length < 8) return "The password is at least 8 characters long";
+    for (size_t i = 0; i < length; i++)
+        if (credentials->password[i] < 0x20 || credentials->password[i] > 0x7E)
+            return "The password can only hold printable ASCII characters";
+    return NULL;
+}
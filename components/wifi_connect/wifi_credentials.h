@@ -0,0 +1,47 @@
+#pragma once
+#include "./http_form.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Longest body of the connect form accepted: both fields with every byte
+// escaped, and room for the submit button or whatever else a browser adds
+#define WIFI_CREDENTIALS_BODY_MAX 1024
+
+// What the portal form submits, sized like wifi_sta_config_t
+typedef struct {
+    uint8_t ssid[32];
+    uint8_t ssid_length;
+    uint8_t password[64];
+    uint8_t password_length;
+} wifi_credentials_t;
+
+// Reads the fields "ssid" and "password" of the form body into a
+// wifi_credentials_t, see http_form_t
+typedef struct {
+    http_form_t form;
+    http_form_field_t fields[2];
+    wifi_credentials_t *credentials;
+} wifi_credentials_parser_t;
+
+void wifi_credentials_parser_init(wifi_credentials_parser_t *parser,
+                                  wifi_credentials_t *credentials);
+// Returns false once the body is known to be invalid
+bool wifi_credentials_parser_feed(wifi_credentials_parser_t *parser,
+                                  const char *data, size_t length);
+// Returns NULL if the body held valid credentials, else what is wrong with
+// it, to show to the user
+const char *wifi_credentials_parser_finish(wifi_credentials_parser_t *parser);
+
+// Returns NULL if the station can be configured with `credentials`: an
+// SSID of 1 to 32 bytes and no password (an open network), a WPA
+// passphrase of 8 to 63 printable ASCII characters or a 64 hex digit key
+const char *wifi_credentials_check(const wifi_credentials_t *credentials);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,86 @@
+#include "./wifi_fast_connect.h"
+#include <string.h>
+
+enum {
+    WIFI_FAST_CONNECT_IDLE,      // not connecting
+    WIFI_FAST_CONNECT_TARGETED,  // trying the stored lease
+    WIFI_FAST_CONNECT_FULL,      // scanning
+    WIFI_FAST_CONNECT_CONNECTED, // got an address
+};
+
+// Calls come one at a time: attempts from the reconnect task, the others
+// from the event loop task, each waiting for the one before
+static wifi_lease_t lease;
+static int state;
+static bool lease_failed; // until the next address
+static uint32_t started_ms;
+static wifi_fast_connect_metrics_t metrics;
+
+void wifi_fast_connect_init(const wifi_lease_t *stored) {
+    if (stored != NULL && stored->valid)
+        lease = *stored;
+    else
+        memset(&lease, 0, sizeof(lease));
+    state = WIFI_FAST_CONNECT_IDLE;
+    lease_failed = false;
+    memset(&metrics, 0, sizeof(metrics));
+}
+
+const wifi_lease_t *wifi_fast_connect_attempt(uint32_t now_ms) {
+    if (state == WIFI_FAST_CONNECT_IDLE ||
+        state == WIFI_FAST_CONNECT_CONNECTED)
+        started_ms = now_ms;
+    if (lease.valid && !lease_failed) {
+        state = WIFI_FAST_CONNECT_TARGETED;
+        return &lease;
+    }
+    state = WIFI_FAST_CONNECT_FULL;
+    return NULL;
+}
+
+void wifi_fast_connect_disconnected(void) {
+    if (state == WIFI_FAST_CONNECT_TARGETED) {
+        lease_failed = true;
+        metrics.fallbacks++;
+    }
+    // Attempts that follow belong to the same connection, unless it had
+    // been up
+    if (state == WIFI_FAST_CONNECT_CONNECTED) state = WIFI_FAST_CONNECT_IDLE;
+}
+
+static bool wifi_lease_equal(const wifi_lease_t *a, const wifi_lease_t *b) {
+    return memcmp(a->bssid, b->bssid, sizeof(a->bssid)) == 0 &&
+           a->channel == b->channel;
+}
+
+bool wifi_fast_connect_got_ip(uint32_t now_ms, const wifi_lease_t *current) {
+    // The address may also change while connected, that is no connection
+    if (state != WIFI_FAST_CONNECT_CONNECTED) {
+        if (state == WIFI_FAST_CONNECT_TARGETED)
+            metrics.fast++;
+        else
+            metrics.full++;
+        uint32_t ms = now_ms - started_ms;
+        size_t bucket = 0;
+        while (bucket < WIFI_FAST_CONNECT_BUCKETS - 1 &&
+               ms >= ((uint32_t)WIFI_FAST_CONNECT_MIN_MS << bucket))
+            bucket++;
+        metrics.latency[bucket]++;
+        metrics.last_ms = ms;
+    }
+    state = WIFI_FAST_CONNECT_CONNECTED;
+    lease_failed = false;
+    if (lease.valid && wifi_lease_equal(&lease, current)) return false;
+    lease = *current;
+    lease.valid = 1;
+    return true;
+}
+
+void wifi_fast_connect_forget(void) {
+    memset(&lease, 0, sizeof(lease));
+    lease_failed = false;
+}
+
+void wifi_fast_connect_get_metrics(wifi_fast_connect_metrics_t *out) {
+    *out = metrics;
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Bucket i counts connections that got an address in less than
+// WIFI_FAST_CONNECT_MIN_MS << i milliseconds, the last one everything slower
+#define WIFI_FAST_CONNECT_BUCKETS 8
+#define WIFI_FAST_CONNECT_MIN_MS 128
+
+// The access point the station last got an address through, kept in NVS
+// across boots. The address itself is left to DHCP, which asks for the last
+// one again (CONFIG_LWIP_DHCP_RESTORE_LAST_IP) and takes whatever the server
+// answers, so a stale address is never used.
+typedef struct {
+    uint8_t bssid[6];
+    uint8_t channel;
+    uint8_t valid;
+} wifi_lease_t;
+
+typedef struct {
+    uint32_t fast;      // connections through the stored lease
+    uint32_t full;      // connections through a scan
+    uint32_t fallbacks; // stored leases that did not work
+    uint32_t last_ms;   // time to an address of the last connection
+    uint32_t latency[WIFI_FAST_CONNECT_BUCKETS];
+} wifi_fast_connect_metrics_t;
+
+// Picks how the station connects. With a stored lease it goes straight to
+// the access point on its channel; if that does not get an address, it
+// falls back to the full scan until the next success. The caller does the
+// connecting and persisting, so this runs against the device's events as
+// well as simulated ones.
+void wifi_fast_connect_init(const wifi_lease_t *stored);
+// Returns the lease to connect with, NULL for a full scan. The time to an
+// address is counted from the first attempt after a disconnection.
+const wifi_lease_t *wifi_fast_connect_attempt(uint32_t now_ms);
+// The station lost or never got its connection
+void wifi_fast_connect_disconnected(void);
+// The station got an address with `current`. Returns true if the lease
+// changed and should be stored.
+bool wifi_fast_connect_got_ip(uint32_t now_ms, const wifi_lease_t *current);
+// Forgets the lease, for new credentials
+void wifi_fast_connect_forget(void);
+void wifi_fast_connect_get_metrics(wifi_fast_connect_metrics_t *metrics);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,45 @@
+#include "./wifi_reconnect.h"
+
+void wifi_reconnect_init(wifi_reconnect_t *reconnect, uint32_t seed) {
+    reconnect->failures = 0;
+    reconnect->auth_failures = 0;
+    reconnect->random = seed != 0 ? seed : 0x9E3779B9U;
+}
+
+static uint32_t wifi_reconnect_random(wifi_reconnect_t *reconnect) {
+    uint32_t x = reconnect->random;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return reconnect->random = x;
+}
+
+static bool wifi_reconnect_is_auth(uint8_t reason) {
+    return reason == WIFI_RECONNECT_REASON_AUTH_FAIL ||
+           reason == WIFI_RECONNECT_REASON_4WAY_HANDSHAKE_TIMEOUT ||
+           reason == WIFI_RECONNECT_REASON_HANDSHAKE_TIMEOUT;
+}
+
+uint32_t wifi_reconnect_disconnected(wifi_reconnect_t *reconnect,
+                                     uint8_t reason, bool was_connected) {
+    if (was_connected) {
+        // A working connection that dropped, most likely a blip: try again
+        // right away, backing off only if that fails too
+        reconnect->failures = 0;
+        reconnect->auth_failures = 0;
+        return 0;
+    }
+    reconnect->failures++;
+    if (wifi_reconnect_is_auth(reason))
+        reconnect->auth_failures++;
+    if (reconnect->failures >= WIFI_RECONNECT_MAX_FAILURES ||
+        reconnect->auth_failures >= WIFI_RECONNECT_MAX_AUTH_FAILURES)
+        return WIFI_RECONNECT_GIVE_UP;
+
+    uint32_t delay = WIFI_RECONNECT_MAX_MS;
+    if (reconnect->failures <= 16 &&
+        (WIFI_RECONNECT_BASE_MS << (reconnect->failures - 1)) <
+            WIFI_RECONNECT_MAX_MS)
+        delay = WIFI_RECONNECT_BASE_MS << (reconnect->failures - 1);
+    return delay - wifi_reconnect_random(reconnect) % (delay / 2 + 1);
+}
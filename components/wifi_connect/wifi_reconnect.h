@@ -0,0 +1,44 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Waits between attempts double from WIFI_RECONNECT_BASE_MS up to
+// WIFI_RECONNECT_MAX_MS, each one jittered down by up to half so stations
+// dropped together do not come back together
+#define WIFI_RECONNECT_BASE_MS 500
+#define WIFI_RECONNECT_MAX_MS 30000
+// Failed attempts in a row before giving up, 1.5 to 2 minutes of trying
+#define WIFI_RECONNECT_MAX_FAILURES 10
+// Rejected credentials do not get better by trying, give up sooner
+#define WIFI_RECONNECT_MAX_AUTH_FAILURES 3
+// Returned instead of a wait when it is time for the configuration mode
+#define WIFI_RECONNECT_GIVE_UP UINT32_MAX
+
+// Disconnection reasons the backoff tells apart, values of
+// wifi_err_reason_t in esp_wifi_types.h
+#define WIFI_RECONNECT_REASON_4WAY_HANDSHAKE_TIMEOUT 15
+#define WIFI_RECONNECT_REASON_BEACON_TIMEOUT 200
+#define WIFI_RECONNECT_REASON_NO_AP_FOUND 201
+#define WIFI_RECONNECT_REASON_AUTH_FAIL 202
+#define WIFI_RECONNECT_REASON_HANDSHAKE_TIMEOUT 204
+
+typedef struct {
+    uint32_t failures;      // attempts that failed since the last connection
+    uint32_t auth_failures; // of which rejected credentials
+    uint32_t random;        // xorshift32 state, never 0
+} wifi_reconnect_t;
+
+void wifi_reconnect_init(wifi_reconnect_t *reconnect, uint32_t seed);
+// The station was disconnected for `reason`; `was_connected` if it had an
+// address, otherwise it was an attempt that failed. Returns how many
+// milliseconds to wait before the next attempt, or WIFI_RECONNECT_GIVE_UP.
+uint32_t wifi_reconnect_disconnected(wifi_reconnect_t *reconnect,
+                                     uint8_t reason, bool was_connected);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,178 @@
+#include "./wifi_scan.h"
+#include <stdio.h>
+#include <string.h>
+
+enum {
+    WIFI_SCAN_JSON_HEADER,
+    WIFI_SCAN_JSON_NETWORKS,
+    WIFI_SCAN_JSON_END,
+    WIFI_SCAN_JSON_DONE,
+};
+
+static const wifi_scanner_t *scanner;
+// Set from the task requesting a scan, cleared from the one it ends in
+static volatile bool scanning;
+// Written by wifi_scan_done() only, then copied to the cache
+static wifi_scan_ap_t staging[WIFI_SCAN_MAX_APS];
+// Everything below is guarded by scanner->lock
+static wifi_scan_ap_t cache[WIFI_SCAN_MAX_APS];
+static size_t cache_count;
+static uint32_t cache_time;
+static uint32_t generation; // 0 until the first scan completed
+
+void wifi_scan_init(const wifi_scanner_t *value) {
+    scanner = value;
+    scanning = false;
+    cache_count = 0;
+    generation = 0;
+}
+
+bool wifi_scan_request(uint32_t now_ms) {
+    if (scanning) return true;
+    scanner->lock(scanner->ctx);
+    bool fresh = generation != 0 && now_ms - cache_time < WIFI_SCAN_MAX_AGE_MS;
+    scanner->unlock(scanner->ctx);
+    if (fresh) return false;
+    // Set first, the scan may be done before start() returns
+    scanning = true;
+    if (!scanner->start(scanner->ctx)) scanning = false;
+    return scanning;
+}
+
+// Strongest first, and each network only once: access points sharing an
+// SSID (repeaters, mesh) show up as their strongest one
+static size_t wifi_scan_sort(wifi_scan_ap_t *aps, size_t count) {
+    for (size_t i = 1; i < count; i++) {
+        wifi_scan_ap_t ap = aps[i];
+        size_t j = i;
+        for (; j > 0 && aps[j - 1].rssi < ap.rssi; j--)
+            aps[j] = aps[j - 1];
+        aps[j] = ap;
+    }
+    size_t kept = 0;
+    for (size_t i = 0; i < count; i++) {
+        bool duplicate = aps[i].ssid[0] == '\0'; // hidden
+        for (size_t j = 0; j < kept && !duplicate; j++)
+            duplicate = strcmp(aps[j].ssid, aps[i].ssid) == 0;
+        if (!duplicate) aps[kept++] = aps[i];
+    }
+    return kept;
+}
+
+void wifi_scan_done(uint32_t now_ms, bool success) {
+    scanning = false;
+    if (!success) return;
+    size_t count = scanner->results(scanner->ctx, staging, WIFI_SCAN_MAX_APS);
+    if (count > WIFI_SCAN_MAX_APS) count = WIFI_SCAN_MAX_APS;
+    for (size_t i = 0; i < count; i++)
+        staging[i].ssid[sizeof(staging[i].ssid) - 1] = '\0';
+    count = wifi_scan_sort(staging, count);
+
+    scanner->lock(scanner->ctx);
+    memcpy(cache, staging, count * sizeof(*cache));
+    cache_count = count;
+    cache_time = now_ms;
+    generation++;
+    scanner->unlock(scanner->ctx);
+}
+
+size_t wifi_scan_count(void) {
+    scanner->lock(scanner->ctx);
+    size_t count = cache_count;
+    scanner->unlock(scanner->ctx);
+    return count;
+}
+
+static size_t json_string(char *out, const char *value) {
+    static const char hex[] = "0123456789abcdef";
+    size_t length = 0;
+    out[length++] = '"';
+    for (const uint8_t *c = (const uint8_t *)value; *c != '\0'; c++) {
+        if (*c == '"' || *c == '\\') {
+            out[length++] = '\\';
+            out[length++] = (char)*c;
+        } else if (*c < 0x20 || *c == 0x7F) {
+            memcpy(out + length, "\\u00", 4);
+            out[length + 4] = hex[*c >> 4];
+            out[length + 5] = hex[*c & 0xF];
+            length += 6;
+        } else {
+            out[length++] = (char)*c;
+        }
+    }
+    out[length++] = '"';
+    return length;
+}
+
+static size_t json_network(char *out, const wifi_scan_ap_t *ap, bool first) {
+    size_t length = 0;
+    if (!first) out[length++] = ',';
+    memcpy(out + length, "{\"ssid\":", 8);
+    length += 8;
+    length += json_string(out + length, ap->ssid);
+    length += sprintf(out + length,
+                      ",\"bssid\":\"%02x:%02x:%02x:%02x:%02x:%02x\""
+                      ",\"rssi\":%d,\"channel\":%u,\"auth\":%u}",
+                      ap->bssid[0], ap->bssid[1], ap->bssid[2], ap->bssid[3],
+                      ap->bssid[4], ap->bssid[5], ap->rssi, ap->channel,
+                      ap->authmode);
+    return length;
+}
+
+void wifi_scan_json_begin(wifi_scan_json_t *json, uint32_t now_ms) {
+    scanner->lock(scanner->ctx);
+    json->generation = generation;
+    uint32_t age = generation != 0 ? now_ms - cache_time : 0;
+    scanner->unlock(scanner->ctx);
+
+    json->index = 0;
+    json->stage = WIFI_SCAN_JSON_HEADER;
+    json->length = (size_t)sprintf(
+        json->entry, "{\"age_ms\":%u,\"scanning\":%s,\"networks\":[",
+        (unsigned)age, scanning ? "true" : "false");
+    json->offset = 0;
+}
+
+// Formats the next piece of the JSON into json->entry
+static void wifi_scan_json_next(wifi_scan_json_t *json) {
+    json->offset = 0;
+    json->length = 0;
+    if (json->stage == WIFI_SCAN_JSON_HEADER)
+        json->stage = WIFI_SCAN_JSON_NETWORKS;
+    if (json->stage == WIFI_SCAN_JSON_NETWORKS) {
+        // Copied out so the lock is not held while formatting
+        wifi_scan_ap_t ap;
+        scanner->lock(scanner->ctx);
+        bool more = json->generation == generation && json->index < cache_count;
+        if (more) ap = cache[json->index];
+        scanner->unlock(scanner->ctx);
+        if (more) {
+            json->length = json_network(json->entry, &ap, json->index == 0);
+            json->index++;
+            return;
+        }
+        json->stage = WIFI_SCAN_JSON_END;
+    }
+    if (json->stage == WIFI_SCAN_JSON_END) {
+        memcpy(json->entry, "]}", 2);
+        json->length = 2;
+        json->stage = WIFI_SCAN_JSON_DONE;
+    }
+}
+
+size_t wifi_scan_json_read(wifi_scan_json_t *json, char *buffer, size_t size) {
+    size_t filled = 0;
+    while (filled < size) {
+        if (json->offset == json->length) {
+            if (json->stage == WIFI_SCAN_JSON_DONE) break;
+            wifi_scan_json_next(json);
+            continue;
+        }
+        size_t count = json->length - json->offset;
+        if (count > size - filled) count = size - filled;
+        memcpy(buffer + filled, json->entry + json->offset, count);
+        json->offset += count;
+        filled += count;
+    }
+    return filled;
+}
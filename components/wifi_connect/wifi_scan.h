@@ -0,0 +1,74 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Most networks kept from a scan, the strongest ones
+#define WIFI_SCAN_MAX_APS 20
+// Results older than this are refreshed by the next wifi_scan_request()
+#define WIFI_SCAN_MAX_AGE_MS 15000
+
+typedef struct {
+    char ssid[33];
+    uint8_t bssid[6];
+    int8_t rssi;
+    uint8_t channel;
+    uint8_t authmode; // wifi_auth_mode_t
+} wifi_scan_ap_t;
+
+// What the scan service needs from the radio: esp_wifi on the device
+// (wifi_scan_esp.c), a stand-in on the host
+typedef struct {
+    // Starts a scan without waiting for it, wifi_scan_done() is called when
+    // it is over. Returns false if it could not be started.
+    bool (*start)(void *ctx);
+    // Copies up to `max` results of the scan that just finished, returns
+    // how many there were
+    size_t (*results)(void *ctx, wifi_scan_ap_t *aps, size_t max);
+    // Guard the cached results, which are replaced from the task the scan
+    // completes in and read from the httpd task
+    void (*lock)(void *ctx);
+    void (*unlock)(void *ctx);
+    void *ctx;
+} wifi_scanner_t;
+
+// Scans in the background and keeps the last result set, so the portal
+// never waits for the radio
+void wifi_scan_init(const wifi_scanner_t *scanner);
+// Starts a scan if none is running and the results are missing or older
+// than WIFI_SCAN_MAX_AGE_MS. Returns true if a scan is running.
+bool wifi_scan_request(uint32_t now_ms);
+// To be called when a scan finishes, `success` false if it failed
+void wifi_scan_done(uint32_t now_ms, bool success);
+size_t wifi_scan_count(void);
+
+// Longest JSON object of one network: 32 byte SSID with every character
+// escaped as \u00XX, plus the other members
+#define WIFI_SCAN_JSON_ENTRY_MAX (32 * 6 + 96)
+
+// Streams the cached results as
+//   {"age_ms":N,"scanning":B,"networks":[{"ssid":S,"bssid":S,"rssi":N,
+//    "channel":N,"auth":N},...]}
+// through a buffer of any size. If the results are replaced while being
+// streamed, the array ends early; the JSON stays valid.
+typedef struct {
+    uint32_t generation;
+    size_t index;
+    int stage;
+    char entry[WIFI_SCAN_JSON_ENTRY_MAX];
+    size_t length;
+    size_t offset;
+} wifi_scan_json_t;
+
+void wifi_scan_json_begin(wifi_scan_json_t *json, uint32_t now_ms);
+// Fills up to `size` bytes of `buffer` with the next part of the JSON,
+// returns how many; 0 once all of it has been read
+size_t wifi_scan_json_read(wifi_scan_json_t *json, char *buffer, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
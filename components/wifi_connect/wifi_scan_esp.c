@@ -0,0 +1,55 @@
+#include "./wifi_scan_esp.h"
+#include <esp_log.h>
+#include <esp_wifi.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <stdlib.h>
+#include <string.h>
+
+const static char *TAG = "wifi_scan";
+
+static bool wifi_scan_esp_start(void *ctx) {
+    esp_err_t err = esp_wifi_scan_start(NULL, false);
+    if (err != ESP_OK) ESP_LOGW(TAG, "Scan not started: %d", err);
+    return err == ESP_OK;
+}
+
+static size_t wifi_scan_esp_results(void *ctx, wifi_scan_ap_t *aps,
+                                    size_t max) {
+    uint16_t count = 0;
+    esp_wifi_scan_get_ap_num(&count);
+    if (count > max) count = max;
+    // Records are large, they only live until they are converted. Asking
+    // for fewer than were found still frees the driver's list.
+    wifi_ap_record_t *records = malloc(sizeof(*records) * (count ? count : 1));
+    if (records == NULL) {
+        ESP_LOGE(TAG, "No memory for %u scan results", count);
+        return 0;
+    }
+    if (esp_wifi_scan_get_ap_records(&count, records) != ESP_OK) count = 0;
+    for (size_t i = 0; i < count; i++) {
+        memcpy(aps[i].ssid, records[i].ssid, sizeof(aps[i].ssid));
+        memcpy(aps[i].bssid, records[i].bssid, sizeof(aps[i].bssid));
+        aps[i].rssi = records[i].rssi;
+        aps[i].channel = records[i].primary;
+        aps[i].authmode = records[i].authmode;
+    }
+    free(records);
+    return count;
+}
+
+// The cache is only ever copied in and out, a critical section is cheaper
+// than a mutex for that
+static void wifi_scan_esp_lock(void *ctx) { taskENTER_CRITICAL(); }
+
+static void wifi_scan_esp_unlock(void *ctx) { taskEXIT_CRITICAL(); }
+
+static const wifi_scanner_t scanner = {
+    .start = wifi_scan_esp_start,
+    .results = wifi_scan_esp_results,
+    .lock = wifi_scan_esp_lock,
+    .unlock = wifi_scan_esp_unlock,
+    .ctx = NULL,
+};
+
+const wifi_scanner_t *wifi_scan_esp_scanner(void) { return &scanner; }
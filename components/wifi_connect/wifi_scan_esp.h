@@ -0,0 +1,6 @@
+#pragma once
+#include "./wifi_scan.h"
+
+// The scanner of the device's own radio, esp_wifi_scan_start() and the
+// SYSTEM_EVENT_SCAN_DONE event handled in wifi_connect.c
+const wifi_scanner_t *wifi_scan_esp_scanner(void);
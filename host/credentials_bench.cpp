@@ -0,0 +1,161 @@
+// Checks the streaming parser of the portal's connect form: the same
+// credentials come out whatever chunks the body arrives in, down to one
+// byte at a time, escapes and '+' are decoded, other fields are skipped,
+// and bodies that are malformed, too long or hold invalid credentials are
+// rejected. Then times parsing a body fed at once and in the 64 byte
+// chunks the httpd handler reads.
+//   credentials_bench [rounds]
+#include "bench_check.h"
+#include "wifi_credentials.h"
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+typedef std::chrono::steady_clock Clock;
+
+// Parses `body` fed in chunks of `chunk` bytes, returns the error or NULL
+static const char *parse(const std::string &body, size_t chunk,
+                         wifi_credentials_t &credentials) {
+    wifi_credentials_parser_t parser;
+    wifi_credentials_parser_init(&parser, &credentials);
+    for (size_t offset = 0; offset < body.size(); offset += chunk) {
+        size_t length = body.size() - offset < chunk ? body.size() - offset
+                                                     : chunk;
+        if (!wifi_credentials_parser_feed(&parser, body.data() + offset,
+                                          length))
+            break;
+    }
+    return wifi_credentials_parser_finish(&parser);
+}
+
+static bool is(const wifi_credentials_t &credentials, const std::string &ssid,
+               const std::string &password) {
+    return credentials.ssid_length == ssid.size() &&
+           memcmp(credentials.ssid, ssid.data(), ssid.size()) == 0 &&
+           credentials.password_length == password.size() &&
+           memcmp(credentials.password, password.data(), password.size()) == 0;
+}
+
+// Parses `body` in every chunk size up to its length and checks each
+// gives `ssid` and `password`
+static void accepts(const std::string &body, const std::string &ssid,
+                    const std::string &password, const char *what) {
+    bool all = true;
+    for (size_t chunk = 1; chunk <= body.size(); chunk++) {
+        wifi_credentials_t credentials;
+        all &= parse(body, chunk, credentials) == NULL &&
+               is(credentials, ssid, password);
+    }
+    CHECK(all, what);
+}
+
+static void rejects(const std::string &body, const char *what) {
+    bool all = true;
+    for (size_t chunk = 1; chunk <= body.size(); chunk++) {
+        wifi_credentials_t credentials;
+        all &= parse(body, chunk, credentials) != NULL;
+    }
+    CHECK(all, what);
+}
+
+static std::string escaped(const std::string &value) {
+    static const char hex[] = "0123456789ABCDEF";
+    std::string out;
+    for (unsigned char c : value) {
+        out += '%';
+        out += hex[c >> 4];
+        out += hex[c & 15];
+    }
+    return out;
+}
+
+static void checks() {
+    accepts("ssid=HomeNet&password=secret123", "HomeNet", "secret123",
+            "plain form");
+    accepts("password=secret123&ssid=HomeNet", "HomeNet", "secret123",
+            "fields in any order");
+    accepts("ssid=Caf%C3%A9+Wi-Fi&password=p%40ss+w%2Bord%26%3D",
+            "Caf\xC3\xA9 Wi-Fi", "p@ss w+ord&=", "escapes and '+' decoded");
+    accepts("ssid=Open", "Open", "", "open network without password");
+    accepts("ssid=Open&password=", "Open", "", "empty password");
+    accepts("remember=on&ssid=Home&note=" + escaped(std::string(200, 'n')) +
+                "&password=12345678&submit=Connect",
+            "Home", "12345678", "other fields skipped, however long");
+    accepts("a_very_long_field_name_beyond_the_buffer=x&ssid=Home&"
+            "ssid_but_longer=Other&password=12345678",
+            "Home", "12345678", "long and similar names skipped");
+    accepts("ssid=First&ssid=Second&password=12345678", "Second", "12345678",
+            "last value wins");
+    accepts("checkbox&ssid=Home&password=12345678", "Home", "12345678",
+            "name without value");
+
+    std::string ssid32(32, 'S'), password63(63, 'p'), hex64(64, 'a');
+    hex64[10] = 'F';
+    accepts("ssid=" + escaped(ssid32) + "&password=" + escaped(password63),
+            ssid32, password63, "longest values, every byte escaped");
+    accepts("ssid=Home&password=" + hex64, "Home", hex64, "64 hex digit key");
+    std::string binarySsid("a\0b\xFF", 4);
+    accepts("ssid=a%00b%FF&password=12345678", binarySsid, "12345678",
+            "SSID of any bytes");
+
+    rejects("ssid=" + std::string(33, 'S') + "&password=12345678",
+            "SSID too long");
+    rejects("ssid=Home&password=" + std::string(65, 'p'),
+            "password too long");
+    rejects("ssid=Home&password=" + std::string(64, 'p'),
+            "64 character password not hex");
+    rejects("ssid=Home&password=1234567", "password too short");
+    rejects("ssid=Home&password=1234%0A5678", "control character");
+    rejects("ssid=Home&password=%E2%82%AC12345678", "non ASCII password");
+    rejects("password=12345678", "SSID missing");
+    rejects("ssid=&password=12345678", "SSID empty");
+    rejects("ssid=Home&password=12345%4", "cut in an escape");
+    rejects("ssid=Ho%G1me&password=12345678", "bad escape");
+    rejects("", "empty body");
+
+    // The error is one the page can show
+    wifi_credentials_t credentials;
+    const char *error = parse("ssid=Home&password=short", 64, credentials);
+    CHECK(error != NULL && strstr(error, "8 characters") != NULL,
+          "error message");
+}
+
+static double timeParse(const std::string &body, size_t chunk, long rounds) {
+    wifi_credentials_t credentials;
+    size_t valid = 0;
+    Clock::time_point begin = Clock::now();
+    for (long i = 0; i < rounds; i++)
+        valid += parse(body, chunk, credentials) == NULL;
+    double ns =
+        std::chrono::duration<double, std::nano>(Clock::now() - begin).count();
+    CHECK(valid == (size_t)rounds, "timed body valid");
+    return ns / rounds;
+}
+
+int main(int argc, char **argv) {
+    long rounds = argc > 1 ? atol(argv[1]) : 200000;
+
+    checks();
+
+    static const char *bodies[][2] = {
+        {"typical", "ssid=HomeNet&password=correct+horse+battery"},
+        {"escaped", NULL},
+    };
+    std::string escapedBody = "ssid=" + escaped(std::string(32, 'S')) +
+                              "&password=" + escaped(std::string(63, 'p')) +
+                              "&submit=Connect";
+    printf("%10s %8s %12s %12s %10s\n", "body", "bytes", "whole ns",
+           "64 B ns", "MB/s");
+    for (size_t i = 0; i < sizeof(bodies) / sizeof(bodies[0]); i++) {
+        std::string body = bodies[i][1] != NULL ? bodies[i][1] : escapedBody;
+        double whole = timeParse(body, body.size(), rounds);
+        double chunked = timeParse(body, 64, rounds);
+        printf("%10s %8zu %12.1f %12.1f %10.1f\n", bodies[i][0], body.size(),
+               whole, chunked, body.size() / whole * 1000);
+    }
+    printf("parser state %zu bytes\n", sizeof(wifi_credentials_parser_t));
+
+    return checkResult();
+}
@@ -0,0 +1,477 @@
+// dnsperf style load generator for DNSResponder. Runs the responder on a
+// PosixDNSTransport bound to loopback, replays a query corpus against it
+// with a bounded number of outstanding queries and reports throughput,
+// latency percentiles and heap allocations per query. With -b the responder
+// drains the socket in batches (recvmmsg/sendmmsg) instead of one datagram
+// per call. With -u another thread keeps switching the configuration between
+// two addresses while the load runs; every query must still be answered,
+// with one of the two. With -s the fixed-function DNSStaticResponder
+// answers instead, from a record built at compile time. Header checks the
+// load does not exercise run first.
+#include "DNSResponder.h"
+#include "DNSStaticResponder.h"
+#include "PosixDNSTransport.h"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <atomic>
+#include <chrono>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+typedef std::chrono::steady_clock Clock;
+
+// Queries sent / replies received per system call by the client
+#define CLIENT_BATCH 64
+
+// The default domain "*" of the responder, for -s
+static constexpr auto staticRecord = dnsStaticRecord("*", 192, 168, 4, 1, 60);
+// The encoding is checked by the compiler
+static constexpr auto mixedCaseRecord =
+    dnsStaticRecord("Portal.Local", 10, 0, 0, 1, 300);
+static_assert(mixedCaseRecord.name[0] == 6 && mixedCaseRecord.name[1] == 'p' &&
+                  mixedCaseRecord.name[7] == 5 &&
+                  mixedCaseRecord.name[8] == 'l' &&
+                  mixedCaseRecord.name[13] == 0 &&
+                  sizeof(mixedCaseRecord.name) == 14,
+              "wire name built at compile time");
+static_assert(mixedCaseRecord.answer[8] == 1 &&
+                  mixedCaseRecord.answer[9] == 44 &&
+                  mixedCaseRecord.answer[15] == 1,
+              "answer built at compile time");
+
+static std::atomic<uint64_t> allocations(0);
+static thread_local bool countAllocations = false;
+
+extern "C" {
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void __real_free(void *ptr);
+
+void *__wrap_malloc(size_t size) {
+    if (countAllocations) allocations++;
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t count, size_t size) {
+    if (countAllocations) allocations++;
+    return __real_calloc(count, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+    if (countAllocations) allocations++;
+    return __real_realloc(ptr, size);
+}
+
+void __wrap_free(void *ptr) { __real_free(ptr); }
+}
+
+// Keep operator new inside this executable so it goes through the wrapped
+// malloc above instead of the one libstdc++ was linked against
+void *operator new(size_t size) {
+    void *ptr = malloc(size ? size : 1);
+    if (ptr == NULL) throw std::bad_alloc();
+    return ptr;
+}
+void *operator new[](size_t size) { return operator new(size); }
+void operator delete(void *ptr) noexcept { free(ptr); }
+void operator delete[](void *ptr) noexcept { free(ptr); }
+void operator delete(void *ptr, size_t) noexcept { free(ptr); }
+void operator delete[](void *ptr, size_t) noexcept { free(ptr); }
+
+struct Query {
+    std::vector<uint8_t> wire;
+};
+
+static const char *defaultCorpus[] = {
+    "nile.local A",
+    "www.nile.local A",
+    "connectivitycheck.gstatic.com A",
+    "captive.apple.com A",
+    "www.msftconnecttest.com A",
+    "clients3.google.com AAAA",
+    "time.google.com A",
+    "example.org MX",
+};
+
+static uint16_t parseType(const std::string &type) {
+    static const struct {
+        const char *name;
+        uint16_t value;
+    } types[] = {{"A", 1},    {"NS", 2},    {"CNAME", 5}, {"SOA", 6},
+                 {"PTR", 12}, {"MX", 15},   {"TXT", 16},  {"AAAA", 28},
+                 {"SRV", 33}, {"HTTPS", 65}, {"ANY", 255}};
+    for (size_t i = 0; i < sizeof(types) / sizeof(types[0]); i++) {
+        if (strcasecmp(types[i].name, type.c_str()) == 0) return types[i].value;
+    }
+    return (uint16_t)atoi(type.c_str());
+}
+
+// Encodes a corpus line ("name [type]") as a wire format query
+static bool buildQuery(const std::string &line, Query &query) {
+    char name[MAX_DNSNAME_LENGTH + 1], type[16] = "A";
+    if (sscanf(line.c_str(), "%253s %15s", name, type) < 1) return false;
+    if (name[0] == '#') return false;
+
+    DNSHeader header;
+    memset(&header, 0, sizeof(header));
+    header.RD = 1;
+    header.QDCount = dns_htons(1);
+    query.wire.assign((uint8_t *)&header, (uint8_t *)&header + sizeof(header));
+
+    const char *label = name;
+    while (*label != '\0') {
+        const char *dot = strchr(label, '.');
+        size_t length = dot ? (size_t)(dot - label) : strlen(label);
+        if (length == 0 || length > 63) return false;
+        query.wire.push_back((uint8_t)length);
+        query.wire.insert(query.wire.end(), label, label + length);
+        label += length;
+        if (*label == '.') label++;
+    }
+    query.wire.push_back(0);
+
+    uint16_t qtype = dns_htons(parseType(type));
+    uint16_t qclass = dns_htons(DNS_QCLASS_IN);
+    query.wire.insert(query.wire.end(), (uint8_t *)&qtype,
+                      (uint8_t *)&qtype + 2);
+    query.wire.insert(query.wire.end(), (uint8_t *)&qclass,
+                      (uint8_t *)&qclass + 2);
+    return true;
+}
+
+static bool loadCorpus(const char *path, std::vector<Query> &corpus) {
+    Query query;
+    if (path == NULL) {
+        for (size_t i = 0; i < sizeof(defaultCorpus) / sizeof(*defaultCorpus);
+             i++) {
+            if (buildQuery(defaultCorpus[i], query)) corpus.push_back(query);
+        }
+        return true;
+    }
+    FILE *file = fopen(path, "r");
+    if (file == NULL) return false;
+    char line[512];
+    while (fgets(line, sizeof(line), file) != NULL) {
+        if (buildQuery(line, query)) corpus.push_back(query);
+    }
+    fclose(file);
+    return !corpus.empty();
+}
+
+// Hands the responder one query and keeps its reply, for the checks
+// below
+class OneShotTransport : public DNSTransport {
+  public:
+    std::vector<uint8_t> query;
+    std::vector<uint8_t> reply;
+
+    size_t receive(uint8_t *buffer, size_t capacity,
+                   DNSEndpoint &from) override {
+        if (query.size() > capacity) return 0;
+        memcpy(buffer, query.data(), query.size());
+        from.addr = htonl(INADDR_LOOPBACK);
+        from.port = htons(40000);
+        from.local = htonl(INADDR_LOOPBACK);
+        return query.size();
+    }
+    bool send(const DNSSlice *slices, size_t count,
+              const DNSEndpoint &) override {
+        reply.clear();
+        for (size_t i = 0; i < count; i++)
+            reply.insert(reply.end(), slices[i].data,
+                         slices[i].data + slices[i].length);
+        return true;
+    }
+    void setReceiveTimeout(uint32_t) override {}
+};
+
+// An A query followed by one EDNS0 OPT record, claiming `arCount`
+// additional records. Only a count of 0 or 1 is answered: the count is
+// compared in host byte order, so 256 (0x0100 on the wire) is refused as
+// well as 2.
+static bool checkARCount() {
+    static const uint8_t opt[DNS_OPT_RECORD_SIZE] = {
+        0, 0, DNS_QTYPE_OPT, 0x05, 0xC0, 0, 0, 0, 0, 0, 0};
+    static const struct {
+        uint16_t arCount;
+        bool answered;
+    } cases[] = {{0, true}, {1, true}, {2, false}, {256, false}};
+    OneShotTransport transport;
+    DNSResponder responder;
+    const uint8_t ip[4] = {192, 168, 4, 1};
+    std::string domain = "*";
+    Query query;
+    responder.setTransport(&transport);
+    responder.setDomain(domain, ip);
+    buildQuery("nile.local A", query);
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        transport.query = query.wire;
+        if (cases[i].arCount != 0)
+            transport.query.insert(transport.query.end(), opt,
+                                   opt + sizeof(opt));
+        DNSHeader *header = (DNSHeader *)transport.query.data();
+        header->ARCount = dns_htons(cases[i].arCount);
+        transport.reply.clear();
+        responder.processNextRequest();
+        header = (DNSHeader *)transport.reply.data();
+        bool answered = transport.reply.size() >= DNS_HEADER_SIZE &&
+                        header->RCode == 0 && header->ANCount == dns_htons(1);
+        bool refused = transport.reply.size() >= DNS_HEADER_SIZE &&
+                       header->RCode == (uint8_t)DNSReplyCode::FormError;
+        if (cases[i].answered ? !answered : !refused) {
+            fprintf(stderr, "ARCount %u %s\n", cases[i].arCount,
+                    cases[i].answered ? "not answered" : "not refused");
+            return false;
+        }
+    }
+    return true;
+}
+
+static void usage(const char *argv0) {
+    fprintf(stderr,
+            "Usage: %s [-d domain] [-f corpus] [-n queries] [-w window] "
+            "[-a max-allocs-per-query] [-b] [-u interval-us] [-s]\n"
+            "  -d  domain served by the responder (default \"*\")\n"
+            "  -f  query corpus, one \"name [type]\" per line\n"
+            "  -n  number of queries to send (default 100000)\n"
+            "  -w  maximum outstanding queries (default 16)\n"
+            "  -a  exit with failure if allocations per query exceed this\n"
+            "  -b  answer in batches of up to DNS_BATCH_SIZE requests\n"
+            "  -u  publish a new configuration every interval-us\n"
+            "  -s  answer with DNSStaticResponder, \"*\" built at compile "
+            "time\n",
+            argv0);
+}
+
+int main(int argc, char **argv) {
+    std::string domain = "*";
+    const char *corpusPath = NULL;
+    long queryCount = 100000;
+    int window = 16;
+    double maxAllocs = -1;
+    bool batch = false;
+    long updateInterval = 0;
+    bool fixed = false;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "d:f:n:w:a:bu:sh")) != -1) {
+        switch (opt) {
+            case 'd':
+                domain = optarg;
+                break;
+            case 'f':
+                corpusPath = optarg;
+                break;
+            case 'n':
+                queryCount = atol(optarg);
+                break;
+            case 'w':
+                window = atoi(optarg);
+                break;
+            case 'a':
+                maxAllocs = atof(optarg);
+                break;
+            case 'b':
+                batch = true;
+                break;
+            case 'u':
+                updateInterval = atol(optarg);
+                break;
+            case 's':
+                fixed = true;
+                break;
+            default:
+                usage(argv[0]);
+                return 2;
+        }
+    }
+    if (queryCount <= 0 || window <= 0 || window > 0xFFFF ||
+        (fixed && (batch || updateInterval > 0 || domain != "*"))) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    if (!checkARCount()) return 1;
+
+    std::vector<Query> corpus;
+    if (!loadCorpus(corpusPath, corpus)) {
+        fprintf(stderr, "Could not load corpus %s\n", corpusPath);
+        return 2;
+    }
+
+    PosixDNSTransport transport;
+    if (!transport.open(htonl(INADDR_LOOPBACK), 0, 50)) {
+        perror("server socket");
+        return 2;
+    }
+    DNSResponder responder;
+    const uint8_t resolvedIP[4] = {192, 168, 4, 1};
+    responder.setTransport(&transport);
+    responder.setDomain(domain, resolvedIP);
+    static DNSStaticResponder staticResponder(staticRecord);
+    staticResponder.setTransport(&transport);
+
+    std::atomic<bool> running(true);
+    std::thread server([&]() {
+        countAllocations = true;
+        while (running) {
+            if (fixed)
+                staticResponder.processNextRequest();
+            else if (batch)
+                responder.processNextBatch();
+            else
+                responder.processNextRequest();
+        }
+    });
+
+    const uint8_t otherIP[4] = {10, 0, 0, 1};
+    std::atomic<long> updates(0);
+    std::thread updater([&]() {
+        while (running && updateInterval > 0) {
+            DNSConfig *config = responder.beginUpdate();
+            config->setDomain(domain, updates % 2 ? resolvedIP : otherIP);
+            responder.commitUpdate(config);
+            updates++;
+            std::this_thread::sleep_for(
+                std::chrono::microseconds(updateInterval));
+        }
+    });
+
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    sockaddr_in serverAddr;
+    memset(&serverAddr, 0, sizeof(serverAddr));
+    serverAddr.sin_family = AF_INET;
+    serverAddr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    serverAddr.sin_port = htons(transport.port());
+    if (fd < 0 || connect(fd, (sockaddr *)&serverAddr, sizeof(serverAddr))) {
+        perror("client socket");
+        return 2;
+    }
+
+    std::vector<Clock::time_point> sentAt(0x10000);
+    std::vector<double> latencies;
+    latencies.reserve(queryCount);
+    long sent = 0, lost = 0, wrong = 0;
+    int outstanding = 0;
+
+    // The client sends and receives with sendmmsg()/recvmmsg() so that it
+    // is cheaper per query than the responder it measures
+    static uint8_t queries[CLIENT_BATCH][MAX_DNS_PACKETSIZE];
+    static uint8_t replies[CLIENT_BATCH][MAX_DNS_PACKETSIZE];
+    mmsghdr msgs[CLIENT_BATCH];
+    iovec iov[CLIENT_BATCH];
+
+    Clock::time_point begin = Clock::now();
+    while (sent < queryCount || outstanding > 0) {
+        int n = 0;
+        while (sent + n < queryCount && outstanding + n < window &&
+               n < CLIENT_BATCH) {
+            std::vector<uint8_t> &wire = corpus[(sent + n) % corpus.size()].wire;
+            uint16_t id = (uint16_t)(sent + n);
+            memcpy(queries[n], &wire[0], wire.size());
+            memcpy(queries[n], &id, sizeof(id));
+            iov[n].iov_base = queries[n];
+            iov[n].iov_len = wire.size();
+            memset(&msgs[n], 0, sizeof(msgs[n]));
+            msgs[n].msg_hdr.msg_iov = &iov[n];
+            msgs[n].msg_hdr.msg_iovlen = 1;
+            sentAt[id] = Clock::now();
+            n++;
+        }
+        for (int i = 0; i < n;) {
+            int r = sendmmsg(fd, msgs + i, n - i, 0);
+            if (r <= 0) {
+                perror("sendmmsg");
+                return 2;
+            }
+            i += r;
+        }
+        sent += n;
+        outstanding += n;
+
+        pollfd pfd = {fd, POLLIN, 0};
+        if (poll(&pfd, 1, 1000) <= 0) {
+            // Whatever is still outstanding is not coming back
+            lost += outstanding;
+            outstanding = 0;
+            continue;
+        }
+        for (int i = 0; i < CLIENT_BATCH; i++) {
+            iov[i].iov_base = replies[i];
+            iov[i].iov_len = sizeof(replies[i]);
+            memset(&msgs[i], 0, sizeof(msgs[i]));
+            msgs[i].msg_hdr.msg_iov = &iov[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+        int received = recvmmsg(fd, msgs, CLIENT_BATCH, MSG_DONTWAIT, NULL);
+        Clock::time_point now = Clock::now();
+        for (int i = 0; i < received; i++) {
+            // Late replies to queries already written off as lost are
+            // ignored
+            if (msgs[i].msg_len < DNS_HEADER_SIZE || outstanding == 0)
+                continue;
+            uint16_t id;
+            memcpy(&id, replies[i], sizeof(id));
+            // A answers end with the address, which must be one of the
+            // configured ones whatever the updates are doing
+            DNSHeader *header = (DNSHeader *)replies[i];
+            const uint8_t *address = replies[i] + msgs[i].msg_len - 4;
+            if (header->ANCount != 0 && header->ARCount == 0 &&
+                memcmp(address, resolvedIP, 4) != 0 &&
+                memcmp(address, otherIP, 4) != 0)
+                wrong++;
+            latencies.push_back(
+                std::chrono::duration<double, std::micro>(now - sentAt[id])
+                    .count());
+            outstanding--;
+        }
+    }
+    double seconds =
+        std::chrono::duration<double>(Clock::now() - begin).count();
+
+    running = false;
+    server.join();
+    updater.join();
+    close(fd);
+
+    size_t completed = latencies.size();
+    std::sort(latencies.begin(), latencies.end());
+    double p50 = completed ? latencies[completed / 2] : 0;
+    double p99 = completed ? latencies[completed * 99 / 100] : 0;
+    double allocsPerQuery =
+        completed ? (double)allocations.load() / completed : 0;
+
+    printf("queries sent:      %ld\n", sent);
+    printf("queries completed: %zu (lost %ld)\n", completed, lost);
+    printf("run time:          %.3f s\n", seconds);
+    printf("queries/sec:       %.0f\n", completed / seconds);
+    printf("latency p50:       %.1f us\n", p50);
+    printf("latency p99:       %.1f us\n", p99);
+    printf("allocations/query: %.2f\n", allocsPerQuery);
+    printf("responder size:    %zu bytes\n",
+           fixed ? sizeof(staticResponder) : sizeof(responder));
+    if (updateInterval > 0)
+        printf("config updates:    %ld (%ld wrong answers)\n", updates.load(),
+               wrong);
+
+    if (updateInterval > 0 && (lost != 0 || wrong != 0)) {
+        fprintf(stderr, "queries lost or misanswered during updates\n");
+        return 1;
+    }
+
+    if (maxAllocs >= 0 && allocsPerQuery > maxAllocs) {
+        fprintf(stderr, "allocations per query %.2f exceed limit %.2f\n",
+                allocsPerQuery, maxAllocs);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,143 @@
+// Replays station events against wifi_fast_connect with a simulated radio
+// and clock: first boot, reboot with a stored lease, a dropped connection,
+// an access point that was replaced and a connection failing halfway. Checks
+// which path each attempt takes and what gets stored, and reports the
+// simulated time to an address of each path.
+#include "bench_check.h"
+#include "wifi_fast_connect.h"
+#include <stdio.h>
+#include <string.h>
+
+// Rough costs on the air: a scan listens ~120 ms per channel, DHCP is a
+// couple of round trips plus the server's delay, asking for the last
+// address again on the same network is one
+#define SCAN_CHANNEL_MS 120
+#define CHANNELS 13
+#define ASSOCIATE_MS 60
+#define DHCP_MS 1200
+#define DHCP_REBOOT_MS 40
+
+struct AccessPoint {
+    uint8_t bssid[6];
+    uint8_t channel;
+    bool up;
+};
+
+static uint32_t clock_ms;
+static AccessPoint ap = {{0x24, 0x0a, 0xc4, 0x00, 0x00, 0x01}, 6, true};
+static wifi_lease_t nvs; // what the device would have stored
+static unsigned stores;
+
+static wifi_lease_t current(void) {
+    wifi_lease_t lease;
+    memset(&lease, 0, sizeof(lease));
+    memcpy(lease.bssid, ap.bssid, sizeof(lease.bssid));
+    lease.channel = ap.channel;
+    lease.valid = 1;
+    return lease;
+}
+
+// One connection attempt the way wifi_connect.c makes it: returns true on
+// SYSTEM_EVENT_STA_GOT_IP, false on SYSTEM_EVENT_STA_DISCONNECTED
+static bool attempt(bool *targeted) {
+    const wifi_lease_t *lease = wifi_fast_connect_attempt(clock_ms);
+    *targeted = lease != NULL;
+    if (lease != NULL) {
+        clock_ms += SCAN_CHANNEL_MS;
+        if (!ap.up || memcmp(lease->bssid, ap.bssid, 6) != 0 ||
+            lease->channel != ap.channel) {
+            wifi_fast_connect_disconnected(); // NO_AP_FOUND
+            return false;
+        }
+        clock_ms += ASSOCIATE_MS + DHCP_REBOOT_MS;
+    } else {
+        clock_ms += SCAN_CHANNEL_MS * CHANNELS;
+        if (!ap.up) {
+            wifi_fast_connect_disconnected();
+            return false;
+        }
+        clock_ms += ASSOCIATE_MS + DHCP_MS;
+    }
+    wifi_lease_t connected = current();
+    if (wifi_fast_connect_got_ip(clock_ms, &connected)) {
+        nvs = connected;
+        stores++;
+    }
+    return true;
+}
+
+int main() {
+    bool targeted;
+    wifi_fast_connect_metrics_t metrics;
+
+    // First boot: nothing stored, full scan, lease stored
+    wifi_fast_connect_init(NULL);
+    CHECK(attempt(&targeted) && !targeted, "first boot scans");
+    CHECK(stores == 1 && nvs.valid && nvs.channel == 6, "first lease stored");
+    wifi_fast_connect_get_metrics(&metrics);
+    uint32_t full_ms = metrics.last_ms;
+
+    // Reboot: straight to the stored access point, nothing to store
+    clock_ms += 10000;
+    wifi_fast_connect_init(&nvs);
+    CHECK(attempt(&targeted) && targeted,
+          "reboot goes to the stored access point");
+    CHECK(stores == 1, "nothing stored again");
+    wifi_fast_connect_get_metrics(&metrics);
+    uint32_t fast_ms = metrics.last_ms;
+
+    // Beacon timeout: the lease still works
+    wifi_fast_connect_disconnected();
+    CHECK(attempt(&targeted) && targeted,
+          "lease still works after a beacon timeout");
+
+    // The access point was replaced: one targeted attempt, then a scan
+    // finds the new one and its lease is stored
+    wifi_fast_connect_disconnected();
+    ap.bssid[5] = 0x02;
+    ap.channel = 11;
+    uint32_t lost = clock_ms;
+    CHECK(!attempt(&targeted) && targeted, "replaced access point tried once");
+    CHECK(attempt(&targeted) && !targeted, "then scanned for");
+    CHECK(stores == 2 && nvs.channel == 11 && nvs.bssid[5] == 0x02,
+          "new lease stored");
+    wifi_fast_connect_get_metrics(&metrics);
+    CHECK(metrics.last_ms == clock_ms - lost, "time counted from the loss");
+    uint32_t fallback_ms = metrics.last_ms;
+
+    // Down for two scans: time is counted from the first attempt, and the
+    // new lease is used again once connected
+    wifi_fast_connect_disconnected();
+    ap.up = false;
+    lost = clock_ms;
+    CHECK(!attempt(&targeted) && targeted,
+          "outage: stored access point tried once");
+    CHECK(!attempt(&targeted) && !targeted, "outage: then scanned for");
+    ap.up = true;
+    CHECK(attempt(&targeted) && !targeted, "scan finds it back");
+    wifi_fast_connect_get_metrics(&metrics);
+    CHECK(metrics.last_ms == clock_ms - lost,
+          "time counted from the first attempt");
+    wifi_fast_connect_disconnected();
+    CHECK(attempt(&targeted) && targeted, "new lease used again");
+
+    // New credentials
+    wifi_fast_connect_forget();
+    wifi_fast_connect_disconnected();
+    CHECK(attempt(&targeted) && !targeted, "new credentials scan");
+
+    wifi_fast_connect_get_metrics(&metrics);
+    // Counted since the reboot
+    CHECK(metrics.fast == 3 && metrics.full == 3 && metrics.fallbacks == 2,
+          "connections counted");
+    uint32_t counted = 0;
+    for (int i = 0; i < WIFI_FAST_CONNECT_BUCKETS; i++)
+        counted += metrics.latency[i];
+    CHECK(counted == metrics.fast + metrics.full,
+          "every connection in the histogram");
+
+    printf("time to address (simulated): lease %u ms, scan %u ms, "
+           "replaced access point %u ms\n",
+           fast_ms, full_ms, fallback_ms);
+    return checkResult();
+}
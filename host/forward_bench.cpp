@@ -0,0 +1,300 @@
+// Checks DNSResponder in forwarding mode against a stand-in upstream
+// resolver on loopback, then measures how fast cached answers come back.
+// The resolver answers every A question with 203.0.113.1, names starting
+// with "nx" with NXDOMAIN and an SOA, and names starting with "short" with
+// a TTL of one second. It counts the queries it gets, which is how the
+// cache and the de-duplication of questions in flight are checked.
+#include "DNSResponder.h"
+#include "PosixDNSTransport.h"
+#include "bench_check.h"
+#include <arpa/inet.h>
+#include <atomic>
+#include <chrono>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+
+typedef std::chrono::steady_clock Clock;
+
+static const uint8_t upstreamAnswer[4] = {203, 0, 113, 1};
+static const uint8_t portalIP[4] = {192, 168, 4, 1};
+
+static int udpSocket(uint16_t *port) {
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    sockaddr_in addr;
+    socklen_t length = sizeof(addr);
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (fd < 0 || bind(fd, (sockaddr *)&addr, sizeof(addr)) != 0 ||
+        getsockname(fd, (sockaddr *)&addr, &length) != 0) {
+        perror("socket");
+        exit(2);
+    }
+    if (port != NULL) *port = ntohs(addr.sin_port);
+    return fd;
+}
+
+static void put16(uint8_t *out, uint16_t value) {
+    value = htons(value);
+    memcpy(out, &value, sizeof(value));
+}
+
+static void put32(uint8_t *out, uint32_t value) {
+    value = htonl(value);
+    memcpy(out, &value, sizeof(value));
+}
+
+// Stand-in for the resolver of the network the station joined. Replies
+// after `delayMs` so that questions can pile up in the forwarder.
+class Upstream {
+  public:
+    std::atomic<int> queries;
+    std::atomic<int> delayMs;
+
+    Upstream() : queries(0), delayMs(0), _running(true) {
+        _fd = udpSocket(&_port);
+        _thread = std::thread(&Upstream::run, this);
+    }
+    ~Upstream() {
+        _running = false;
+        _thread.join();
+        close(_fd);
+    }
+    uint16_t port() const { return _port; }
+
+  private:
+    int _fd;
+    uint16_t _port;
+    std::atomic<bool> _running;
+    std::thread _thread;
+
+    void run() {
+        uint8_t buffer[MAX_DNS_PACKETSIZE];
+        while (_running) {
+            pollfd pfd = {_fd, POLLIN, 0};
+            if (poll(&pfd, 1, 20) <= 0) continue;
+            sockaddr_in from;
+            socklen_t fromLength = sizeof(from);
+            ssize_t length = recvfrom(_fd, buffer, sizeof(buffer), 0,
+                                      (sockaddr *)&from, &fromLength);
+            if (length < (ssize_t)DNS_HEADER_SIZE) continue;
+            queries++;
+            if (delayMs > 0)
+                std::this_thread::sleep_for(
+                    std::chrono::milliseconds(delayMs.load()));
+            length = respond(buffer, (size_t)length);
+            sendto(_fd, buffer, length, 0, (sockaddr *)&from, fromLength);
+        }
+    }
+
+    static size_t respond(uint8_t *buffer, size_t length) {
+        DNSHeader *header = (DNSHeader *)buffer;
+        const uint8_t *name = buffer + DNS_HEADER_SIZE;
+        bool nx = name[0] >= 2 && memcmp(name + 1, "nx", 2) == 0;
+        bool shortLived = name[0] >= 5 && memcmp(name + 1, "short", 5) == 0;
+        size_t nameLength = dnsNameLength(name, length - DNS_HEADER_SIZE);
+        uint8_t *out = buffer + DNS_HEADER_SIZE + nameLength + 4;
+
+        header->QR = DNS_QR_RESPONSE;
+        header->RA = 1;
+        header->ARCount = 0;
+        // Owner name: pointer to the question
+        put16(out, 0xC000 | DNS_HEADER_SIZE);
+        if (nx) {
+            header->RCode = (unsigned char)DNSReplyCode::NonExistentDomain;
+            header->NSCount = htons(1);
+            put16(out + 2, DNS_QTYPE_SOA);
+            put16(out + 4, DNS_QCLASS_IN);
+            put32(out + 6, 60);
+            put16(out + 10, DNS_SOA_RDATA_SIZE);
+            memset(out + 12, 0, DNS_SOA_RDATA_SIZE);
+            put32(out + 12 + DNS_SOA_RDATA_SIZE - 4, 60);
+            return out + 12 + DNS_SOA_RDATA_SIZE - buffer;
+        }
+        header->ANCount = htons(1);
+        put16(out + 2, DNS_QTYPE_A);
+        put16(out + 4, DNS_QCLASS_IN);
+        put32(out + 6, shortLived ? 1 : 300);
+        put16(out + 10, 4);
+        memcpy(out + 12, upstreamAnswer, 4);
+        return out + 16 - buffer;
+    }
+};
+
+struct Reply {
+    size_t length;
+    uint8_t data[MAX_DNS_PACKETSIZE];
+
+    const DNSHeader *header() const { return (const DNSHeader *)data; }
+    // Last four bytes, the address of a single A answer
+    const uint8_t *address() const { return data + length - 4; }
+    // TTL of the first record after the question
+    uint32_t ttl(size_t questionLength) const {
+        uint32_t ttl;
+        memcpy(&ttl, data + DNS_HEADER_SIZE + questionLength + 6,
+               sizeof(ttl));
+        return ntohl(ttl);
+    }
+};
+
+static size_t buildQuery(const char *name, uint16_t id, uint8_t *out) {
+    memset(out, 0, DNS_HEADER_SIZE);
+    DNSHeader *header = (DNSHeader *)out;
+    header->ID = id;
+    header->RD = 1;
+    header->QDCount = htons(1);
+    size_t nameLength = dnsEncodeName(name, out + DNS_HEADER_SIZE,
+                                      MAX_DNS_PACKETSIZE - DNS_HEADER_SIZE);
+    put16(out + DNS_HEADER_SIZE + nameLength, DNS_QTYPE_A);
+    put16(out + DNS_HEADER_SIZE + nameLength + 2, DNS_QCLASS_IN);
+    return DNS_HEADER_SIZE + nameLength + 4;
+}
+
+static bool receiveReply(int fd, Reply &reply, int timeoutMs = 1000) {
+    pollfd pfd = {fd, POLLIN, 0};
+    if (poll(&pfd, 1, timeoutMs) <= 0) return false;
+    ssize_t length = recv(fd, reply.data, sizeof(reply.data), 0);
+    if (length < (ssize_t)DNS_HEADER_SIZE) return false;
+    reply.length = (size_t)length;
+    return true;
+}
+
+// Sends one query for `name` and waits for its reply
+static bool ask(int fd, const sockaddr_in &server, const char *name,
+                Reply &reply) {
+    uint8_t query[MAX_DNS_PACKETSIZE];
+    static uint16_t id = 1;
+    size_t length = buildQuery(name, htons(id++), query);
+    sendto(fd, query, length, 0, (const sockaddr *)&server, sizeof(server));
+    return receiveReply(fd, reply) && memcmp(reply.data, query, 2) == 0;
+}
+
+int main(int argc, char **argv) {
+    long queryCount = argc > 1 ? atol(argv[1]) : 100000;
+
+    Upstream upstream;
+    PosixDNSTransport transport;
+    if (!transport.open(htonl(INADDR_LOOPBACK), 0, 20)) {
+        perror("server socket");
+        return 2;
+    }
+    DNSResponder responder;
+    responder.setTransport(&transport);
+    std::string domain = "portal.local";
+    responder.setDomain(domain, portalIP);
+    DNSConfig *config = responder.beginUpdate();
+    DNSEndpoint endpoint = {htonl(INADDR_LOOPBACK), htons(upstream.port())};
+    config->setUpstream(endpoint);
+    responder.commitUpdate(config);
+
+    std::atomic<bool> running(true);
+    std::thread server([&]() {
+        while (running) responder.processNextBatch();
+    });
+
+    sockaddr_in serverAddr;
+    memset(&serverAddr, 0, sizeof(serverAddr));
+    serverAddr.sin_family = AF_INET;
+    serverAddr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    serverAddr.sin_port = htons(transport.port());
+    int fd = udpSocket(NULL);
+    Reply reply;
+    // Name, QTYPE and QCLASS of "example.com"
+    const size_t exampleQuestion = 13 + 4;
+
+    // Forwarded, then answered from the cache with a TTL counting down
+    CHECK(ask(fd, serverAddr, "example.com", reply) &&
+              reply.header()->ANCount == htons(1) &&
+              memcmp(reply.address(), upstreamAnswer, 4) == 0,
+          "forwarded answer");
+    CHECK(upstream.queries == 1, "one upstream query");
+    CHECK(ask(fd, serverAddr, "Example.COM", reply) &&
+              memcmp(reply.address(), upstreamAnswer, 4) == 0,
+          "cached answer");
+    CHECK(upstream.queries == 1, "cache hit without upstream query");
+
+    // The same question from several clients while the first one is on its
+    // way upstream goes there once
+    upstream.delayMs = 100;
+    int clients[DNS_FORWARDER_WAITERS];
+    uint8_t query[MAX_DNS_PACKETSIZE];
+    for (int i = 0; i < DNS_FORWARDER_WAITERS; i++) {
+        clients[i] = udpSocket(NULL);
+        size_t length = buildQuery("burst.example.com", htons(1000 + i), query);
+        sendto(clients[i], query, length, 0, (sockaddr *)&serverAddr,
+               sizeof(serverAddr));
+    }
+    int joined = 0;
+    for (int i = 0; i < DNS_FORWARDER_WAITERS; i++) {
+        uint16_t id = htons(1000 + i);
+        if (receiveReply(clients[i], reply) &&
+            memcmp(reply.data, &id, 2) == 0 &&
+            memcmp(reply.address(), upstreamAnswer, 4) == 0)
+            joined++;
+        close(clients[i]);
+    }
+    CHECK(joined == DNS_FORWARDER_WAITERS, "every waiting client answered");
+    CHECK(upstream.queries == 2, "identical questions sent upstream once");
+    upstream.delayMs = 0;
+
+    // Negative answers are cached for the TTL of their SOA
+    CHECK(ask(fd, serverAddr, "nx.example.com", reply) &&
+              reply.header()->RCode ==
+                  (unsigned char)DNSReplyCode::NonExistentDomain &&
+              reply.header()->NSCount == htons(1),
+          "forwarded NXDOMAIN");
+    CHECK(ask(fd, serverAddr, "nx.example.com", reply) &&
+              reply.header()->RCode ==
+                  (unsigned char)DNSReplyCode::NonExistentDomain,
+          "cached NXDOMAIN");
+    CHECK(upstream.queries == 3, "NXDOMAIN cached");
+
+    // Names of the zone never leave the device
+    CHECK(ask(fd, serverAddr, "portal.local", reply) &&
+              memcmp(reply.address(), portalIP, 4) == 0,
+          "zone answered locally");
+    CHECK(upstream.queries == 3, "zone not forwarded");
+
+    // Expiry: the one second answer is asked for again, the five minute
+    // one comes from the cache with less time left
+    CHECK(ask(fd, serverAddr, "short.example.com", reply), "short TTL");
+    std::this_thread::sleep_for(std::chrono::milliseconds(1100));
+    CHECK(ask(fd, serverAddr, "short.example.com", reply) &&
+              memcmp(reply.address(), upstreamAnswer, 4) == 0,
+          "expired answer forwarded again");
+    CHECK(upstream.queries == 5, "expired answer not served");
+    CHECK(ask(fd, serverAddr, "example.com", reply) &&
+              reply.ttl(exampleQuestion) < 300 &&
+              reply.ttl(exampleQuestion) >= 298,
+          "cached TTL counts down");
+
+    // Cache hits, one outstanding query at a time
+    Clock::time_point begin = Clock::now();
+    long answered = 0;
+    for (long i = 0; i < queryCount; i++) {
+        if (ask(fd, serverAddr, "example.com", reply)) answered++;
+    }
+    double seconds =
+        std::chrono::duration<double>(Clock::now() - begin).count();
+    CHECK(answered == queryCount, "every cached query answered");
+    CHECK(upstream.queries == 5, "cache hits stay local");
+
+    running = false;
+    server.join();
+    close(fd);
+
+    const DNSMetrics &metrics = responder.metrics();
+    printf("upstream queries:  %d\n", upstream.queries.load());
+    printf("forwarded:         %u\n", metrics.forwarded);
+    printf("cache hits:        %u\n", metrics.cacheHits);
+    printf("cached queries/s:  %.0f (%.1f us each)\n", answered / seconds,
+           seconds * 1e6 / (answered ? answered : 1));
+    return checkResult();
+}
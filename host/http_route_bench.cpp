@@ -0,0 +1,235 @@
+// Compares request routing through the compiled route table with the glob
+// matcher it replaced, which esp_http_server ran against every registered
+// handler in turn. Both must pick the same route for every URI; a random
+// cross-check over small patterns covers what the fixed set does not. Built
+// with the route table limits raised (CMakeLists.txt), the fixed set is
+// larger than what the device serves.
+#include "http_routes.h"
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+typedef std::chrono::steady_clock Clock;
+
+#define METHOD_GET 1
+#define METHOD_POST 3
+
+struct Route {
+    int method;
+    const char *pattern;
+};
+
+// What the portal is heading for: API, probes, assets, catch-all last
+static const Route portalRoutes[] = {
+    {METHOD_GET, "/metrics"},
+    {METHOD_GET, "/generate_204"},
+    {METHOD_GET, "/gen_204"},
+    {METHOD_GET, "/hotspot-detect.html"},
+    {METHOD_GET, "/connecttest.txt"},
+    {METHOD_GET, "/ncsi.txt"},
+    {METHOD_GET, "/api/scan"},
+    {METHOD_GET, "/api/status"},
+    {METHOD_POST, "/api/connect"},
+    {METHOD_GET, "/static/*.css"},
+    {METHOD_GET, "/static/*.js"},
+    {METHOD_GET, "/static/*"},
+    {METHOD_GET, "/favicon.ico"},
+    {METHOD_GET, "/"},
+    {METHOD_GET, "/*"},
+};
+
+static const struct {
+    int method;
+    const char *uri;
+} requests[] = {
+    {METHOD_GET, "/"},
+    {METHOD_GET, "/generate_204"},
+    {METHOD_GET, "/hotspot-detect.html"},
+    {METHOD_GET, "/ncsi.txt"},
+    {METHOD_GET, "/api/status"},
+    {METHOD_POST, "/api/connect"},
+    {METHOD_POST, "/api/unknown"},
+    {METHOD_GET, "/static/css/portal.min.css"},
+    {METHOD_GET, "/static/js/app.bundle.js"},
+    {METHOD_GET, "/static/img/logo.svg"},
+    {METHOD_GET, "/library/test/success.html"},
+    {METHOD_GET, "/some/deep/path/that/only/the/catch/all/matches.html"},
+};
+
+#define REQUEST_COUNT (sizeof(requests) / sizeof(requests[0]))
+
+// The route esp_http_server picked: the first registered handler whose
+// method matches and whose pattern the glob matcher accepts
+static const Route *globRoute(const Route *routes, size_t count, int method,
+                              const char *uri, size_t len_uri) {
+    for (size_t i = 0; i < count; i++) {
+        if (routes[i].method == method &&
+            httpd_uri_match_glob(routes[i].pattern, uri, len_uri))
+            return &routes[i];
+    }
+    return NULL;
+}
+
+static bool buildTable(http_routes_t &table, const Route *routes,
+                       size_t count) {
+    http_routes_init(&table);
+    for (size_t i = 0; i < count; i++) {
+        if (!http_routes_add(&table, routes[i].method, routes[i].pattern,
+                             (void *)&routes[i]))
+            return false;
+    }
+    return http_routes_compile(&table);
+}
+
+// Random patterns and URIs over a tiny alphabet, so that wildcards,
+// backtracking and overlapping routes are exercised often
+static bool crossCheck(long rounds, long &refused) {
+    static const char patternChars[] = "ab/*?";
+    static const char uriChars[] = "ab/";
+    std::vector<std::string> patterns;
+    std::vector<Route> routes;
+    srand(1);
+    for (long r = 0; r < rounds; r++) {
+        size_t count = 1 + rand() % 8;
+        patterns.assign(count, std::string());
+        routes.resize(count);
+        for (size_t i = 0; i < count; i++) {
+            size_t length = rand() % 7;
+            for (size_t j = 0; j < length; j++)
+                patterns[i] += patternChars[rand() % 5];
+            routes[i].method = METHOD_GET + rand() % 2;
+            routes[i].pattern = patterns[i].c_str();
+        }
+        // Sets with many inner '*' may not fit the automaton, they must
+        // then match nothing
+        static http_routes_t table;
+        bool compiled = buildTable(table, &routes[0], count);
+        if (!compiled) refused++;
+        for (int u = 0; u < 16; u++) {
+            char uri[9];
+            size_t length = rand() % sizeof(uri);
+            for (size_t j = 0; j < length; j++) uri[j] = uriChars[rand() % 3];
+            uri[length] = '\0';
+            int method = METHOD_GET + rand() % 2;
+            const Route *expected =
+                compiled ? globRoute(&routes[0], count, method, uri, length)
+                         : NULL;
+            const Route *found =
+                (const Route *)http_routes_find(&table, method, uri, length);
+            if (expected != found) {
+                fprintf(stderr, "mismatch for \"%s\": glob %s, table %s\n",
+                        uri, expected ? expected->pattern : "none",
+                        found ? found->pattern : "none");
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// A set of routes too large for the automaton, next to routes the portal
+// has, must be refused as a whole: nothing is routed through a half-built
+// automaton, and the same routes without the culprit compile again
+static bool checkRefused() {
+    static const Route routes[] = {
+        {METHOD_GET, "/metrics"},      {METHOD_GET, "/api/scan"},
+        {METHOD_POST, "/api/connect"}, {METHOD_GET, "/static/*"},
+        {METHOD_GET, "/*/x/*"},        {METHOD_GET, "*a*b*c*d*e*f*g*h*"},
+    };
+    static const char *uris[] = {"/metrics",      "/api/scan",
+                                 "/api/connect",  "/static/a.css",
+                                 "/y/x/z",        "/abcdefgh",
+                                 "/nothing"};
+    static http_routes_t table;
+    if (buildTable(table, routes, 6)) {
+        fprintf(stderr, "refusal check: %s was not refused\n",
+                routes[5].pattern);
+        return false;
+    }
+    for (int pass = 0; pass < 2; pass++) {
+        if (pass == 1 && !buildTable(table, routes, 5)) {
+            fprintf(stderr, "refusal check: routes do not fit\n");
+            return false;
+        }
+        for (size_t i = 0; i < sizeof(uris) / sizeof(uris[0]); i++) {
+            int method = strcmp(uris[i], "/api/connect") == 0 ? METHOD_POST
+                                                               : METHOD_GET;
+            size_t length = strlen(uris[i]);
+            const Route *expected =
+                pass == 1 ? globRoute(routes, 5, method, uris[i], length)
+                          : NULL;
+            const Route *found = (const Route *)http_routes_find(
+                &table, method, uris[i], length);
+            if (expected != found) {
+                fprintf(stderr, "refusal check: %s routed to %s, not %s\n",
+                        uris[i], found ? found->pattern : "none",
+                        expected ? expected->pattern : "none");
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    long rounds = argc > 1 ? atol(argv[1]) : 200000;
+    const size_t routeCount = sizeof(portalRoutes) / sizeof(portalRoutes[0]);
+
+    static http_routes_t table;
+    if (!buildTable(table, portalRoutes, routeCount)) {
+        fprintf(stderr, "route table full\n");
+        return 1;
+    }
+    printf("%zu routes in %zu trie nodes, %zu states, %zu edges "
+           "(%zu bytes)\n",
+           routeCount, table.node_count, table.state_count,
+           table.edge_count, sizeof(table));
+
+    size_t lengths[REQUEST_COUNT];
+    for (size_t i = 0; i < REQUEST_COUNT; i++) {
+        lengths[i] = strlen(requests[i].uri);
+        const Route *expected =
+            globRoute(portalRoutes, routeCount, requests[i].method,
+                      requests[i].uri, lengths[i]);
+        const Route *found = (const Route *)http_routes_find(
+            &table, requests[i].method, requests[i].uri, lengths[i]);
+        if (expected != found) {
+            fprintf(stderr, "%s: glob picked %s, route table %s\n",
+                    requests[i].uri, expected ? expected->pattern : "none",
+                    found ? found->pattern : "none");
+            return 1;
+        }
+    }
+    if (!checkRefused()) return 1;
+    long refused = 0;
+    if (!crossCheck(20000, refused)) return 1;
+    printf("random cross-check passed, %ld route sets refused as too "
+           "large\n",
+           refused);
+
+    printf("%-56s %10s %10s\n", "uri", "glob ns", "table ns");
+    volatile const void *sink;
+    for (size_t i = 0; i < REQUEST_COUNT; i++) {
+        Clock::time_point begin = Clock::now();
+        for (long r = 0; r < rounds; r++)
+            sink = globRoute(portalRoutes, routeCount, requests[i].method,
+                             requests[i].uri, lengths[i]);
+        Clock::time_point middle = Clock::now();
+        for (long r = 0; r < rounds; r++)
+            sink = http_routes_find(&table, requests[i].method,
+                                    requests[i].uri, lengths[i]);
+        Clock::time_point end = Clock::now();
+        printf("%-56s %10.1f %10.1f\n", requests[i].uri,
+               std::chrono::duration<double, std::nano>(middle - begin)
+                       .count() /
+                   rounds,
+               std::chrono::duration<double, std::nano>(end - middle)
+                       .count() /
+                   rounds);
+    }
+    (void)sink;
+    return 0;
+}
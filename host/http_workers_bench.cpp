@@ -0,0 +1,315 @@
+// Drives the HTTP worker pool with a stand-in server: one thread playing
+// the httpd task answers fast routes itself and hands a slow route (a
+// handler blocking for SLOW_MS, like an NVS write or a radio call) to the
+// pool, whose responses come back through the server's work queue the way
+// httpd_queue_work() does. Checks the bounded queue, cancellation and the
+// responses, then compares the latency of fast requests while slow ones
+// are busy, with the slow handler in the pool and inline in the server.
+//   http_workers_bench [seconds]
+#include "bench_check.h"
+#include "http_workers.h"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+typedef std::chrono::steady_clock Clock;
+
+#define SLOW_MS 50
+
+static Clock::time_point epoch = Clock::now();
+
+static double msSince(Clock::time_point begin) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - begin)
+        .count();
+}
+
+// The platform: a mutex, a counting semaphore and the server's work queue
+struct Platform {
+    std::mutex mutex;
+    std::mutex semaphoreMutex;
+    std::condition_variable semaphoreCondition;
+    unsigned semaphore = 0;
+    std::function<void(http_job_t *)> done;
+};
+
+static Platform platform;
+
+static void platformLock(void *) { platform.mutex.lock(); }
+
+static void platformUnlock(void *) { platform.mutex.unlock(); }
+
+static void platformSignal(void *) {
+    std::lock_guard<std::mutex> guard(platform.semaphoreMutex);
+    platform.semaphore++;
+    platform.semaphoreCondition.notify_one();
+}
+
+static void platformWait(void *) {
+    std::unique_lock<std::mutex> guard(platform.semaphoreMutex);
+    platform.semaphoreCondition.wait(guard,
+                                     [] { return platform.semaphore != 0; });
+    platform.semaphore--;
+}
+
+static uint32_t platformNow(void *) { return (uint32_t)msSince(epoch); }
+
+static void platformDone(void *, http_job_t *job) { platform.done(job); }
+
+static const http_workers_platform_t workersPlatform = {
+    platformLock, platformUnlock, platformSignal, platformWait,
+    platformNow,  platformDone,   NULL,
+};
+
+static std::vector<std::thread> startWorkers() {
+    http_workers_init(&workersPlatform);
+    std::vector<std::thread> workers;
+    for (int i = 0; i < HTTP_WORKERS_COUNT; i++)
+        workers.emplace_back([] {
+            while (http_workers_work()) {
+            }
+        });
+    return workers;
+}
+
+static void stopWorkers(std::vector<std::thread> &workers) {
+    http_workers_stop();
+    for (std::thread &worker : workers) worker.join();
+}
+
+static void slowJob(http_job_t *job) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(SLOW_MS));
+    http_job_respond(job, "200 OK", "application/json", "{\"ok\":true}", 11);
+}
+
+static void silentJob(http_job_t *) {}
+
+static unsigned runs = 0;
+
+static void countedJob(http_job_t *job) {
+    runs++;
+    http_job_respond(job, "200 OK", "text/plain", (const char *)job->data,
+                     strlen((const char *)job->data));
+}
+
+// Jobs done, as the server would get them through its work queue
+struct Delivered {
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::vector<http_job_t *> jobs;
+
+    void push(http_job_t *job) {
+        std::lock_guard<std::mutex> guard(mutex);
+        jobs.push_back(job);
+        condition.notify_all();
+    }
+    // Waits for `count` jobs in all
+    void wait(size_t count) {
+        std::unique_lock<std::mutex> guard(mutex);
+        condition.wait(guard, [&] { return jobs.size() >= count; });
+    }
+};
+
+static void checks() {
+    Delivered delivered;
+    platform.done = [&](http_job_t *job) { delivered.push(job); };
+    std::vector<std::thread> workers = startWorkers();
+
+    // Every job taken: the next request is turned away at once
+    http_job_t *taken[HTTP_WORKERS_JOBS];
+    for (int i = 0; i < HTTP_WORKERS_JOBS; i++) taken[i] = http_workers_claim();
+    CHECK(http_workers_claim() == NULL, "claim beyond the bound refused");
+    for (int i = 0; i < HTTP_WORKERS_JOBS; i++) {
+        strcpy((char *)taken[i]->data, "hello");
+        http_workers_submit(taken[i], countedJob, NULL, 100 + i);
+    }
+    delivered.wait(HTTP_WORKERS_JOBS);
+    bool allAnswered = runs == HTTP_WORKERS_JOBS;
+    for (http_job_t *job : delivered.jobs)
+        allAnswered &= http_workers_deliverable(job) &&
+                       job->body_length == 5 &&
+                       memcmp(job->body, "hello", 5) == 0 &&
+                       strcmp(job->status, "200 OK") == 0;
+    CHECK(allAnswered, "queued jobs all run and answered");
+
+    char head[160];
+    size_t length = http_job_format_head(delivered.jobs[0], head, sizeof(head));
+    CHECK(length != 0 && strncmp(head, "HTTP/1.1 200 OK\r\n", 17) == 0 &&
+              strstr(head, "Content-Length: 5\r\n") != NULL &&
+              strcmp(head + length - 4, "\r\n\r\n") == 0,
+          "response head");
+    CHECK(http_job_format_head(delivered.jobs[0], head, 20) == 0,
+          "head too long for the buffer");
+    for (http_job_t *job : delivered.jobs) http_workers_release(job);
+    delivered.jobs.clear();
+
+    // A job that does not answer, and one that answers too much
+    http_job_t *job = http_workers_claim();
+    http_workers_submit(job, silentJob, NULL, 1);
+    delivered.wait(1);
+    CHECK(strncmp(job->status, "500", 3) == 0, "silent job answers 500");
+    CHECK(!http_job_respond(job, "200 OK", "text/plain", head,
+                            HTTP_JOB_BODY_MAX + 1) &&
+              strncmp(job->status, "500", 3) == 0,
+          "oversized body answers 500");
+    http_workers_release(job);
+    delivered.jobs.clear();
+
+    // Canceled while queued behind busy workers: never run, not delivered
+    http_job_t *busy[HTTP_WORKERS_COUNT];
+    for (int i = 0; i < HTTP_WORKERS_COUNT; i++) {
+        busy[i] = http_workers_claim();
+        http_workers_submit(busy[i], slowJob, NULL, 10 + i);
+    }
+    job = http_workers_claim();
+    strcpy((char *)job->data, "gone");
+    unsigned runsBefore = runs;
+    http_workers_submit(job, countedJob, NULL, 20);
+    http_workers_cancel(job);
+    delivered.wait(HTTP_WORKERS_COUNT + 1);
+    CHECK(runs == runsBefore, "canceled job not run");
+    CHECK(!http_workers_deliverable(job), "canceled job not delivered");
+    for (http_job_t *done : delivered.jobs) http_workers_release(done);
+    delivered.jobs.clear();
+
+    http_workers_metrics_t metrics;
+    http_workers_get_metrics(&metrics);
+    CHECK(metrics.submitted == HTTP_WORKERS_JOBS + 1 + HTTP_WORKERS_COUNT + 1 &&
+              metrics.rejected == 1 && metrics.canceled == 1 &&
+              metrics.max_busy == HTTP_WORKERS_JOBS,
+          "metrics");
+    stopWorkers(workers);
+}
+
+// The stand-in httpd task: requests and finished jobs arrive in one queue
+// and are handled in order, one at a time
+struct Server {
+    struct Event {
+        bool slow;
+        http_job_t *job; // a job done, not a request
+        Clock::time_point sent;
+    };
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::deque<Event> events;
+    bool pool;
+    bool running = true;
+    std::vector<double> fastMs, slowMs;
+    unsigned rejected = 0;
+
+    void post(const Event &event) {
+        std::lock_guard<std::mutex> guard(mutex);
+        events.push_back(event);
+        condition.notify_one();
+    }
+
+    void run() {
+        for (;;) {
+            Event event;
+            {
+                std::unique_lock<std::mutex> guard(mutex);
+                condition.wait(guard,
+                               [&] { return !events.empty() || !running; });
+                if (events.empty()) return;
+                event = events.front();
+                events.pop_front();
+            }
+            if (event.job != NULL) {
+                // Send the response, and the job is free again
+                http_workers_deliverable(event.job);
+                slowMs.push_back(msSince(event.sent));
+                http_workers_release(event.job);
+            } else if (!event.slow) {
+                fastMs.push_back(msSince(event.sent));
+            } else if (!pool) {
+                std::this_thread::sleep_for(
+                    std::chrono::milliseconds(SLOW_MS));
+                slowMs.push_back(msSince(event.sent));
+            } else {
+                http_job_t *job = http_workers_claim();
+                if (job == NULL) {
+                    rejected++; // 503
+                    continue;
+                }
+                memcpy(job->data, &event.sent, sizeof(event.sent));
+                http_workers_submit(job, slowJob, NULL, 0);
+            }
+        }
+    }
+};
+
+static double percentile(std::vector<double> values, double p) {
+    if (values.empty()) return 0;
+    std::sort(values.begin(), values.end());
+    return values[(size_t)(p * (values.size() - 1))];
+}
+
+// A fast request every millisecond and a slow one every 100 ms for
+// `seconds`, against a server with or without the pool
+static void load(Server &server, double seconds) {
+    std::vector<std::thread> workers;
+    if (server.pool) {
+        platform.done = [&](http_job_t *job) {
+            Clock::time_point sent;
+            memcpy(&sent, job->data, sizeof(sent));
+            server.post({false, job, sent});
+        };
+        workers = startWorkers();
+    }
+    std::thread thread([&] { server.run(); });
+    Clock::time_point begin = Clock::now();
+    for (long tick = 0; msSince(begin) < seconds * 1000; tick++) {
+        server.post({false, NULL, Clock::now()});
+        if (tick % 100 == 0) server.post({true, NULL, Clock::now()});
+        std::this_thread::sleep_until(begin + std::chrono::milliseconds(tick));
+    }
+    if (server.pool) {
+        // Let the jobs still running come back first
+        std::this_thread::sleep_for(std::chrono::milliseconds(3 * SLOW_MS));
+        stopWorkers(workers);
+    }
+    {
+        std::lock_guard<std::mutex> guard(server.mutex);
+        server.running = false;
+        server.condition.notify_one();
+    }
+    thread.join();
+}
+
+int main(int argc, char **argv) {
+    double seconds = argc > 1 ? atof(argv[1]) : 2;
+
+    checks();
+
+    Server inlined, pooled;
+    inlined.pool = false;
+    pooled.pool = true;
+    load(inlined, seconds);
+    load(pooled, seconds);
+
+    printf("%8s %10s %10s %10s %10s %10s\n", "slow in", "fast p50", "fast p99",
+           "fast max", "slow done", "rejected");
+    const Server *servers[] = {&inlined, &pooled};
+    for (const Server *server : servers)
+        printf("%8s %8.2fms %8.2fms %8.2fms %10zu %10u\n",
+               server->pool ? "pool" : "server",
+               percentile(server->fastMs, 0.5),
+               percentile(server->fastMs, 0.99), percentile(server->fastMs, 1),
+               server->slowMs.size(), server->rejected);
+
+    CHECK(percentile(pooled.fastMs, 0.99) < SLOW_MS / 5,
+          "fast routes stay fast while slow ones run in the pool");
+    CHECK(percentile(inlined.fastMs, 0.99) >= SLOW_MS / 2,
+          "slow handlers in the server hold fast routes up");
+    CHECK(pooled.rejected == 0 && pooled.slowMs.size() == inlined.slowMs.size(),
+          "every slow request answered by the pool");
+
+    return checkResult();
+}
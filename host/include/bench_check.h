@@ -0,0 +1,24 @@
+#pragma once
+// Checks of the host benches. A failed check is reported and counted, and
+// the bench goes on, so one run shows every failure; checkResult() turns
+// the count into the exit status of main(), which ctest looks at.
+#include <stdio.h>
+
+static int checkFailures = 0;
+
+#define CHECK(condition, what)                                                 \
+    do {                                                                       \
+        if (!(condition)) {                                                    \
+            fprintf(stderr, "%s:%d: FAILED: %s\n", __FILE__, __LINE__, what);  \
+            checkFailures++;                                                   \
+        }                                                                      \
+    } while (0)
+
+static inline int checkResult() {
+    if (checkFailures != 0) {
+        fprintf(stderr, "%d checks failed\n", checkFailures);
+        return 1;
+    }
+    printf("all checks passed\n");
+    return 0;
+}
@@ -0,0 +1,9 @@
+#pragma once
+// Host stand-in for ESP-IDF's esp_log.h. Logging is compiled out so that
+// benchmarks measure the code path rather than stdio.
+
+#define ESP_LOGE(tag, format, ...) ((void)(tag))
+#define ESP_LOGW(tag, format, ...) ((void)(tag))
+#define ESP_LOGI(tag, format, ...) ((void)(tag))
+#define ESP_LOGD(tag, format, ...) ((void)(tag))
+#define ESP_LOGV(tag, format, ...) ((void)(tag))
@@ -0,0 +1,11 @@
+#pragma once
+// Host stand-in for ESP-IDF's esp_timer.h, only the monotonic clock
+#include <stdint.h>
+#include <time.h>
+
+// Microseconds since an arbitrary point, like the device's time since boot
+static inline int64_t esp_timer_get_time(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
@@ -0,0 +1,151 @@
+// Checks serving several interfaces from one task: the responder listens on
+// 127.0.0.1 and 127.0.0.2 (two "interfaces" on loopback) through one
+// PosixDNSTransport, answers "*" with the address each query came to and
+// replies from that address. Halfway the second interface moves to
+// 127.0.0.3 while the server runs, the way DNSServer rebinds when an
+// interface gets a new address. Then measures a load spread over both.
+#include "DNSResponder.h"
+#include "PosixDNSTransport.h"
+#include "bench_check.h"
+#include <arpa/inet.h>
+#include <atomic>
+#include <chrono>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+
+typedef std::chrono::steady_clock Clock;
+
+static const uint8_t fixedIP[4] = {10, 0, 0, 9};
+
+static uint32_t loopback(uint8_t host) { return htonl(0x7F000000 | host); }
+
+static size_t buildQuery(const char *name, uint16_t id, uint8_t *out) {
+    uint16_t value;
+    memset(out, 0, DNS_HEADER_SIZE);
+    DNSHeader *header = (DNSHeader *)out;
+    header->ID = id;
+    header->RD = 1;
+    header->QDCount = htons(1);
+    size_t nameLength = dnsEncodeName(name, out + DNS_HEADER_SIZE,
+                                      MAX_DNS_PACKETSIZE - DNS_HEADER_SIZE);
+    value = htons(DNS_QTYPE_A);
+    memcpy(out + DNS_HEADER_SIZE + nameLength, &value, 2);
+    value = htons(DNS_QCLASS_IN);
+    memcpy(out + DNS_HEADER_SIZE + nameLength + 2, &value, 2);
+    return DNS_HEADER_SIZE + nameLength + 4;
+}
+
+// Asks `name` at `server` and checks the reply comes from there and
+// answers `expected`. Returns false if there is no reply at all.
+static bool ask(int fd, uint32_t server, uint16_t port, const char *name,
+                const uint8_t expected[4], bool &correct) {
+    static uint16_t id = 1;
+    uint8_t query[MAX_DNS_PACKETSIZE], reply[MAX_DNS_PACKETSIZE];
+    sockaddr_in addr;
+    socklen_t addrLength = sizeof(addr);
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = server;
+    addr.sin_port = htons(port);
+    size_t length = buildQuery(name, id++, query);
+    sendto(fd, query, length, 0, (sockaddr *)&addr, sizeof(addr));
+
+    pollfd pfd = {fd, POLLIN, 0};
+    if (poll(&pfd, 1, 200) <= 0) return false;
+    ssize_t n = recvfrom(fd, reply, sizeof(reply), 0, (sockaddr *)&addr,
+                         &addrLength);
+    correct = n >= (ssize_t)(length + DNS_ANSWER_SIZE) &&
+              memcmp(reply, query, 2) == 0 && addr.sin_addr.s_addr == server &&
+              memcmp(reply + n - 4, expected, 4) == 0;
+    return n > 0;
+}
+
+int main(int argc, char **argv) {
+    long queryCount = argc > 1 ? atol(argv[1]) : 100000;
+
+    PosixDNSTransport transport;
+    if (!transport.open(loopback(1), 0, 20) ||
+        !transport.listen(1, loopback(2))) {
+        perror("listen on 127.0.0.1 and 127.0.0.2");
+        return 2;
+    }
+    DNSResponder responder;
+    std::string all = "*";
+    const uint8_t interfaceAddress[4] = {0, 0, 0, 0};
+    responder.setTransport(&transport);
+    responder.setDomain(all, interfaceAddress);
+    responder.addRecord("fixed.local", fixedIP);
+
+    // The server task: rebinding happens between batches, like
+    // DNSServer::applyInterfaces()
+    std::atomic<bool> running(true), move(false);
+    std::thread server([&]() {
+        while (running) {
+            if (move) {
+                transport.listen(1, loopback(3));
+                move = false;
+            }
+            responder.processNextBatch();
+        }
+    });
+
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    uint16_t port = transport.port();
+    const uint8_t first[4] = {127, 0, 0, 1}, second[4] = {127, 0, 0, 2},
+                  third[4] = {127, 0, 0, 3};
+    bool correct;
+
+    CHECK(ask(fd, loopback(1), port, "portal.local", first, correct) &&
+              correct,
+          "first interface answers with its address");
+    CHECK(ask(fd, loopback(2), port, "portal.local", second, correct) &&
+              correct,
+          "second interface answers with its address");
+    CHECK(ask(fd, loopback(2), port, "fixed.local", fixedIP, correct) &&
+              correct,
+          "records with an address keep it");
+
+    move = true;
+    while (move) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    CHECK(ask(fd, loopback(3), port, "portal.local", third, correct) &&
+              correct,
+          "moved interface answers with its new address");
+    CHECK(!ask(fd, loopback(2), port, "portal.local", second, correct),
+          "old address no longer served");
+    CHECK(ask(fd, loopback(1), port, "portal.local", first, correct) &&
+              correct,
+          "other interface unaffected by the move");
+
+    // One query at a time, alternating between the interfaces
+    long answered = 0, wrong = 0;
+    Clock::time_point begin = Clock::now();
+    for (long i = 0; i < queryCount; i++) {
+        bool odd = i & 1;
+        if (ask(fd, odd ? loopback(3) : loopback(1), port, "portal.local",
+                odd ? third : first, correct)) {
+            answered++;
+            if (!correct) wrong++;
+        }
+    }
+    double seconds =
+        std::chrono::duration<double>(Clock::now() - begin).count();
+    CHECK(answered == queryCount && wrong == 0,
+          "every query answered from and with the address asked");
+
+    running = false;
+    server.join();
+    close(fd);
+
+    printf("queries:           %ld (%ld unanswered, %ld wrong)\n", queryCount,
+           queryCount - answered, wrong);
+    printf("queries/s:         %.0f (%.1f us each)\n", answered / seconds,
+           seconds * 1e6 / (answered ? answered : 1));
+    return checkResult();
+}
@@ -0,0 +1,562 @@
+// Checks MDNSResponder: first with the clock in hand through a transport
+// that records what is sent (aggregation, known-answer and duplicate answer
+// suppression, the one second rule, truncated queries, QU and legacy
+// queries), then over loopback multicast with real sockets. Last it
+// simulates a busy network and compares the multicast responses sent with
+// one response per query.
+//
+//   mdns_bench [port] [queries]
+//
+// The loopback part uses `port` (15353 by default) rather than 5353 so that
+// the host's own mDNS responder neither answers nor takes the queries.
+#include "MDNSResponder.h"
+#include "PosixDNSTransport.h"
+#include "bench_check.h"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <atomic>
+#include <chrono>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+typedef std::chrono::steady_clock Clock;
+
+static const char *hostName = "Nile_A1B2C3.local";
+static const uint8_t anyIP[4] = {0, 0, 0, 0};
+static const uint8_t printerIP[4] = {192, 168, 1, 9};
+static const uint8_t printerIP6[16] = {0xFE, 0x80, 0, 0, 0, 0, 0, 0,
+                                       0,    0,    0, 0, 0, 0, 0, 9};
+// The interface of the recorded part, 192.168.1.50/24
+static const uint8_t interfaceIP[4] = {192, 168, 1, 50};
+
+static uint32_t address(const uint8_t ip[4]) {
+    uint32_t value;
+    memcpy(&value, ip, sizeof(value));
+    return value;
+}
+
+static uint32_t neighbour(uint8_t host) {
+    return htonl(0xC0A80100 | host);
+}
+
+// Builds mDNS messages. Names after the first one are compressed: a name
+// that ends like an earlier one points at it.
+class Message {
+  public:
+    std::vector<uint8_t> bytes;
+
+    explicit Message(bool response = false, bool truncated = false)
+        : bytes(DNS_HEADER_SIZE, 0) {
+        if (response) bytes[2] = 0x84;
+        if (truncated) bytes[2] |= 0x02;
+    }
+    Message &question(const char *name, uint16_t type, bool qu = false) {
+        this->name(name);
+        put16(type);
+        put16(DNS_QCLASS_IN | (qu ? MDNS_CLASS_QU : 0));
+        count(4);
+        return *this;
+    }
+    Message &answer(const char *name, uint16_t type, uint32_t ttl,
+                    const uint8_t *rdata, size_t rdLength) {
+        this->name(name);
+        put16(type);
+        put16(DNS_QCLASS_IN | MDNS_CLASS_FLUSH);
+        put16(ttl >> 16);
+        put16(ttl & 0xFFFF);
+        put16(rdLength);
+        bytes.insert(bytes.end(), rdata, rdata + rdLength);
+        count(6);
+        return *this;
+    }
+    Message &id(uint16_t value) {
+        bytes[0] = value >> 8;
+        bytes[1] = value & 0xFF;
+        return *this;
+    }
+
+  private:
+    std::vector<std::pair<std::vector<uint8_t>, size_t>> _names;
+
+    void put16(uint16_t value) {
+        bytes.push_back(value >> 8);
+        bytes.push_back(value & 0xFF);
+    }
+    void count(size_t offset) {
+        if (++bytes[offset + 1] == 0) bytes[offset]++;
+    }
+    // Writes the labels of `name` before `end` literally, remembering where
+    // each suffix starts, then a pointer to `target` unless it is 0
+    void name(const std::vector<uint8_t> &name, size_t end, size_t target) {
+        size_t start = bytes.size();
+        for (size_t at = 0; at < end; at += name[at] + 1)
+            _names.push_back(std::make_pair(
+                std::vector<uint8_t>(name.begin() + at, name.end()),
+                start + at));
+        bytes.insert(bytes.end(), name.begin(), name.begin() + end);
+        if (target != 0)
+            put16(0xC000 | target);
+        else
+            bytes.push_back(0);
+    }
+    void name(const char *dotted) {
+        uint8_t wire[MAX_DNS_WIRENAME_LENGTH];
+        size_t length = dnsEncodeName(dotted, wire, sizeof(wire));
+        std::vector<uint8_t> name(wire, wire + length);
+        // Longest suffix, label by label, that was written before
+        for (size_t at = 0; name[at] != 0; at += name[at] + 1) {
+            std::vector<uint8_t> suffix(name.begin() + at, name.end());
+            for (auto &earlier : _names) {
+                if (earlier.first == suffix)
+                    return this->name(name, at, earlier.second);
+            }
+        }
+        this->name(name, length - 1, 0);
+    }
+};
+
+// Transport that keeps what is sent, for the recorded checks and the
+// simulated network
+class RecordingTransport : public DNSTransport {
+  public:
+    struct Datagram {
+        std::vector<uint8_t> bytes;
+        DNSEndpoint to;
+    };
+    std::vector<Datagram> sent;
+    size_t bytesSent = 0;
+    bool keep = true;
+
+    size_t receive(uint8_t *, size_t, DNSEndpoint &) override { return 0; }
+    bool send(const DNSSlice *slices, size_t count,
+              const DNSEndpoint &to) override {
+        Datagram datagram;
+        for (size_t i = 0; i < count; i++)
+            datagram.bytes.insert(datagram.bytes.end(), slices[i].data,
+                                  slices[i].data + slices[i].length);
+        bytesSent += datagram.bytes.size();
+        datagram.to = to;
+        if (keep) sent.push_back(datagram);
+        return true;
+    }
+    void setReceiveTimeout(uint32_t) override {}
+};
+
+static uint16_t get16(const uint8_t *at) { return at[0] << 8 | at[1]; }
+
+// The answers of a response: owner, type, class, TTL and RDATA, which
+// points into the message
+struct Answer {
+    uint8_t name[MAX_DNS_WIRENAME_LENGTH];
+    uint16_t type, rclass;
+    uint32_t ttl;
+    const uint8_t *rdata;
+};
+
+static std::vector<Answer> answers(const std::vector<uint8_t> &message) {
+    std::vector<Answer> result;
+    size_t offset = DNS_HEADER_SIZE;
+    uint8_t name[MAX_DNS_WIRENAME_LENGTH];
+    if (message.size() < DNS_HEADER_SIZE) return result;
+    for (uint16_t i = 0; i < get16(&message[4]); i++)
+        offset += dnsExpandName(message.data(), message.size(), offset, name) +
+                  4;
+    for (uint16_t i = 0; i < get16(&message[6]); i++) {
+        Answer answer;
+        size_t length = dnsExpandName(message.data(), message.size(), offset,
+                                      answer.name);
+        if (length == 0) break;
+        offset += length;
+        answer.type = get16(&message[offset]);
+        answer.rclass = get16(&message[offset + 2]);
+        answer.ttl = (uint32_t)get16(&message[offset + 4]) << 16 |
+                     get16(&message[offset + 6]);
+        answer.rdata = &message[offset + 10];
+        offset += 10 + get16(&message[offset + 8]);
+        result.push_back(answer);
+    }
+    return result;
+}
+
+static bool isName(const uint8_t *wire, const char *dotted) {
+    uint8_t expected[MAX_DNS_WIRENAME_LENGTH];
+    dnsEncodeName(dotted, expected, sizeof(expected));
+    return dnsNameEquals(wire, expected);
+}
+
+static void deliver(MDNSResponder &responder, Message message, uint32_t from,
+                    uint32_t nowMs, uint16_t port = MDNS_PORT) {
+    DNSEndpoint endpoint = {from, htons(port), 0};
+    responder.handleDatagram(message.bytes.data(), message.bytes.size(),
+                             endpoint, nowMs);
+}
+
+// Runs the clock from `fromMs` to `toMs` a millisecond at a time, returning
+// the multicast responses sent meanwhile
+static size_t runUntil(MDNSResponder &responder,
+                       RecordingTransport &transport, uint32_t fromMs,
+                       uint32_t toMs) {
+    size_t before = transport.sent.size();
+    for (uint32_t now = fromMs; now <= toMs; now++) responder.sendDue(now);
+    return transport.sent.size() - before;
+}
+
+static void recordedChecks() {
+    RecordingTransport transport;
+    MDNSResponder responder;
+    responder.setTransport(&transport);
+    responder.setInterface(0, address(interfaceIP), htonl(0xFFFFFF00));
+    CHECK(responder.addRecord(hostName, anyIP), "host record added");
+    CHECK(responder.addRecord("printer.local", printerIP, printerIP6),
+          "printer record added");
+    CHECK(!responder.addRecord("bad..name", anyIP), "invalid name refused");
+
+    // One query: held back for aggregation, then multicast
+    deliver(responder, Message().question("nile_a1b2c3.local", DNS_QTYPE_A),
+            neighbour(10), 0);
+    CHECK(runUntil(responder, transport, 0, MDNS_RESPONSE_DELAY_MS - 1) == 0,
+          "response held back for aggregation");
+    CHECK(runUntil(responder, transport, MDNS_RESPONSE_DELAY_MS,
+                   MDNS_RESPONSE_DELAY_MS) == 1,
+          "response sent when due");
+    const RecordingTransport::Datagram &first = transport.sent.back();
+    std::vector<Answer> got = answers(first.bytes);
+    CHECK(first.to.addr == MDNS_GROUP && first.to.port == htons(MDNS_PORT) &&
+              first.to.local == address(interfaceIP),
+          "multicast to the group on the interface asked");
+    CHECK(first.bytes[2] == 0x84 && get16(&first.bytes[4]) == 0 &&
+              got.size() == 1,
+          "authoritative response without question");
+    CHECK(got.size() == 1 && isName(got[0].name, hostName) &&
+              got[0].type == DNS_QTYPE_A &&
+              got[0].rclass == (DNS_QCLASS_IN | MDNS_CLASS_FLUSH) &&
+              got[0].ttl == MDNS_DEFAULT_TTL &&
+              memcmp(got[0].rdata, interfaceIP, 4) == 0,
+          "host answered with the interface address, cache flush set");
+
+    // Ten hosts asking within the window get one response
+    MDNSMetrics before = responder.metrics();
+    for (uint8_t i = 0; i < 10; i++)
+        deliver(responder, Message().question(hostName, DNS_QTYPE_A),
+                neighbour(20 + i), 2000 + i);
+    CHECK(runUntil(responder, transport, 2000, 2100) == 1,
+          "ten queries answered by one response");
+    CHECK(responder.metrics().aggregated - before.aggregated == 9,
+          "nine queries aggregated");
+
+    // Asked again right after: the record waits for its second to be over
+    uint32_t sentAt = 2000 + MDNS_RESPONSE_DELAY_MS;
+    deliver(responder, Message().question(hostName, DNS_QTYPE_A),
+            neighbour(10), 2200);
+    CHECK(runUntil(responder, transport, 2200,
+                   sentAt + MDNS_MULTICAST_INTERVAL_MS - 1) == 0,
+          "no record multicast twice within a second");
+    CHECK(runUntil(responder, transport, sentAt + MDNS_MULTICAST_INTERVAL_MS,
+                   sentAt + MDNS_MULTICAST_INTERVAL_MS) == 1,
+          "held back record multicast after the second");
+
+    // Known answers with at least half the TTL left are not repeated
+    deliver(responder,
+            Message()
+                .question(hostName, DNS_QTYPE_A)
+                .answer(hostName, DNS_QTYPE_A, MDNS_DEFAULT_TTL, interfaceIP,
+                        4),
+            neighbour(10), 10000);
+    CHECK(runUntil(responder, transport, 10000, 12000) == 0,
+          "known answer suppressed");
+    deliver(responder,
+            Message()
+                .question(hostName, DNS_QTYPE_A)
+                .answer(hostName, DNS_QTYPE_A, MDNS_DEFAULT_TTL / 2 - 1,
+                        interfaceIP, 4),
+            neighbour(10), 12000);
+    CHECK(runUntil(responder, transport, 12000, 12100) == 1,
+          "known answer about to expire answered");
+    deliver(responder,
+            Message()
+                .question(hostName, DNS_QTYPE_A)
+                .answer(hostName, DNS_QTYPE_A, MDNS_DEFAULT_TTL, printerIP, 4),
+            neighbour(10), 14000);
+    CHECK(runUntil(responder, transport, 14000, 14100) == 1,
+          "known answer with other data answered");
+
+    // Several questions, the second name compressed, one response
+    deliver(responder,
+            Message()
+                .question("printer.local", DNS_QTYPE_ANY)
+                .question(hostName, DNS_QTYPE_A),
+            neighbour(10), 16000);
+    CHECK(runUntil(responder, transport, 16000, 16100) == 1,
+          "questions answered together");
+    got = answers(transport.sent.back().bytes);
+    CHECK(got.size() == 3, "A and AAAA of the printer and the host's A");
+    CHECK(got.size() == 3 && got[2].type == DNS_QTYPE_AAAA &&
+              isName(got[2].name, "printer.local") &&
+              memcmp(got[2].rdata, printerIP6, 16) == 0,
+          "AAAA answered");
+
+    // A truncated query waits for its known answers, which cancel it
+    deliver(responder, Message(false, true).question(hostName, DNS_QTYPE_A),
+            neighbour(30), 20000);
+    CHECK(runUntil(responder, transport, 20000,
+                   20000 + MDNS_TRUNCATED_DELAY_MS - 1) == 0,
+          "truncated query waits for its known answers");
+    deliver(responder,
+            Message().answer(hostName, DNS_QTYPE_A, MDNS_DEFAULT_TTL,
+                             interfaceIP, 4),
+            neighbour(30), 20010);
+    CHECK(runUntil(responder, transport, 20000, 21000) == 0,
+          "known answers of a truncated query cancel it");
+    deliver(responder, Message(false, true).question(hostName, DNS_QTYPE_A),
+            neighbour(30), 22000);
+    size_t sent = runUntil(responder, transport, 22000,
+                           22000 + MDNS_TRUNCATED_DELAY_MS - 1);
+    sent += runUntil(responder, transport,
+                     22000 + MDNS_TRUNCATED_DELAY_MS,
+                     22000 + MDNS_TRUNCATED_DELAY_MS +
+                         MDNS_TRUNCATED_JITTER_MS);
+    CHECK(sent == 1, "truncated query answered after 400-500 ms");
+
+    // Another responder sending the record first makes ours a duplicate
+    before = responder.metrics();
+    deliver(responder, Message().question(hostName, DNS_QTYPE_A),
+            neighbour(10), 30000);
+    deliver(responder,
+            Message(true).answer(hostName, DNS_QTYPE_A, MDNS_DEFAULT_TTL,
+                                 interfaceIP, 4),
+            neighbour(40), 30005);
+    CHECK(runUntil(responder, transport, 30000, 31000) == 0 &&
+              responder.metrics().duplicates - before.duplicates == 1,
+          "duplicate answer suppressed");
+
+    // QU: unicast right away if multicast lately, else multicast
+    deliver(responder, Message().question(hostName, DNS_QTYPE_A),
+            neighbour(10), 40000);
+    runUntil(responder, transport, 40000, 40100);
+    size_t count = transport.sent.size();
+    deliver(responder, Message().question(hostName, DNS_QTYPE_A, true),
+            neighbour(11), 41000);
+    CHECK(transport.sent.size() == count + 1 &&
+              transport.sent.back().to.addr == neighbour(11) &&
+              transport.sent.back().to.port == htons(MDNS_PORT),
+          "QU answered by unicast");
+    count = transport.sent.size();
+    deliver(responder, Message().question(hostName, DNS_QTYPE_A, true),
+            neighbour(11), 41000 + MDNS_DEFAULT_TTL * 1000 / 4);
+    CHECK(transport.sent.size() == count &&
+              runUntil(responder, transport, 71000, 71100) == 1 &&
+              transport.sent.back().to.addr == MDNS_GROUP,
+          "QU multicast after a quarter TTL");
+
+    // Legacy resolvers: unicast, ID and question kept, short TTL
+    count = transport.sent.size();
+    deliver(responder,
+            Message().id(0x1234).question("printer.local", DNS_QTYPE_A),
+            neighbour(10), 80000, 40000);
+    CHECK(transport.sent.size() == count + 1, "legacy query answered");
+    if (transport.sent.size() == count + 1) {
+        const RecordingTransport::Datagram &reply = transport.sent.back();
+        got = answers(reply.bytes);
+        CHECK(reply.to.port == htons(40000) && get16(&reply.bytes[0]) ==
+                                                   0x1234 &&
+                  get16(&reply.bytes[4]) == 1 && got.size() == 1 &&
+                  got[0].ttl == MDNS_LEGACY_TTL &&
+                  got[0].rclass == DNS_QCLASS_IN &&
+                  memcmp(got[0].rdata, printerIP, 4) == 0,
+              "legacy reply like a unicast DNS reply");
+    }
+
+    // Not for us, or not from the link
+    count = transport.sent.size();
+    before = responder.metrics();
+    deliver(responder, Message().question("other.local", DNS_QTYPE_A),
+            neighbour(10), 90000);
+    deliver(responder, Message().question(hostName, DNS_QTYPE_A),
+            htonl(0x0A000001), 90000);
+    Message loop;
+    loop.bytes[5] = 1;
+    loop.bytes.push_back(0xC0);
+    loop.bytes.push_back(DNS_HEADER_SIZE);
+    deliver(responder, loop, neighbour(10), 90000);
+    CHECK(runUntil(responder, transport, 90000, 91000) == 0 &&
+              transport.sent.size() == count,
+          "other names, other subnets and pointer loops not answered");
+    CHECK(responder.metrics().ignored - before.ignored == 2,
+          "off-link and malformed queries counted as ignored");
+}
+
+static int multicastSocket(uint16_t port) {
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    int reuse = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    ip_mreq request;
+    request.imr_multiaddr.s_addr = MDNS_GROUP;
+    request.imr_interface.s_addr = htonl(INADDR_LOOPBACK);
+    in_addr local;
+    local.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(fd, (sockaddr *)&addr, sizeof(addr)) != 0 ||
+        setsockopt(fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &request,
+                   sizeof(request)) != 0 ||
+        setsockopt(fd, IPPROTO_IP, IP_MULTICAST_IF, &local, sizeof(local)) !=
+            0) {
+        perror("multicast socket");
+        exit(2);
+    }
+    return fd;
+}
+
+// Sends `query` to the group and waits for a response, skipping queries
+// (our own among them, looped back). Returns its length, 0 if none came.
+static size_t ask(int fd, uint16_t port, const Message &query,
+                  uint8_t *response, int timeoutMs) {
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = MDNS_GROUP;
+    addr.sin_port = htons(port);
+    sendto(fd, query.bytes.data(), query.bytes.size(), 0, (sockaddr *)&addr,
+           sizeof(addr));
+    Clock::time_point end =
+        Clock::now() + std::chrono::milliseconds(timeoutMs);
+    for (;;) {
+        int left = (int)std::chrono::duration_cast<std::chrono::milliseconds>(
+                       end - Clock::now())
+                       .count();
+        pollfd pfd = {fd, POLLIN, 0};
+        if (left <= 0 || poll(&pfd, 1, left) <= 0) return 0;
+        ssize_t n = recv(fd, response, MAX_DNS_PACKETSIZE, 0);
+        if (n >= (ssize_t)DNS_HEADER_SIZE && (response[2] & 0x80)) return n;
+    }
+}
+
+static void loopbackChecks(uint16_t port) {
+    PosixDNSTransport transport;
+    if (!transport.open(htonl(INADDR_ANY), port, MDNS_POLL_MS) ||
+        !transport.joinGroup(MDNS_GROUP, htonl(INADDR_LOOPBACK), true)) {
+        perror("mDNS socket on loopback");
+        exit(2);
+    }
+    MDNSResponder responder;
+    responder.setTransport(&transport, port);
+    responder.setInterface(0, htonl(INADDR_LOOPBACK), htonl(0xFF000000));
+    responder.addRecord(hostName, anyIP);
+    responder.addRecord("printer.local", printerIP);
+
+    std::atomic<bool> running(true);
+    std::thread server([&]() {
+        while (running) responder.processNextRequest();
+    });
+
+    int fd = multicastSocket(port);
+    uint8_t response[MAX_DNS_PACKETSIZE];
+    const uint8_t loopbackIP[4] = {127, 0, 0, 1};
+    size_t n = ask(fd, port, Message().question(hostName, DNS_QTYPE_A),
+                   response, 500);
+    std::vector<uint8_t> reply(response, response + n);
+    std::vector<Answer> got = answers(reply);
+    CHECK(n != 0 && got.size() == 1 &&
+              memcmp(got[0].rdata, loopbackIP, 4) == 0,
+          "multicast query answered over loopback with the interface address");
+
+    n = ask(fd, port,
+            Message()
+                .question("printer.local", DNS_QTYPE_A)
+                .answer("printer.local", DNS_QTYPE_A, MDNS_DEFAULT_TTL,
+                        printerIP, 4),
+            response, 300);
+    CHECK(n == 0, "known answer suppressed over loopback");
+
+    // From an ephemeral port: a legacy resolver, answered by unicast
+    int legacy = socket(AF_INET, SOCK_DGRAM, 0);
+    in_addr local;
+    local.s_addr = htonl(INADDR_LOOPBACK);
+    setsockopt(legacy, IPPROTO_IP, IP_MULTICAST_IF, &local, sizeof(local));
+    n = ask(legacy, port, Message().id(7).question("printer.local",
+                                                    DNS_QTYPE_A),
+            response, 500);
+    reply.assign(response, response + n);
+    got = answers(reply);
+    CHECK(n != 0 && get16(response) == 7 && got.size() == 1 &&
+              got[0].ttl == MDNS_LEGACY_TTL &&
+              memcmp(got[0].rdata, printerIP, 4) == 0,
+          "legacy query answered by unicast over loopback");
+
+    running = false;
+    server.join();
+    close(legacy);
+    close(fd);
+}
+
+// A busy network: `queries` queries from 50 hosts over as many seconds as
+// there are thousands of queries, half of them listing the answer they
+// have cached. Compares what goes out with one response per query.
+static void simulate(long queries) {
+    RecordingTransport transport;
+    transport.keep = false;
+    MDNSResponder responder;
+    responder.setTransport(&transport);
+    responder.setInterface(0, address(interfaceIP), htonl(0xFFFFFF00));
+    responder.addRecord(hostName, anyIP);
+
+    Message plain = Message().question(hostName, DNS_QTYPE_A);
+    Message known = Message().question(hostName, DNS_QTYPE_A)
+                        .answer(hostName, DNS_QTYPE_A, MDNS_DEFAULT_TTL,
+                                interfaceIP, 4);
+    uint32_t seed = 1;
+    uint32_t durationMs = (uint32_t)(queries > 1000 ? queries : 1000);
+    std::vector<uint32_t> times(queries);
+    for (long i = 0; i < queries; i++) {
+        seed = seed * 1103515245 + 12345;
+        times[i] = (seed >> 8) % durationMs;
+    }
+    std::sort(times.begin(), times.end());
+
+    Clock::time_point begin = Clock::now();
+    long next = 0;
+    for (uint32_t now = 0; now <= durationMs + 2000; now++) {
+        for (; next < queries && times[next] == now; next++) {
+            const Message &message = next % 2 ? known : plain;
+            deliver(responder, message, neighbour(1 + next % 50), now);
+        }
+        responder.sendDue(now);
+    }
+    double seconds =
+        std::chrono::duration<double>(Clock::now() - begin).count();
+
+    const MDNSMetrics &metrics = responder.metrics();
+    size_t responseSize = DNS_HEADER_SIZE + strlen(hostName) + 2 +
+                          DNS_ANSWER_PREFIX_SIZE - 2 + 4;
+    CHECK(metrics.queries == (uint32_t)queries, "every query received");
+    CHECK(metrics.responses <= durationMs / MDNS_MULTICAST_INTERVAL_MS + 1,
+          "at most one response a second");
+    printf("queries:           %ld over %.0f s, from 50 hosts\n", queries,
+           durationMs / 1000.0);
+    printf("responses:         %u multicast, %zu bytes (one per query would "
+           "be %zu)\n",
+           metrics.responses, transport.bytesSent, queries * responseSize);
+    printf("suppressed:        %u known, %u aggregated\n",
+           metrics.knownAnswers, metrics.aggregated);
+    printf("handling:          %.2f us per query\n",
+           seconds * 1e6 / (queries ? queries : 1));
+}
+
+int main(int argc, char **argv) {
+    uint16_t port = argc > 1 ? atoi(argv[1]) : 15353;
+    long queries = argc > 2 ? atol(argv[2]) : 100000;
+
+    recordedChecks();
+    loopbackChecks(port);
+    simulate(queries);
+    return checkResult();
+}
@@ -0,0 +1,111 @@
+// Times the captive portal probe table for each connectivity check URL,
+// against routing the same request through the route table to the
+// catch-all handler it used to fall into. Checks that every probe is found,
+// that other paths are not, and that each response is well formed HTTP
+// with a Content-Length matching its body.
+#include "captive_probe.h"
+#include "http_routes.h"
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef std::chrono::steady_clock Clock;
+
+#define METHOD_GET 1
+#define METHOD_POST 3
+
+static const char *probePaths[] = {
+    "/generate_204",        "/gen_204",
+    "/hotspot-detect.html", "/library/test/success.html",
+    "/connecttest.txt",     "/ncsi.txt",
+};
+
+static const char *otherPaths[] = {
+    "/", "/index.html", "/generate_205", "/ncsi.txt2", "/hotspot-detect.htm",
+};
+
+static bool wellFormed(const char *response, size_t length) {
+    if (length < 12 || memcmp(response, "HTTP/1.1 ", 9) != 0) return false;
+    const char *end = strstr(response, "\r\n\r\n");
+    const char *header = strstr(response, "Content-Length: ");
+    if (end == NULL || header == NULL || header > end) return false;
+    size_t body = (size_t)(response + length - (end + 4));
+    return (size_t)atol(header + 16) == body;
+}
+
+static bool checkResponses(const captive_probe_t *probe) {
+    for (int online = 0; online < 2; online++) {
+        size_t length;
+        captive_probes_set_online(online != 0);
+        const char *response = captive_probe_response(probe, &length);
+        if (!wellFormed(response, length)) {
+            fprintf(stderr, "%s: malformed %s response\n", probe->path,
+                    online ? "online" : "redirect");
+            return false;
+        }
+    }
+    captive_probes_set_online(false);
+    return true;
+}
+
+int main(int argc, char **argv) {
+    long rounds = argc > 1 ? atol(argv[1]) : 2000000;
+    if (!captive_probes_init("192.168.4.1")) return 1;
+
+    // The portal's routes (http_server.c), the probes used to end up in
+    // the last one. They must fit the route table as the device sizes it.
+    static http_routes_t routes;
+    static int metrics, scan, connect, assets;
+    http_routes_init(&routes);
+    if (!http_routes_add(&routes, METHOD_GET, "/metrics", &metrics) ||
+        !http_routes_add(&routes, METHOD_GET, "/api/scan", &scan) ||
+        !http_routes_add(&routes, METHOD_POST, "/api/connect", &connect) ||
+        !http_routes_add(&routes, METHOD_GET, "/*", &assets) ||
+        !http_routes_compile(&routes)) {
+        fprintf(stderr, "portal routes do not fit the route table\n");
+        return 1;
+    }
+    printf("portal routes: %zu nodes, %zu states, %zu edges, %zu bytes\n",
+           routes.node_count, routes.state_count, routes.edge_count,
+           sizeof(routes));
+
+    for (size_t i = 0; i < sizeof(otherPaths) / sizeof(*otherPaths); i++) {
+        if (captive_probe_find(otherPaths[i], strlen(otherPaths[i]))) {
+            fprintf(stderr, "%s taken for a probe\n", otherPaths[i]);
+            return 1;
+        }
+    }
+
+    printf("%-28s %12s %12s\n", "probe", "table ns", "routing ns");
+    volatile const void *sink;
+    for (size_t i = 0; i < sizeof(probePaths) / sizeof(*probePaths); i++) {
+        const char *path = probePaths[i];
+        size_t length = strlen(path), responseLength;
+        const captive_probe_t *probe = captive_probe_find(path, length);
+        if (probe == NULL) {
+            fprintf(stderr, "%s not found\n", path);
+            return 1;
+        }
+        if (!checkResponses(probe)) return 1;
+
+        Clock::time_point begin = Clock::now();
+        for (long r = 0; r < rounds; r++) {
+            probe = captive_probe_find(path, length);
+            sink = captive_probe_response(probe, &responseLength);
+        }
+        Clock::time_point middle = Clock::now();
+        for (long r = 0; r < rounds; r++)
+            sink = http_routes_find(&routes, METHOD_GET, path, length);
+        Clock::time_point end = Clock::now();
+        printf("%-28s %12.1f %12.1f\n", path,
+               std::chrono::duration<double, std::nano>(middle - begin)
+                       .count() /
+                   rounds,
+               std::chrono::duration<double, std::nano>(end - middle)
+                       .count() /
+                   rounds);
+    }
+    (void)sink;
+    return 0;
+}
@@ -0,0 +1,96 @@
+// Replays sequences of disconnection reasons through wifi_reconnect: the
+// access point going away, rejected credentials, a flapping connection, and
+// many stations dropped at once. Checks the waits grow, stay within the cap
+// and their jitter, and when it gives up; reports how many attempts an
+// outage costs against reconnecting right away as the event handler used to.
+#include "bench_check.h"
+#include "wifi_reconnect.h"
+#include <set>
+#include <stdio.h>
+
+// An attempt that fails takes about this long on the air
+#define ATTEMPT_MS 120
+
+static uint32_t nominal(uint32_t failures) {
+    uint32_t delay = WIFI_RECONNECT_BASE_MS;
+    for (uint32_t i = 1; i < failures && delay < WIFI_RECONNECT_MAX_MS; i++)
+        delay *= 2;
+    return delay < WIFI_RECONNECT_MAX_MS ? delay : WIFI_RECONNECT_MAX_MS;
+}
+
+int main() {
+    wifi_reconnect_t reconnect;
+
+    // Access point gone: growing, jittered waits, then the configuration
+    // mode. Counts the time it takes to give up.
+    wifi_reconnect_init(&reconnect, 1);
+    CHECK(wifi_reconnect_disconnected(
+              &reconnect, WIFI_RECONNECT_REASON_BEACON_TIMEOUT, true) == 0,
+          "connection lost: first attempt right away");
+    uint32_t outage_ms = 0;
+    unsigned attempts = 1;
+    for (;;) {
+        uint32_t delay = wifi_reconnect_disconnected(
+            &reconnect, WIFI_RECONNECT_REASON_NO_AP_FOUND, false);
+        outage_ms += ATTEMPT_MS;
+        if (delay == WIFI_RECONNECT_GIVE_UP) break;
+        uint32_t expected = nominal(reconnect.failures);
+        CHECK(delay <= expected && delay >= expected / 2,
+              "waits grow, jittered below the nominal delay");
+        outage_ms += delay;
+        attempts++;
+    }
+    CHECK(attempts == WIFI_RECONNECT_MAX_FAILURES,
+          "gives up after WIFI_RECONNECT_MAX_FAILURES attempts");
+
+    // Wrong password: gives up after a few rejections, even with other
+    // failures in between
+    wifi_reconnect_init(&reconnect, 2);
+    CHECK(wifi_reconnect_disconnected(
+              &reconnect, WIFI_RECONNECT_REASON_AUTH_FAIL, false) != 0,
+          "wrong password: retried at first");
+    CHECK(wifi_reconnect_disconnected(
+              &reconnect, WIFI_RECONNECT_REASON_NO_AP_FOUND, false) !=
+              WIFI_RECONNECT_GIVE_UP,
+          "other failures in between do not give up");
+    CHECK(wifi_reconnect_disconnected(
+              &reconnect, WIFI_RECONNECT_REASON_4WAY_HANDSHAKE_TIMEOUT,
+              false) != WIFI_RECONNECT_GIVE_UP,
+          "handshake timeout counts as a rejection");
+    CHECK(wifi_reconnect_disconnected(
+              &reconnect, WIFI_RECONNECT_REASON_HANDSHAKE_TIMEOUT, false) ==
+              WIFI_RECONNECT_GIVE_UP,
+          "third rejection gives up");
+
+    // Flapping: every connection that worked resets the backoff, so a
+    // station that keeps coming back never gives up
+    wifi_reconnect_init(&reconnect, 3);
+    for (int i = 0; i < 100; i++) {
+        CHECK(wifi_reconnect_disconnected(
+                  &reconnect, WIFI_RECONNECT_REASON_BEACON_TIMEOUT, true) ==
+                  0,
+              "flapping: reconnects right away");
+        for (int j = 0; j < WIFI_RECONNECT_MAX_FAILURES - 1; j++)
+            CHECK(wifi_reconnect_disconnected(
+                      &reconnect, WIFI_RECONNECT_REASON_NO_AP_FOUND,
+                      false) != WIFI_RECONNECT_GIVE_UP,
+                  "flapping never gives up");
+    }
+
+    // Devices dropped by the same outage: their first waits spread out
+    std::set<uint32_t> waits;
+    for (uint32_t seed = 1; seed <= 100; seed++) {
+        wifi_reconnect_init(&reconnect, seed * 2654435761U);
+        for (int i = 0; i < 5; i++)
+            wifi_reconnect_disconnected(
+                &reconnect, WIFI_RECONNECT_REASON_NO_AP_FOUND, false);
+        waits.insert(wifi_reconnect_disconnected(
+            &reconnect, WIFI_RECONNECT_REASON_NO_AP_FOUND, false));
+    }
+    CHECK(waits.size() > 90, "first waits spread out");
+
+    printf("access point gone: %u attempts over %.1f s before the "
+           "configuration mode, %u when reconnecting right away\n",
+           attempts, outage_ms / 1000.0, outage_ms / ATTEMPT_MS);
+    return checkResult();
+}
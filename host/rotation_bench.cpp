@@ -0,0 +1,265 @@
+// Checks names that resolve to several addresses (DNSAddressSet): every
+// reply carries the whole set, compressed to 16 bytes per address, and the
+// address that comes first rotates round robin or by weight, for each name
+// on its own. Queries go through an in-memory transport, so the spread over
+// the addresses is exact. Then measures the cost against a single address.
+#include "DNSResponder.h"
+#include "bench_check.h"
+#include <arpa/inet.h>
+#include <chrono>
+#include <map>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+typedef std::chrono::steady_clock Clock;
+
+static const uint8_t localIP[4] = {192, 168, 4, 1};
+static const uint8_t units[4][4] = {
+    {10, 0, 0, 1}, {10, 0, 0, 2}, {10, 0, 0, 3}, {10, 0, 0, 4}};
+
+// Hands out one query at a time and keeps the last reply
+class QueueTransport : public DNSTransport {
+  public:
+    std::vector<uint8_t> query;
+    std::vector<uint8_t> reply;
+
+    size_t receive(uint8_t *buffer, size_t capacity,
+                   DNSEndpoint &from) override {
+        if (query.size() > capacity) return 0;
+        memcpy(buffer, query.data(), query.size());
+        from.addr = htonl(0xC0A80402);
+        from.port = htons(40000);
+        memcpy(&from.local, localIP, 4);
+        return query.size();
+    }
+    bool send(const DNSSlice *slices, size_t count,
+              const DNSEndpoint &) override {
+        reply.clear();
+        for (size_t i = 0; i < count; i++)
+            reply.insert(reply.end(), slices[i].data,
+                         slices[i].data + slices[i].length);
+        return true;
+    }
+    void setReceiveTimeout(uint32_t) override {}
+};
+
+static std::vector<uint8_t> buildQuery(const char *name, bool edns) {
+    std::vector<uint8_t> out(MAX_DNS_PACKETSIZE, 0);
+    DNSHeader *header = (DNSHeader *)out.data();
+    uint16_t value;
+    header->ID = htons(0x1234);
+    header->RD = 1;
+    header->QDCount = htons(1);
+    size_t length = DNS_HEADER_SIZE;
+    length += dnsEncodeName(name, &out[length], out.size() - length);
+    value = htons(DNS_QTYPE_A);
+    memcpy(&out[length], &value, 2);
+    value = htons(DNS_QCLASS_IN);
+    memcpy(&out[length + 2], &value, 2);
+    length += 4;
+    if (edns) {
+        static const uint8_t opt[DNS_OPT_RECORD_SIZE] = {
+            0, 0, DNS_QTYPE_OPT, 0x05, 0xC0, 0, 0, 0, 0, 0, 0};
+        header->ARCount = htons(1);
+        memcpy(&out[length], opt, sizeof(opt));
+        length += sizeof(opt);
+    }
+    out.resize(length);
+    return out;
+}
+
+static uint16_t get16(const uint8_t *at) { return at[0] << 8 | at[1]; }
+
+// The addresses answered, in order. Every answer must be an A record whose
+// name points at the question.
+static std::vector<uint32_t> answers(const std::vector<uint8_t> &reply,
+                                     size_t queryLength, bool &wellFormed) {
+    std::vector<uint32_t> result;
+    wellFormed = reply.size() >= queryLength;
+    if (!wellFormed) return result;
+    size_t offset = queryLength;
+    for (uint16_t i = 0; i < get16(&reply[6]); i++) {
+        if (offset + DNS_ANSWER_SIZE > reply.size() ||
+            get16(&reply[offset]) != (0xC000 | DNS_HEADER_SIZE) ||
+            get16(&reply[offset + 2]) != DNS_QTYPE_A ||
+            get16(&reply[offset + 10]) != 4) {
+            wellFormed = false;
+            return result;
+        }
+        uint32_t address;
+        memcpy(&address, &reply[offset + 12], 4);
+        result.push_back(address);
+        offset += DNS_ANSWER_SIZE;
+    }
+    return result;
+}
+
+static uint32_t address(const uint8_t ip[4]) {
+    uint32_t value;
+    memcpy(&value, ip, 4);
+    return value;
+}
+
+// Asks `name` `count` times, counting which address comes first. Checks
+// each reply answers `expected` addresses and fits the plain DNS limit.
+static std::map<uint32_t, long> spread(DNSResponder &responder,
+                                       QueueTransport &transport,
+                                       const char *name, long count,
+                                       size_t expected, const char *what) {
+    std::map<uint32_t, long> first;
+    bool allGood = true;
+    transport.query = buildQuery(name, false);
+    for (long i = 0; i < count; i++) {
+        bool wellFormed;
+        responder.processNextRequest();
+        std::vector<uint32_t> got =
+            answers(transport.reply, transport.query.size(), wellFormed);
+        allGood &= wellFormed && got.size() == expected &&
+                   transport.reply.size() <= MAX_DNS_PACKETSIZE;
+        if (!got.empty()) first[got[0]]++;
+    }
+    CHECK(allGood, what);
+    return first;
+}
+
+static void checks() {
+    QueueTransport transport;
+    DNSResponder responder;
+    responder.setTransport(&transport);
+
+    // Round robin: the whole set in every reply, each address first in turn
+    CHECK(responder.addRecord("api.nile.local", units, NULL, 3),
+          "set of three added");
+    std::map<uint32_t, long> first =
+        spread(responder, transport, "api.nile.local", 300, 3,
+               "round robin replies carry the whole set");
+    CHECK(first[address(units[0])] == 100 && first[address(units[1])] == 100 &&
+              first[address(units[2])] == 100,
+          "round robin spreads evenly");
+    CHECK(transport.reply.size() ==
+              transport.query.size() + 3 * DNS_ANSWER_SIZE,
+          "answers are 16 bytes each, names compressed");
+    DNSHeader *header = (DNSHeader *)transport.reply.data();
+    CHECK(header->QR == DNS_QR_RESPONSE && header->RCode == 0 &&
+              !header->TC && header->ID == htons(0x1234),
+          "reply header");
+
+    // Weighted, with one unit drained
+    const uint8_t weights[4] = {3, 1, 0, 4};
+    CHECK(responder.addRecord("api.nile.local", units, weights, 4),
+          "set replaced with weights");
+    first = spread(responder, transport, "api.nile.local", 800, 3,
+                   "drained address left out");
+    CHECK(first[address(units[0])] == 300 && first[address(units[1])] == 100 &&
+              first[address(units[2])] == 0 && first[address(units[3])] == 400,
+          "first address spread by weight");
+    const uint8_t drained[2] = {0, 0};
+    CHECK(!responder.addRecord("api.nile.local", units, drained, 2),
+          "set without weight refused");
+
+    // Each name rotates on its own, even when queries alternate
+    CHECK(responder.addRecord("a.nile.local", units, NULL, 2) &&
+              responder.addRecord("b.nile.local", units + 2, NULL, 2),
+          "two more sets added");
+    std::map<uint32_t, long> firstA, firstB;
+    for (int i = 0; i < 100; i++) {
+        firstA[spread(responder, transport, "a.nile.local", 1, 2,
+                      "alternating names")
+                   .begin()
+                   ->first]++;
+        firstB[spread(responder, transport, "b.nile.local", 1, 2,
+                      "alternating names")
+                   .begin()
+                   ->first]++;
+    }
+    CHECK(firstA[address(units[0])] == 50 && firstB[address(units[2])] == 50,
+          "names rotate independently");
+
+    // 0.0.0.0 in a set is the address the query came to
+    const uint8_t portal[2][4] = {{0, 0, 0, 0}, {10, 0, 0, 9}};
+    CHECK(responder.addRecord("portal.nile.local", portal, NULL, 2),
+          "set with the interface address added");
+    CHECK(!responder.addRecord("full.nile.local", units, NULL, 2),
+          "no fifth set");
+    bool wellFormed;
+    transport.query = buildQuery("portal.nile.local", false);
+    responder.processNextRequest();
+    std::vector<uint32_t> got =
+        answers(transport.reply, transport.query.size(), wellFormed);
+    CHECK(wellFormed && got.size() == 2 &&
+              (got[0] == address(localIP) || got[1] == address(localIP)),
+          "0.0.0.0 answered with the local address");
+
+    // EDNS0: the OPT record follows the answers
+    transport.query = buildQuery("a.nile.local", true);
+    responder.processNextRequest();
+    header = (DNSHeader *)transport.reply.data();
+    CHECK(transport.reply.size() == transport.query.size() +
+                                         2 * DNS_ANSWER_SIZE &&
+              header->ARCount == htons(1) &&
+              transport.reply[transport.reply.size() - 9] == DNS_QTYPE_OPT,
+          "OPT record after the answers");
+
+    // Single addresses and removal free the sets again
+    CHECK(responder.addRecord("a.nile.local", units[0]) &&
+              responder.removeRecord("b.nile.local"),
+          "sets replaced and removed");
+    CHECK(responder.addRecord("full.nile.local", units, NULL, 2) &&
+              responder.addRecord("more.nile.local", units, NULL, 2),
+          "freed sets reused");
+    transport.query = buildQuery("a.nile.local", false);
+    responder.processNextRequest();
+    got = answers(transport.reply, transport.query.size(), wellFormed);
+    CHECK(wellFormed && got.size() == 1 && got[0] == address(units[0]),
+          "single address after replacing a set");
+
+    // The largest set under the longest name still fits 512 bytes
+    CHECK(responder.removeRecord("more.nile.local"), "set removed");
+    uint8_t eight[DNS_ADDRESS_SET_SIZE][4];
+    for (size_t i = 0; i < DNS_ADDRESS_SET_SIZE; i++)
+        memcpy(eight[i], units[i % 4], 4), eight[i][2] = i;
+    std::string longName;
+    while (longName.size() < 240) longName += "abcdefghijklmnopqrstuvwxyz.";
+    longName.resize(240);
+    longName += ".nile.local";
+    CHECK(responder.addRecord(longName.c_str(), eight, NULL,
+                              DNS_ADDRESS_SET_SIZE),
+          "eight addresses under a long name added");
+    spread(responder, transport, longName.c_str(), 8, DNS_ADDRESS_SET_SIZE,
+           "eight addresses fit");
+}
+
+static double timeQueries(DNSResponder &responder, QueueTransport &transport,
+                          const char *name, long count) {
+    transport.query = buildQuery(name, false);
+    Clock::time_point begin = Clock::now();
+    for (long i = 0; i < count; i++) responder.processNextRequest();
+    return std::chrono::duration<double, std::nano>(Clock::now() - begin)
+               .count() /
+           count;
+}
+
+int main(int argc, char **argv) {
+    long queryCount = argc > 1 ? atol(argv[1]) : 1000000;
+
+    checks();
+
+    QueueTransport transport;
+    DNSResponder responder;
+    responder.setTransport(&transport);
+    responder.addRecord("one.nile.local", units[0]);
+    responder.addRecord("four.nile.local", units, NULL, 4);
+    double one = timeQueries(responder, transport, "one.nile.local",
+                             queryCount);
+    size_t oneSize = transport.reply.size();
+    double four = timeQueries(responder, transport, "four.nile.local",
+                              queryCount);
+    size_t fourSize = transport.reply.size();
+    printf("%10s %10s %10s\n", "addresses", "ns/query", "bytes");
+    printf("%10d %10.1f %10zu\n", 1, one, oneSize);
+    printf("%10d %10.1f %10zu\n", 4, four, fourSize);
+
+    return checkResult();
+}
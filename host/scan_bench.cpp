@@ -0,0 +1,167 @@
+// Drives the Wi-Fi scan service with a stand-in radio: a scan is only
+// started when the results are missing or stale, results come out strongest
+// first with hidden and repeated networks dropped, and the JSON is the same
+// whatever buffer it is streamed through, also when a scan completes in the
+// middle of it. Then times streaming the JSON of a full result set.
+//   scan_bench [rounds] [-p]   -p prints the JSON of the full result set
+#include "bench_check.h"
+#include "wifi_scan.h"
+#include <chrono>
+#include <mutex>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+typedef std::chrono::steady_clock Clock;
+
+// The stand-in radio: start() is counted, results() hands out whatever the
+// test put in `aps`
+struct FakeRadio {
+    std::mutex mutex;
+    wifi_scan_ap_t aps[WIFI_SCAN_MAX_APS * 2];
+    size_t count = 0;
+    unsigned starts = 0;
+    bool fail = false;
+};
+
+static FakeRadio radio;
+
+static bool fakeStart(void *ctx) {
+    radio.starts++;
+    return !radio.fail;
+}
+
+static size_t fakeResults(void *ctx, wifi_scan_ap_t *aps, size_t max) {
+    size_t count = radio.count < max ? radio.count : max;
+    memcpy(aps, radio.aps, count * sizeof(*aps));
+    return count;
+}
+
+static void fakeLock(void *ctx) { radio.mutex.lock(); }
+
+static void fakeUnlock(void *ctx) { radio.mutex.unlock(); }
+
+static const wifi_scanner_t scanner = {
+    fakeStart, fakeResults, fakeLock, fakeUnlock, NULL,
+};
+
+static void addAp(const char *ssid, int rssi) {
+    wifi_scan_ap_t &ap = radio.aps[radio.count];
+    memset(&ap, 0, sizeof(ap));
+    strncpy(ap.ssid, ssid, sizeof(ap.ssid) - 1);
+    ap.bssid[5] = (uint8_t)radio.count;
+    ap.rssi = (int8_t)rssi;
+    ap.channel = (uint8_t)(1 + radio.count % 13);
+    ap.authmode = 3;
+    radio.count++;
+}
+
+static std::string stream(size_t chunk, uint32_t now) {
+    wifi_scan_json_t json;
+    char buffer[512];
+    std::string out;
+    size_t length;
+    wifi_scan_json_begin(&json, now);
+    while ((length = wifi_scan_json_read(&json, buffer, chunk)) != 0)
+        out.append(buffer, length);
+    return out;
+}
+
+int main(int argc, char **argv) {
+    long rounds = argc > 1 && argv[1][0] != '-' ? atol(argv[1]) : 200000;
+    bool print = argc > 1 && strcmp(argv[argc - 1], "-p") == 0;
+
+    wifi_scan_init(&scanner);
+    CHECK(stream(64, 0) ==
+              "{\"age_ms\":0,\"scanning\":false,\"networks\":[]}",
+          "empty list before the first scan");
+
+    // No results yet: scan, and only once while it runs
+    CHECK(wifi_scan_request(1000), "first request scans");
+    CHECK(wifi_scan_request(1100), "second request while scanning");
+    CHECK(radio.starts == 1, "radio started once");
+    CHECK(stream(64, 1100).find("\"scanning\":true") != std::string::npos,
+          "scanning while the scan runs");
+    addAp("weak", -90);
+    addAp("", -20); // hidden
+    addAp("strong", -30);
+    addAp("weak", -60); // same network, a closer access point
+    addAp("quote\"back\\slash\x01", -50);
+    wifi_scan_done(3000, true);
+    CHECK(wifi_scan_count() == 3, "hidden and repeated networks left out");
+
+    // Fresh results are served as they are, stale ones are refreshed
+    CHECK(!wifi_scan_request(3000 + WIFI_SCAN_MAX_AGE_MS - 1),
+          "fresh results served as they are");
+    CHECK(radio.starts == 1, "no scan for fresh results");
+    std::string json = stream(1, 4000);
+    static const char header[] =
+        "{\"age_ms\":1000,\"scanning\":false,\"networks\":[";
+    CHECK(json.compare(0, sizeof(header) - 1, header) == 0, "JSON header");
+    size_t strong = json.find("\"ssid\":\"strong\"");
+    size_t quoted = json.find("\"ssid\":\"quote\\\"back\\\\slash\\u0001\"");
+    size_t weak = json.find("\"ssid\":\"weak\",\"bssid\":"
+                            "\"00:00:00:00:00:03\",\"rssi\":-60");
+    CHECK(strong != std::string::npos && quoted != std::string::npos &&
+              weak != std::string::npos,
+          "every network listed");
+    CHECK(strong < quoted && quoted < weak, "sorted by signal, escaped");
+    for (size_t chunk = 1; chunk <= 512; chunk++)
+        CHECK(stream(chunk, 4000) == json, "same JSON in every chunk size");
+    CHECK(wifi_scan_request(3000 + WIFI_SCAN_MAX_AGE_MS),
+          "stale results refreshed");
+    CHECK(radio.starts == 2, "radio started again");
+
+    // A failed scan keeps the old results and is retried on request
+    wifi_scan_done(20000, false);
+    CHECK(wifi_scan_count() == 3, "failed scan keeps the old results");
+    radio.fail = true;
+    CHECK(!wifi_scan_request(20000), "failed scan start reported");
+    radio.fail = false;
+
+    // Results replaced mid-stream: the array ends early
+    {
+        wifi_scan_json_t partial;
+        char buffer[16];
+        std::string out;
+        size_t length;
+        wifi_scan_json_begin(&partial, 20000);
+        while (out.find("\"strong\"") == std::string::npos)
+            out.append(buffer, wifi_scan_json_read(&partial, buffer, 16));
+        CHECK(wifi_scan_request(20000), "rescan while streaming");
+        wifi_scan_done(21000, true);
+        while ((length = wifi_scan_json_read(&partial, buffer, 16)) != 0)
+            out.append(buffer, length);
+        CHECK(out.find("\"quote") == std::string::npos,
+              "replaced results not streamed");
+        CHECK(out.compare(out.size() - 3, 3, "}]}") == 0, "array closed early");
+    }
+
+    // A full result set of the longest SSIDs
+    radio.count = 0;
+    for (int i = 0; i < WIFI_SCAN_MAX_APS * 2; i++) {
+        char ssid[33];
+        // Every character after the number is escaped
+        memset(ssid, '"', sizeof(ssid) - 1);
+        ssid[0] = (char)('0' + i / 10);
+        ssid[1] = (char)('0' + i % 10);
+        ssid[sizeof(ssid) - 1] = '\0';
+        addAp(ssid, -40 - i);
+    }
+    CHECK(wifi_scan_request(40000), "full scan");
+    wifi_scan_done(41000, true);
+    CHECK(wifi_scan_count() == WIFI_SCAN_MAX_APS,
+          "results capped at WIFI_SCAN_MAX_APS");
+    json = stream(128, 41000);
+    if (print) printf("%s\n", json.c_str());
+
+    size_t total = 0;
+    auto start = Clock::now();
+    for (long i = 0; i < rounds; i++) total += stream(128, 41000).size();
+    double seconds =
+        std::chrono::duration<double>(Clock::now() - start).count();
+    printf("scan JSON: %zu bytes, %.2f us per response, %.1f MB/s\n",
+           json.size(), seconds * 1e6 / rounds, total / seconds / 1e6);
+    return checkResult();
+}
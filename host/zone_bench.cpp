@@ -0,0 +1,124 @@
+// Measures DNSZone lookup cost against zone size, for names that are in the
+// zone and names that are not. A linear scan over the same wire format names
+// is timed alongside as the baseline the hash table replaces. Then measures
+// DNSPatternMatcher against the number of suffix patterns.
+#include "DNSPatternMatcher.h"
+#include "DNSZone.h"
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+typedef std::chrono::steady_clock Clock;
+
+struct WireName {
+    uint8_t bytes[MAX_DNS_WIRENAME_LENGTH];
+};
+
+static void makeName(char *name, size_t size, const char *prefix, size_t i) {
+    // Mixed case on purpose, lookups are case-insensitive
+    snprintf(name, size, "%s%zu.Devices.Nile.local", prefix, i);
+}
+
+template <typename Lookup>
+static double timeLookups(const std::vector<WireName> &queries, long rounds,
+                          Lookup lookup, size_t &found) {
+    found = 0;
+    Clock::time_point begin = Clock::now();
+    for (long r = 0; r < rounds; r++) {
+        for (size_t i = 0; i < queries.size(); i++) {
+            if (lookup(queries[i].bytes)) found++;
+        }
+    }
+    double ns =
+        std::chrono::duration<double, std::nano>(Clock::now() - begin).count();
+    return ns / (rounds * queries.size());
+}
+
+int main(int argc, char **argv) {
+    long lookups = argc > 1 ? atol(argv[1]) : 2000000;
+    static const size_t sizes[] = {1, 4, 16, 64, 256, 1024};
+
+    printf("%8s %12s %12s %12s %12s\n", "records", "hit ns", "miss ns",
+           "linear hit", "linear miss");
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        size_t size = sizes[s];
+        DNSZone zone(size);
+        std::vector<WireName> names(size), hits(size), misses(size);
+        char name[64];
+        for (size_t i = 0; i < size; i++) {
+            DNSZoneRecord record = {{10, 0, (uint8_t)(i >> 8), (uint8_t)i}};
+            makeName(name, sizeof(name), "host", i);
+            zone.add(name, record);
+            dnsEncodeName(name, names[i].bytes, sizeof(names[i].bytes));
+            makeName(name, sizeof(name), "HOST", (i * 7919) % size);
+            dnsEncodeName(name, hits[i].bytes, sizeof(hits[i].bytes));
+            hits[i].bytes[1] = 'H'; // upper case on the wire
+            makeName(name, sizeof(name), "other", i);
+            dnsEncodeName(name, misses[i].bytes, sizeof(misses[i].bytes));
+        }
+
+        long rounds = lookups / size > 0 ? lookups / size : 1;
+        size_t found;
+        auto hashed = [&](const uint8_t *query) {
+            return zone.lookup(query) != NULL;
+        };
+        auto linear = [&](const uint8_t *query) {
+            for (size_t i = 0; i < names.size(); i++) {
+                if (dnsNameEquals(names[i].bytes, query)) return true;
+            }
+            return false;
+        };
+        double hit = timeLookups(hits, rounds, hashed, found);
+        if (found != rounds * size) {
+            fprintf(stderr, "lookup missed names in a zone of %zu\n", size);
+            return 1;
+        }
+        double miss = timeLookups(misses, rounds, hashed, found);
+        if (found != 0) {
+            fprintf(stderr, "lookup found names not in a zone of %zu\n", size);
+            return 1;
+        }
+        double linearHit = timeLookups(hits, rounds, linear, found);
+        double linearMiss = timeLookups(misses, rounds, linear, found);
+        printf("%8zu %12.1f %12.1f %12.1f %12.1f\n", size, hit, miss,
+               linearHit, linearMiss);
+    }
+
+    printf("\n%8s %12s %12s\n", "patterns", "hit ns", "miss ns");
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        size_t size = sizes[s];
+        DNSPatternMatcher patterns;
+        std::vector<WireName> hits(size), misses(size);
+        char name[64];
+        for (size_t i = 0; i < size; i++) {
+            DNSZoneRecord record = {{10, 1, (uint8_t)(i >> 8), (uint8_t)i}};
+            snprintf(name, sizeof(name), "*.site%zu.portal.local", i);
+            patterns.add(name, (uint16_t)i, record);
+            snprintf(name, sizeof(name), "a.b.site%zu.Portal.local",
+                     (i * 7919) % size);
+            dnsEncodeName(name, hits[i].bytes, sizeof(hits[i].bytes));
+            snprintf(name, sizeof(name), "a.b.site%zu.other.local", i);
+            dnsEncodeName(name, misses[i].bytes, sizeof(misses[i].bytes));
+        }
+
+        long rounds = lookups / size > 0 ? lookups / size : 1;
+        size_t found;
+        auto matched = [&](const uint8_t *query) {
+            return patterns.match(query) != NULL;
+        };
+        double hit = timeLookups(hits, rounds, matched, found);
+        if (found != rounds * size) {
+            fprintf(stderr, "match missed names for %zu patterns\n", size);
+            return 1;
+        }
+        double miss = timeLookups(misses, rounds, matched, found);
+        if (found != 0) {
+            fprintf(stderr, "match found wrong names for %zu patterns\n",
+                    size);
+            return 1;
+        }
+        printf("%8zu %12.1f %12.1f\n", size, hit, miss);
+    }
+    return 0;
+}